@@ -199,6 +199,8 @@ SMP_API size_t smp_message_get_encoded_size(SmpMessage *msg);
 
 SMP_API uint32_t smp_message_get_msgid(SmpMessage *msg);
 SMP_API void smp_message_set_id(SmpMessage *msg, uint32_t id);
+SMP_API int smp_message_get_rx_timestamp(SmpMessage *msg, uint64_t *start_ns,
+        uint64_t *end_ns);
 SMP_API int smp_message_n_args(SmpMessage *msg);
 
 SMP_API int smp_message_get(SmpMessage *msg, int index, ...);
@@ -235,6 +237,34 @@ SMP_API int smp_message_set_cstring(SmpMessage *msg, int index, const char *valu
 SMP_API int smp_message_set_craw(SmpMessage *msg, int index, const uint8_t *raw,
                 size_t size);
 
+/* Prepared message API */
+typedef struct SmpPreparedMessage SmpPreparedMessage;
+
+SMP_API SmpPreparedMessage *smp_prepared_message_new(SmpMessage *msg);
+SMP_API void smp_prepared_message_free(SmpPreparedMessage *pm);
+SMP_API int smp_prepared_message_set_value(SmpPreparedMessage *pm, int index,
+                const SmpValue *value);
+SMP_API int smp_prepared_message_set_uint8(SmpPreparedMessage *pm, int index,
+                uint8_t value);
+SMP_API int smp_prepared_message_set_int8(SmpPreparedMessage *pm, int index,
+                int8_t value);
+SMP_API int smp_prepared_message_set_uint16(SmpPreparedMessage *pm, int index,
+                uint16_t value);
+SMP_API int smp_prepared_message_set_int16(SmpPreparedMessage *pm, int index,
+                int16_t value);
+SMP_API int smp_prepared_message_set_uint32(SmpPreparedMessage *pm, int index,
+                uint32_t value);
+SMP_API int smp_prepared_message_set_int32(SmpPreparedMessage *pm, int index,
+                int32_t value);
+SMP_API int smp_prepared_message_set_uint64(SmpPreparedMessage *pm, int index,
+                uint64_t value);
+SMP_API int smp_prepared_message_set_int64(SmpPreparedMessage *pm, int index,
+                int64_t value);
+SMP_API int smp_prepared_message_set_float(SmpPreparedMessage *pm, int index,
+                float value);
+SMP_API int smp_prepared_message_set_double(SmpPreparedMessage *pm, int index,
+                double value);
+
 /* Serial API */
 
 /**
@@ -270,6 +300,17 @@ typedef enum
     SMP_SERIAL_PARITY_EVEN,    /**< Even parity */
 } SmpSerialParity;
 
+/**
+ * \ingroup serial_frame
+ * Frame check appended to each frame. Both peers have to use the same one.
+ */
+typedef enum
+{
+    SMP_SERIAL_CHECKSUM_XOR8,         /**< 8 bits XOR of the payload (default) */
+    SMP_SERIAL_CHECKSUM_CRC16_CCITT,  /**< CRC-16/CCITT-FALSE, 2 bytes */
+    SMP_SERIAL_CHECKSUM_CRC32C,       /**< CRC-32C (Castagnoli), 4 bytes */
+} SmpSerialChecksum;
+
 #if defined(_WIN32) || defined(_WIN64)
 #include <windows.h>
 typedef struct
@@ -283,6 +324,74 @@ typedef struct
 } SmpSerialDevice;
 #endif
 
+/* Transport API */
+typedef struct SmpTransport SmpTransport;
+
+/**
+ * \ingroup transport
+ * A buffer of a scatter-gather write.
+ */
+typedef struct
+{
+    /** Start of the buffer */
+    const void *base;
+    /** Size of the buffer in bytes */
+    size_t size;
+} SmpIoVec;
+
+/**
+ * \ingroup transport
+ * Operations of a transport. Like the serial device, read and write must not
+ * block and return SMP_ERROR_WOULD_BLOCK when they can't make progress.
+ */
+typedef struct
+{
+    /** Open the transport, path meaning depends on the transport */
+    int (*open)(SmpTransport *transport, const char *path);
+    /** Close the transport */
+    void (*close)(SmpTransport *transport);
+    /** Read up to size bytes, return the number of bytes read */
+    ssize_t (*read)(SmpTransport *transport, void *buf, size_t size);
+    /** Write up to size bytes, return the number of bytes written */
+    ssize_t (*write)(SmpTransport *transport, const void *buf, size_t size);
+    /** Wait for data to read, negative timeout_ms means infinite */
+    int (*wait)(SmpTransport *transport, int timeout_ms);
+    /** Get a pollable file descriptor, may be NULL */
+    intptr_t (*get_fd)(SmpTransport *transport);
+    /** Set the serial configuration, may be NULL */
+    int (*set_config)(SmpTransport *transport, SmpSerialBaudrate baudrate,
+            SmpSerialParity parity, int flow_control);
+    /** Release the transport, called by smp_transport_free(), may be NULL */
+    void (*free)(SmpTransport *transport);
+    /** Start the writes queued by write, may be NULL */
+    int (*flush)(SmpTransport *transport);
+    /** Get the number of written bytes not sent yet, may be NULL */
+    ssize_t (*get_output_queue)(SmpTransport *transport);
+    /** Write the buffers in order like write does, may be NULL to write them
+     * one by one */
+    ssize_t (*writev)(SmpTransport *transport, const SmpIoVec *iov,
+            int iovcnt);
+} SmpTransportVTable;
+
+/**
+ * \ingroup transport
+ * A transport moves bytes between a context and its peer. Implementations
+ * embed it as their first member.
+ */
+struct SmpTransport
+{
+    /** The transport operations */
+    const SmpTransportVTable *vtable;
+};
+
+SMP_API SmpTransport *smp_transport_new_serial(void);
+SMP_API SmpTransport *smp_transport_new_loopback(size_t capacity);
+SMP_API SmpTransport *smp_transport_new_fd(intptr_t read_fd, intptr_t write_fd);
+SMP_API SmpTransport *smp_transport_new_unix_socket(void);
+SMP_API SmpTransport *smp_transport_new_shm(size_t capacity, bool create);
+SMP_API SmpTransport *smp_transport_new_uring(intptr_t fd);
+SMP_API void smp_transport_free(SmpTransport *transport);
+
 /* Context API */
 typedef struct SmpContext SmpContext;
 
@@ -312,20 +421,284 @@ typedef struct
     void (*error_cb)(SmpContext *ctx, SmpError error, void *userdata);
 } SmpEventCallbacks;
 
+/**
+ * Context statistics, see smp_context_get_stats().
+ */
+typedef struct
+{
+    /** Bytes read from the device */
+    uint64_t rx_bytes;
+    /** Valid frames received */
+    uint64_t rx_frames;
+    /** Bytes written to the device */
+    uint64_t tx_bytes;
+    /** Frames written to the device */
+    uint64_t tx_frames;
+
+    /** Frames dropped because of an invalid checksum */
+    uint64_t checksum_errors;
+    /** Frames interrupted by a start byte */
+    uint64_t resyncs;
+    /** Frames dropped because they exceed the decoder maximum capacity */
+    uint64_t oversize_frames;
+    /** Reallocations of the decoder buffer */
+    uint64_t decoder_reallocs;
+    /** Writes the device didn't complete */
+    uint64_t short_writes;
+
+    /** Time spent in the new message and call completion callbacks, in
+     * nanoseconds, 0 if the platform has no clock */
+    uint64_t callback_time_ns;
+
+    /** Busy polls which received data before the end of their budget */
+    uint64_t busy_poll_hits;
+    /** Busy polls which ran out of budget and fell back to waiting */
+    uint64_t busy_poll_misses;
+
+    /** Queued messages replaced by a newer one with the same id */
+    uint64_t tx_conflated;
+    /** Received messages dropped for a newer one with the same id */
+    uint64_t rx_conflated;
+    /** Times sending was delayed to keep the device queue short */
+    uint64_t tx_paced;
+
+    /** Scheduled messages written */
+    uint64_t tx_scheduled;
+    /** Total delay between the scheduled and the actual write times, in
+     * nanoseconds */
+    uint64_t tx_schedule_delay_ns;
+    /** Maximum delay between the scheduled and the actual write times, in
+     * nanoseconds */
+    uint64_t tx_schedule_max_delay_ns;
+
+    /** Messages written with their large RAW arguments taken from the caller
+     * buffers */
+    uint64_t tx_zerocopy;
+} SmpContextStats;
+
+/**
+ * Sizes of a real-time context, see smp_context_new_realtime().
+ */
+typedef struct
+{
+    /** Largest encoded message sent or received, in bytes */
+    size_t max_message_size;
+    /** Largest number of values of a received message */
+    size_t max_values;
+    /** Largest number of outstanding calls, 0 if smp_context_call() isn't
+     * used */
+    size_t max_calls;
+    /** Lock the memory of the context in RAM, creation fails where it isn't
+     * supported */
+    bool lock_memory;
+} SmpContextRealtimeConfig;
+
+/**
+ * Per message id statistics, see smp_context_get_message_stats().
+ */
+typedef struct
+{
+    /** The message id */
+    uint32_t msgid;
+
+    /** Messages received */
+    uint64_t rx_messages;
+    /** Encoded bytes of messages received */
+    uint64_t rx_bytes;
+    /** Messages sent */
+    uint64_t tx_messages;
+    /** Encoded bytes of messages sent */
+    uint64_t tx_bytes;
+} SmpMessageStats;
+
+/**
+ * Called when a call made with smp_context_call() completes.
+ *
+ * @warning response is only valid in the callback.
+ *
+ * @param[in] ctx the Context the call was made on.
+ * @param[in] response the response, without its correlation id, or NULL if
+ *                     the call failed.
+ * @param[in] status 0 if a response was received, SMP_ERROR_TIMEDOUT if none
+ *                   came in time or SMP_ERROR_BAD_FD if the context was closed.
+ * @param[in] userdata the userdata pointer passed to smp_context_call().
+ */
+typedef void (*SmpCallCompletionFunc)(SmpContext *ctx, SmpMessage *response,
+        SmpError status, void *userdata);
+
+/**
+ * Called with the payload of each valid frame received, before it is decoded
+ * into a message.
+ *
+ * @warning payload is only valid in the callback.
+ *
+ * @param[in] ctx the Context which received the frame.
+ * @param[in] payload the frame payload, an encoded message, without framing
+ *                    nor escaping.
+ * @param[in] size the payload size.
+ * @param[in] userdata the userdata pointer passed to
+ *                     smp_context_set_frame_cb().
+ *
+ * @return true if the frame was handled, false to have it decoded and passed
+ *         to the new_message_cb callback as usual.
+ */
+typedef bool (*SmpFrameFunc)(SmpContext *ctx, const uint8_t *payload,
+        size_t size, void *userdata);
+
+/**
+ * \ingroup context
+ * Format of the data given to smp_context_send_frame().
+ */
+typedef enum
+{
+    /** An encoded message, framed and escaped before being sent */
+    SMP_FRAME_FORMAT_PAYLOAD,
+    /** A complete frame, escaped and with its checksum, sent as is */
+    SMP_FRAME_FORMAT_SERIAL,
+} SmpFrameFormat;
+
+/**
+ * \ingroup context
+ * Priority of an outgoing message, see smp_context_enable_priorities().
+ */
+typedef enum
+{
+    /** Control messages, sent before any other */
+    SMP_PRIORITY_HIGH,
+    /** The priority of smp_context_send_message() */
+    SMP_PRIORITY_NORMAL,
+    /** Bulk transfers, sent when nothing else is waiting */
+    SMP_PRIORITY_LOW,
+} SmpPriority;
+
+/**
+ * \ingroup context
+ * Conflation flags of a message id, see smp_context_set_conflation().
+ */
+typedef enum
+{
+    /** Send every message */
+    SMP_CONFLATION_NONE = 0,
+    /** Replace a queued message by a newer one with the same id */
+    SMP_CONFLATION_TX = (1 << 0),
+    /** Deliver only the newest message with the id received at once */
+    SMP_CONFLATION_RX = (1 << 1),
+} SmpConflation;
+
 SMP_API SmpContext *smp_context_new(const SmpEventCallbacks *cbs, void *userdata);
+SMP_API SmpContext *smp_context_new_realtime(const SmpEventCallbacks *cbs,
+        void *userdata, const SmpContextRealtimeConfig *config);
 SMP_API void smp_context_free(SmpContext *ctx);
 
 SMP_API int smp_context_open(SmpContext *ctx, const char *device);
 SMP_API void smp_context_close(SmpContext *ctx);
+SMP_API int smp_context_set_transport(SmpContext *ctx,
+                SmpTransport *transport);
 SMP_API int smp_context_set_serial_config(SmpContext *ctx,
                 SmpSerialBaudrate baudrate, SmpSerialParity parity,
                 int flow_control);
 SMP_API intptr_t smp_context_get_fd(SmpContext *ctx);
 SMP_API int smp_context_send_message(SmpContext *ctx, SmpMessage *msg);
+SMP_API int smp_context_send_prepared_message(SmpContext *ctx,
+        SmpPreparedMessage *pm);
+SMP_API int smp_context_enable_priorities(SmpContext *ctx,
+        size_t fragment_size);
+SMP_API int smp_context_send_message_with_priority(SmpContext *ctx,
+        SmpMessage *msg, SmpPriority priority);
+SMP_API int smp_context_set_conflation(SmpContext *ctx, uint32_t msgid,
+        int flags);
+SMP_API int smp_context_set_tx_pacing(SmpContext *ctx, size_t max_queued);
+SMP_API int smp_context_schedule_message(SmpContext *ctx, SmpMessage *msg,
+        uint64_t time_ns, uint64_t period_ns);
+SMP_API int smp_context_update_scheduled_message(SmpContext *ctx, int id,
+        SmpMessage *msg);
+SMP_API int smp_context_cancel_scheduled_message(SmpContext *ctx, int id);
+SMP_API int smp_context_enable_send_queue(SmpContext *ctx);
+SMP_API int smp_context_queue_message(SmpContext *ctx, SmpMessage *msg);
+SMP_API intptr_t smp_context_get_queue_fd(SmpContext *ctx);
+SMP_API int smp_context_process_queue(SmpContext *ctx);
+SMP_API int smp_context_set_frame_cb(SmpContext *ctx, SmpFrameFunc cb,
+                void *userdata);
+SMP_API int smp_context_send_frame(SmpContext *ctx, const uint8_t *data,
+                size_t size, SmpFrameFormat format);
 SMP_API int smp_context_process_fd(SmpContext *ctx);
+SMP_API int smp_context_process_budget(SmpContext *ctx,
+        unsigned int max_frames, uint64_t max_ns);
 SMP_API int smp_context_wait_and_process(SmpContext *ctx, int timeout_ms);
+SMP_API int smp_context_set_busy_poll(SmpContext *ctx, unsigned int budget_us,
+        bool pause);
 
 SMP_API int smp_context_set_decoder_maximum_capacity(SmpContext *ctx, size_t max);
+SMP_API int smp_context_set_checksum(SmpContext *ctx,
+                SmpSerialChecksum checksum);
+
+SMP_API int smp_context_enable_reliability(SmpContext *ctx,
+                unsigned int window);
+SMP_API int smp_context_enable_flow_control(SmpContext *ctx, size_t rx_window);
+SMP_API int smp_context_call(SmpContext *ctx, SmpMessage *request,
+                int timeout_ms, SmpCallCompletionFunc cb, void *userdata);
+SMP_API int smp_context_reply(SmpContext *ctx, SmpMessage *request,
+                SmpMessage *response);
+SMP_API uint64_t smp_context_get_time_ns(void);
+SMP_API int smp_context_get_next_timeout(SmpContext *ctx);
+SMP_API int smp_context_get_stats(SmpContext *ctx, SmpContextStats *stats);
+SMP_API ssize_t smp_context_get_message_stats(SmpContext *ctx,
+                SmpMessageStats *stats, size_t n_stats);
+SMP_API void smp_context_reset_stats(SmpContext *ctx);
+SMP_API int smp_context_enable_tracing(SmpContext *ctx, size_t n_events);
+SMP_API int smp_context_write_trace(SmpContext *ctx, const char *path);
+SMP_API int smp_context_start_capture(SmpContext *ctx, const char *path);
+SMP_API void smp_context_stop_capture(SmpContext *ctx);
+SMP_API int smp_context_replay_capture(SmpContext *ctx, const char *path,
+        bool realtime);
+SMP_API int smp_context_process_timers(SmpContext *ctx);
+
+/* Capture API */
+
+/**
+ * \ingroup capture
+ * Called for each message decoded by smp_capture_decode().
+ *
+ * @warning msg is only valid in the callback.
+ *
+ * @param[in] msg the decoded message
+ * @param[in] userdata the userdata pointer passed to smp_capture_decode().
+ */
+typedef void (*SmpCaptureMessageFunc)(SmpMessage *msg, void *userdata);
+
+SMP_API ssize_t smp_capture_decode(const char *path, SmpSerialChecksum checksum,
+                unsigned int n_threads, SmpCaptureMessageFunc cb,
+                void *userdata);
+
+/* Bridge API */
+typedef struct SmpBridge SmpBridge;
+
+/**
+ * \ingroup bridge
+ * Bridge counters, side A and B being the first and second device or file
+ * descriptor given when opening the bridge.
+ */
+typedef struct
+{
+    /** Bytes forwarded from A to B */
+    uint64_t a_to_b_bytes;
+    /** Frames seen from A to B */
+    uint64_t a_to_b_frames;
+    /** Bytes forwarded from B to A */
+    uint64_t b_to_a_bytes;
+    /** Frames seen from B to A */
+    uint64_t b_to_a_frames;
+} SmpBridgeStats;
+
+SMP_API SmpBridge *smp_bridge_new(void);
+SMP_API void smp_bridge_free(SmpBridge *bridge);
+SMP_API int smp_bridge_open(SmpBridge *bridge, const char *path_a,
+                const char *path_b);
+SMP_API int smp_bridge_open_fds(SmpBridge *bridge, intptr_t fd_a,
+                intptr_t fd_b);
+SMP_API void smp_bridge_close(SmpBridge *bridge);
+SMP_API int smp_bridge_process(SmpBridge *bridge, int timeout_ms);
+SMP_API int smp_bridge_get_stats(SmpBridge *bridge, SmpBridgeStats *stats);
 
 /* Buffer API */
 typedef struct SmpBuffer SmpBuffer;
@@ -24,13 +24,17 @@ EXCLUDED_FILES = [
     "serial-device-avr.c",
     "serial-device-posix.c",
     "serial-device-win32.c",
+    "transport-posix.c",
+    "transport-uring.c",
     "libsmp-static.h.in"
 ]
 
 CONFIGURATION_PARAMETERS = {
     "config.h": [
         ("SMP_CONTEXT_PROCESS_CHUNK_SIZE", 1,
-        "Number of bytes processed by a single call of smp_context_process_fd")
+        "Number of bytes processed by a single call of smp_context_process_fd"),
+        ("SMP_CONTEXT_MESSAGE_STATS_SIZE", 0,
+        "Number of message ids tracked by smp_context_get_message_stats")
         ],
 }
 
@@ -51,7 +55,17 @@ STATIC_REP_LIST = [
     ('SmpSerialDevice', 'int'),
     ('SmpEventCallbacks cbs', 'void *cbs[2]'),
     ('SmpBuffer', 'void'),
+    ('SmpMessageStats', 'void'),
     ('SmpMessage', 'void'),
+    ('SmpLink', 'void'),
+    ('SmpCallTable', 'void'),
+    ('SmpTrace', 'void'),
+    ('SmpCapture', 'void'),
+    ('SmpTransport', 'void'),
+    ('SmpSendQueue', 'void'),
+    ('SmpTxScheduler', 'void'),
+    ('SmpConflationTable', 'void'),
+    ('SmpScheduleTable', 'void'),
     ]
 
 
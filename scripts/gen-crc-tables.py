@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+# Generate src/crc-tables.h, the slicing-by-8 lookup tables used by src/crc.c
+import argparse
+
+CRC16_POLY = 0x1021        # CRC-16/CCITT, non reflected
+CRC32C_POLY = 0x82F63B78   # CRC-32C (Castagnoli), reflected
+
+N_SLICES = 8
+
+HEADER = """/* libsmp
+ * Copyright (C) 2026 Actronika SAS
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Generated by scripts/gen-crc-tables.py, do not edit */
+
+#ifndef CRC_TABLES_H
+#define CRC_TABLES_H
+
+#include <stdint.h>
+
+"""
+
+FOOTER = """
+#endif
+"""
+
+
+def crc16_tables():
+    tables = [[0] * 256 for _ in range(N_SLICES)]
+    for i in range(256):
+        crc = i << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ CRC16_POLY) if crc & 0x8000 else (crc << 1)
+            crc &= 0xffff
+        tables[0][i] = crc
+
+    # table k gives the contribution of a byte followed by k zero bytes
+    for k in range(1, N_SLICES):
+        for i in range(256):
+            prev = tables[k - 1][i]
+            tables[k][i] = ((prev << 8) & 0xffff) ^ tables[0][prev >> 8]
+
+    return tables
+
+
+def crc32c_tables():
+    tables = [[0] * 256 for _ in range(N_SLICES)]
+    for i in range(256):
+        crc = i
+        for _ in range(8):
+            crc = (crc >> 1) ^ (CRC32C_POLY if crc & 1 else 0)
+        tables[0][i] = crc
+
+    for k in range(1, N_SLICES):
+        for i in range(256):
+            prev = tables[k - 1][i]
+            tables[k][i] = (prev >> 8) ^ tables[0][prev & 0xff]
+
+    return tables
+
+
+def write_tables(out, ctype, name, tables, width, per_line):
+    out.write('static const %s %s[%d][256] = {\n' % (ctype, name, N_SLICES))
+    for table in tables:
+        out.write('    {\n')
+        for i in range(0, 256, per_line):
+            values = ', '.join('0x%0*x' % (width, v)
+                               for v in table[i:i + per_line])
+            out.write('        ' + values + ',\n')
+        out.write('    },\n')
+    out.write('};\n')
+
+
+parser = argparse.ArgumentParser()
+parser.add_argument("output", nargs='?', default="crc-tables.h",
+                    help="the output file name")
+args = parser.parse_args()
+
+with open(args.output, 'w') as out:
+    out.write(HEADER)
+    write_tables(out, 'uint16_t', 'crc16_ccitt_table', crc16_tables(), 4, 8)
+    out.write('\n')
+    write_tables(out, 'uint32_t', 'crc32c_table', crc32c_tables(), 8, 6)
+    out.write(FOOTER)
@@ -0,0 +1,542 @@
+/* libsmp
+ * Copyright (C) 2026 Actronika SAS
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file
+ * \defgroup bridge Bridge
+ *
+ * Byte level forwarding between two serial devices or file descriptors.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* splice() and tee() */
+#endif
+
+#include "config.h"
+
+#include "libsmp.h"
+
+#ifdef SMP_ENABLE_POSIX_TRANSPORTS
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libsmp-private.h"
+#include "libsmp-private-posix.h"
+#include "serial-device.h"
+#include "serial-protocol.h"
+
+/* bytes moved at once, fits in a default pipe */
+#define SMP_BRIDGE_CHUNK_SIZE (64 * 1024)
+
+#ifdef HAVE_SPLICE
+#define SMP_BRIDGE_SPLICE_FLAGS (SPLICE_F_MOVE | SPLICE_F_NONBLOCK)
+#endif
+
+/* One way of the bridge. Bytes go through a pipe with splice() and a copy
+ * made with tee() feeds the frame tap, or through a buffer when the kernel
+ * can't splice these descriptors. */
+typedef struct
+{
+    int in_fd;
+    int out_fd;
+
+    bool use_splice;
+    int pipe_fds[2];
+    int tap_fds[2];
+    size_t pending;     /* bytes in the pipe, not written yet */
+
+    uint8_t *buf;
+    size_t offset;
+    size_t len;
+
+    /* frame tap */
+    bool in_frame;
+    bool esc;
+    uint64_t bytes;
+    uint64_t frames;
+} SmpBridgeDirection;
+
+struct SmpBridge
+{
+    SmpSerialDevice devices[2];
+    bool owned;
+    bool opened;
+    SmpBridgeDirection dirs[2];
+};
+
+static void smp_bridge_tap(SmpBridgeDirection *dir, const uint8_t *data,
+        size_t size)
+{
+    size_t i;
+
+    dir->bytes += size;
+
+    for (i = 0; i < size; i++) {
+        uint8_t byte = data[i];
+
+        if (dir->esc) {
+            dir->esc = false;
+        } else if (byte == SMP_SERIAL_PROTOCOL_START_BYTE) {
+            dir->in_frame = true;
+        } else if (!dir->in_frame) {
+            continue;
+        } else if (byte == SMP_SERIAL_PROTOCOL_ESC_BYTE) {
+            dir->esc = true;
+        } else if (byte == SMP_SERIAL_PROTOCOL_END_BYTE) {
+            dir->in_frame = false;
+            dir->frames++;
+        }
+    }
+}
+
+static void smp_bridge_close_pipes(SmpBridgeDirection *dir)
+{
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        if (dir->pipe_fds[i] >= 0)
+            close(dir->pipe_fds[i]);
+        if (dir->tap_fds[i] >= 0)
+            close(dir->tap_fds[i]);
+        dir->pipe_fds[i] = -1;
+        dir->tap_fds[i] = -1;
+    }
+
+    dir->use_splice = false;
+}
+
+static int smp_bridge_direction_init(SmpBridgeDirection *dir, int in_fd,
+        int out_fd)
+{
+    memset(dir, 0, sizeof(*dir));
+    dir->in_fd = in_fd;
+    dir->out_fd = out_fd;
+    dir->pipe_fds[0] = dir->pipe_fds[1] = -1;
+    dir->tap_fds[0] = dir->tap_fds[1] = -1;
+
+    dir->buf = malloc(SMP_BRIDGE_CHUNK_SIZE);
+    if (dir->buf == NULL)
+        return SMP_ERROR_NO_MEM;
+
+#ifdef HAVE_SPLICE
+    if (pipe2(dir->pipe_fds, O_NONBLOCK) == 0
+            && pipe2(dir->tap_fds, O_NONBLOCK) == 0) {
+        dir->use_splice = true;
+    } else {
+        smp_bridge_close_pipes(dir);
+    }
+#endif
+
+    return 0;
+}
+
+static void smp_bridge_direction_clear(SmpBridgeDirection *dir)
+{
+    smp_bridge_close_pipes(dir);
+    free(dir->buf);
+    dir->buf = NULL;
+}
+
+/* go on with the buffer when the descriptors can't be spliced, keeping what
+ * is already in the pipe */
+static int smp_bridge_fallback(SmpBridgeDirection *dir)
+{
+    ssize_t ret;
+
+    while (dir->pending > 0) {
+        ret = read(dir->pipe_fds[0], dir->buf + dir->len, dir->pending);
+        if (ret <= 0)
+            return SMP_ERROR_IO;
+
+        dir->len += ret;
+        dir->pending -= ret;
+    }
+
+    smp_bridge_close_pipes(dir);
+    return 0;
+}
+
+#ifdef HAVE_SPLICE
+static ssize_t smp_bridge_splice_in(SmpBridgeDirection *dir)
+{
+    uint8_t tap[4096];
+    ssize_t n;
+    ssize_t i;
+
+    n = splice(dir->in_fd, NULL, dir->pipe_fds[1], NULL,
+            SMP_BRIDGE_CHUNK_SIZE, SMP_BRIDGE_SPLICE_FLAGS);
+    if (n < 0)
+        return errno_to_smp_error(errno);
+    else if (n == 0)
+        return SMP_ERROR_PIPE;
+
+    dir->pending += n;
+
+    /* the tap pipe is drained after each tee() so it takes it all */
+    i = tee(dir->pipe_fds[0], dir->tap_fds[1], n, SPLICE_F_NONBLOCK);
+    while (i > 0) {
+        ssize_t ret = read(dir->tap_fds[0], tap,
+                ((size_t) i < sizeof(tap)) ? (size_t) i : sizeof(tap));
+
+        if (ret <= 0)
+            break;
+
+        smp_bridge_tap(dir, tap, ret);
+        i -= ret;
+    }
+
+    return n;
+}
+#endif
+
+/* move bytes from in_fd to out_fd until one of them would block */
+static int smp_bridge_direction_run(SmpBridgeDirection *dir)
+{
+    ssize_t ret;
+
+    while (1) {
+#ifdef HAVE_SPLICE
+        if (dir->use_splice) {
+            if (dir->pending > 0) {
+                ret = splice(dir->pipe_fds[0], NULL, dir->out_fd, NULL,
+                        dir->pending, SMP_BRIDGE_SPLICE_FLAGS);
+                if (ret < 0 && errno == EINVAL) {
+                    ret = smp_bridge_fallback(dir);
+                    if (ret < 0)
+                        return (int) ret;
+                    continue;
+                } else if (ret < 0) {
+                    return (errno == EAGAIN) ? 0 : errno_to_smp_error(errno);
+                }
+
+                dir->pending -= ret;
+                if (dir->pending > 0)
+                    continue;
+            }
+
+            ret = smp_bridge_splice_in(dir);
+            if (ret == SMP_ERROR_INVALID_PARAM) {
+                smp_bridge_close_pipes(dir);
+                continue;
+            } else if (ret < 0) {
+                return (ret == SMP_ERROR_WOULD_BLOCK) ? 0 : (int) ret;
+            }
+
+            continue;
+        }
+#endif
+
+        if (dir->offset < dir->len) {
+            ret = write(dir->out_fd, dir->buf + dir->offset,
+                    dir->len - dir->offset);
+            if (ret < 0)
+                return (errno == EAGAIN) ? 0 : errno_to_smp_error(errno);
+
+            dir->offset += ret;
+            continue;
+        }
+
+        dir->offset = 0;
+        dir->len = 0;
+
+        ret = read(dir->in_fd, dir->buf, SMP_BRIDGE_CHUNK_SIZE);
+        if (ret < 0)
+            return (errno == EAGAIN) ? 0 : errno_to_smp_error(errno);
+        else if (ret == 0)
+            return SMP_ERROR_PIPE;
+
+        smp_bridge_tap(dir, dir->buf, ret);
+        dir->len = ret;
+    }
+}
+
+static bool smp_bridge_direction_has_pending(SmpBridgeDirection *dir)
+{
+    return dir->pending > 0 || dir->offset < dir->len;
+}
+
+static int smp_bridge_start(SmpBridge *bridge, int fd_a, int fd_b)
+{
+    int ret;
+
+    ret = smp_bridge_direction_init(&bridge->dirs[0], fd_a, fd_b);
+    if (ret == 0)
+        ret = smp_bridge_direction_init(&bridge->dirs[1], fd_b, fd_a);
+
+    if (ret < 0) {
+        smp_bridge_direction_clear(&bridge->dirs[0]);
+        smp_bridge_direction_clear(&bridge->dirs[1]);
+        return ret;
+    }
+
+    bridge->opened = true;
+    return 0;
+}
+
+/**
+ * \ingroup bridge
+ * Create a new bridge.
+ *
+ * @return a new SmpBridge or NULL on error.
+ */
+SmpBridge *smp_bridge_new(void)
+{
+    SmpBridge *bridge;
+    int i;
+
+    bridge = smp_new(SmpBridge);
+    if (bridge == NULL)
+        return NULL;
+
+    for (i = 0; i < 2; i++)
+        smp_serial_device_init(&bridge->devices[i]);
+
+    return bridge;
+}
+
+/**
+ * \ingroup bridge
+ * Close and free a bridge.
+ *
+ * @param[in] bridge the SmpBridge
+ */
+void smp_bridge_free(SmpBridge *bridge)
+{
+    return_if_fail(bridge != NULL);
+
+    smp_bridge_close(bridge);
+    free(bridge);
+}
+
+/**
+ * \ingroup bridge
+ * Open two serial devices and forward everything received on one of them to
+ * the other one.
+ *
+ * @param[in] bridge the SmpBridge
+ * @param[in] path_a path to the first serial device
+ * @param[in] path_b path to the second serial device
+ *
+ * @return 0 on success, a SmpError otherwise.
+ */
+int smp_bridge_open(SmpBridge *bridge, const char *path_a, const char *path_b)
+{
+    int ret;
+
+    return_val_if_fail(bridge != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(path_a != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(path_b != NULL, SMP_ERROR_INVALID_PARAM);
+
+    if (bridge->opened)
+        return SMP_ERROR_BUSY;
+
+    ret = smp_serial_device_open(&bridge->devices[0], path_a);
+    if (ret < 0)
+        return ret;
+
+    ret = smp_serial_device_open(&bridge->devices[1], path_b);
+    if (ret < 0) {
+        smp_serial_device_close(&bridge->devices[0]);
+        return ret;
+    }
+
+    ret = smp_bridge_start(bridge, bridge->devices[0].fd,
+            bridge->devices[1].fd);
+    if (ret < 0) {
+        smp_serial_device_close(&bridge->devices[0]);
+        smp_serial_device_close(&bridge->devices[1]);
+        return ret;
+    }
+
+    bridge->owned = true;
+    return 0;
+}
+
+/**
+ * \ingroup bridge
+ * Forward between two file descriptors, like a serial device and a socket.
+ * They are switched to non-blocking mode and are not closed by the bridge.
+ *
+ * @param[in] bridge the SmpBridge
+ * @param[in] fd_a the first file descriptor
+ * @param[in] fd_b the second file descriptor
+ *
+ * @return 0 on success, a SmpError otherwise.
+ */
+int smp_bridge_open_fds(SmpBridge *bridge, intptr_t fd_a, intptr_t fd_b)
+{
+    int fds[2] = { (int) fd_a, (int) fd_b };
+    int i;
+
+    return_val_if_fail(bridge != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(fd_a >= 0, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(fd_b >= 0, SMP_ERROR_INVALID_PARAM);
+
+    if (bridge->opened)
+        return SMP_ERROR_BUSY;
+
+    for (i = 0; i < 2; i++) {
+        int flags = fcntl(fds[i], F_GETFL);
+
+        if (flags < 0 || fcntl(fds[i], F_SETFL, flags | O_NONBLOCK) < 0)
+            return errno_to_smp_error(errno);
+    }
+
+    bridge->owned = false;
+    return smp_bridge_start(bridge, fds[0], fds[1]);
+}
+
+/**
+ * \ingroup bridge
+ * Stop forwarding, closing the devices opened by smp_bridge_open(). Bytes
+ * not written yet are lost.
+ *
+ * @param[in] bridge the SmpBridge
+ */
+void smp_bridge_close(SmpBridge *bridge)
+{
+    int i;
+
+    return_if_fail(bridge != NULL);
+
+    if (!bridge->opened)
+        return;
+
+    for (i = 0; i < 2; i++) {
+        smp_bridge_direction_clear(&bridge->dirs[i]);
+        if (bridge->owned)
+            smp_serial_device_close(&bridge->devices[i]);
+    }
+
+    bridge->opened = false;
+}
+
+/**
+ * \ingroup bridge
+ * Wait for data on either side and forward it. Bytes are moved with
+ * splice() when the kernel supports it for these descriptors, through a
+ * buffer otherwise.
+ *
+ * @param[in] bridge the SmpBridge
+ * @param[in] timeout_ms a timeout in milliseconds. A negative value means no
+ *                       timeout
+ *
+ * @return 0 on success, SMP_ERROR_TIMEDOUT if nothing happened,
+ *         SMP_ERROR_PIPE if one side was closed, a SmpError otherwise.
+ */
+int smp_bridge_process(SmpBridge *bridge, int timeout_ms)
+{
+    struct pollfd pfds[2];
+    int ret;
+    int i;
+
+    return_val_if_fail(bridge != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(bridge->opened, SMP_ERROR_BAD_FD);
+
+    /* wait for the output when bytes are pending, for the input otherwise */
+    for (i = 0; i < 2; i++) {
+        SmpBridgeDirection *dir = &bridge->dirs[i];
+
+        if (smp_bridge_direction_has_pending(dir)) {
+            pfds[i].fd = dir->out_fd;
+            pfds[i].events = POLLOUT;
+        } else {
+            pfds[i].fd = dir->in_fd;
+            pfds[i].events = POLLIN;
+        }
+        pfds[i].revents = 0;
+    }
+
+    ret = poll(pfds, 2, timeout_ms);
+    if (ret < 0)
+        return errno_to_smp_error(errno);
+    else if (ret == 0)
+        return SMP_ERROR_TIMEDOUT;
+
+    for (i = 0; i < 2; i++) {
+        if (pfds[i].revents == 0)
+            continue;
+
+        ret = smp_bridge_direction_run(&bridge->dirs[i]);
+        if (ret < 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+/**
+ * \ingroup bridge
+ * Get the bridge counters.
+ *
+ * @param[in] bridge the SmpBridge
+ * @param[out] stats the counters
+ *
+ * @return 0 on success, a SmpError otherwise.
+ */
+int smp_bridge_get_stats(SmpBridge *bridge, SmpBridgeStats *stats)
+{
+    return_val_if_fail(bridge != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(stats != NULL, SMP_ERROR_INVALID_PARAM);
+
+    stats->a_to_b_bytes = bridge->dirs[0].bytes;
+    stats->a_to_b_frames = bridge->dirs[0].frames;
+    stats->b_to_a_bytes = bridge->dirs[1].bytes;
+    stats->b_to_a_frames = bridge->dirs[1].frames;
+    return 0;
+}
+
+#else /* SMP_ENABLE_POSIX_TRANSPORTS */
+
+SmpBridge *smp_bridge_new(void)
+{
+    return NULL;
+}
+
+void smp_bridge_free(SmpBridge *bridge)
+{
+}
+
+int smp_bridge_open(SmpBridge *bridge, const char *path_a, const char *path_b)
+{
+    return SMP_ERROR_NOT_SUPPORTED;
+}
+
+int smp_bridge_open_fds(SmpBridge *bridge, intptr_t fd_a, intptr_t fd_b)
+{
+    return SMP_ERROR_NOT_SUPPORTED;
+}
+
+void smp_bridge_close(SmpBridge *bridge)
+{
+}
+
+int smp_bridge_process(SmpBridge *bridge, int timeout_ms)
+{
+    return SMP_ERROR_NOT_SUPPORTED;
+}
+
+int smp_bridge_get_stats(SmpBridge *bridge, SmpBridgeStats *stats)
+{
+    return SMP_ERROR_NOT_SUPPORTED;
+}
+
+#endif /* SMP_ENABLE_POSIX_TRANSPORTS */
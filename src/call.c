@@ -0,0 +1,261 @@
+/* libsmp
+ * Copyright (C) 2026 Actronika SAS
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "call.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define SMP_CALL_TABLE_MIN_CAPACITY 16
+
+/* ids are allocated sequentially so the low bits are already well spread */
+static inline size_t smp_call_table_home(SmpCallTable *table, uint32_t id)
+{
+    return id & (table->capacity - 1);
+}
+
+static SmpCall *smp_call_table_lookup(SmpCallTable *table, uint32_t id)
+{
+    size_t i;
+
+    if (table->capacity == 0)
+        return NULL;
+
+    for (i = smp_call_table_home(table, id); table->calls[i].used;
+            i = (i + 1) & (table->capacity - 1)) {
+        if (table->calls[i].id == id)
+            return &table->calls[i];
+    }
+
+    return NULL;
+}
+
+static void smp_call_table_insert(SmpCallTable *table, const SmpCall *call)
+{
+    size_t i;
+
+    for (i = smp_call_table_home(table, call->id); table->calls[i].used;
+            i = (i + 1) & (table->capacity - 1));
+
+    table->calls[i] = *call;
+}
+
+static int smp_call_table_resize(SmpCallTable *table, size_t capacity)
+{
+    SmpCall *old_calls = table->calls;
+    size_t old_capacity = table->capacity;
+    size_t i;
+
+    table->calls = calloc(capacity, sizeof(*table->calls));
+    if (table->calls == NULL) {
+        table->calls = old_calls;
+        return SMP_ERROR_NO_MEM;
+    }
+
+    table->capacity = capacity;
+    for (i = 0; i < old_capacity; i++) {
+        if (old_calls[i].used)
+            smp_call_table_insert(table, &old_calls[i]);
+    }
+
+    free(old_calls);
+    return 0;
+}
+
+/* backward shift deletion, so lookups never need tombstones */
+static void smp_call_table_remove(SmpCallTable *table, SmpCall *call)
+{
+    size_t mask = table->capacity - 1;
+    size_t i = (size_t) (call - table->calls);
+    size_t j = i;
+
+    while (1) {
+        size_t home;
+
+        j = (j + 1) & mask;
+        if (!table->calls[j].used)
+            break;
+
+        /* move the entry into the hole unless its home lies cyclically in
+         * (i, j] */
+        home = smp_call_table_home(table, table->calls[j].id);
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            table->calls[i] = table->calls[j];
+            i = j;
+        }
+    }
+
+    table->calls[i].used = false;
+    table->n_calls--;
+}
+
+static void smp_call_table_take_entry(SmpCallTable *table, SmpCall *entry,
+        SmpCall *call)
+{
+    *call = *entry;
+    smp_call_table_remove(table, entry);
+}
+
+/* Internal API */
+SmpCallTable *smp_call_table_new(void)
+{
+    SmpCallTable *table;
+
+    table = smp_new(SmpCallTable);
+    if (table == NULL)
+        return NULL;
+
+    table->next_id = 1;
+    return table;
+}
+
+/* capacity must be a power of two, table holds up to capacity / 2 calls */
+void smp_call_table_init_static(SmpCallTable *table, SmpCall *calls,
+        size_t capacity)
+{
+    memset(table, 0, sizeof(*table));
+    memset(calls, 0, capacity * sizeof(*calls));
+    table->calls = calls;
+    table->capacity = capacity;
+    table->next_id = 1;
+    table->fixed = true;
+}
+
+void smp_call_table_free(SmpCallTable *table)
+{
+    return_if_fail(table != NULL);
+
+    free(table->calls);
+    free(table);
+}
+
+int smp_call_table_add(SmpCallTable *table, uint32_t msgid,
+        SmpCallCompletionFunc cb, void *userdata, uint64_t deadline,
+        uint32_t *id)
+{
+    SmpCall call;
+    int ret;
+
+    /* keep the load factor under 1/2 so probe sequences stay short */
+    if ((table->n_calls + 1) * 2 > table->capacity) {
+        size_t capacity = table->capacity * 2;
+
+        if (table->fixed)
+            return SMP_ERROR_BUSY;
+
+        if (capacity < SMP_CALL_TABLE_MIN_CAPACITY)
+            capacity = SMP_CALL_TABLE_MIN_CAPACITY;
+
+        ret = smp_call_table_resize(table, capacity);
+        if (ret < 0)
+            return ret;
+    }
+
+    /* skip ids which are still in use after wrapping */
+    do {
+        call.id = table->next_id++ & ~SMP_CALL_RESPONSE_FLAG;
+    } while (smp_call_table_lookup(table, call.id) != NULL);
+
+    call.msgid = msgid;
+    call.used = true;
+    call.cb = cb;
+    call.userdata = userdata;
+    call.deadline = deadline;
+
+    smp_call_table_insert(table, &call);
+    table->n_calls++;
+
+    *id = call.id;
+    return 0;
+}
+
+/* remove the call with the given id and return it in call */
+bool smp_call_table_take(SmpCallTable *table, uint32_t id, SmpCall *call)
+{
+    SmpCall *entry;
+
+    entry = smp_call_table_lookup(table, id);
+    if (entry == NULL)
+        return false;
+
+    smp_call_table_take_entry(table, entry, call);
+    return true;
+}
+
+/* remove the call with the given id if it was made with a request of id
+ * msgid */
+bool smp_call_table_take_response(SmpCallTable *table, uint32_t id,
+        uint32_t msgid, SmpCall *call)
+{
+    SmpCall *entry;
+
+    entry = smp_call_table_lookup(table, id);
+    if (entry == NULL || entry->msgid != msgid)
+        return false;
+
+    smp_call_table_take_entry(table, entry, call);
+    return true;
+}
+
+bool smp_call_table_take_expired(SmpCallTable *table, uint64_t now,
+        SmpCall *call)
+{
+    size_t i;
+
+    for (i = 0; i < table->capacity; i++) {
+        SmpCall *entry = &table->calls[i];
+
+        if (entry->used && entry->deadline != 0 && entry->deadline <= now) {
+            smp_call_table_take_entry(table, entry, call);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool smp_call_table_take_any(SmpCallTable *table, SmpCall *call)
+{
+    size_t i;
+
+    for (i = 0; i < table->capacity; i++) {
+        if (table->calls[i].used) {
+            smp_call_table_take_entry(table, &table->calls[i], call);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* return the earliest call deadline or 0 if there is none */
+uint64_t smp_call_table_get_next_deadline(SmpCallTable *table)
+{
+    uint64_t deadline = 0;
+    size_t i;
+
+    for (i = 0; i < table->capacity; i++) {
+        SmpCall *entry = &table->calls[i];
+
+        if (!entry->used || entry->deadline == 0)
+            continue;
+
+        if (deadline == 0 || entry->deadline < deadline)
+            deadline = entry->deadline;
+    }
+
+    return deadline;
+}
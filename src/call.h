@@ -0,0 +1,77 @@
+/* libsmp
+ * Copyright (C) 2026 Actronika SAS
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CALL_H
+#define CALL_H
+
+#include "libsmp.h"
+#include "libsmp-private.h"
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Set in the correlation id of responses so they can't be mistaken for
+ * requests of the peer, which allocates ids on its own */
+#define SMP_CALL_RESPONSE_FLAG 0x80000000u
+
+typedef struct
+{
+    uint32_t id;
+    uint32_t msgid;     /* id of the request message */
+    bool used;
+
+    SmpCallCompletionFunc cb;
+    void *userdata;
+    uint64_t deadline;  /* 0 if the call doesn't time out */
+} SmpCall;
+
+/* Outstanding calls indexed by correlation id, open addressing with linear
+ * probing */
+typedef struct
+{
+    SmpCall *calls;
+    size_t capacity;    /* always a power of two */
+    size_t n_calls;
+    uint32_t next_id;
+    bool fixed;         /* calls provided by the caller, never resized */
+} SmpCallTable;
+
+SmpCallTable *smp_call_table_new(void);
+void smp_call_table_init_static(SmpCallTable *table, SmpCall *calls,
+        size_t capacity);
+void smp_call_table_free(SmpCallTable *table);
+
+int smp_call_table_add(SmpCallTable *table, uint32_t msgid,
+        SmpCallCompletionFunc cb, void *userdata, uint64_t deadline,
+        uint32_t *id);
+
+bool smp_call_table_take(SmpCallTable *table, uint32_t id, SmpCall *call);
+bool smp_call_table_take_response(SmpCallTable *table, uint32_t id,
+        uint32_t msgid, SmpCall *call);
+bool smp_call_table_take_expired(SmpCallTable *table, uint64_t now,
+        SmpCall *call);
+bool smp_call_table_take_any(SmpCallTable *table, SmpCall *call);
+
+uint64_t smp_call_table_get_next_deadline(SmpCallTable *table);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
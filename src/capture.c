@@ -0,0 +1,767 @@
+/* libsmp
+ * Copyright (C) 2026 Actronika SAS
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file
+ * \defgroup capture Capture
+ *
+ * Offline processing of capture files.
+ */
+
+#include "config.h"
+
+#include "capture.h"
+
+#ifdef SMP_ENABLE_CAPTURE
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#include "libsmp-private.h"
+#include "serial-protocol.h"
+
+/* decoded chunks are sized to give each thread a few of them, in bounds
+ * keeping the thread overhead low and the memory usage reasonable */
+#define SMP_CAPTURE_DECODE_MIN_CHUNK_SIZE 4096
+#define SMP_CAPTURE_DECODE_MAX_CHUNK_SIZE (4 * 1024 * 1024)
+
+static const uint8_t magic[8] = { 'S', 'M', 'P', 'C', 'A', 'P', '\r', '\n' };
+
+static inline size_t padded_size(size_t size)
+{
+    return (size + 7) & ~(size_t) 7;
+}
+
+static void put_le16(uint8_t *buf, uint16_t val)
+{
+    buf[0] = (uint8_t) val;
+    buf[1] = (uint8_t) (val >> 8);
+}
+
+static void put_le32(uint8_t *buf, uint32_t val)
+{
+    put_le16(buf, (uint16_t) val);
+    put_le16(buf + 2, (uint16_t) (val >> 16));
+}
+
+static void put_le64(uint8_t *buf, uint64_t val)
+{
+    put_le32(buf, (uint32_t) val);
+    put_le32(buf + 4, (uint32_t) (val >> 32));
+}
+
+static uint16_t get_le16(const uint8_t *buf)
+{
+    return (uint16_t) (buf[0] | (buf[1] << 8));
+}
+
+static uint32_t get_le32(const uint8_t *buf)
+{
+    return (uint32_t) get_le16(buf) | ((uint32_t) get_le16(buf + 2) << 16);
+}
+
+static uint64_t get_le64(const uint8_t *buf)
+{
+    return (uint64_t) get_le32(buf) | ((uint64_t) get_le32(buf + 4) << 32);
+}
+
+/* Writer */
+SmpCapture *smp_capture_new(const char *path)
+{
+    uint8_t header[SMP_CAPTURE_FILE_HEADER_SIZE] = { 0 };
+    SmpCapture *capture;
+
+    capture = smp_new(SmpCapture);
+    if (capture == NULL)
+        return NULL;
+
+    /* records are appended to an existing capture, a new one starts with the
+     * file header */
+    capture->f = fopen(path, "ab");
+    if (capture->f == NULL) {
+        free(capture);
+        return NULL;
+    }
+
+    if (fseek(capture->f, 0, SEEK_END) == 0 && ftell(capture->f) == 0) {
+        memcpy(header, magic, sizeof(magic));
+        put_le16(header + 8, SMP_CAPTURE_VERSION);
+        put_le16(header + 10, SMP_CAPTURE_FILE_HEADER_SIZE);
+
+        if (fwrite(header, sizeof(header), 1, capture->f) != 1) {
+            fclose(capture->f);
+            free(capture);
+            return NULL;
+        }
+    }
+
+    return capture;
+}
+
+void smp_capture_free(SmpCapture *capture)
+{
+    return_if_fail(capture != NULL);
+
+    fclose(capture->f);
+    free(capture);
+}
+
+int smp_capture_write(SmpCapture *capture, SmpCaptureDirection direction,
+        uint64_t time, const void *data, size_t size)
+{
+    static const uint8_t padding[8] = { 0 };
+    uint8_t header[SMP_CAPTURE_RECORD_HEADER_SIZE] = { 0 };
+    size_t npad = padded_size(size) - size;
+
+    return_val_if_fail(size <= UINT32_MAX, SMP_ERROR_TOO_BIG);
+
+    put_le64(header, time);
+    put_le32(header + 8, (uint32_t) size);
+    header[12] = (uint8_t) direction;
+
+    /* stdio buffers the records so this doesn't cost a syscall per chunk */
+    if (fwrite(header, sizeof(header), 1, capture->f) != 1
+            || fwrite(data, 1, size, capture->f) != size
+            || fwrite(padding, 1, npad, capture->f) != npad)
+        return SMP_ERROR_IO;
+
+    return 0;
+}
+
+/* return the size of the file header, header fields added by later
+ * revisions are skipped */
+static int smp_capture_parse_file_header(const uint8_t *header)
+{
+    uint16_t header_size;
+
+    if (memcmp(header, magic, sizeof(magic)) != 0
+            || get_le16(header + 8) != SMP_CAPTURE_VERSION)
+        return SMP_ERROR_BAD_MESSAGE;
+
+    header_size = get_le16(header + 10);
+    if (header_size < SMP_CAPTURE_FILE_HEADER_SIZE)
+        return SMP_ERROR_BAD_MESSAGE;
+
+    return header_size;
+}
+
+/* Reader */
+int smp_capture_reader_open(SmpCaptureReader *reader, const char *path)
+{
+    uint8_t header[SMP_CAPTURE_FILE_HEADER_SIZE];
+    int header_size;
+
+    return_val_if_fail(reader != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(path != NULL, SMP_ERROR_INVALID_PARAM);
+
+    reader->buf = NULL;
+    reader->bufsize = 0;
+    reader->f = fopen(path, "rb");
+    if (reader->f == NULL)
+        return SMP_ERROR_NOT_FOUND;
+
+    if (fread(header, sizeof(header), 1, reader->f) != 1)
+        goto bad_file;
+
+    header_size = smp_capture_parse_file_header(header);
+    if (header_size < 0 || fseek(reader->f, header_size, SEEK_SET) != 0)
+        goto bad_file;
+
+    return 0;
+
+bad_file:
+    fclose(reader->f);
+    reader->f = NULL;
+    return SMP_ERROR_BAD_MESSAGE;
+}
+
+void smp_capture_reader_close(SmpCaptureReader *reader)
+{
+    return_if_fail(reader != NULL);
+
+    if (reader->f != NULL)
+        fclose(reader->f);
+
+    free(reader->buf);
+    reader->f = NULL;
+    reader->buf = NULL;
+    reader->bufsize = 0;
+}
+
+/* return 1 if a record was read, 0 at the end of the capture. A truncated
+ * last record, as left by an interrupted recording, ends the capture. */
+int smp_capture_reader_next(SmpCaptureReader *reader, SmpCaptureRecord *record)
+{
+    uint8_t header[SMP_CAPTURE_RECORD_HEADER_SIZE];
+    size_t size;
+    size_t padded;
+
+    if (fread(header, sizeof(header), 1, reader->f) != 1)
+        return ferror(reader->f) ? SMP_ERROR_IO : 0;
+
+    size = get_le32(header + 8);
+    padded = padded_size(size);
+
+    if (padded > reader->bufsize) {
+        uint8_t *buf = realloc(reader->buf, padded);
+
+        if (buf == NULL)
+            return SMP_ERROR_NO_MEM;
+
+        reader->buf = buf;
+        reader->bufsize = padded;
+    }
+
+    if (padded > 0 && fread(reader->buf, 1, padded, reader->f) != padded)
+        return ferror(reader->f) ? SMP_ERROR_IO : 0;
+
+    record->time = get_le64(header);
+    record->direction = (SmpCaptureDirection) header[12];
+    record->data = reader->buf;
+    record->size = size;
+    return 1;
+}
+
+/* Parallel decoder
+ *
+ * The received data of the capture is seen as a single stream made of the
+ * RX records. It is split in chunks starting on frame boundaries which are
+ * decoded by independent decoders on several threads, then the messages are
+ * built and passed to the user in stream order. As a START_BYTE resets the
+ * decoder whatever its state, decoding a chunk from a fresh decoder gives
+ * the same frames as decoding the whole stream. */
+typedef struct
+{
+    const uint8_t *data;
+    size_t size;
+    uint64_t time;
+    uint64_t pos;   /* position in the received stream */
+} SmpCaptureSegment;
+
+typedef struct
+{
+    uint8_t *file;
+    size_t file_size;
+
+    SmpCaptureSegment *segs;
+    size_t n_segs;
+    uint64_t size;
+} SmpCaptureStream;
+
+/* decoded frames are stored as this header followed by the frame, padded
+ * to keep the headers aligned */
+typedef struct
+{
+    uint64_t start_time;
+    uint64_t end_time;
+    size_t size;
+} SmpCaptureFrame;
+
+typedef struct
+{
+    const SmpCaptureStream *stream;
+    SmpSerialChecksum checksum;
+    uint64_t start;
+    uint64_t end;
+
+    uint8_t *frames;
+    size_t frames_size;
+    size_t frames_capacity;
+    int ret;
+
+#ifdef HAVE_PTHREAD
+    pthread_t thread;
+    bool started;
+#endif
+} SmpCaptureChunk;
+
+static int smp_capture_stream_map(SmpCaptureStream *stream, const char *path)
+{
+#ifdef HAVE_MMAP
+    struct stat st;
+    void *file;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return SMP_ERROR_NOT_FOUND;
+
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        return SMP_ERROR_BAD_MESSAGE;
+    }
+
+    file = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (file == MAP_FAILED)
+        return SMP_ERROR_IO;
+
+    stream->file = file;
+    stream->file_size = (size_t) st.st_size;
+    return 0;
+#else
+    FILE *f;
+    long size;
+
+    f = fopen(path, "rb");
+    if (f == NULL)
+        return SMP_ERROR_NOT_FOUND;
+
+    if (fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) <= 0
+            || fseek(f, 0, SEEK_SET) != 0) {
+        fclose(f);
+        return SMP_ERROR_BAD_MESSAGE;
+    }
+
+    stream->file = malloc((size_t) size);
+    if (stream->file == NULL) {
+        fclose(f);
+        return SMP_ERROR_NO_MEM;
+    }
+
+    if (fread(stream->file, 1, (size_t) size, f) != (size_t) size) {
+        free(stream->file);
+        fclose(f);
+        return SMP_ERROR_IO;
+    }
+
+    fclose(f);
+    stream->file_size = (size_t) size;
+    return 0;
+#endif
+}
+
+static void smp_capture_stream_close(SmpCaptureStream *stream)
+{
+#ifdef HAVE_MMAP
+    munmap(stream->file, stream->file_size);
+#else
+    free(stream->file);
+#endif
+    free(stream->segs);
+}
+
+/* list the RX records, or count them if segs is NULL */
+static size_t smp_capture_stream_index(const uint8_t *file, size_t file_size,
+        size_t offset, SmpCaptureSegment *segs)
+{
+    uint64_t pos = 0;
+    size_t n = 0;
+
+    while (file_size - offset >= SMP_CAPTURE_RECORD_HEADER_SIZE) {
+        const uint8_t *header = file + offset;
+        size_t size = get_le32(header + 8);
+        size_t padded = padded_size(size);
+
+        /* a truncated last record ends the capture */
+        if (file_size - offset - SMP_CAPTURE_RECORD_HEADER_SIZE < padded)
+            break;
+
+        if (header[12] == SMP_CAPTURE_DIRECTION_RX && size > 0) {
+            if (segs != NULL) {
+                segs[n].data = header + SMP_CAPTURE_RECORD_HEADER_SIZE;
+                segs[n].size = size;
+                segs[n].time = get_le64(header);
+                segs[n].pos = pos;
+            }
+
+            pos += size;
+            n++;
+        }
+
+        offset += SMP_CAPTURE_RECORD_HEADER_SIZE + padded;
+    }
+
+    return n;
+}
+
+static int smp_capture_stream_open(SmpCaptureStream *stream, const char *path)
+{
+    int header_size;
+    int ret;
+
+    memset(stream, 0, sizeof(*stream));
+
+    ret = smp_capture_stream_map(stream, path);
+    if (ret < 0)
+        return ret;
+
+    if (stream->file_size < SMP_CAPTURE_FILE_HEADER_SIZE) {
+        ret = SMP_ERROR_BAD_MESSAGE;
+        goto error;
+    }
+
+    header_size = smp_capture_parse_file_header(stream->file);
+    if (header_size < 0 || (size_t) header_size > stream->file_size) {
+        ret = SMP_ERROR_BAD_MESSAGE;
+        goto error;
+    }
+
+    stream->n_segs = smp_capture_stream_index(stream->file, stream->file_size,
+            header_size, NULL);
+    if (stream->n_segs == 0)
+        return 0;
+
+    stream->segs = malloc(stream->n_segs * sizeof(*stream->segs));
+    if (stream->segs == NULL) {
+        ret = SMP_ERROR_NO_MEM;
+        goto error;
+    }
+
+    smp_capture_stream_index(stream->file, stream->file_size, header_size,
+            stream->segs);
+    stream->size = stream->segs[stream->n_segs - 1].pos
+        + stream->segs[stream->n_segs - 1].size;
+    return 0;
+
+error:
+    smp_capture_stream_close(stream);
+    return ret;
+}
+
+/* return the index of the segment containing pos */
+static size_t smp_capture_stream_find_segment(const SmpCaptureStream *stream,
+        uint64_t pos)
+{
+    size_t lo = 0;
+    size_t hi = stream->n_segs;
+
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (stream->segs[mid].pos <= pos)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+static uint8_t smp_capture_stream_get_byte(const SmpCaptureStream *stream,
+        uint64_t pos)
+{
+    const SmpCaptureSegment *seg;
+
+    seg = &stream->segs[smp_capture_stream_find_segment(stream, pos)];
+    return seg->data[pos - seg->pos];
+}
+
+/* return the position of the first frame start at or after pos, or the
+ * stream size if there is none */
+static uint64_t smp_capture_stream_find_frame(const SmpCaptureStream *stream,
+        uint64_t pos)
+{
+    size_t i;
+
+    for (i = smp_capture_stream_find_segment(stream, pos); i < stream->n_segs;
+            i++) {
+        const SmpCaptureSegment *seg = &stream->segs[i];
+        size_t offset = (pos > seg->pos) ? pos - seg->pos : 0;
+        const uint8_t *p;
+
+        while ((p = memchr(seg->data + offset, SMP_SERIAL_PROTOCOL_START_BYTE,
+                        seg->size - offset)) != NULL) {
+            uint64_t start = seg->pos + (uint64_t) (p - seg->data);
+            uint64_t n_esc = 0;
+
+            /* an escaped START_BYTE is preceded by an odd number of ESC */
+            while (n_esc < start && smp_capture_stream_get_byte(stream,
+                        start - n_esc - 1) == SMP_SERIAL_PROTOCOL_ESC_BYTE)
+                n_esc++;
+
+            if (n_esc % 2 == 0)
+                return start;
+
+            offset = (size_t) (p - seg->data) + 1;
+        }
+    }
+
+    return stream->size;
+}
+
+static int smp_capture_chunk_add_frame(SmpCaptureChunk *chunk,
+        const SmpSerialProtocolDecoder *decoder, const uint8_t *frame,
+        size_t size)
+{
+    SmpCaptureFrame header;
+    size_t needed = sizeof(header) + padded_size(size);
+
+    if (chunk->frames_capacity - chunk->frames_size < needed) {
+        size_t capacity = chunk->frames_capacity * 2;
+        uint8_t *frames;
+
+        if (capacity < chunk->frames_size + needed)
+            capacity = chunk->frames_size + needed;
+
+        frames = realloc(chunk->frames, capacity);
+        if (frames == NULL)
+            return SMP_ERROR_NO_MEM;
+
+        chunk->frames = frames;
+        chunk->frames_capacity = capacity;
+    }
+
+    header.start_time = decoder->frame_start_time;
+    header.end_time = decoder->rx_time;
+    header.size = size;
+    memcpy(chunk->frames + chunk->frames_size, &header, sizeof(header));
+    memcpy(chunk->frames + chunk->frames_size + sizeof(header), frame, size);
+    chunk->frames_size += needed;
+    return 0;
+}
+
+static void *smp_capture_chunk_decode(void *data)
+{
+    SmpCaptureChunk *chunk = data;
+    const SmpCaptureStream *stream = chunk->stream;
+    SmpSerialProtocolDecoder *decoder;
+    uint64_t pos = chunk->start;
+    size_t i;
+
+    chunk->frames_size = 0;
+    chunk->ret = 0;
+
+    decoder = smp_serial_protocol_decoder_new(0);
+    if (decoder == NULL) {
+        chunk->ret = SMP_ERROR_NO_MEM;
+        return NULL;
+    }
+
+    smp_serial_protocol_decoder_set_checksum(decoder, chunk->checksum);
+
+    for (i = smp_capture_stream_find_segment(stream, pos);
+            pos < chunk->end && chunk->ret == 0; i++) {
+        const SmpCaptureSegment *seg = &stream->segs[i];
+        size_t offset = (size_t) (pos - seg->pos);
+        size_t n = seg->size - offset;
+        size_t j;
+
+        if (n > chunk->end - pos)
+            n = (size_t) (chunk->end - pos);
+
+        smp_serial_protocol_decoder_set_rx_time(decoder, seg->time);
+        for (j = offset; j < offset + n; j++) {
+            uint8_t *frame;
+            size_t framesize;
+
+            /* decoding errors are dropped frames, as in a context */
+            smp_serial_protocol_decoder_process_byte(decoder, seg->data[j],
+                    &frame, &framesize);
+            if (frame != NULL) {
+                chunk->ret = smp_capture_chunk_add_frame(chunk, decoder,
+                        frame, framesize);
+                if (chunk->ret < 0)
+                    break;
+            }
+        }
+
+        pos += n;
+    }
+
+    smp_serial_protocol_decoder_free(decoder);
+    return NULL;
+}
+
+/* decode the chunks, the first one on the calling thread. A chunk which
+ * can't get a thread is decoded on the calling thread too. */
+static void smp_capture_decode_chunks(SmpCaptureChunk *chunks,
+        size_t n_chunks)
+{
+#ifdef HAVE_PTHREAD
+    size_t i;
+
+    for (i = 1; i < n_chunks; i++) {
+        chunks[i].started = pthread_create(&chunks[i].thread, NULL,
+                smp_capture_chunk_decode, &chunks[i]) == 0;
+        if (!chunks[i].started)
+            smp_capture_chunk_decode(&chunks[i]);
+    }
+
+    smp_capture_chunk_decode(&chunks[0]);
+
+    for (i = 1; i < n_chunks; i++) {
+        if (chunks[i].started)
+            pthread_join(chunks[i].thread, NULL);
+    }
+#else
+    size_t i;
+
+    for (i = 0; i < n_chunks; i++)
+        smp_capture_chunk_decode(&chunks[i]);
+#endif
+}
+
+#ifdef HAVE_PTHREAD
+static unsigned int smp_capture_get_n_cpus(void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (n > 0)
+        return (unsigned int) n;
+#endif
+
+    return 1;
+}
+#endif
+
+/**
+ * \ingroup capture
+ * Decode the data received in a capture file, as recorded by
+ * smp_context_start_capture(), using several threads. The file is mapped and
+ * split in chunks on frame boundaries which are decoded in parallel, then
+ * messages are passed to cb, on the calling thread and in the order they
+ * were received. Their reception times are available with
+ * smp_message_get_rx_timestamp().
+ *
+ * The capture must come from a context without link features. Frames which
+ * fail to decode or don't contain a valid message are skipped.
+ *
+ * @param[in] path the capture file
+ * @param[in] checksum the frame checksum used by the captured traffic
+ * @param[in] n_threads the number of threads to use, 0 for one per CPU
+ * @param[in] cb the function called for each message
+ * @param[in] userdata a pointer to userdata passed to cb
+ *
+ * @return the number of messages decoded on success, a SmpError otherwise.
+ */
+ssize_t smp_capture_decode(const char *path, SmpSerialChecksum checksum,
+        unsigned int n_threads, SmpCaptureMessageFunc cb, void *userdata)
+{
+    SmpCaptureStream stream;
+    SmpCaptureChunk *chunks;
+    SmpMessage *msg;
+    uint64_t chunk_size;
+    uint64_t pos = 0;
+    ssize_t n_messages = 0;
+    size_t i;
+    int ret;
+
+    return_val_if_fail(path != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(cb != NULL, SMP_ERROR_INVALID_PARAM);
+
+#ifdef HAVE_PTHREAD
+    if (n_threads == 0)
+        n_threads = smp_capture_get_n_cpus();
+#else
+    n_threads = 1;
+#endif
+
+    ret = smp_capture_stream_open(&stream, path);
+    if (ret < 0)
+        return ret;
+
+    chunk_size = stream.size / (n_threads * 4);
+    if (chunk_size < SMP_CAPTURE_DECODE_MIN_CHUNK_SIZE)
+        chunk_size = SMP_CAPTURE_DECODE_MIN_CHUNK_SIZE;
+    else if (chunk_size > SMP_CAPTURE_DECODE_MAX_CHUNK_SIZE)
+        chunk_size = SMP_CAPTURE_DECODE_MAX_CHUNK_SIZE;
+
+    chunks = calloc(n_threads, sizeof(*chunks));
+    msg = smp_message_new();
+    if (chunks == NULL || msg == NULL) {
+        n_messages = SMP_ERROR_NO_MEM;
+        goto done;
+    }
+
+    while (pos < stream.size) {
+        size_t n_chunks;
+
+        for (n_chunks = 0; n_chunks < n_threads && pos < stream.size;
+                n_chunks++) {
+            SmpCaptureChunk *chunk = &chunks[n_chunks];
+
+            chunk->stream = &stream;
+            chunk->checksum = checksum;
+            chunk->start = pos;
+            if (stream.size - pos > chunk_size)
+                chunk->end = smp_capture_stream_find_frame(&stream,
+                        pos + chunk_size);
+            else
+                chunk->end = stream.size;
+
+            pos = chunk->end;
+        }
+
+        smp_capture_decode_chunks(chunks, n_chunks);
+
+        for (i = 0; i < n_chunks; i++) {
+            SmpCaptureChunk *chunk = &chunks[i];
+            size_t offset = 0;
+
+            if (chunk->ret < 0) {
+                n_messages = chunk->ret;
+                goto done;
+            }
+
+            while (offset < chunk->frames_size) {
+                SmpCaptureFrame header;
+                const uint8_t *frame;
+
+                memcpy(&header, chunk->frames + offset, sizeof(header));
+                frame = chunk->frames + offset + sizeof(header);
+                offset += sizeof(header) + padded_size(header.size);
+
+                if (smp_message_build_from_buffer(msg, frame, header.size) < 0)
+                    continue;
+
+                msg->rx_start_time = header.start_time;
+                msg->rx_end_time = header.end_time;
+                cb(msg, userdata);
+                smp_message_clear(msg);
+                n_messages++;
+            }
+        }
+    }
+
+done:
+    if (chunks != NULL) {
+        for (i = 0; i < n_threads; i++)
+            free(chunks[i].frames);
+    }
+
+    free(chunks);
+    if (msg != NULL)
+        smp_message_free(msg);
+
+    smp_capture_stream_close(&stream);
+    return n_messages;
+}
+
+#else /* SMP_ENABLE_CAPTURE */
+
+#include "libsmp.h"
+
+ssize_t smp_capture_decode(const char *path, SmpSerialChecksum checksum,
+        unsigned int n_threads, SmpCaptureMessageFunc cb, void *userdata)
+{
+    return SMP_ERROR_NOT_SUPPORTED;
+}
+
+#endif /* SMP_ENABLE_CAPTURE */
@@ -0,0 +1,103 @@
+/* libsmp
+ * Copyright (C) 2026 Actronika SAS
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include "config.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef SMP_ENABLE_CAPTURE
+#include <stdio.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Capture files are a 16 bytes file header followed by records, all fields
+ * are little endian:
+ *
+ *   file header: magic "SMPCAP\r\n", u16 version, u16 header size,
+ *                u32 reserved
+ *   record:      u64 time in ns, u32 data size, u8 direction,
+ *                3 reserved bytes, data padded to a multiple of 8 bytes
+ *
+ * so every record header is 8 bytes aligned when the file is mapped. */
+#define SMP_CAPTURE_VERSION 1
+#define SMP_CAPTURE_FILE_HEADER_SIZE 16
+#define SMP_CAPTURE_RECORD_HEADER_SIZE 16
+
+typedef enum
+{
+    SMP_CAPTURE_DIRECTION_RX = 0,
+    SMP_CAPTURE_DIRECTION_TX = 1,
+} SmpCaptureDirection;
+
+#ifdef SMP_ENABLE_CAPTURE
+
+typedef struct
+{
+    FILE *f;
+} SmpCapture;
+
+typedef struct
+{
+    uint64_t time;
+    SmpCaptureDirection direction;
+    const uint8_t *data;    /* valid until the next record is read */
+    size_t size;
+} SmpCaptureRecord;
+
+typedef struct
+{
+    FILE *f;
+    uint8_t *buf;
+    size_t bufsize;
+} SmpCaptureReader;
+
+SmpCapture *smp_capture_new(const char *path);
+void smp_capture_free(SmpCapture *capture);
+int smp_capture_write(SmpCapture *capture, SmpCaptureDirection direction,
+        uint64_t time, const void *data, size_t size);
+
+int smp_capture_reader_open(SmpCaptureReader *reader, const char *path);
+void smp_capture_reader_close(SmpCaptureReader *reader);
+int smp_capture_reader_next(SmpCaptureReader *reader, SmpCaptureRecord *record);
+
+/* record device traffic when a capture is running on the context */
+#define SMP_CAPTURE_RECORD(ctx, direction, time, data, size) \
+    do { \
+        if ((ctx)->capture != NULL) \
+            smp_capture_write((ctx)->capture, (direction), (time), (data), \
+                    (size)); \
+    } while (0)
+
+#else /* SMP_ENABLE_CAPTURE */
+
+typedef struct SmpCapture SmpCapture;
+
+#define SMP_CAPTURE_RECORD(ctx, direction, time, data, size) do {} while (0)
+
+#endif /* SMP_ENABLE_CAPTURE */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
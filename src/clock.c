@@ -0,0 +1,84 @@
+/* libsmp
+ * Copyright (C) 2026 Actronika SAS
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "config.h"
+
+#include "clock.h"
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#elif defined(HAVE_CLOCK_GETTIME)
+#include <time.h>
+#endif
+
+#if defined(_WIN32) || defined(_WIN64)
+uint64_t smp_clock_get_time_ns(void)
+{
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER counter;
+
+    if (freq.QuadPart == 0)
+        QueryPerformanceFrequency(&freq);
+
+    QueryPerformanceCounter(&counter);
+
+    /* split to avoid overflowing when multiplying by 1e9 */
+    return (uint64_t) (counter.QuadPart / freq.QuadPart) * SMP_NSEC_PER_SEC
+        + (uint64_t) (counter.QuadPart % freq.QuadPart) * SMP_NSEC_PER_SEC
+        / freq.QuadPart;
+}
+
+void smp_clock_sleep_until(uint64_t deadline)
+{
+    uint64_t now = smp_clock_get_time_ns();
+
+    if (deadline > now)
+        Sleep((DWORD) ((deadline - now) / SMP_NSEC_PER_MSEC));
+}
+#elif defined(HAVE_CLOCK_GETTIME)
+uint64_t smp_clock_get_time_ns(void)
+{
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+        return 0;
+
+    return (uint64_t) ts.tv_sec * SMP_NSEC_PER_SEC + (uint64_t) ts.tv_nsec;
+}
+
+void smp_clock_sleep_until(uint64_t deadline)
+{
+    uint64_t now;
+
+    /* relative sleeps, clock_nanosleep() isn't available everywhere */
+    while ((now = smp_clock_get_time_ns()) != 0 && now < deadline) {
+        struct timespec ts;
+
+        ts.tv_sec = (time_t) ((deadline - now) / SMP_NSEC_PER_SEC);
+        ts.tv_nsec = (long) ((deadline - now) % SMP_NSEC_PER_SEC);
+        nanosleep(&ts, NULL);
+    }
+}
+#else
+uint64_t smp_clock_get_time_ns(void)
+{
+    return 0;
+}
+
+void smp_clock_sleep_until(uint64_t deadline)
+{
+}
+#endif
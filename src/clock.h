@@ -0,0 +1,41 @@
+/* libsmp
+ * Copyright (C) 2026 Actronika SAS
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SMP_NSEC_PER_MSEC 1000000ULL
+#define SMP_NSEC_PER_SEC 1000000000ULL
+
+/* Return a monotonic time in nanoseconds, or 0 if there is no clock on this
+ * platform. Features relying on timers are disabled in the latter case. */
+uint64_t smp_clock_get_time_ns(void);
+
+/* Sleep until the monotonic time reaches deadline, return immediately if
+ * there is no clock. */
+void smp_clock_sleep_until(uint64_t deadline);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
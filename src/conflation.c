@@ -0,0 +1,126 @@
+/* libsmp
+ * Copyright (C) 2026 Actronika SAS
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "conflation.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define SMP_CONFLATION_TABLE_MIN_CAPACITY 8
+
+SmpConflationTable *smp_conflation_table_new(void)
+{
+    return smp_new(SmpConflationTable);
+}
+
+void smp_conflation_table_free(SmpConflationTable *table)
+{
+    size_t i;
+
+    return_if_fail(table != NULL);
+
+    for (i = 0; i < table->n_entries; i++)
+        free(table->entries[i].rx_data);
+
+    free(table->entries);
+    free(table);
+}
+
+int smp_conflation_table_set(SmpConflationTable *table, uint32_t msgid,
+        int flags)
+{
+    SmpConflationEntry *entry;
+    size_t i;
+
+    return_val_if_fail(table != NULL, SMP_ERROR_INVALID_PARAM);
+
+    for (i = 0; i < table->n_entries; i++) {
+        if (table->entries[i].msgid == msgid) {
+            /* a held message is still delivered */
+            table->entries[i].flags = flags;
+            return 0;
+        }
+    }
+
+    if (flags == 0)
+        return 0;
+
+    if (table->n_entries == table->capacity) {
+        size_t capacity = table->capacity * 2;
+        SmpConflationEntry *entries;
+
+        if (capacity == 0)
+            capacity = SMP_CONFLATION_TABLE_MIN_CAPACITY;
+
+        entries = realloc(table->entries, capacity * sizeof(*entries));
+        if (entries == NULL)
+            return SMP_ERROR_NO_MEM;
+
+        table->entries = entries;
+        table->capacity = capacity;
+    }
+
+    entry = &table->entries[table->n_entries++];
+    memset(entry, 0, sizeof(*entry));
+    entry->msgid = msgid;
+    entry->flags = flags;
+    return 0;
+}
+
+/* return the entry of msgid if flag is set on it, NULL otherwise */
+SmpConflationEntry *smp_conflation_table_lookup(SmpConflationTable *table,
+        uint32_t msgid, int flag)
+{
+    size_t i;
+
+    for (i = 0; i < table->n_entries; i++) {
+        SmpConflationEntry *entry = &table->entries[i];
+
+        if (entry->msgid == msgid)
+            return (entry->flags & flag) ? entry : NULL;
+    }
+
+    return NULL;
+}
+
+/* keep a copy of payload in place of the message held, if any */
+int smp_conflation_entry_hold(SmpConflationTable *table,
+        SmpConflationEntry *entry, const uint8_t *payload, size_t size,
+        uint64_t start_time, uint64_t end_time)
+{
+    if (size > entry->rx_capacity) {
+        uint8_t *data = realloc(entry->rx_data, size);
+
+        if (data == NULL)
+            return SMP_ERROR_NO_MEM;
+
+        entry->rx_data = data;
+        entry->rx_capacity = size;
+    }
+
+    memcpy(entry->rx_data, payload, size);
+    entry->rx_size = size;
+    entry->rx_start_time = start_time;
+    entry->rx_end_time = end_time;
+
+    if (!entry->rx_pending) {
+        entry->rx_pending = true;
+        table->n_rx_pending++;
+    }
+
+    return 0;
+}
@@ -0,0 +1,70 @@
+/* libsmp
+ * Copyright (C) 2026 Actronika SAS
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef CONFLATION_H
+#define CONFLATION_H
+
+#include "libsmp.h"
+#include "libsmp-private.h"
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct
+{
+    uint32_t msgid;
+    int flags;          /* SmpConflation flags, 0 once disabled */
+
+    /* newest payload received while processing, delivered at the end */
+    uint8_t *rx_data;
+    size_t rx_size;
+    size_t rx_capacity;
+    bool rx_pending;
+    uint64_t rx_start_time;
+    uint64_t rx_end_time;
+} SmpConflationEntry;
+
+/* Message ids with a conflation policy. Entries are never removed so their
+ * index stays valid while held messages are delivered. */
+typedef struct
+{
+    SmpConflationEntry *entries;
+    size_t n_entries;
+    size_t capacity;
+    size_t n_rx_pending;
+} SmpConflationTable;
+
+SmpConflationTable *smp_conflation_table_new(void);
+void smp_conflation_table_free(SmpConflationTable *table);
+
+int smp_conflation_table_set(SmpConflationTable *table, uint32_t msgid,
+        int flags);
+SmpConflationEntry *smp_conflation_table_lookup(SmpConflationTable *table,
+        uint32_t msgid, int flag);
+
+int smp_conflation_entry_hold(SmpConflationTable *table,
+        SmpConflationEntry *entry, const uint8_t *payload, size_t size,
+        uint64_t start_time, uint64_t end_time);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -30,11 +30,38 @@
 #include <stdlib.h>
 
 #include "buffer.h"
+#include "call.h"
+#include "capture.h"
+#include "clock.h"
+#include "link.h"
+#include "prepared-message.h"
 #include "serial-device.h"
+#include "stats.h"
+#include "trace.h"
 #include "config.h"
+#include <string.h>
+
+#ifdef HAVE_MLOCK
+#include <sys/mman.h>
+#endif
 
 SMP_STATIC_ASSERT(sizeof(SmpContext) == sizeof(SmpStaticContext));
 
+/* encoded messages start with their id and payload size */
+#define MSG_HEADER_SIZE 8
+
+/* delay before writing again to a device which didn't take all the data */
+#define SMP_CONTEXT_TX_RETRY_NS SMP_NSEC_PER_MSEC
+
+/* the message id is encoded in host order, as in message.c */
+static inline uint32_t read_msgid(const uint8_t *buf)
+{
+    uint32_t msgid;
+
+    memcpy(&msgid, buf, sizeof(msgid));
+    return msgid;
+}
+
 static void smp_context_init(SmpContext *ctx, SmpSerialProtocolDecoder *decoder,
         const SmpEventCallbacks *cbs, void *userdata, bool statically_allocated)
 {
@@ -42,8 +69,154 @@ static void smp_context_init(SmpContext *ctx, SmpSerialProtocolDecoder *decoder,
     smp_serial_device_init(&ctx->device);
     ctx->cbs = *cbs;
     ctx->userdata = userdata;
+    ctx->frame_cb = NULL;
+    ctx->frame_userdata = NULL;
     ctx->opened = false;
+    ctx->processing = false;
+    ctx->rx_chunk_size = 0;
+    ctx->rx_chunk_offset = 0;
+    ctx->rx_chunk_time = 0;
+    ctx->busy_poll_ns = 0;
+    ctx->busy_poll_pause = false;
+    ctx->checksum = SMP_SERIAL_CHECKSUM_XOR8;
+    ctx->link = NULL;
+    ctx->calls = NULL;
+    ctx->send_queue = NULL;
+    ctx->tx_sched = NULL;
+    ctx->conflation = NULL;
+    ctx->schedule = NULL;
+    ctx->tx_pacing_max = 0;
+    ctx->tx_byte_ns = 0;
+    ctx->tx_drain_time = 0;
+    ctx->tx_pacing_deadline = 0;
+    memset(&ctx->stats, 0, sizeof(ctx->stats));
+    ctx->msg_stats = NULL;
+    ctx->trace = NULL;
+    ctx->rx_start_time = 0;
+    ctx->rx_end_time = 0;
+    ctx->capture = NULL;
+    ctx->transport = NULL;
     ctx->statically_allocated = statically_allocated;
+    ctx->realtime_size = 0;
+    ctx->realtime_max_message_size = 0;
+    ctx->realtime_locked = false;
+}
+
+/* I/O goes through the transport when one is set, through the built-in serial
+ * device otherwise */
+static int smp_context_io_open(SmpContext *ctx, const char *path)
+{
+    if (ctx->transport != NULL)
+        return ctx->transport->vtable->open(ctx->transport, path);
+
+    return smp_serial_device_open(&ctx->device, path);
+}
+
+static void smp_context_io_close(SmpContext *ctx)
+{
+    if (ctx->transport != NULL)
+        ctx->transport->vtable->close(ctx->transport);
+    else
+        smp_serial_device_close(&ctx->device);
+}
+
+static ssize_t smp_context_io_read(SmpContext *ctx, void *buf, size_t size)
+{
+    if (ctx->transport != NULL)
+        return ctx->transport->vtable->read(ctx->transport, buf, size);
+
+    return smp_serial_device_read(&ctx->device, buf, size);
+}
+
+static ssize_t smp_context_io_write(SmpContext *ctx, const void *buf,
+        size_t size)
+{
+    if (ctx->transport != NULL)
+        return ctx->transport->vtable->write(ctx->transport, buf, size);
+
+    return smp_serial_device_write(&ctx->device, buf, size);
+}
+
+/* write the buffers in order, one by one if the transport can't gather
+ * them */
+static ssize_t smp_context_io_writev(SmpContext *ctx, const SmpIoVec *iov,
+        int iovcnt)
+{
+    ssize_t total = 0;
+    int i;
+
+    if (ctx->transport == NULL)
+        return smp_serial_device_writev(&ctx->device, iov, iovcnt);
+
+    if (ctx->transport->vtable->writev != NULL)
+        return ctx->transport->vtable->writev(ctx->transport, iov, iovcnt);
+
+    for (i = 0; i < iovcnt; i++) {
+        ssize_t wbytes;
+
+        wbytes = ctx->transport->vtable->write(ctx->transport, iov[i].base,
+                iov[i].size);
+        if (wbytes < 0)
+            return total > 0 ? total : wbytes;
+
+        total += wbytes;
+        if ((size_t) wbytes != iov[i].size)
+            break;
+    }
+
+    return total;
+}
+
+static int smp_context_io_wait(SmpContext *ctx, int timeout_ms)
+{
+    if (ctx->transport != NULL)
+        return ctx->transport->vtable->wait(ctx->transport, timeout_ms);
+
+    return smp_serial_device_wait(&ctx->device, timeout_ms);
+}
+
+/* number of bytes written but not sent yet, SMP_ERROR_NOT_SUPPORTED if the
+ * device can't tell */
+static ssize_t smp_context_io_get_output_queue(SmpContext *ctx)
+{
+    if (ctx->transport != NULL) {
+        if (ctx->transport->vtable->get_output_queue == NULL)
+            return SMP_ERROR_NOT_SUPPORTED;
+
+        return ctx->transport->vtable->get_output_queue(ctx->transport);
+    }
+
+    return smp_serial_device_get_output_queue(&ctx->device);
+}
+
+/* start the writes a transport may have queued */
+static int smp_context_io_flush(SmpContext *ctx)
+{
+    if (ctx->transport != NULL && ctx->transport->vtable->flush != NULL)
+        return ctx->transport->vtable->flush(ctx->transport);
+
+    return 0;
+}
+
+/* the answers written while processing are flushed together at the end */
+static bool smp_context_begin_processing(SmpContext *ctx)
+{
+    bool nested = ctx->processing;
+
+    ctx->processing = true;
+    return nested;
+}
+
+static int smp_context_end_processing(SmpContext *ctx, bool nested, int ret)
+{
+    int flush_ret;
+
+    if (nested)
+        return ret;
+
+    ctx->processing = false;
+    flush_ret = smp_context_io_flush(ctx);
+    return (ret < 0) ? ret : flush_ret;
 }
 
 static void smp_context_notify_new_message(SmpContext *ctx, SmpMessage *msg)
@@ -52,18 +225,248 @@ static void smp_context_notify_new_message(SmpContext *ctx, SmpMessage *msg)
         ctx->cbs.new_message_cb(ctx, msg, ctx->userdata);
 }
 
-static void smp_context_notify_error(SmpContext *ctx, SmpError err)
+static void smp_context_process_serial_frame(SmpContext *ctx, uint8_t *frame,
+        size_t framesize)
+{
+    int ret;
+
+    ctx->rx_start_time = ctx->decoder->frame_start_time;
+    ctx->rx_end_time = ctx->decoder->rx_time;
+
+    if (ctx->link == NULL) {
+        smp_context_deliver_payload(ctx, frame, framesize);
+        return;
+    }
+
+    ret = smp_link_process_frame(ctx->link, ctx, frame, framesize);
+    if (ret < 0)
+        smp_context_notify_error(ctx, ret);
+}
+
+/* decode data until max_frames frames are complete, 0 for no limit, and
+ * return the number of bytes used */
+static size_t smp_context_process_data(SmpContext *ctx, const uint8_t *data,
+        size_t size, uint64_t time, unsigned int max_frames,
+        unsigned int *n_frames)
+{
+    uint8_t *frame;
+    size_t framesize;
+    unsigned int frames = 0;
+    size_t i;
+    int ret;
+
+    smp_serial_protocol_decoder_set_rx_time(ctx->decoder, time);
+
+    /* decoding is traced per run of bytes up to a complete frame */
+    SMP_TRACE_BEGIN(ctx, decode_start);
+    for (i = 0; i < size; i++) {
+        ret = smp_serial_protocol_decoder_process_byte(ctx->decoder,
+                data[i], &frame, &framesize);
+        if (ret < 0)
+            smp_context_notify_error(ctx, ret);
+
+        if (frame != NULL) {
+            SMP_TRACE_END(ctx, SMP_TRACE_STAGE_DECODE, decode_start);
+            SMP_STATS_INC(ctx->stats.rx_frames);
+            smp_context_process_serial_frame(ctx, frame, framesize);
+            SMP_TRACE_RESTART(ctx, decode_start);
+
+            if (++frames == max_frames) {
+                i++;
+                break;
+            }
+        }
+    }
+    SMP_TRACE_END(ctx, SMP_TRACE_STAGE_DECODE, decode_start);
+
+    SMP_STATS_ADD(ctx->stats.rx_bytes, i);
+    if (n_frames != NULL)
+        *n_frames = frames;
+
+    return i;
+}
+
+/* return the statistics entry of msgid, NULL if they are disabled or the
+ * table is full */
+static SmpMessageStats *smp_context_get_msg_stats(SmpContext *ctx,
+        uint32_t msgid)
+{
+#if SMP_CONTEXT_MESSAGE_STATS_SIZE > 0
+    size_t i;
+    size_t n;
+
+    if (ctx->msg_stats == NULL)
+        return NULL;
+
+    i = (size_t) (msgid * 2654435761u) % SMP_CONTEXT_MESSAGE_STATS_SIZE;
+    for (n = 0; n < SMP_CONTEXT_MESSAGE_STATS_SIZE; n++) {
+        SmpMessageStats *entry = &ctx->msg_stats[i];
+
+        /* entries without any message are free */
+        if (entry->rx_messages == 0 && entry->tx_messages == 0) {
+            SMP_STATS_STORE(entry->msgid, msgid);
+            return entry;
+        }
+
+        if (entry->msgid == msgid)
+            return entry;
+
+        i = (i + 1) % SMP_CONTEXT_MESSAGE_STATS_SIZE;
+    }
+#endif
+
+    return NULL;
+}
+
+/* account a message of the given id and encoded size as sent */
+static void smp_context_count_tx_message(SmpContext *ctx, uint32_t msgid,
+        size_t size)
+{
+    SmpMessageStats *entry;
+
+    entry = smp_context_get_msg_stats(ctx, msgid);
+    if (entry != NULL) {
+        SMP_STATS_INC(entry->tx_messages);
+        SMP_STATS_ADD(entry->tx_bytes, size);
+    }
+}
+
+/* pass msg to the call it answers, if any */
+static bool smp_context_complete_call(SmpContext *ctx, SmpMessage *msg)
+{
+    SmpCall call;
+    uint64_t correlation;
+    uint32_t id;
+    int n;
+
+    if (ctx->calls == NULL || ctx->calls->n_calls == 0)
+        return false;
+
+    /* the correlation is the last argument, a uint64 holding the request
+     * message id and the call id */
+    n = smp_message_n_args(msg);
+    if (n < 1 || smp_message_get_uint64(msg, n - 1, &correlation) < 0)
+        return false;
+
+    id = (uint32_t) correlation;
+    if (!(id & SMP_CALL_RESPONSE_FLAG))
+        return false;
+
+    if (!smp_call_table_take_response(ctx->calls, id & ~SMP_CALL_RESPONSE_FLAG,
+                (uint32_t) (correlation >> 32), &call))
+        return false;
+
+    msg->values[n - 1].type = SMP_TYPE_NONE;
+    call.cb(ctx, msg, SMP_ERROR_NONE, call.userdata);
+    return true;
+}
+
+/* send msg with id appended as its last argument, msg is left unchanged */
+static int smp_context_send_message_with_id(SmpContext *ctx, SmpMessage *msg,
+        const SmpValue *id)
+{
+    int ret;
+    int n;
+
+    n = smp_message_n_args(msg);
+    if (n < 0)
+        return n;
+
+    ret = smp_message_set_value(msg, n, id);
+    if (ret == SMP_ERROR_NOT_FOUND)
+        return SMP_ERROR_TOO_BIG;
+    else if (ret < 0)
+        return ret;
+
+    ret = smp_context_send_message(ctx, msg);
+    msg->values[n].type = SMP_TYPE_NONE;
+
+    return ret;
+}
+
+static uint64_t smp_context_get_next_deadline(SmpContext *ctx)
+{
+    uint64_t deadline = 0;
+
+    if (ctx->link != NULL)
+        deadline = smp_link_get_next_deadline(ctx->link);
+
+    if (ctx->calls != NULL) {
+        uint64_t call_deadline = smp_call_table_get_next_deadline(ctx->calls);
+
+        if (deadline == 0 || (call_deadline != 0 && call_deadline < deadline))
+            deadline = call_deadline;
+    }
+
+    if (ctx->tx_sched != NULL && smp_tx_scheduler_has_backlog(ctx->tx_sched)) {
+        uint64_t tx_deadline = smp_clock_get_time_ns() + SMP_CONTEXT_TX_RETRY_NS;
+
+        if (deadline == 0 || tx_deadline < deadline)
+            deadline = tx_deadline;
+    }
+
+    if (ctx->tx_pacing_deadline != 0
+            && (deadline == 0 || ctx->tx_pacing_deadline < deadline))
+        deadline = ctx->tx_pacing_deadline;
+
+    if (ctx->schedule != NULL) {
+        uint64_t sched_time = smp_schedule_table_get_next_time(ctx->schedule);
+
+        if (deadline == 0 || (sched_time != 0 && sched_time < deadline))
+            deadline = sched_time;
+    }
+
+    return deadline;
+}
+
+/* free the link once all its features are disabled */
+static void smp_context_release_link(SmpContext *ctx)
+{
+    if (ctx->link != NULL && !smp_link_is_enabled(ctx->link)) {
+        smp_link_free(ctx->link);
+        ctx->link = NULL;
+    }
+}
+
+/* Internal API */
+void smp_context_notify_error(SmpContext *ctx, SmpError err)
 {
     if (ctx->cbs.error_cb != NULL)
         ctx->cbs.error_cb(ctx, err, ctx->userdata);
 }
 
-static void smp_context_process_serial_frame(SmpContext *ctx, uint8_t *frame,
-        size_t framesize)
+/* build a message from an encoded payload and pass it to the user */
+static void smp_context_deliver_payload_now(SmpContext *ctx,
+        const uint8_t *payload, size_t size)
 {
+    SmpMessageStats *entry;
     SmpMessage *msg;
+    uint64_t start;
     int ret;
 
+    if (ctx->frame_cb != NULL) {
+        bool handled;
+
+        start = smp_clock_get_time_ns();
+        SMP_TRACE_BEGIN(ctx, frame_cb_start);
+        handled = ctx->frame_cb(ctx, payload, size, ctx->frame_userdata);
+        SMP_TRACE_END(ctx, SMP_TRACE_STAGE_CALLBACK, frame_cb_start);
+        SMP_STATS_ADD(ctx->stats.callback_time_ns,
+                smp_clock_get_time_ns() - start);
+
+        if (handled) {
+            if (size >= MSG_HEADER_SIZE) {
+                entry = smp_context_get_msg_stats(ctx,
+                        read_msgid(payload));
+                if (entry != NULL) {
+                    SMP_STATS_INC(entry->rx_messages);
+                    SMP_STATS_ADD(entry->rx_bytes, size);
+                }
+            }
+            return;
+        }
+    }
+
     if (ctx->msg_rx != NULL)
         msg = ctx->msg_rx;
     else
@@ -74,13 +477,33 @@ static void smp_context_process_serial_frame(SmpContext *ctx, uint8_t *frame,
         return;
     }
 
-    ret = smp_message_build_from_buffer(msg, frame, framesize);
+    SMP_TRACE_BEGIN(ctx, build_start);
+    ret = smp_message_build_from_buffer(msg, payload, size);
+    SMP_TRACE_END(ctx, SMP_TRACE_STAGE_BUILD_MESSAGE, build_start);
     if (ret < 0) {
         smp_context_notify_error(ctx, ret);
         return;
     };
 
-    smp_context_notify_new_message(ctx, msg);
+    msg->rx_start_time = ctx->rx_start_time;
+    msg->rx_end_time = ctx->rx_end_time;
+
+    entry = smp_context_get_msg_stats(ctx, smp_message_get_msgid(msg));
+    if (entry != NULL) {
+        SMP_STATS_INC(entry->rx_messages);
+        SMP_STATS_ADD(entry->rx_bytes, size);
+    }
+
+    start = smp_clock_get_time_ns();
+    SMP_TRACE_BEGIN(ctx, cb_start);
+
+    if (!smp_context_complete_call(ctx, msg))
+        smp_context_notify_new_message(ctx, msg);
+
+    SMP_TRACE_END(ctx, SMP_TRACE_STAGE_CALLBACK, cb_start);
+
+    SMP_STATS_ADD(ctx->stats.callback_time_ns,
+            smp_clock_get_time_ns() - start);
 
     if (ctx->msg_rx == NULL)
         smp_message_free(msg);
@@ -88,6 +511,210 @@ static void smp_context_process_serial_frame(SmpContext *ctx, uint8_t *frame,
         smp_message_clear(msg);
 }
 
+/* messages with rx conflation are held until the received data is
+ * processed */
+void smp_context_deliver_payload(SmpContext *ctx, const uint8_t *payload,
+        size_t size)
+{
+    SmpConflationEntry *entry = NULL;
+
+    if (ctx->conflation != NULL && ctx->processing && size >= MSG_HEADER_SIZE)
+        entry = smp_conflation_table_lookup(ctx->conflation,
+                read_msgid(payload), SMP_CONFLATION_RX);
+
+    if (entry == NULL) {
+        smp_context_deliver_payload_now(ctx, payload, size);
+        return;
+    }
+
+    if (entry->rx_pending)
+        SMP_STATS_INC(ctx->stats.rx_conflated);
+
+    if (smp_conflation_entry_hold(ctx->conflation, entry, payload, size,
+                ctx->rx_start_time, ctx->rx_end_time) < 0) {
+        smp_context_notify_error(ctx, SMP_ERROR_NO_MEM);
+    }
+}
+
+/* deliver the newest message held for each id */
+static void smp_context_deliver_conflated(SmpContext *ctx)
+{
+    SmpConflationTable *table = ctx->conflation;
+    size_t i;
+
+    if (table == NULL || table->n_rx_pending == 0)
+        return;
+
+    /* callbacks may enable conflation on other ids, or process incoming data
+     * and hold a message again, so take the payload out of the entry */
+    for (i = 0; i < table->n_entries; i++) {
+        SmpConflationEntry *entry = &table->entries[i];
+        uint8_t *data = entry->rx_data;
+        size_t capacity = entry->rx_capacity;
+
+        if (!entry->rx_pending)
+            continue;
+
+        entry->rx_pending = false;
+        entry->rx_data = NULL;
+        entry->rx_capacity = 0;
+        table->n_rx_pending--;
+
+        ctx->rx_start_time = entry->rx_start_time;
+        ctx->rx_end_time = entry->rx_end_time;
+        smp_context_deliver_payload_now(ctx, data, entry->rx_size);
+
+        entry = &table->entries[i];
+        if (entry->rx_data == NULL) {
+            entry->rx_data = data;
+            entry->rx_capacity = capacity;
+        } else {
+            free(data);
+        }
+    }
+}
+
+/* write data to the device, return the number of bytes written or a
+ * SmpError */
+static ssize_t smp_context_write_device(SmpContext *ctx, const uint8_t *data,
+        size_t size)
+{
+    ssize_t wbytes;
+
+    SMP_TRACE_BEGIN(ctx, write_start);
+    wbytes = smp_context_io_write(ctx, data, size);
+    SMP_TRACE_END(ctx, SMP_TRACE_STAGE_WRITE, write_start);
+    if (wbytes > 0) {
+        SMP_CAPTURE_RECORD(ctx, SMP_CAPTURE_DIRECTION_TX,
+                smp_clock_get_time_ns(), data, wbytes);
+    }
+    if (wbytes < 0)
+        return wbytes;
+
+    if (ctx->tx_pacing_max > 0 && ctx->tx_byte_ns > 0) {
+        uint64_t now = smp_clock_get_time_ns();
+
+        if (ctx->tx_drain_time < now)
+            ctx->tx_drain_time = now;
+        ctx->tx_drain_time += (uint64_t) wbytes * ctx->tx_byte_ns;
+    }
+
+    if (!ctx->processing) {
+        int ret = smp_context_io_flush(ctx);
+
+        if (ret < 0)
+            return ret;
+    }
+
+    SMP_STATS_ADD(ctx->stats.tx_bytes, wbytes);
+    return wbytes;
+}
+
+/* write what is left of the frames the device didn't take */
+static int smp_context_write_backlog(SmpContext *ctx)
+{
+    SmpTxScheduler *sched = ctx->tx_sched;
+    ssize_t wbytes;
+
+    if (!smp_tx_scheduler_has_backlog(sched))
+        return 0;
+
+    wbytes = smp_context_write_device(ctx,
+            sched->backlog + sched->backlog_offset,
+            sched->backlog_size - sched->backlog_offset);
+    if (wbytes == SMP_ERROR_WOULD_BLOCK)
+        return 0;
+    else if (wbytes < 0)
+        return (int) wbytes;
+
+    smp_tx_scheduler_consume_backlog(sched, (size_t) wbytes);
+    return 0;
+}
+
+/* Write n_frames complete frames to the device at once. With priorities,
+ * bytes the device doesn't take are kept and written before the next
+ * frames, instead of failing with a short write. */
+static int smp_context_write_frames(SmpContext *ctx, const uint8_t *data,
+        size_t size, unsigned int n_frames)
+{
+    ssize_t wbytes;
+    int ret;
+
+    if (ctx->tx_sched != NULL) {
+        ret = smp_context_write_backlog(ctx);
+        if (ret < 0)
+            return ret;
+
+        if (smp_tx_scheduler_has_backlog(ctx->tx_sched)) {
+            ret = smp_tx_scheduler_append_backlog(ctx->tx_sched, data, size);
+            if (ret < 0)
+                return ret;
+
+            SMP_STATS_ADD(ctx->stats.tx_frames, n_frames);
+            return 0;
+        }
+    }
+
+    wbytes = smp_context_write_device(ctx, data, size);
+    if (wbytes == SMP_ERROR_WOULD_BLOCK && ctx->tx_sched != NULL)
+        wbytes = 0;
+    else if (wbytes < 0)
+        return (int) wbytes;
+
+    if ((size_t) wbytes != size) {
+        if (ctx->tx_sched == NULL) {
+            SMP_STATS_INC(ctx->stats.short_writes);
+            return SMP_ERROR_IO;
+        }
+
+        ret = smp_tx_scheduler_append_backlog(ctx->tx_sched, data + wbytes,
+                size - wbytes);
+        if (ret < 0)
+            return ret;
+    }
+
+    SMP_STATS_ADD(ctx->stats.tx_frames, n_frames);
+    return 0;
+}
+
+/* write a complete frame to the device */
+static int smp_context_write_serial(SmpContext *ctx, const uint8_t *frame,
+        size_t size)
+{
+    return smp_context_write_frames(ctx, frame, size, 1);
+}
+
+/* frame the payload and write it to the device */
+int smp_context_write_payload(SmpContext *ctx, const uint8_t *payload,
+        size_t size)
+{
+    uint8_t *serial_buf = NULL;
+    size_t serial_bufsize = 0;
+    ssize_t encoded_size;
+    int ret;
+
+    if (ctx->serial_tx != NULL) {
+        serial_buf = ctx->serial_tx->data;
+        serial_bufsize = ctx->serial_tx->maxsize;
+    }
+
+    SMP_TRACE_BEGIN(ctx, encode_start);
+    encoded_size = smp_serial_protocol_encode_with_checksum(payload, size,
+            &serial_buf, serial_bufsize, ctx->checksum);
+    SMP_TRACE_END(ctx, SMP_TRACE_STAGE_ENCODE_FRAME, encode_start);
+    if (encoded_size < 0)
+        return (int) encoded_size;
+
+    ret = smp_context_write_serial(ctx, serial_buf, encoded_size);
+
+    if (ctx->serial_tx == NULL) {
+        /* we have allocated buffer so free it */
+        free(serial_buf);
+    }
+
+    return ret;
+}
+
 /* API */
 
 /**
@@ -117,314 +744,2667 @@ SmpContext *smp_context_new(const SmpEventCallbacks *cbs, void *userdata)
     }
 
     smp_context_init(ctx, decoder, cbs, userdata, false);
+
+#if SMP_CONTEXT_MESSAGE_STATS_SIZE > 0
+    ctx->msg_stats = calloc(SMP_CONTEXT_MESSAGE_STATS_SIZE,
+            sizeof(*ctx->msg_stats));
+    if (ctx->msg_stats == NULL) {
+        smp_serial_protocol_decoder_free(decoder);
+        free(ctx);
+        return NULL;
+    }
+#endif
+
     return ctx;
 }
 
 /**
  * \ingroup context
- * Create a new SmpContext object from a static storage.
+ * Create a new SmpContext object from a static storage.
+ *
+ * @param[in] sctx a SmpStaticContext
+ * @param[in] struct_size the size of sctx
+ * @param[in] cbs callback to use to notify events
+ * @param[in] userdata a pointer to userdata which will be passed to callback
+ * @param[in] decoder a SmpSerialProtocolDecoder to use with this context
+ * @param[in] serial_tx a SmpBuffer to use as serial TX buffer
+ * @param[in] msg_tx a SmpBuffer to use as msg TX buffer
+ * @param[in] msg_rx a SmpMessage to use for reception
+ *
+ * @return a SmpContext or NULL on error.
+ */
+SmpContext *smp_context_new_from_static(SmpStaticContext *sctx,
+        size_t struct_size, const SmpEventCallbacks *cbs, void *userdata,
+        SmpSerialProtocolDecoder *decoder, SmpBuffer *serial_tx,
+        SmpBuffer *msg_tx, SmpMessage *msg_rx)
+{
+    SmpContext *ctx = (SmpContext *) sctx;
+
+    return_val_if_fail(sctx != NULL, NULL);
+    return_val_if_fail(struct_size >= sizeof(SmpContext), NULL);
+    return_val_if_fail(cbs != NULL, NULL);
+    return_val_if_fail(decoder != NULL, NULL);
+    return_val_if_fail(msg_tx != NULL, NULL);
+    return_val_if_fail(serial_tx != NULL, NULL);
+    return_val_if_fail(msg_rx != NULL, NULL);
+
+    smp_context_init(ctx, decoder, cbs, userdata, true);
+
+    ctx->serial_tx = serial_tx;
+    ctx->msg_tx = msg_tx;
+    ctx->msg_rx = msg_rx;
+
+    return ctx;
+}
+
+/* a real-time context, followed by its buffers in the same block */
+typedef struct
+{
+    SmpStaticContext ctx;
+    SmpStaticSerialProtocolDecoder decoder;
+    SmpStaticBuffer serial_tx;
+    SmpStaticBuffer msg_tx;
+    SmpStaticMessage msg_rx;
+    SmpCallTable calls;
+} SmpRealtimeContext;
+
+#define SMP_REALTIME_ALIGN(size) (((size) + 7) & ~(size_t) 7)
+
+/**
+ * \ingroup context
+ * Create a new SmpContext for real-time threads. All the buffers are allocated
+ * here, in a single block which can be locked in RAM, so sending and
+ * receiving messages never use the heap:
+ *  - frames bigger than config->max_message_size are dropped as oversized and
+ *    sending a bigger message returns SMP_ERROR_OVERFLOW,
+ *  - received messages with more than config->max_values values are reported
+ *    as errors,
+ *  - smp_context_call() returns SMP_ERROR_BUSY when config->max_calls calls
+ *    are outstanding, and SMP_ERROR_NOT_SUPPORTED if max_calls is 0,
+ *  - smp_context_enable_reliability() and smp_context_enable_flow_control()
+ *    allocate the buffers of the link layer for the largest message.
+ *
+ * Features are set up between this call and smp_context_open(), the
+ * allocations they make are not locked in RAM. Messages sent by the
+ * application should use static storage or a capacity set beforehand.
+ *
+ * @param[in] cbs callback to use to notify events
+ * @param[in] userdata a pointer to userdata which will be passed to callback
+ * @param[in] config the sizes of the context
+ *
+ * @return a SmpContext or NULL on error, including when memory can't be
+ *         locked.
+ */
+SmpContext *smp_context_new_realtime(const SmpEventCallbacks *cbs,
+        void *userdata, const SmpContextRealtimeConfig *config)
+{
+    SmpRealtimeContext *rt;
+    SmpSerialProtocolDecoder *decoder;
+    SmpBuffer *serial_tx;
+    SmpBuffer *msg_tx;
+    SmpMessage *msg_rx;
+    SmpContext *ctx;
+    uint8_t *block;
+    size_t call_capacity = 0;
+    size_t rx_size, tx_size;
+    size_t stats_offset, values_offset, calls_offset;
+    size_t rx_offset, tx_offset, msg_offset;
+    size_t size;
+
+    return_val_if_fail(cbs != NULL, NULL);
+    return_val_if_fail(config != NULL, NULL);
+    return_val_if_fail(config->max_message_size >= MSG_HEADER_SIZE, NULL);
+    return_val_if_fail(config->max_message_size <= SIZE_MAX / 4, NULL);
+    return_val_if_fail(config->max_values > 0, NULL);
+    return_val_if_fail(config->max_values <= SIZE_MAX / 4 / sizeof(SmpValue),
+            NULL);
+    return_val_if_fail(config->max_calls <= SIZE_MAX / 4 / sizeof(SmpCall),
+            NULL);
+
+#ifndef HAVE_MLOCK
+    if (config->lock_memory)
+        return NULL;
+#endif
+
+    /* the largest frame carries a link header, the decoder keeps its frame
+     * check and the encoder may escape every byte */
+    rx_size = config->max_message_size + SMP_LINK_MAX_HEADER_SIZE + 4;
+    tx_size = 2 * rx_size + 2;
+
+    if (config->max_calls > 0) {
+        call_capacity = 1;
+        while (call_capacity < 2 * config->max_calls)
+            call_capacity <<= 1;
+    }
+
+    size = SMP_REALTIME_ALIGN(sizeof(SmpRealtimeContext));
+    stats_offset = size;
+    size += SMP_REALTIME_ALIGN(SMP_CONTEXT_MESSAGE_STATS_SIZE
+            * sizeof(SmpMessageStats));
+    values_offset = size;
+    size += SMP_REALTIME_ALIGN(config->max_values * sizeof(SmpValue));
+    calls_offset = size;
+    size += SMP_REALTIME_ALIGN(call_capacity * sizeof(SmpCall));
+    rx_offset = size;
+    size += SMP_REALTIME_ALIGN(rx_size);
+    tx_offset = size;
+    size += SMP_REALTIME_ALIGN(tx_size);
+    msg_offset = size;
+    size += config->max_message_size;
+
+    block = calloc(1, size);
+    if (block == NULL)
+        return NULL;
+
+    rt = (SmpRealtimeContext *) block;
+    decoder = smp_serial_protocol_decoder_new_from_static(&rt->decoder,
+            sizeof(rt->decoder), block + rx_offset, rx_size);
+    serial_tx = smp_buffer_new_from_static(&rt->serial_tx,
+            sizeof(rt->serial_tx), block + tx_offset, tx_size, NULL);
+    msg_tx = smp_buffer_new_from_static(&rt->msg_tx, sizeof(rt->msg_tx),
+            block + msg_offset, config->max_message_size, NULL);
+    msg_rx = smp_message_new_from_static(&rt->msg_rx, sizeof(rt->msg_rx),
+            (SmpValue *) (block + values_offset), config->max_values);
+    if (decoder == NULL || serial_tx == NULL || msg_tx == NULL
+            || msg_rx == NULL) {
+        free(block);
+        return NULL;
+    }
+
+    ctx = smp_context_new_from_static(&rt->ctx, sizeof(rt->ctx), cbs,
+            userdata, decoder, serial_tx, msg_tx, msg_rx);
+    if (ctx == NULL) {
+        free(block);
+        return NULL;
+    }
+
+#if SMP_CONTEXT_MESSAGE_STATS_SIZE > 0
+    ctx->msg_stats = (SmpMessageStats *) (block + stats_offset);
+#else
+    (void) stats_offset;
+#endif
+
+    if (call_capacity > 0) {
+        smp_call_table_init_static(&rt->calls,
+                (SmpCall *) (block + calls_offset), call_capacity);
+        ctx->calls = &rt->calls;
+    }
+
+    ctx->realtime_size = size;
+    ctx->realtime_max_message_size = config->max_message_size;
+
+#ifdef HAVE_MLOCK
+    if (config->lock_memory) {
+        if (mlock(block, size) < 0) {
+            free(block);
+            return NULL;
+        }
+
+        ctx->realtime_locked = true;
+    }
+#endif
+
+    return ctx;
+}
+
+/* the block of a real-time context holds everything but the features
+ * enabled afterwards */
+static void smp_context_free_realtime(SmpContext *ctx)
+{
+#ifdef HAVE_MLOCK
+    if (ctx->realtime_locked)
+        munlock(ctx, ctx->realtime_size);
+#endif
+
+    free(ctx);
+}
+
+/**
+ * \ingroup context
+ * Free a SmpContext object.
+ *
+ * It is safe to call this function on a statically allocated context.
+ *
+ * @param[in] ctx the SmpContext
+ */
+void smp_context_free(SmpContext *ctx)
+{
+    return_if_fail(ctx != NULL);
+
+    smp_context_stop_capture(ctx);
+    if (ctx->send_queue != NULL) {
+        smp_send_queue_free(ctx->send_queue);
+        ctx->send_queue = NULL;
+    }
+    if (ctx->tx_sched != NULL) {
+        smp_tx_scheduler_free(ctx->tx_sched);
+        ctx->tx_sched = NULL;
+    }
+    if (ctx->conflation != NULL) {
+        smp_conflation_table_free(ctx->conflation);
+        ctx->conflation = NULL;
+    }
+    if (ctx->schedule != NULL) {
+        smp_schedule_table_free(ctx->schedule);
+        ctx->schedule = NULL;
+    }
+    if (ctx->link != NULL) {
+        smp_link_free(ctx->link);
+        ctx->link = NULL;
+    }
+    /* the calls of real-time contexts are part of their allocation */
+    if (ctx->calls != NULL && ctx->realtime_size == 0) {
+        smp_call_table_free(ctx->calls);
+        ctx->calls = NULL;
+    }
+#ifdef SMP_ENABLE_TRACE
+    if (ctx->trace != NULL) {
+        smp_trace_free(ctx->trace);
+        ctx->trace = NULL;
+    }
+#endif
+
+    if (ctx->statically_allocated) {
+        if (ctx->realtime_size > 0)
+            smp_context_free_realtime(ctx);
+        return;
+    }
+
+    smp_serial_protocol_decoder_free(ctx->decoder);
+
+    free(ctx->msg_stats);
+
+    free(ctx);
+}
+
+/**
+ * \ingroup context
+ * Open the provided serial device and use it in the given context.
+ *
+ * @param[in] ctx the SmpContext
+ * @param[in] device path to the serial device to use
+ *
+ * @return 0 on success, a SmpError otherwise.
+ */
+int smp_context_open(SmpContext *ctx, const char *device)
+{
+    int ret;
+
+    return_val_if_fail(ctx != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(device != NULL, SMP_ERROR_INVALID_PARAM);
+
+    if (ctx->opened)
+        return SMP_ERROR_BUSY;
+
+    ret = smp_context_io_open(ctx, device);
+    if (ret < 0)
+        return ret;
+
+    ctx->opened = true;
+    return 0;
+}
+
+/**
+ * \ingroup context
+ * Close the context, releasing the attached serial device. Outstanding calls
+ * complete with SMP_ERROR_BAD_FD.
+ *
+ * @param[in] ctx the SmpContext
+ */
+void smp_context_close(SmpContext *ctx)
+{
+    SmpCall call;
+
+    return_if_fail(ctx != NULL);
+
+    if (!ctx->opened)
+        return;
+
+    smp_context_io_close(ctx);
+    ctx->opened = false;
+    ctx->rx_chunk_size = 0;
+    ctx->rx_chunk_offset = 0;
+
+    smp_context_stop_capture(ctx);
+
+    while (ctx->calls != NULL && smp_call_table_take_any(ctx->calls, &call))
+        call.cb(ctx, NULL, SMP_ERROR_BAD_FD, call.userdata);
+}
+
+/**
+ * \ingroup context
+ * Use a transport instead of the serial device of the platform. The context
+ * must be closed and the transport must outlive its use by the context.
+ *
+ * @param[in] ctx the SmpContext
+ * @param[in] transport the SmpTransport, NULL to use the serial device again
+ *
+ * @return 0 on success, a SmpError otherwise.
+ */
+int smp_context_set_transport(SmpContext *ctx, SmpTransport *transport)
+{
+    return_val_if_fail(ctx != NULL, SMP_ERROR_INVALID_PARAM);
+
+    if (ctx->opened)
+        return SMP_ERROR_BUSY;
+
+    ctx->transport = transport;
+    return 0;
+}
+
+/**
+ * \ingroup context
+ * Set serial device config. Depending on the system, it could be not
+ * implemented.
+ *
+ * @param[in] ctx the SmpContext
+ * @param[in] baudrate the baudrate
+ * @param[in] parity the parity configuration
+ * @param[in] flow_control 1 to enable flow control, 0 to disable
+ *
+ * @return 0 on success, a SmpError otherwise.
+ */
+int smp_context_set_serial_config(SmpContext *ctx, SmpSerialBaudrate baudrate,
+        SmpSerialParity parity, int flow_control)
+{
+    static const uint32_t bauds[] = {
+        1200, 2400, 4800, 9600, 19200, 38400, 57600, 115200, 230400, 460800,
+        921600, 1000000, 2000000, 4000000,
+    };
+    uint64_t bits;
+    int ret;
+
+    return_val_if_fail(ctx != NULL, SMP_ERROR_INVALID_PARAM);
+
+    if (ctx->transport != NULL) {
+        if (ctx->transport->vtable->set_config == NULL)
+            return SMP_ERROR_NOT_SUPPORTED;
+
+        ret = ctx->transport->vtable->set_config(ctx->transport, baudrate,
+                parity, flow_control);
+    } else {
+        ret = smp_serial_device_set_config(&ctx->device, baudrate, parity,
+                flow_control);
+    }
+    if (ret < 0)
+        return ret;
+
+    /* start bit, 8 data bits, parity bit and stop bit */
+    bits = (parity == SMP_SERIAL_PARITY_NONE) ? 10 : 11;
+    if ((size_t) baudrate < sizeof(bauds) / sizeof(bauds[0]))
+        ctx->tx_byte_ns = bits * SMP_NSEC_PER_SEC / bauds[baudrate];
+    else
+        ctx->tx_byte_ns = 0;
+
+    return 0;
+}
+
+/**
+ * \ingroup context
+ * Get the file descriptor of the opened serial device.
+ *
+ * @param[in] ctx the SmpContext
+ *
+ * @return the fd (or a handle on Win32) on success, a SmpError otherwise.
+ */
+intptr_t smp_context_get_fd(SmpContext *ctx)
+{
+    return_val_if_fail(ctx != NULL, SMP_ERROR_INVALID_PARAM);
+
+    if (ctx->transport != NULL) {
+        if (ctx->transport->vtable->get_fd == NULL)
+            return SMP_ERROR_NOT_SUPPORTED;
+
+        return ctx->transport->vtable->get_fd(ctx->transport);
+    }
+
+    return smp_serial_device_get_fd(&ctx->device);
+}
+
+/* Get the time at which the device queue will be short enough to write again,
+ * 0 to write now. Both the queue reported by the device and the one estimated
+ * from the baudrate are checked: ptys and USB adapters often report an empty
+ * queue. */
+static uint64_t smp_context_get_pacing_deadline(SmpContext *ctx)
+{
+    uint64_t now;
+    uint64_t deadline = 0;
+    ssize_t queued;
+
+    now = smp_clock_get_time_ns();
+    if (now == 0)
+        return 0;
+
+    if (ctx->tx_byte_ns > 0) {
+        uint64_t max_ns = (uint64_t) ctx->tx_pacing_max * ctx->tx_byte_ns;
+
+        if (ctx->tx_drain_time > now + max_ns)
+            deadline = ctx->tx_drain_time - max_ns;
+    }
+
+    queued = smp_context_io_get_output_queue(ctx);
+    if (queued > 0 && (size_t) queued > ctx->tx_pacing_max) {
+        uint64_t queue_deadline = now + SMP_CONTEXT_TX_RETRY_NS;
+
+        if (ctx->tx_byte_ns > 0) {
+            queue_deadline = now + ((size_t) queued - ctx->tx_pacing_max)
+                * ctx->tx_byte_ns;
+        }
+
+        if (queue_deadline > deadline)
+            deadline = queue_deadline;
+    }
+
+    return deadline;
+}
+
+/* Send the queued messages, most urgent first, as long as the device takes
+ * the data and the link layer accepts it. A fragment is written only once the
+ * previous frames left, so a new urgent message waits for one fragment at
+ * most. */
+static int smp_context_schedule_tx(SmpContext *ctx)
+{
+    SmpTxScheduler *sched = ctx->tx_sched;
+    int ret;
+
+    if (sched == NULL)
+        return 0;
+
+    ctx->tx_pacing_deadline = 0;
+
+    while (1) {
+        SmpPriority priority;
+        SmpTxMessage *txmsg;
+        size_t size;
+        bool last = true;
+
+        if (ctx->tx_pacing_max > 0 && (smp_tx_scheduler_has_backlog(sched)
+                    || smp_tx_scheduler_peek(sched, &priority) != NULL)) {
+            uint64_t deadline = smp_context_get_pacing_deadline(ctx);
+
+            if (deadline != 0) {
+                /* keep the frames here where urgent ones can go first */
+                ctx->tx_pacing_deadline = deadline;
+                SMP_STATS_INC(ctx->stats.tx_paced);
+                return 0;
+            }
+        }
+
+        ret = smp_context_write_backlog(ctx);
+        if (ret < 0 || smp_tx_scheduler_has_backlog(sched))
+            return ret;
+
+        txmsg = smp_tx_scheduler_peek(sched, &priority);
+        if (txmsg == NULL)
+            return 0;
+
+        size = txmsg->size - txmsg->offset;
+        if (sched->fragment_size > 0 && size > sched->fragment_size) {
+            size = sched->fragment_size;
+            last = false;
+        }
+
+        if (txmsg->offset == 0 && last) {
+            ret = smp_link_send_message(ctx->link, ctx, txmsg->data, size);
+        } else {
+            ret = smp_link_send_fragment(ctx->link, ctx,
+                    txmsg->data + txmsg->offset, size, priority,
+                    txmsg->offset == 0, last);
+        }
+
+        if (ret == SMP_ERROR_WOULD_BLOCK) {
+            /* the window or the credit of the link is full, we'll go on
+             * after processing incoming data */
+            return 0;
+        } else if (ret < 0) {
+            /* the peer drops the fragments received so far */
+            smp_context_notify_error(ctx, ret);
+            smp_tx_scheduler_pop(sched, priority);
+            continue;
+        }
+
+        txmsg->offset += size;
+        if (last) {
+            smp_context_count_tx_message(ctx, txmsg->msgid, txmsg->size);
+            smp_tx_scheduler_pop(sched, priority);
+        }
+    }
+}
+
+/* send an encoded message: queue it by priority, the scheduler sends it
+ * through the link layer, or send it right away */
+static int smp_context_send_payload(SmpContext *ctx, uint32_t msgid,
+        const uint8_t *data, size_t size, SmpPriority priority)
+{
+    int ret;
+
+    if (ctx->tx_sched != NULL) {
+        bool nested;
+
+        ret = 0;
+        if (ctx->conflation != NULL && smp_conflation_table_lookup(
+                    ctx->conflation, msgid, SMP_CONFLATION_TX) != NULL) {
+            ret = smp_tx_scheduler_replace(ctx->tx_sched, msgid, data, size);
+            if (ret > 0)
+                SMP_STATS_INC(ctx->stats.tx_conflated);
+        }
+
+        if (ret == 0) {
+            ret = smp_tx_scheduler_push(ctx->tx_sched, priority, msgid, data,
+                    size);
+        }
+        if (ret < 0)
+            return ret;
+
+        nested = smp_context_begin_processing(ctx);
+        ret = smp_context_schedule_tx(ctx);
+        return smp_context_end_processing(ctx, nested, ret);
+    }
+
+    /* send it over the serial, through the link layer if enabled */
+    if (ctx->link != NULL)
+        ret = smp_link_send_message(ctx->link, ctx, data, size);
+    else
+        ret = smp_context_write_payload(ctx, data, size);
+
+    if (ret == 0)
+        smp_context_count_tx_message(ctx, msgid, size);
+
+    return ret;
+}
+
+/* the frame description takes too much stack on AVR */
+#ifndef __AVR
+
+/* RAW arguments at least this large are written from the caller buffer */
+#define SMP_CONTEXT_ZEROCOPY_MIN_SIZE 256
+
+/* room for the escaped bytes of the frame which don't come from a large RAW
+ * argument */
+#define SMP_CONTEXT_ZEROCOPY_SCRATCH_SIZE 512
+
+/* A frame written with a single writev: the escaped START byte, header,
+ * small values, frame check and END byte are copied in scratch, large RAW
+ * arguments are referenced from the message. */
+typedef struct
+{
+    SmpIoVec iov[SMP_SERIAL_DEVICE_IOV_MAX];
+    int iovcnt;
+    size_t size;
+
+    uint8_t scratch[SMP_CONTEXT_ZEROCOPY_SCRATCH_SIZE];
+    size_t scratch_size;
+    /* start of the scratch bytes not added to iov yet */
+    size_t scratch_pending;
+
+    SmpSerialChecksum checksum;
+    uint32_t check;
+} SmpZeroCopyFrame;
+
+static const uint8_t smp_zerocopy_esc_byte = SMP_SERIAL_PROTOCOL_ESC_BYTE;
+
+static bool smp_zerocopy_frame_add_iov(SmpZeroCopyFrame *frame,
+        const void *base, size_t size)
+{
+    if (size == 0)
+        return true;
+
+    if (frame->iovcnt == SMP_SERIAL_DEVICE_IOV_MAX)
+        return false;
+
+    frame->iov[frame->iovcnt].base = base;
+    frame->iov[frame->iovcnt].size = size;
+    frame->iovcnt++;
+    frame->size += size;
+    return true;
+}
+
+static bool smp_zerocopy_frame_flush_scratch(SmpZeroCopyFrame *frame)
+{
+    size_t pending = frame->scratch_pending;
+
+    frame->scratch_pending = frame->scratch_size;
+    return smp_zerocopy_frame_add_iov(frame, frame->scratch + pending,
+            frame->scratch_size - pending);
+}
+
+/* escape data in scratch, data may be at the end of scratch as long as there
+ * is room for all of it escaped: writes never get ahead of reads then */
+static bool smp_zerocopy_frame_escape(SmpZeroCopyFrame *frame,
+        const uint8_t *data, size_t size)
+{
+    size_t i;
+
+    if (frame->scratch_size + 2 * size > sizeof(frame->scratch))
+        return false;
+
+    for (i = 0; i < size; i++) {
+        uint8_t byte = data[i];
+
+        if (smp_serial_protocol_is_magic_byte(byte))
+            frame->scratch[frame->scratch_size++] = SMP_SERIAL_PROTOCOL_ESC_BYTE;
+        frame->scratch[frame->scratch_size++] = byte;
+    }
+
+    return true;
+}
+
+static bool smp_zerocopy_frame_copy(SmpZeroCopyFrame *frame,
+        const uint8_t *data, size_t size)
+{
+    frame->check = smp_serial_protocol_check_update(frame->checksum,
+            frame->check, data, size);
+    return smp_zerocopy_frame_escape(frame, data, size);
+}
+
+/* reference data, with an escape byte before each magic byte */
+static bool smp_zerocopy_frame_reference(SmpZeroCopyFrame *frame,
+        const uint8_t *data, size_t size)
+{
+    size_t start = 0;
+    size_t i;
+
+    frame->check = smp_serial_protocol_check_update(frame->checksum,
+            frame->check, data, size);
+
+    if (!smp_zerocopy_frame_flush_scratch(frame))
+        return false;
+
+    i = smp_serial_protocol_find_magic_byte(data, size);
+    while (i < size) {
+        /* the magic byte starts the next segment, after its escape */
+        if (!smp_zerocopy_frame_add_iov(frame, data + start, i - start)
+                || !smp_zerocopy_frame_add_iov(frame, &smp_zerocopy_esc_byte,
+                    1))
+            return false;
+
+        start = i;
+        i += 1 + smp_serial_protocol_find_magic_byte(data + i + 1,
+                size - i - 1);
+    }
+
+    return smp_zerocopy_frame_add_iov(frame, data + start, size - start);
+}
+
+static bool smp_zerocopy_frame_add_value(SmpZeroCopyFrame *frame,
+        const SmpValue *value)
+{
+    uint8_t *buf;
+    size_t size;
+
+    if (value->type == SMP_TYPE_RAW
+            && value->value.craw_size >= SMP_CONTEXT_ZEROCOPY_MIN_SIZE
+            && value->value.craw_size <= UINT16_MAX) {
+        uint8_t hdr[3];
+        uint16_t raw_size = (uint16_t) value->value.craw_size;
+
+        /* type | size, then the data */
+        hdr[0] = SMP_TYPE_RAW;
+        memcpy(hdr + 1, &raw_size, sizeof(raw_size));
+        return smp_zerocopy_frame_copy(frame, hdr, sizeof(hdr))
+            && smp_zerocopy_frame_reference(frame, value->value.craw,
+                    value->value.craw_size);
+    }
+
+    /* encode at the end of scratch and escape in place */
+    size = 1 + smp_value_compute_size(value);
+    if (frame->scratch_size + 2 * size > sizeof(frame->scratch))
+        return false;
+
+    buf = frame->scratch + sizeof(frame->scratch) - size;
+    if (smp_message_encode_value(value, buf) == 0)
+        return false;
+
+    return smp_zerocopy_frame_copy(frame, buf, size);
+}
+
+/* frame msg referencing its large RAW arguments, false if it can't be done */
+static bool smp_zerocopy_frame_build(SmpZeroCopyFrame *frame,
+        SmpMessage *msg, SmpSerialChecksum checksum)
+{
+    uint8_t buf[MSG_HEADER_SIZE];
+    uint8_t check[4];
+    size_t check_size;
+    uint32_t payload_size;
+    size_t i;
+
+    frame->iovcnt = 0;
+    frame->size = 0;
+    frame->scratch_size = 0;
+    frame->scratch_pending = 0;
+    frame->checksum = checksum;
+    frame->check = smp_serial_protocol_check_init(checksum);
+
+    frame->scratch[frame->scratch_size++] = SMP_SERIAL_PROTOCOL_START_BYTE;
+
+    payload_size = (uint32_t) (smp_message_get_encoded_size(msg)
+            - MSG_HEADER_SIZE);
+    memcpy(buf, &msg->msgid, 4);
+    memcpy(buf + 4, &payload_size, 4);
+    if (!smp_zerocopy_frame_copy(frame, buf, sizeof(buf)))
+        return false;
+
+    for (i = 0; i < msg->capacity; i++) {
+        if (msg->values[i].type == SMP_TYPE_NONE)
+            continue;
+
+        if (!smp_zerocopy_frame_add_value(frame, &msg->values[i]))
+            return false;
+    }
+
+    check_size = smp_serial_protocol_check_finish(checksum, frame->check,
+            check);
+    if (!smp_zerocopy_frame_escape(frame, check, check_size)
+            || frame->scratch_size == sizeof(frame->scratch))
+        return false;
+
+    frame->scratch[frame->scratch_size++] = SMP_SERIAL_PROTOCOL_END_BYTE;
+    return smp_zerocopy_frame_flush_scratch(frame);
+}
+
+static bool smp_context_can_send_zerocopy(SmpContext *ctx, SmpMessage *msg)
+{
+    size_t i;
+
+    /* the link layer and the TX scheduler keep a copy of the payload */
+    if (ctx->link != NULL || ctx->tx_sched != NULL)
+        return false;
+
+    for (i = 0; i < msg->capacity; i++) {
+        const SmpValue *value = &msg->values[i];
+
+        if (value->type == SMP_TYPE_RAW
+                && value->value.craw_size >= SMP_CONTEXT_ZEROCOPY_MIN_SIZE
+                && value->value.craw_size <= UINT16_MAX)
+            return true;
+    }
+
+    return false;
+}
+
+/* Write msg with its large RAW arguments taken from the caller buffers, which
+ * aren't referenced once the write returns. Return SMP_ERROR_NOT_SUPPORTED if
+ * the frame has to be built with copies. */
+static int smp_context_send_message_zerocopy(SmpContext *ctx,
+        SmpMessage *msg)
+{
+    SmpZeroCopyFrame frame;
+    ssize_t wbytes;
+    int ret;
+
+    SMP_TRACE_BEGIN(ctx, encode_start);
+    if (!smp_zerocopy_frame_build(&frame, msg, ctx->checksum))
+        return SMP_ERROR_NOT_SUPPORTED;
+    SMP_TRACE_END(ctx, SMP_TRACE_STAGE_ENCODE_FRAME, encode_start);
+
+    SMP_TRACE_BEGIN(ctx, write_start);
+    wbytes = smp_context_io_writev(ctx, frame.iov, frame.iovcnt);
+    SMP_TRACE_END(ctx, SMP_TRACE_STAGE_WRITE, write_start);
+#ifdef SMP_ENABLE_CAPTURE
+    if (wbytes > 0 && ctx->capture != NULL) {
+        uint64_t now = smp_clock_get_time_ns();
+        size_t left = (size_t) wbytes;
+        int i;
+
+        for (i = 0; i < frame.iovcnt && left > 0; i++) {
+            size_t n = (left < frame.iov[i].size) ? left : frame.iov[i].size;
+
+            SMP_CAPTURE_RECORD(ctx, SMP_CAPTURE_DIRECTION_TX, now,
+                    frame.iov[i].base, n);
+            left -= n;
+        }
+    }
+#endif
+    if (wbytes < 0)
+        return (int) wbytes;
+
+    if (!ctx->processing) {
+        ret = smp_context_io_flush(ctx);
+        if (ret < 0)
+            return ret;
+    }
+
+    SMP_STATS_ADD(ctx->stats.tx_bytes, wbytes);
+    if ((size_t) wbytes != frame.size) {
+        SMP_STATS_INC(ctx->stats.short_writes);
+        return SMP_ERROR_IO;
+    }
+
+    SMP_STATS_INC(ctx->stats.tx_frames);
+    SMP_STATS_INC(ctx->stats.tx_zerocopy);
+    smp_context_count_tx_message(ctx, msg->msgid,
+            smp_message_get_encoded_size(msg));
+    return 0;
+}
+
+#endif /* __AVR */
+
+static int smp_context_send_message_full(SmpContext *ctx, SmpMessage *msg,
+        SmpPriority priority)
+{
+    SmpBuffer *msgbuf;
+    size_t msgsize;
+    ssize_t encoded_size;
+    int ret;
+
+    msgbuf = ctx->msg_tx;
+    msgsize = smp_message_get_encoded_size(msg);
+
+    /* check size */
+    if (msgbuf != NULL && msgbuf->maxsize < msgsize)
+        return SMP_ERROR_OVERFLOW;
+
+#ifndef __AVR
+    if (smp_context_can_send_zerocopy(ctx, msg)) {
+        ret = smp_context_send_message_zerocopy(ctx, msg);
+        if (ret != SMP_ERROR_NOT_SUPPORTED)
+            return ret;
+    }
+#endif
+
+    /* step 1: encode the message */
+    if (msgbuf == NULL) {
+        /* no user provided buffer, alloc */
+        msgbuf = smp_buffer_new_allocate(msgsize);
+        if (msgbuf == NULL)
+            return SMP_ERROR_NO_MEM;
+    }
+
+    SMP_TRACE_BEGIN(ctx, encode_start);
+    encoded_size = smp_message_encode(msg, msgbuf->data, msgbuf->maxsize);
+    SMP_TRACE_END(ctx, SMP_TRACE_STAGE_ENCODE_MESSAGE, encode_start);
+    if (encoded_size < 0) {
+        ret = (int) encoded_size;
+        goto done;
+    }
+
+    /* step 2: send it */
+    ret = smp_context_send_payload(ctx, smp_message_get_msgid(msg),
+            msgbuf->data, encoded_size, priority);
+
+done:
+    if (ctx->msg_tx == NULL) {
+        /* we have allocated buffer so free it */
+        smp_buffer_free(msgbuf);
+    }
+
+    return ret;
+}
+
+/**
+ * Send a message using the specified context.
+ *
+ * When reliable delivery is enabled and too many messages are waiting for an
+ * acknowledgement, SMP_ERROR_WOULD_BLOCK is returned and the message should be
+ * sent again after processing incoming data. With priorities, the message is
+ * queued with SMP_PRIORITY_NORMAL instead.
+ *
+ * Without the link layer and priorities, large RAW arguments are written
+ * straight from the buffers set with smp_message_set_craw(). The write is
+ * complete when this function returns, the buffers can be reused right away.
+ *
+ * @param[in] ctx the SmpContext
+ * @param[in] msg the SmpMessage to send
+ *
+ * @return 0 on success, a SmpError otherwise.
+ */
+int smp_context_send_message(SmpContext *ctx, SmpMessage *msg)
+{
+    return_val_if_fail(ctx != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(msg != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(ctx->opened, SMP_ERROR_BAD_FD);
+
+    return smp_context_send_message_full(ctx, msg, SMP_PRIORITY_NORMAL);
+}
+
+/**
+ * \ingroup context
+ * Send a prepared message, see smp_prepared_message_new(). Without link
+ * layer, its frame is written as is; otherwise the encoded message is sent
+ * like smp_context_send_message() does, saving only the encoding.
+ *
+ * @param[in] ctx the SmpContext
+ * @param[in] pm the SmpPreparedMessage to send
+ *
+ * @return 0 on success, a SmpError otherwise.
+ */
+int smp_context_send_prepared_message(SmpContext *ctx, SmpPreparedMessage *pm)
+{
+    const uint8_t *frame;
+    size_t size;
+    int ret;
+
+    return_val_if_fail(ctx != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(pm != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(ctx->opened, SMP_ERROR_BAD_FD);
+
+    if (ctx->link != NULL) {
+        return smp_context_send_payload(ctx, pm->msgid, pm->payload,
+                pm->payload_size, SMP_PRIORITY_NORMAL);
+    }
+
+    ret = smp_prepared_message_get_frame(pm, ctx->checksum, &frame, &size);
+    if (ret < 0)
+        return ret;
+
+    ret = smp_context_write_serial(ctx, frame, size);
+    if (ret == 0)
+        smp_context_count_tx_message(ctx, pm->msgid, pm->payload_size);
+
+    return ret;
+}
+
+/**
+ * \ingroup context
+ * Send outgoing messages by priority instead of in call order. Messages are
+ * queued, one queue per SmpPriority, and the most urgent queued message is
+ * sent each time the device took the previous frame. Messages bigger than
+ * fragment_size are split so a control message doesn't wait for the end of a
+ * bulk transfer: it goes out after the fragment being written.
+ *
+ * Frames then carry a link header, so both peers have to enable priorities;
+ * the fragment size of the receiver doesn't matter. The data the device
+ * doesn't take is kept instead of failing with a short write and written
+ * again by smp_context_wait_and_process(), so the latency of an urgent
+ * message also depends on the buffer of the device. Queued messages are
+ * copied, which allocates.
+ *
+ * @param[in] ctx the SmpContext
+ * @param[in] fragment_size the maximum number of message bytes per frame, 0
+ *                          to send messages whole
+ *
+ * @return 0 on success, a SmpError otherwise.
+ */
+int smp_context_enable_priorities(SmpContext *ctx, size_t fragment_size)
+{
+    int ret;
+
+    return_val_if_fail(ctx != NULL, SMP_ERROR_INVALID_PARAM);
+
+    if (ctx->tx_sched != NULL)
+        return SMP_ERROR_BUSY;
+
+    if (ctx->link == NULL) {
+        ctx->link = smp_link_new();
+        if (ctx->link == NULL)
+            return SMP_ERROR_NO_MEM;
+    }
+
+    ret = smp_link_set_fragmentation(ctx->link, true);
+    if (ret < 0)
+        return ret;
+
+    ctx->tx_sched = smp_tx_scheduler_new(fragment_size);
+    if (ctx->tx_sched == NULL) {
+        smp_link_set_fragmentation(ctx->link, false);
+        smp_context_release_link(ctx);
+        return SMP_ERROR_NO_MEM;
+    }
+
+    return 0;
+}
+
+/**
+ * \ingroup context
+ * Queue a message with the given priority, see
+ * smp_context_enable_priorities(). Messages of the same priority are sent in
+ * order.
+ *
+ * @param[in] ctx the SmpContext
+ * @param[in] msg the SmpMessage to send
+ * @param[in] priority the SmpPriority of the message
+ *
+ * @return 0 on success, a SmpError otherwise.
+ */
+int smp_context_send_message_with_priority(SmpContext *ctx, SmpMessage *msg,
+        SmpPriority priority)
+{
+    return_val_if_fail(ctx != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(msg != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(priority <= SMP_PRIORITY_LOW, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(ctx->opened, SMP_ERROR_BAD_FD);
+    return_val_if_fail(ctx->tx_sched != NULL, SMP_ERROR_NOT_SUPPORTED);
+
+    return smp_context_send_message_full(ctx, msg, priority);
+}
+
+/**
+ * \ingroup context
+ * Set the conflation policy of a message id, for state messages where only
+ * the latest value matters. Queues then hold at most one message per
+ * conflated id whatever the producer rate.
+ *
+ * With SMP_CONFLATION_TX, a message queued by smp_context_enable_priorities()
+ * and not started yet is replaced in place by a newer one with the same id,
+ * keeping its place in the queue. Without priorities, messages are written
+ * right away and there is nothing to replace.
+ *
+ * With SMP_CONFLATION_RX, the messages received by a call processing the
+ * incoming data are held and only the newest one is delivered, after the
+ * other messages, once the available data is processed.
+ *
+ * @param[in] ctx the SmpContext
+ * @param[in] msgid the message id
+ * @param[in] flags SmpConflation flags, SMP_CONFLATION_NONE to send and
+ *                  deliver every message again
+ *
+ * @return 0 on success, a SmpError otherwise.
+ */
+int smp_context_set_conflation(SmpContext *ctx, uint32_t msgid, int flags)
+{
+    return_val_if_fail(ctx != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail((flags & ~(SMP_CONFLATION_TX | SMP_CONFLATION_RX)) == 0,
+            SMP_ERROR_INVALID_PARAM);
+
+    if (ctx->conflation == NULL) {
+        if (flags == SMP_CONFLATION_NONE)
+            return 0;
+
+        ctx->conflation = smp_conflation_table_new();
+        if (ctx->conflation == NULL)
+            return SMP_ERROR_NO_MEM;
+    }
+
+    return smp_conflation_table_set(ctx->conflation, msgid, flags);
+}
+
+/**
+ * \ingroup context
+ * Keep the queue of the device short so the messages sent with
+ * smp_context_enable_priorities() wait in the context, where an urgent
+ * message can go before them, instead of behind kilobytes already handed to
+ * the kernel.
+ *
+ * Queued frames are written only while the device holds at most max_queued
+ * bytes. The queue is read from the device when it can tell, like TIOCOUTQ
+ * on a tty, and estimated from the bytes written and the baudrate set by
+ * smp_context_set_serial_config(), since ptys and many USB adapters report an
+ * empty queue. The frames left are written by smp_context_process_timers()
+ * and smp_context_wait_and_process(), and smp_context_get_next_timeout() takes
+ * the pacing into account. Writes are not paced when the device can't tell and
+ * the baudrate is unknown.
+ *
+ * A whole fragment is written at once so the queue may exceed max_queued by
+ * one frame. Acknowledgements and retransmissions of the link layer are not
+ * paced. Pacing needs a clock, SMP_ERROR_NOT_SUPPORTED is returned on
+ * platforms without one.
+ *
+ * @param[in] ctx the SmpContext
+ * @param[in] max_queued the maximum number of bytes in the device queue, 0
+ *                       to disable pacing
+ *
+ * @return 0 on success, a SmpError otherwise.
+ */
+int smp_context_set_tx_pacing(SmpContext *ctx, size_t max_queued)
+{
+    return_val_if_fail(ctx != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(ctx->tx_sched != NULL, SMP_ERROR_NOT_SUPPORTED);
+
+    if (max_queued > 0 && smp_clock_get_time_ns() == 0)
+        return SMP_ERROR_NOT_SUPPORTED;
+
+    ctx->tx_pacing_max = max_queued;
+    ctx->tx_drain_time = 0;
+    ctx->tx_pacing_deadline = 0;
+
+    return 0;
+}
+
+/* build the serial frame of the message encoded at the start of data,
+ * right after it */
+static ssize_t smp_context_frame_scheduled(SmpContext *ctx, uint8_t *data,
+        size_t msg_size, size_t capacity)
+{
+    uint8_t *frame = data + msg_size;
+
+    return smp_serial_protocol_encode_with_checksum(data, msg_size, &frame,
+            capacity - msg_size, ctx->checksum);
+}
+
+/* encode msg into the scheduled message, framed now unless the link layer
+ * adds its header when sending. The message keeps its previous content on
+ * failure. */
+static int smp_context_encode_scheduled(SmpContext *ctx,
+        SmpScheduledMessage *sm, SmpMessage *msg)
+{
+    size_t msgsize;
+    size_t maxsize;
+    ssize_t encoded_size;
+    ssize_t frame_size = 0;
+    uint8_t *data;
+
+    msgsize = smp_message_get_encoded_size(msg);
+
+    /* a frame is at most twice the escaped message and checksum plus its
+     * start and end bytes, there is room for it in case the link layer is
+     * disabled later */
+    maxsize = msgsize + 2 * (msgsize + 4) + 2;
+    data = smp_scheduled_message_reserve(sm, maxsize);
+    if (data == NULL)
+        return SMP_ERROR_NO_MEM;
+
+    encoded_size = smp_message_encode(msg, data, msgsize);
+    if (encoded_size < 0)
+        return (int) encoded_size;
+
+    if (ctx->link == NULL) {
+        frame_size = smp_context_frame_scheduled(ctx, data,
+                (size_t) encoded_size, maxsize);
+        if (frame_size < 0)
+            return (int) frame_size;
+    }
+
+    smp_scheduled_message_commit(sm);
+    sm->msgid = smp_message_get_msgid(msg);
+    sm->msg_size = (size_t) encoded_size;
+    sm->frame_size = (size_t) frame_size;
+    sm->frame_checksum = ctx->checksum;
+    return 0;
+}
+
+/* write a scheduled message. Its prebuilt frame is written as is, it is
+ * only framed again when the link layer was disabled or the checksum
+ * changed since it was scheduled. */
+static int smp_context_write_scheduled(SmpContext *ctx,
+        SmpScheduledMessage *sm)
+{
+    if (ctx->link != NULL)
+        return smp_link_send_message(ctx->link, ctx, sm->data, sm->msg_size);
+
+    if (sm->frame_size == 0 || sm->frame_checksum != ctx->checksum) {
+        ssize_t frame_size;
+
+        frame_size = smp_context_frame_scheduled(ctx, sm->data,
+                sm->msg_size, sm->capacity);
+        if (frame_size < 0)
+            return (int) frame_size;
+
+        sm->frame_size = (size_t) frame_size;
+        sm->frame_checksum = ctx->checksum;
+    }
+
+    return smp_context_write_serial(ctx, sm->data + sm->msg_size,
+            sm->frame_size);
+}
+
+/* write the scheduled messages whose time has come */
+static int smp_context_send_scheduled(SmpContext *ctx)
+{
+    SmpScheduledMessage *sm;
+    uint64_t now;
+
+    if (ctx->schedule == NULL)
+        return 0;
+
+    now = smp_clock_get_time_ns();
+    while ((sm = smp_schedule_table_pop_expired(ctx->schedule, now)) != NULL) {
+        uint64_t write_time = smp_clock_get_time_ns();
+        int ret;
+
+        ret = smp_context_write_scheduled(ctx, sm);
+        if (ret < 0) {
+            /* a late message is worth less than the next one */
+            smp_context_notify_error(ctx, ret);
+        } else {
+            uint64_t delay = write_time - sm->time;
+
+            smp_context_count_tx_message(ctx, sm->msgid, sm->msg_size);
+            SMP_STATS_INC(ctx->stats.tx_scheduled);
+            SMP_STATS_ADD(ctx->stats.tx_schedule_delay_ns, delay);
+            if (delay > SMP_STATS_LOAD(ctx->stats.tx_schedule_max_delay_ns))
+                SMP_STATS_STORE(ctx->stats.tx_schedule_max_delay_ns, delay);
+        }
+
+        if (sm->period == 0) {
+            smp_scheduled_message_free(sm);
+            continue;
+        }
+
+        /* the periods missed are skipped instead of sent in a burst */
+        sm->time += sm->period;
+        if (sm->time <= now)
+            sm->time += ((now - sm->time) / sm->period + 1) * sm->period;
+
+        smp_schedule_table_insert(ctx->schedule, sm);
+    }
+
+    return 0;
+}
+
+/**
+ * \ingroup context
+ * Send a message at a given time, once or periodically, for streams like
+ * actuator setpoints where the jitter of application timers would show on
+ * the wire. The message is encoded and framed now so only the write is left
+ * at the scheduled time. With the link layer, whose header depends on the
+ * time of sending, the message is framed when it is sent.
+ *
+ * Messages are written by smp_context_process_timers().
+ * smp_context_wait_and_process() wakes up for them, waiting with a
+ * millisecond timeout first and then sleeping until the exact time, so the
+ * data received during the last millisecond is processed after the write.
+ * The tx_scheduled, tx_schedule_delay_ns and tx_schedule_max_delay_ns
+ * statistics measure the actual write times.
+ *
+ * Periodic messages keep their phase: when processing was late, the missed
+ * periods are skipped. A message the link layer refuses is dropped and
+ * reported to the error callback. Scheduled messages are written right away
+ * and don't go through the queues of smp_context_enable_priorities().
+ *
+ * @param[in] ctx the SmpContext
+ * @param[in] msg the SmpMessage to send
+ * @param[in] time_ns the time of the first write, from
+ *                    smp_context_get_time_ns(), 0 for the next timer
+ *                    processing
+ * @param[in] period_ns the time between writes, 0 to send the message once
+ *
+ * @return the positive id of the scheduled message on success, a SmpError
+ * otherwise.
+ */
+int smp_context_schedule_message(SmpContext *ctx, SmpMessage *msg,
+        uint64_t time_ns, uint64_t period_ns)
+{
+    SmpScheduledMessage *sm;
+    uint64_t now;
+    int ret;
+
+    return_val_if_fail(ctx != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(msg != NULL, SMP_ERROR_INVALID_PARAM);
+
+    now = smp_clock_get_time_ns();
+    if (now == 0)
+        return SMP_ERROR_NOT_SUPPORTED;
+
+    if (ctx->schedule == NULL) {
+        ctx->schedule = smp_schedule_table_new();
+        if (ctx->schedule == NULL)
+            return SMP_ERROR_NO_MEM;
+    }
+
+    sm = smp_scheduled_message_new(ctx->schedule);
+    if (sm == NULL)
+        return SMP_ERROR_NO_MEM;
+
+    ret = smp_context_encode_scheduled(ctx, sm, msg);
+    if (ret < 0) {
+        smp_scheduled_message_free(sm);
+        return ret;
+    }
+
+    sm->time = (time_ns != 0) ? time_ns : now;
+    sm->period = period_ns;
+    smp_schedule_table_insert(ctx->schedule, sm);
+    return sm->id;
+}
+
+/**
+ * \ingroup context
+ * Replace the content of a scheduled message, like the next value of a
+ * periodic setpoint, keeping its time and period. On failure, the previous
+ * content is kept.
+ *
+ * @param[in] ctx the SmpContext
+ * @param[in] id the id returned by smp_context_schedule_message()
+ * @param[in] msg the new SmpMessage
+ *
+ * @return 0 on success, a SmpError otherwise.
+ */
+int smp_context_update_scheduled_message(SmpContext *ctx, int id,
+        SmpMessage *msg)
+{
+    SmpScheduledMessage *sm;
+
+    return_val_if_fail(ctx != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(msg != NULL, SMP_ERROR_INVALID_PARAM);
+
+    if (ctx->schedule == NULL)
+        return SMP_ERROR_NOT_FOUND;
+
+    sm = smp_schedule_table_lookup(ctx->schedule, id);
+    if (sm == NULL)
+        return SMP_ERROR_NOT_FOUND;
+
+    return smp_context_encode_scheduled(ctx, sm, msg);
+}
+
+/**
+ * \ingroup context
+ * Cancel a scheduled message.
+ *
+ * @param[in] ctx the SmpContext
+ * @param[in] id the id returned by smp_context_schedule_message()
+ *
+ * @return 0 on success, a SmpError otherwise.
+ */
+int smp_context_cancel_scheduled_message(SmpContext *ctx, int id)
+{
+    SmpScheduledMessage *sm;
+
+    return_val_if_fail(ctx != NULL, SMP_ERROR_INVALID_PARAM);
+
+    if (ctx->schedule == NULL)
+        return SMP_ERROR_NOT_FOUND;
+
+    sm = smp_schedule_table_remove(ctx->schedule, id);
+    if (sm == NULL)
+        return SMP_ERROR_NOT_FOUND;
+
+    smp_scheduled_message_free(sm);
+    return 0;
+}
+
+/**
+ * \ingroup context
+ * Let other threads send messages with smp_context_queue_message(). They are
+ * written by the thread processing the context, which is woken up by
+ * smp_context_wait_and_process() or through the file descriptor returned by
+ * smp_context_get_queue_fd().
+ *
+ * This must be called before other threads use the context, after the
+ * checksum and the link layer are configured.
+ *
+ * @param[in] ctx the SmpContext
+ *
+ * @return 0 on success, a SmpError otherwise.
+ */
+int smp_context_enable_send_queue(SmpContext *ctx)
+{
+    return_val_if_fail(ctx != NULL, SMP_ERROR_INVALID_PARAM);
+
+    if (ctx->send_queue != NULL)
+        return SMP_ERROR_BUSY;
+
+    ctx->send_queue = smp_send_queue_new();
+    if (ctx->send_queue == NULL) {
+#ifdef SMP_ENABLE_POSIX_TRANSPORTS
+        return SMP_ERROR_NO_MEM;
+#else
+        return SMP_ERROR_NOT_SUPPORTED;
+#endif
+    }
+
+    return 0;
+}
+
+/**
+ * \ingroup context
+ * Queue a message to be sent by the thread processing the context. Unlike
+ * smp_context_send_message(), this function can be called from any thread:
+ * the message is encoded, and framed unless the link layer is enabled, by
+ * the calling thread and the queue doesn't take any lock. Messages queued by
+ * a thread are sent in order. Errors happening when the message is written
+ * are passed to the error callback.
+ *
+ * The send queue must be enabled with smp_context_enable_send_queue().
+ *
+ * @param[in] ctx the SmpContext
+ * @param[in] msg the SmpMessage to send, left unchanged
+ *
+ * @return 0 on success, a SmpError otherwise.
+ */
+int smp_context_queue_message(SmpContext *ctx, SmpMessage *msg)
+{
+    SmpSendQueueNode *node;
+    size_t msgsize;
+    size_t maxsize;
+    ssize_t encoded_size;
+    uint8_t *msgdata;
+
+    return_val_if_fail(ctx != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(msg != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(ctx->send_queue != NULL, SMP_ERROR_NOT_SUPPORTED);
+
+    msgsize = smp_message_get_encoded_size(msg);
+
+    /* a frame is at most twice the escaped message and checksum plus its
+     * start and end bytes, the message is encoded after it */
+    maxsize = msgsize;
+    if (ctx->link == NULL)
+        maxsize += 2 * (msgsize + 4) + 2;
+
+    node = malloc(sizeof(SmpSendQueueNode) + maxsize);
+    if (node == NULL)
+        return SMP_ERROR_NO_MEM;
+
+    msgdata = node->data + maxsize - msgsize;
+    encoded_size = smp_message_encode(msg, msgdata, msgsize);
+    if (encoded_size < 0) {
+        free(node);
+        return (int) encoded_size;
+    }
+
+    node->msgid = smp_message_get_msgid(msg);
+    node->msg_size = (size_t) encoded_size;
+    node->framed = (ctx->link == NULL);
+
+    if (node->framed) {
+        uint8_t *frame = node->data;
+        ssize_t frame_size;
+
+        frame_size = smp_serial_protocol_encode_with_checksum(msgdata,
+                encoded_size, &frame, maxsize - msgsize, ctx->checksum);
+        if (frame_size < 0) {
+            free(node);
+            return (int) frame_size;
+        }
+
+        node->size = (size_t) frame_size;
+    } else {
+        node->size = (size_t) encoded_size;
+    }
+
+    smp_send_queue_push(ctx->send_queue, node);
+    return 0;
+}
+
+/**
+ * \ingroup context
+ * Get the file descriptor which becomes readable when messages are queued,
+ * to integrate the send queue in an event loop. smp_context_process_queue()
+ * should then be called.
+ *
+ * @param[in] ctx the SmpContext
+ *
+ * @return the file descriptor on success, a SmpError otherwise.
+ */
+intptr_t smp_context_get_queue_fd(SmpContext *ctx)
+{
+    return_val_if_fail(ctx != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(ctx->send_queue != NULL, SMP_ERROR_NOT_SUPPORTED);
+
+    return smp_send_queue_get_fd(ctx->send_queue);
+}
+
+/* write the frames gathered from the send queue at once */
+static int smp_context_write_queue_batch(SmpContext *ctx)
+{
+    SmpSendQueue *queue = ctx->send_queue;
+    SmpSendQueueNode *node;
+    int ret = 0;
+
+    if (queue->batch_frames == 0)
+        return 0;
+
+    ret = smp_context_write_frames(ctx, queue->batch, queue->batch_size,
+            queue->batch_frames);
+    if (ret < 0)
+        smp_context_notify_error(ctx, ret);
+
+    while ((node = queue->batch_nodes) != NULL) {
+        queue->batch_nodes = node->next;
+        if (ret == 0)
+            smp_context_count_tx_message(ctx, node->msgid, node->msg_size);
+        free(node);
+    }
+
+    queue->batch_size = 0;
+    queue->batch_frames = 0;
+    return ret;
+}
+
+/* Send a node popped from the send queue, return false if the link layer
+ * can't take it yet. */
+static bool smp_context_send_queue_node(SmpContext *ctx,
+        SmpSendQueueNode *node)
+{
+    SmpSendQueue *queue = ctx->send_queue;
+    int ret;
+
+    if (node->framed && node->size <= sizeof(queue->batch)) {
+        if (queue->batch_size + node->size > sizeof(queue->batch))
+            smp_context_write_queue_batch(ctx);
+
+        memcpy(queue->batch + queue->batch_size, node->data, node->size);
+        queue->batch_size += node->size;
+        queue->batch_frames++;
+        node->next = queue->batch_nodes;
+        queue->batch_nodes = node;
+        return true;
+    }
+
+    /* keep the order of the frames gathered before */
+    smp_context_write_queue_batch(ctx);
+
+    if (!node->framed && ctx->tx_sched != NULL) {
+        /* counted by the scheduler once sent */
+        ret = smp_tx_scheduler_push(ctx->tx_sched, SMP_PRIORITY_NORMAL,
+                node->msgid, node->data, node->size);
+        if (ret < 0)
+            smp_context_notify_error(ctx, ret);
+
+        free(node);
+        return true;
+    }
+
+    if (node->framed)
+        ret = smp_context_write_serial(ctx, node->data, node->size);
+    else if (ctx->link != NULL)
+        ret = smp_link_send_message(ctx->link, ctx, node->data, node->size);
+    else
+        ret = smp_context_write_payload(ctx, node->data, node->size);
+
+    if (ret == SMP_ERROR_WOULD_BLOCK && !node->framed)
+        return false;
+
+    if (ret == 0)
+        smp_context_count_tx_message(ctx, node->msgid, node->msg_size);
+    else
+        smp_context_notify_error(ctx, ret);
+
+    free(node);
+    return true;
+}
+
+/* send the queued messages, fd_ready tells the queue fd was polled
+ * readable */
+static int smp_context_drain_queue(SmpContext *ctx, bool fd_ready)
+{
+    SmpSendQueue *queue = ctx->send_queue;
+    SmpSendQueueNode *node;
+    bool nested;
+
+    nested = smp_context_begin_processing(ctx);
+
+    smp_send_queue_clear_wakeup(queue, fd_ready);
+
+    /* a message the link layer refused comes first */
+    node = queue->retry;
+    queue->retry = NULL;
+    if (node == NULL)
+        node = smp_send_queue_pop(queue);
+
+    while (node != NULL) {
+        if (!smp_context_send_queue_node(ctx, node)) {
+            queue->retry = node;
+            break;
+        }
+
+        node = smp_send_queue_pop(queue);
+    }
+
+    smp_context_write_queue_batch(ctx);
+
+    return smp_context_end_processing(ctx, nested,
+            smp_context_schedule_tx(ctx));
+}
+
+/**
+ * \ingroup context
+ * Send the messages queued with smp_context_queue_message(). Consecutive
+ * frames are written together. smp_context_wait_and_process() calls it when
+ * the send queue is enabled, use it when waiting on
+ * smp_context_get_queue_fd() in another event loop.
+ *
+ * @param[in] ctx the SmpContext
+ *
+ * @return 0 on success, a SmpError otherwise.
+ */
+int smp_context_process_queue(SmpContext *ctx)
+{
+    return_val_if_fail(ctx != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(ctx->opened, SMP_ERROR_BAD_FD);
+    return_val_if_fail(ctx->send_queue != NULL, SMP_ERROR_NOT_SUPPORTED);
+
+    return smp_context_drain_queue(ctx, true);
+}
+
+/**
+ * \ingroup context
+ * Receive the payload of incoming frames before they are decoded into
+ * messages. This lets a relay forward frames with smp_context_send_frame()
+ * without parsing them.
+ *
+ * @param[in] ctx the SmpContext
+ * @param[in] cb the callback, NULL to decode every frame again
+ * @param[in] userdata the userdata passed to cb
+ *
+ * @return 0 on success, a SmpError otherwise.
+ */
+int smp_context_set_frame_cb(SmpContext *ctx, SmpFrameFunc cb, void *userdata)
+{
+    return_val_if_fail(ctx != NULL, SMP_ERROR_INVALID_PARAM);
+
+    ctx->frame_cb = cb;
+    ctx->frame_userdata = userdata;
+    return 0;
+}
+
+/**
+ * \ingroup context
+ * Send an already encoded message. With SMP_FRAME_FORMAT_PAYLOAD, data is an
+ * encoded message, like the payload passed to the frame callback, and it is
+ * sent as smp_context_send_message() would, going through the priorities,
+ * conflation and pacing of the context. With SMP_FRAME_FORMAT_SERIAL,
+ * data is a complete frame using the checksum of the context and it is
+ * written as is, which isn't possible when a link feature is enabled.
+ *
+ * @param[in] ctx the SmpContext
+ * @param[in] data the payload or the frame
+ * @param[in] size the size of data
+ * @param[in] format the format of data
+ *
+ * @return 0 on success, a SmpError otherwise.
+ */
+int smp_context_send_frame(SmpContext *ctx, const uint8_t *data, size_t size,
+        SmpFrameFormat format)
+{
+    return_val_if_fail(ctx != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(data != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(ctx->opened, SMP_ERROR_BAD_FD);
+
+    switch (format) {
+        case SMP_FRAME_FORMAT_PAYLOAD:
+            if (size < MSG_HEADER_SIZE)
+                return SMP_ERROR_BAD_MESSAGE;
+
+            return smp_context_send_payload(ctx, read_msgid(data), data, size,
+                    SMP_PRIORITY_NORMAL);
+
+        case SMP_FRAME_FORMAT_SERIAL:
+            /* link frames need a header built by the link layer */
+            if (ctx->link != NULL)
+                return SMP_ERROR_NOT_SUPPORTED;
+
+            return smp_context_write_serial(ctx, data, size);
+
+        default:
+            return SMP_ERROR_INVALID_PARAM;
+    }
+}
+
+static inline bool smp_context_has_pending_input(SmpContext *ctx)
+{
+    return ctx->rx_chunk_offset < ctx->rx_chunk_size;
+}
+
+/* read a chunk of data from the device, return the number of bytes read, 0 if
+ * there is no data or a SmpError */
+static ssize_t smp_context_read_chunk(SmpContext *ctx)
+{
+    ssize_t rbytes;
+
+    SMP_TRACE_BEGIN(ctx, read_start);
+    rbytes = smp_context_io_read(ctx, ctx->rx_chunk,
+            SMP_CONTEXT_PROCESS_CHUNK_SIZE);
+    SMP_TRACE_END(ctx, SMP_TRACE_STAGE_READ, read_start);
+    if (rbytes == SMP_ERROR_WOULD_BLOCK)
+        return 0;
+    else if (rbytes <= 0)
+        return rbytes;
+
+    ctx->rx_chunk_size = (size_t) rbytes;
+    ctx->rx_chunk_offset = 0;
+    ctx->rx_chunk_time = smp_clock_get_time_ns();
+    SMP_CAPTURE_RECORD(ctx, SMP_CAPTURE_DIRECTION_RX, ctx->rx_chunk_time,
+            ctx->rx_chunk, rbytes);
+
+    return rbytes;
+}
+
+/* Process the pending data then read and process what is available, until
+ * max_frames frames or max_ns nanoseconds, 0 meaning no limit. Return 1 if
+ * the budget ran out with data left, 0 if the device has no more data or a
+ * SmpError. */
+static int smp_context_process_input(SmpContext *ctx, unsigned int max_frames,
+        uint64_t max_ns)
+{
+    uint64_t start = 0;
+    unsigned int total_frames = 0;
+    bool pending = false;
+    bool nested;
+    int ret = 0;
+
+    if (max_ns > 0)
+        start = smp_clock_get_time_ns();
+
+    nested = smp_context_begin_processing(ctx);
+
+    while (1) {
+        unsigned int limit = 0;
+        unsigned int n_frames;
+
+        if (!smp_context_has_pending_input(ctx)) {
+            ssize_t rbytes = smp_context_read_chunk(ctx);
+
+            if (rbytes == 0) {
+                break;
+            } else if (rbytes == SMP_ERROR_OVERFLOW) {
+                /* the device dropped incoming bytes, keep reading */
+                smp_context_notify_error(ctx, SMP_ERROR_OVERFLOW);
+                continue;
+            } else if (rbytes < 0) {
+                smp_context_deliver_conflated(ctx);
+                return smp_context_end_processing(ctx, nested, (int) rbytes);
+            }
+        }
+
+        /* the budget is checked once data is known to be pending, after a
+         * frame at least so each call makes progress */
+        if ((max_frames > 0 && total_frames >= max_frames)
+                || (max_ns > 0 && total_frames > 0
+                    && smp_clock_get_time_ns() - start >= max_ns)) {
+            pending = true;
+            break;
+        }
+
+        if (max_frames > 0)
+            limit = max_frames - total_frames;
+        if (max_ns > 0)
+            limit = 1;
+
+        ctx->rx_chunk_offset += smp_context_process_data(ctx,
+                ctx->rx_chunk + ctx->rx_chunk_offset,
+                ctx->rx_chunk_size - ctx->rx_chunk_offset, ctx->rx_chunk_time,
+                limit, &n_frames);
+        total_frames += n_frames;
+    }
+
+    smp_context_deliver_conflated(ctx);
+
+    /* acknowledgements may let queued messages go */
+    ret = smp_context_schedule_tx(ctx);
+
+    /* acknowledge received data which wasn't acked by an answer */
+    if (ret == 0 && ctx->link != NULL)
+        ret = smp_link_flush(ctx->link, ctx);
+
+    ret = smp_context_end_processing(ctx, nested, ret);
+    if (ret < 0)
+        return ret;
+
+    return pending ? 1 : 0;
+}
+
+/**
+ * \ingroup context
+ * Process incoming data on the serial file descriptor.
+ * Decoded frame or errors during decoding are passed to their respective
+ * callbacks.
+ *
+ * @param[in] ctx the SmpContext
+ *
+ * @return 0 on success, a SmpError otherwise.
+ */
+int smp_context_process_fd(SmpContext *ctx)
+{
+    return_val_if_fail(ctx != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(ctx->opened, SMP_ERROR_BAD_FD);
+
+    return smp_context_process_input(ctx, 0, 0);
+}
+
+/**
+ * \ingroup context
+ * Like smp_context_process_fd(), but stop once max_frames frames were
+ * received or after max_ns nanoseconds, so a chatty peer can't monopolize the
+ * thread. Data read but not processed is kept for the next call, which
+ * smp_context_wait_and_process() makes without waiting and
+ * smp_context_get_next_timeout() reports with a timeout of 0. The time is
+ * checked between frames and at least one frame is processed, so a frame with
+ * long callbacks may overrun it.
+ *
+ * @param[in] ctx the SmpContext
+ * @param[in] max_frames the maximum number of frames to process, 0 for no
+ *                       limit
+ * @param[in] max_ns the processing time in nanoseconds, 0 for no limit
+ *
+ * @return 0 when the device has no more data, 1 when the budget ran out with
+ *         data left to process, a SmpError otherwise.
+ */
+int smp_context_process_budget(SmpContext *ctx, unsigned int max_frames,
+        uint64_t max_ns)
+{
+    return_val_if_fail(ctx != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(ctx->opened, SMP_ERROR_BAD_FD);
+
+    return smp_context_process_input(ctx, max_frames, max_ns);
+}
+
+static inline void smp_context_cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__ARM_ARCH_7A__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+/* Spin on non-blocking reads for the busy poll budget. Return the number of
+ * bytes read into the pending chunk, SMP_ERROR_WOULD_BLOCK if the budget ran
+ * out or another SmpError. */
+static ssize_t smp_context_busy_poll(SmpContext *ctx, int timeout_ms)
+{
+    uint64_t budget = ctx->busy_poll_ns;
+    uint64_t deadline;
+    uint64_t now;
+    ssize_t rbytes;
+
+    now = smp_clock_get_time_ns();
+    if (now == 0)
+        return SMP_ERROR_WOULD_BLOCK;
+
+    if (timeout_ms >= 0 && (uint64_t) timeout_ms * SMP_NSEC_PER_MSEC < budget)
+        budget = (uint64_t) timeout_ms * SMP_NSEC_PER_MSEC;
+    deadline = now + budget;
+
+    do {
+        rbytes = smp_context_read_chunk(ctx);
+        if (rbytes != 0) {
+            if (rbytes > 0)
+                SMP_STATS_INC(ctx->stats.busy_poll_hits);
+            return rbytes;
+        }
+
+        if (ctx->busy_poll_pause)
+            smp_context_cpu_relax();
+    } while (smp_clock_get_time_ns() < deadline);
+
+    SMP_STATS_INC(ctx->stats.busy_poll_misses);
+    return SMP_ERROR_WOULD_BLOCK;
+}
+
+/* wait for incoming data, spinning first when busy polling is enabled, and
+ * process it */
+static int smp_context_wait_input(SmpContext *ctx, int timeout_ms)
+{
+    int ret;
+
+    /* messages queued since the last wait, or refused by the link layer */
+    if (ctx->send_queue != NULL) {
+        ret = smp_context_drain_queue(ctx, false);
+        if (ret < 0)
+            return ret;
+    }
+
+    /* left by a processing budget */
+    if (smp_context_has_pending_input(ctx))
+        return smp_context_process_input(ctx, 0, 0);
+
+    if (ctx->busy_poll_ns > 0 && timeout_ms != 0) {
+        ssize_t rbytes = smp_context_busy_poll(ctx, timeout_ms);
+
+        if (rbytes > 0)
+            return smp_context_process_input(ctx, 0, 0);
+        else if (rbytes == SMP_ERROR_OVERFLOW)
+            smp_context_notify_error(ctx, SMP_ERROR_OVERFLOW);
+        else if (rbytes != SMP_ERROR_WOULD_BLOCK)
+            return (int) rbytes;
+    }
+
+    if (ctx->send_queue != NULL) {
+        intptr_t fd = smp_context_get_fd(ctx);
+
+        /* a device which can't be polled is waited on alone, queued
+         * messages are then sent once it has data or the wait times out */
+        if (fd >= 0) {
+            bool queue_ready = false;
+            bool device_ready = false;
+
+            ret = smp_send_queue_wait(ctx->send_queue, fd, timeout_ms,
+                    &queue_ready, &device_ready);
+            if (ret < 0)
+                return ret;
+
+            if (queue_ready) {
+                ret = smp_context_drain_queue(ctx, true);
+                if (ret < 0)
+                    return ret;
+            }
+
+            if (!device_ready)
+                return 0;
+
+            return smp_context_process_input(ctx, 0, 0);
+        }
+    }
+
+    ret = smp_context_io_wait(ctx, timeout_ms);
+    if (ret < 0)
+        return ret;
+
+    return smp_context_process_input(ctx, 0, 0);
+}
+
+/**
+ * \ingroup context
+ * Wait for an event on the serial and process it.
+ *
+ * @param[in] ctx the SmpContext
+ * @param[in] timeout_ms a timeout in milliseconds. A negative value means no
+ *                       timeout
+ *
+ * @return 0 on success, a SmpError otherwise.
+ */
+int smp_context_wait_and_process(SmpContext *ctx, int timeout_ms)
+{
+    int ret;
+
+    return_val_if_fail(ctx != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(ctx->opened, SMP_ERROR_BAD_FD);
+
+    if (ctx->link == NULL && ctx->calls == NULL && ctx->schedule == NULL)
+        return smp_context_wait_input(ctx, timeout_ms);
+
+    /* wake up for timers expiring before the user timeout and keep waiting
+     * afterwards */
+    while (1) {
+        int timer_ms = smp_context_get_next_timeout(ctx);
+        int wait_ms = timeout_ms;
+        uint64_t sched_time = 0;
+
+        if (timer_ms >= 0 && (wait_ms < 0 || timer_ms < wait_ms))
+            wait_ms = timer_ms;
+
+        /* wait for the whole milliseconds before a scheduled message and
+         * sleep the rest, rounding the timeout up would make it late */
+        if (ctx->schedule != NULL)
+            sched_time = smp_schedule_table_get_next_time(ctx->schedule);
+        if (sched_time != 0) {
+            uint64_t now = smp_clock_get_time_ns();
+            int sched_ms = 0;
+
+            if (sched_time > now)
+                sched_ms = (int) ((sched_time - now) / SMP_NSEC_PER_MSEC);
+
+            if (wait_ms < 0 || sched_ms <= wait_ms)
+                wait_ms = sched_ms;
+            else
+                sched_time = 0;
+        }
+
+        ret = smp_context_wait_input(ctx, wait_ms);
+        if (ret != SMP_ERROR_TIMEDOUT)
+            return ret;
+
+        if (sched_time != 0)
+            smp_clock_sleep_until(sched_time);
+
+        ret = smp_context_process_timers(ctx);
+        if (ret < 0)
+            return ret;
+
+        if (wait_ms == timeout_ms)
+            return SMP_ERROR_TIMEDOUT;
+
+        if (timeout_ms > 0)
+            timeout_ms -= wait_ms;
+    }
+}
+
+/**
+ * \ingroup context
+ * Make smp_context_wait_and_process() spin on non-blocking reads for a while
+ * before sleeping in the device wait. This saves the wake up latency of the
+ * scheduler when an answer comes quickly, at the cost of burning the CPU, so
+ * it is meant for a thread running alone on its core. The busy_poll_hits and
+ * busy_poll_misses statistics tell whether the budget pays off.
+ *
+ * @param[in] ctx the SmpContext
+ * @param[in] budget_us the time to spin in microseconds, 0 to disable busy
+ *                      polling
+ * @param[in] pause true to execute a pause instruction between reads, which
+ *                  is friendlier to a sibling hyper-thread
+ *
+ * @return 0 on success, a SmpError otherwise.
+ */
+int smp_context_set_busy_poll(SmpContext *ctx, unsigned int budget_us,
+        bool pause)
+{
+    return_val_if_fail(ctx != NULL, SMP_ERROR_INVALID_PARAM);
+
+    /* the budget is measured with the clock */
+    if (budget_us > 0 && smp_clock_get_time_ns() == 0)
+        return SMP_ERROR_NOT_SUPPORTED;
+
+    ctx->busy_poll_ns = (uint64_t) budget_us * 1000;
+    ctx->busy_poll_pause = pause;
+    return 0;
+}
+
+/**
+ * \ingroup context
+ * Set decoder buffer maximum capacity. This value is used as a limit when
+ * reallocating memory for the decoder. If the value is lower than the current
+ * capacity, the buffer won't be reallocated
+ *
+ * @param[in] ctx the SmpContext
+ * @param[in] max the maximum buffer capacity in bytes
+ *
+ * @return 0 on success, a SmpError otherwise.
+ */
+int smp_context_set_decoder_maximum_capacity(SmpContext *ctx, size_t max)
+{
+    return_val_if_fail(ctx != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(max > 16, SMP_ERROR_INVALID_PARAM);
+
+    return smp_serial_protocol_decoder_set_maximum_capacity(ctx->decoder, max);
+}
+
+/**
+ * \ingroup context
+ * Set the frame check used to protect frames sent and received on this
+ * context. The default is SMP_SERIAL_CHECKSUM_XOR8 which is compatible with
+ * older versions of the library; the CRCs detect swapped bytes and multi-bit
+ * errors that the XOR misses. Both peers have to use the same setting.
+ *
+ * @param[in] ctx the SmpContext
+ * @param[in] checksum the SmpSerialChecksum to use
+ *
+ * @return 0 on success, a SmpError otherwise.
+ */
+int smp_context_set_checksum(SmpContext *ctx, SmpSerialChecksum checksum)
+{
+    int ret;
+
+    return_val_if_fail(ctx != NULL, SMP_ERROR_INVALID_PARAM);
+
+    ret = smp_serial_protocol_decoder_set_checksum(ctx->decoder, checksum);
+    if (ret < 0)
+        return ret;
+
+    ctx->checksum = checksum;
+    return 0;
+}
+
+/**
+ * \ingroup context
+ * Enable reliable delivery on this context. Each message is sent with a
+ * sequence number and kept until the peer acknowledges it, lost frames are
+ * retransmitted and received messages are passed to the callback in order and
+ * without duplicates.
+ *
+ * Up to window messages can be waiting for an acknowledgement, after that
+ * smp_context_send_message() returns SMP_ERROR_WOULD_BLOCK. Retransmissions
+ * are made from smp_context_wait_and_process() or, when the application runs
+ * its own event loop, from smp_context_process_timers() called after
+ * smp_context_get_next_timeout(). Both peers have to enable it.
+ *
+ * When the peer restarts, both sides start numbering their messages again
+ * from the first frames exchanged; messages which were waiting for an
+ * acknowledgement are dropped.
+ *
+ * @param[in] ctx the SmpContext
+ * @param[in] window the number of messages in flight, a power of two up to 32
+ *                   or 0 to disable reliable delivery
+ *
+ * @return 0 on success, a SmpError otherwise.
+ */
+int smp_context_enable_reliability(SmpContext *ctx, unsigned int window)
+{
+    int ret;
+
+    return_val_if_fail(ctx != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(window <= SMP_LINK_MAX_WINDOW, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail((window & (window - 1)) == 0, SMP_ERROR_INVALID_PARAM);
+
+    if (ctx->link == NULL) {
+        if (window == 0)
+            return 0;
+
+        ctx->link = smp_link_new();
+        if (ctx->link == NULL)
+            return SMP_ERROR_NO_MEM;
+    }
+
+    ret = smp_link_set_reliable(ctx->link, window);
+    if (ret == 0 && ctx->realtime_size > 0)
+        ret = smp_link_reserve(ctx->link, ctx->realtime_max_message_size);
+    smp_context_release_link(ctx);
+
+    return ret;
+}
+
+/**
+ * \ingroup context
+ * Enable credit based flow control on this context. The receiver grants the
+ * sender a number of message bytes it can send and moves the limit forward as
+ * it processes incoming data, so a peer with small buffers can't be overrun.
  *
- * @param[in] sctx a SmpStaticContext
- * @param[in] struct_size the size of sctx
- * @param[in] cbs callback to use to notify events
- * @param[in] userdata a pointer to userdata which will be passed to callback
- * @param[in] decoder a SmpSerialProtocolDecoder to use with this context
- * @param[in] serial_tx a SmpBuffer to use as serial TX buffer
- * @param[in] msg_tx a SmpBuffer to use as msg TX buffer
- * @param[in] msg_rx a SmpMessage to use for reception
+ * When the peer didn't grant enough credit to send a message,
+ * smp_context_send_message() returns SMP_ERROR_WOULD_BLOCK and asks the peer
+ * for more credit; the message should be sent again after processing incoming
+ * data. A message bigger than the peer window can't be sent: once the peer
+ * granted its window, it is rejected with SMP_ERROR_OVERFLOW, or dropped with
+ * an error notification when it was queued with priorities. Both peers have to
+ * enable it, each with its own window. Flow control needs a clock to send lost
+ * credit requests again, SMP_ERROR_NOT_SUPPORTED is returned on platforms
+ * without one.
  *
- * @return a SmpContext or NULL on error.
+ * @param[in] ctx the SmpContext
+ * @param[in] rx_window the number of message bytes we accept ahead of what we
+ *                      processed, 0 to disable flow control
+ *
+ * @return 0 on success, a SmpError otherwise.
  */
-SmpContext *smp_context_new_from_static(SmpStaticContext *sctx,
-        size_t struct_size, const SmpEventCallbacks *cbs, void *userdata,
-        SmpSerialProtocolDecoder *decoder, SmpBuffer *serial_tx,
-        SmpBuffer *msg_tx, SmpMessage *msg_rx)
+int smp_context_enable_flow_control(SmpContext *ctx, size_t rx_window)
 {
-    SmpContext *ctx = (SmpContext *) sctx;
+    int ret;
 
-    return_val_if_fail(sctx != NULL, NULL);
-    return_val_if_fail(struct_size >= sizeof(SmpContext), NULL);
-    return_val_if_fail(cbs != NULL, NULL);
-    return_val_if_fail(decoder != NULL, NULL);
-    return_val_if_fail(msg_tx != NULL, NULL);
-    return_val_if_fail(serial_tx != NULL, NULL);
-    return_val_if_fail(msg_rx != NULL, NULL);
+    return_val_if_fail(ctx != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(rx_window <= INT32_MAX, SMP_ERROR_INVALID_PARAM);
 
-    smp_context_init(ctx, decoder, cbs, userdata, true);
+    if (ctx->link == NULL) {
+        if (rx_window == 0)
+            return 0;
 
-    ctx->serial_tx = serial_tx;
-    ctx->msg_tx = msg_tx;
-    ctx->msg_rx = msg_rx;
+        ctx->link = smp_link_new();
+        if (ctx->link == NULL)
+            return SMP_ERROR_NO_MEM;
+    }
 
-    return ctx;
+    ret = smp_link_set_flow_control(ctx->link, (uint32_t) rx_window);
+    if (ret == 0 && ctx->realtime_size > 0)
+        ret = smp_link_reserve(ctx->link, ctx->realtime_max_message_size);
+    smp_context_release_link(ctx);
+
+    return ret;
 }
 
 /**
  * \ingroup context
- * Free a SmpContext object.
+ * Send request and call cb when the response arrives or after timeout_ms.
  *
- * It is safe to call this function on a statically allocated context.
+ * A correlation id is sent as an additional uint32 last argument of the
+ * request. The peer answers with smp_context_reply(), which echoes it with its
+ * most significant bit set, along with the id of the request message, in a
+ * uint64 last argument of the response. Any number of calls can be outstanding
+ * and responses can arrive in any order; other messages are never taken for a
+ * response unless they end with the same uint64.
+ * Responses are passed to cb instead of the new_message_cb callback, without
+ * the correlation id. Timeouts are handled by smp_context_wait_and_process()
+ * or smp_context_process_timers().
  *
  * @param[in] ctx the SmpContext
+ * @param[in] request the SmpMessage to send, which is left unchanged
+ * @param[in] timeout_ms a timeout in milliseconds. A negative value means no
+ *                       timeout. Timeouts need a clock, SMP_ERROR_NOT_SUPPORTED
+ *                       is returned on platforms without one
+ * @param[in] cb the completion callback
+ * @param[in] userdata a pointer to userdata which will be passed to cb
+ *
+ * @return 0 on success, a SmpError otherwise in which case cb won't be called.
  */
-void smp_context_free(SmpContext *ctx)
+int smp_context_call(SmpContext *ctx, SmpMessage *request, int timeout_ms,
+        SmpCallCompletionFunc cb, void *userdata)
 {
-    return_if_fail(ctx != NULL);
+    uint64_t deadline = 0;
+    SmpValue value;
+    SmpCall call;
+    uint32_t id;
+    int ret;
 
-    if (ctx->statically_allocated)
-        return;
+    return_val_if_fail(ctx != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(request != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(cb != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(ctx->opened, SMP_ERROR_BAD_FD);
 
-    smp_serial_protocol_decoder_free(ctx->decoder);
-    free(ctx);
+    /* timeouts can't expire without a clock */
+    if (timeout_ms >= 0 && smp_clock_get_time_ns() == 0)
+        return SMP_ERROR_NOT_SUPPORTED;
+
+    if (ctx->calls == NULL) {
+        /* real-time contexts have their calls allocated upfront */
+        if (ctx->realtime_size > 0)
+            return SMP_ERROR_NOT_SUPPORTED;
+
+        ctx->calls = smp_call_table_new();
+        if (ctx->calls == NULL)
+            return SMP_ERROR_NO_MEM;
+    }
+
+    if (timeout_ms >= 0) {
+        deadline = smp_clock_get_time_ns()
+            + (uint64_t) timeout_ms * SMP_NSEC_PER_MSEC;
+    }
+
+    ret = smp_call_table_add(ctx->calls, smp_message_get_msgid(request), cb,
+            userdata, deadline, &id);
+    if (ret < 0)
+        return ret;
+
+    value.type = SMP_TYPE_UINT32;
+    value.value.u32 = id;
+    ret = smp_context_send_message_with_id(ctx, request, &value);
+    if (ret < 0)
+        smp_call_table_take(ctx->calls, id, &call);
+
+    return ret;
 }
 
 /**
  * \ingroup context
- * Open the provided serial device and use it in the given context.
+ * Send response as the answer to request, a message received from a peer
+ * using smp_context_call(). The correlation id of request is appended to
+ * response, which is left unchanged.
  *
  * @param[in] ctx the SmpContext
- * @param[in] device path to the serial device to use
+ * @param[in] request the received request
+ * @param[in] response the SmpMessage to send
  *
  * @return 0 on success, a SmpError otherwise.
  */
-int smp_context_open(SmpContext *ctx, const char *device)
+int smp_context_reply(SmpContext *ctx, SmpMessage *request,
+        SmpMessage *response)
 {
+    SmpValue value;
+    uint32_t id;
     int ret;
+    int n;
 
     return_val_if_fail(ctx != NULL, SMP_ERROR_INVALID_PARAM);
-    return_val_if_fail(device != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(request != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(response != NULL, SMP_ERROR_INVALID_PARAM);
 
-    if (ctx->opened)
-        return SMP_ERROR_BUSY;
+    n = smp_message_n_args(request);
+    if (n < 1)
+        return SMP_ERROR_BAD_MESSAGE;
 
-    ret = smp_serial_device_open(&ctx->device, device);
-    if (ret < 0)
-        return ret;
+    ret = smp_message_get_uint32(request, n - 1, &id);
+    if (ret < 0 || (id & SMP_CALL_RESPONSE_FLAG))
+        return SMP_ERROR_BAD_MESSAGE;
 
-    ctx->opened = true;
-    return 0;
+    value.type = SMP_TYPE_UINT64;
+    value.value.u64 = ((uint64_t) smp_message_get_msgid(request) << 32)
+        | id | SMP_CALL_RESPONSE_FLAG;
+    return smp_context_send_message_with_id(ctx, response, &value);
+}
+
+/**
+ * \ingroup context
+ * Get the current time of the monotonic clock used to timestamp received
+ * messages, see smp_message_get_rx_timestamp().
+ *
+ * @return the time in nanoseconds, 0 if the platform has no clock.
+ */
+uint64_t smp_context_get_time_ns(void)
+{
+    return smp_clock_get_time_ns();
 }
 
 /**
  * \ingroup context
- * Close the context, releasing the attached serial device.
+ * Get the time until the next timer expires, to be used as timeout by
+ * applications waiting on smp_context_get_fd() themselves.
  *
  * @param[in] ctx the SmpContext
+ *
+ * @return the timeout in milliseconds, 0 if a timer already expired or -1 if
+ * there is no pending timer.
  */
-void smp_context_close(SmpContext *ctx)
+int smp_context_get_next_timeout(SmpContext *ctx)
 {
-    return_if_fail(ctx != NULL);
+    uint64_t deadline;
+    uint64_t now;
 
-    if (!ctx->opened)
-        return;
+    return_val_if_fail(ctx != NULL, -1);
 
-    smp_serial_device_close(&ctx->device);
-    ctx->opened = false;
+    /* data left by a processing budget */
+    if (smp_context_has_pending_input(ctx))
+        return 0;
+
+    deadline = smp_context_get_next_deadline(ctx);
+    if (deadline == 0)
+        return -1;
+
+    now = smp_clock_get_time_ns();
+    if (deadline <= now)
+        return 0;
+
+    /* round up so we don't wake up just before the deadline */
+    return (int) ((deadline - now + SMP_NSEC_PER_MSEC - 1) / SMP_NSEC_PER_MSEC);
 }
 
 /**
  * \ingroup context
- * Set serial device config. Depending on the system, it could be not
- * implemented.
+ * Process expired timers: retransmit unacknowledged frames, complete timed out
+ * calls, send the scheduled messages whose time has come and write the frames
+ * held back by pacing or left by the device. Every timer is processed even
+ * when one of them fails.
  *
  * @param[in] ctx the SmpContext
- * @param[in] baudrate the baudrate
- * @param[in] parity the parity configuration
- * @param[in] flow_control 1 to enable flow control, 0 to disable
  *
- * @return 0 on success, a SmpError otherwise.
+ * @return 0 on success, the first SmpError otherwise.
  */
-int smp_context_set_serial_config(SmpContext *ctx, SmpSerialBaudrate baudrate,
-        SmpSerialParity parity, int flow_control)
+int smp_context_process_timers(SmpContext *ctx)
 {
+    uint64_t now;
+    SmpCall call;
+    bool nested;
+    int ret = 0;
+    int tx_ret;
+
     return_val_if_fail(ctx != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(ctx->opened, SMP_ERROR_BAD_FD);
+
+    nested = smp_context_begin_processing(ctx);
+    now = smp_clock_get_time_ns();
+
+    if (ctx->link != NULL)
+        ret = smp_link_process_timers(ctx->link, ctx, now);
+
+    /* the callback may make new calls so take them one at a time */
+    while (ctx->calls != NULL
+            && smp_call_table_take_expired(ctx->calls, now, &call))
+        call.cb(ctx, NULL, SMP_ERROR_TIMEDOUT, call.userdata);
+
+    /* a link failure doesn't delay the scheduled and paced writes */
+    tx_ret = smp_context_send_scheduled(ctx);
+    if (ret == 0)
+        ret = tx_ret;
+
+    /* write what the device didn't take and go on with queued messages */
+    tx_ret = smp_context_schedule_tx(ctx);
+    if (ret == 0)
+        ret = tx_ret;
 
-    return smp_serial_device_set_config(&ctx->device, baudrate, parity,
-            flow_control);
+    return smp_context_end_processing(ctx, nested, ret);
 }
 
 /**
  * \ingroup context
- * Get the file descriptor of the opened serial device.
+ * Get the context statistics. Counters are updated without locking by the
+ * thread processing the context and can be read from any thread.
  *
  * @param[in] ctx the SmpContext
+ * @param[out] stats the SmpContextStats to fill
  *
- * @return the fd (or a handle on Win32) on success, a SmpError otherwise.
+ * @return 0 on success, a SmpError otherwise.
  */
-intptr_t smp_context_get_fd(SmpContext *ctx)
+int smp_context_get_stats(SmpContext *ctx, SmpContextStats *stats)
 {
+    SmpSerialProtocolDecoder *decoder;
+
     return_val_if_fail(ctx != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(stats != NULL, SMP_ERROR_INVALID_PARAM);
+
+    decoder = ctx->decoder;
+
+    stats->rx_bytes = SMP_STATS_LOAD(ctx->stats.rx_bytes);
+    stats->rx_frames = SMP_STATS_LOAD(ctx->stats.rx_frames);
+    stats->tx_bytes = SMP_STATS_LOAD(ctx->stats.tx_bytes);
+    stats->tx_frames = SMP_STATS_LOAD(ctx->stats.tx_frames);
+    stats->checksum_errors = SMP_STATS_LOAD(decoder->n_checksum_errors);
+    stats->resyncs = SMP_STATS_LOAD(decoder->n_resyncs);
+    stats->oversize_frames = SMP_STATS_LOAD(decoder->n_oversize_frames);
+    stats->decoder_reallocs = SMP_STATS_LOAD(decoder->n_reallocs);
+    stats->short_writes = SMP_STATS_LOAD(ctx->stats.short_writes);
+    stats->callback_time_ns = SMP_STATS_LOAD(ctx->stats.callback_time_ns);
+    stats->busy_poll_hits = SMP_STATS_LOAD(ctx->stats.busy_poll_hits);
+    stats->busy_poll_misses = SMP_STATS_LOAD(ctx->stats.busy_poll_misses);
+    stats->tx_conflated = SMP_STATS_LOAD(ctx->stats.tx_conflated);
+    stats->rx_conflated = SMP_STATS_LOAD(ctx->stats.rx_conflated);
+    stats->tx_paced = SMP_STATS_LOAD(ctx->stats.tx_paced);
+    stats->tx_scheduled = SMP_STATS_LOAD(ctx->stats.tx_scheduled);
+    stats->tx_schedule_delay_ns =
+        SMP_STATS_LOAD(ctx->stats.tx_schedule_delay_ns);
+    stats->tx_schedule_max_delay_ns =
+        SMP_STATS_LOAD(ctx->stats.tx_schedule_max_delay_ns);
+    stats->tx_zerocopy = SMP_STATS_LOAD(ctx->stats.tx_zerocopy);
 
-    return smp_serial_device_get_fd(&ctx->device);
+    return 0;
 }
 
 /**
- * Send a message using the specified context.
+ * \ingroup context
+ * Get statistics for each message id sent or received. The number of message
+ * ids tracked is set at build time, it is disabled for statically allocated
+ * contexts.
  *
  * @param[in] ctx the SmpContext
- * @param[in] msg the SmpMessage to send
+ * @param[out] stats an array of SmpMessageStats to fill
+ * @param[in] n_stats the number of elements in stats
  *
- * @return 0 on success, a SmpError otherwise.
+ * @return the number of elements filled on success, a SmpError otherwise.
  */
-int smp_context_send_message(SmpContext *ctx, SmpMessage *msg)
+ssize_t smp_context_get_message_stats(SmpContext *ctx, SmpMessageStats *stats,
+        size_t n_stats)
 {
-    SmpBuffer *msgbuf;
-    size_t msgsize;
-    uint8_t *serial_buf = NULL;
-    size_t serial_bufsize = 0;
-    ssize_t encoded_size;
-    ssize_t wbytes;
-    ssize_t ret;
+    size_t n = 0;
+    size_t i;
 
     return_val_if_fail(ctx != NULL, SMP_ERROR_INVALID_PARAM);
-    return_val_if_fail(msg != NULL, SMP_ERROR_INVALID_PARAM);
-    return_val_if_fail(ctx->opened, SMP_ERROR_BAD_FD);
+    return_val_if_fail(stats != NULL || n_stats == 0, SMP_ERROR_INVALID_PARAM);
 
-    /* step 1: encode the message */
-    msgbuf = ctx->msg_tx;
-    msgsize = smp_message_get_encoded_size(msg);
-
-    if (msgbuf == NULL) {
-        /* no user provided buffer, alloc */
-        msgbuf = smp_buffer_new_allocate(msgsize);
-        if (msgbuf == NULL)
-            return SMP_ERROR_NO_MEM;
-    } else if (msgbuf->maxsize < msgsize) {
-        /* check size */
-        return SMP_ERROR_OVERFLOW;
-    }
-
-    encoded_size = smp_message_encode(msg, msgbuf->data, msgbuf->maxsize);
-    if (encoded_size < 0) {
-        ret = encoded_size;
-        goto done;
-    }
+    if (ctx->msg_stats == NULL)
+        return SMP_ERROR_NOT_SUPPORTED;
 
-    /* step 2: encode the message for the serial */
-    if (ctx->serial_tx != NULL) {
-        serial_buf = ctx->serial_tx->data;
-        serial_bufsize = ctx->serial_tx->maxsize;
-    }
+    for (i = 0; i < SMP_CONTEXT_MESSAGE_STATS_SIZE && n < n_stats; i++) {
+        SmpMessageStats *entry = &ctx->msg_stats[i];
+        SmpMessageStats *out = &stats[n];
 
-    encoded_size = smp_serial_protocol_encode(msgbuf->data, encoded_size,
-            &serial_buf, serial_bufsize);
-    if (encoded_size < 0) {
-        ret = encoded_size;
-        goto done;
-    }
+        out->rx_messages = SMP_STATS_LOAD(entry->rx_messages);
+        out->tx_messages = SMP_STATS_LOAD(entry->tx_messages);
+        if (out->rx_messages == 0 && out->tx_messages == 0)
+            continue;
 
-    /* step 3: send it over the serial */
-    wbytes = smp_serial_device_write(&ctx->device, serial_buf, encoded_size);
-    if (wbytes < 0) {
-        ret = wbytes;
-        goto done;
-    } else if (wbytes != encoded_size) {
-        ret = SMP_ERROR_IO;
-        goto done;
+        out->msgid = SMP_STATS_LOAD(entry->msgid);
+        out->rx_bytes = SMP_STATS_LOAD(entry->rx_bytes);
+        out->tx_bytes = SMP_STATS_LOAD(entry->tx_bytes);
+        n++;
     }
 
-    ret = 0;
+    return (ssize_t) n;
+}
 
-done:
-    if (ctx->msg_tx == NULL) {
-        /* we have allocated buffer so free it */
-        smp_buffer_free(msgbuf);
-    }
+/**
+ * \ingroup context
+ * Reset the context statistics. It should be called from the thread
+ * processing the context.
+ *
+ * @param[in] ctx the SmpContext
+ */
+void smp_context_reset_stats(SmpContext *ctx)
+{
+    return_if_fail(ctx != NULL);
 
-    if (ctx->serial_tx == NULL) {
-        /* we have allocated buffer so free it */
-        free(serial_buf);
+    memset(&ctx->stats, 0, sizeof(ctx->stats));
+    if (ctx->msg_stats != NULL) {
+        memset(ctx->msg_stats, 0,
+                SMP_CONTEXT_MESSAGE_STATS_SIZE * sizeof(*ctx->msg_stats));
     }
 
-    return (int) ret;
+    smp_serial_protocol_decoder_reset_stats(ctx->decoder);
 }
 
 /**
  * \ingroup context
- * Process incoming data on the serial file descriptor.
- * Decoded frame or errors during decoding are passed to their respective
- * callbacks.
+ * Record the duration of each stage of the receive and send paths (device
+ * read, frame decoding, message building, user callback, message and frame
+ * encoding, device write) in a ring of n_events events, keeping the most
+ * recent ones. Timestamps come from the CPU cycle counter when available.
+ *
+ * Tracing is only available when libsmp is built with the tracing option,
+ * otherwise trace points are compiled out and this function returns
+ * SMP_ERROR_NOT_SUPPORTED.
  *
  * @param[in] ctx the SmpContext
+ * @param[in] n_events the number of events to keep, rounded up to a power of
+ *                     two, or 0 to disable tracing
  *
  * @return 0 on success, a SmpError otherwise.
  */
-int smp_context_process_fd(SmpContext *ctx)
+int smp_context_enable_tracing(SmpContext *ctx, size_t n_events)
 {
-    static char chunk[SMP_CONTEXT_PROCESS_CHUNK_SIZE];
-
     return_val_if_fail(ctx != NULL, SMP_ERROR_INVALID_PARAM);
-    return_val_if_fail(ctx->opened, SMP_ERROR_BAD_FD);
 
-    while (1) {
-        ssize_t rbytes;
-        uint8_t *frame;
-        size_t framesize;
-        int ret;
-
-        rbytes = smp_serial_device_read(&ctx->device, chunk,
-                SMP_CONTEXT_PROCESS_CHUNK_SIZE);
-        if (rbytes < 0) {
-            if (rbytes == SMP_ERROR_WOULD_BLOCK)
-                return 0;
+#ifdef SMP_ENABLE_TRACE
+    if (ctx->trace != NULL) {
+        smp_trace_free(ctx->trace);
+        ctx->trace = NULL;
+    }
 
-            return (int) rbytes;
-        } else if (rbytes == 0) {
-            return 0;
-        }
+    if (n_events == 0)
+        return 0;
 
-        ssize_t i;
-        for (i = 0; i < rbytes; i++) {
-            ret = smp_serial_protocol_decoder_process_byte(ctx->decoder,
-                    chunk[i], &frame, &framesize);
-            if (ret < 0)
-                smp_context_notify_error(ctx, ret);
+    ctx->trace = smp_trace_new(n_events);
+    if (ctx->trace == NULL)
+        return SMP_ERROR_NO_MEM;
 
-            if (frame != NULL)
-                smp_context_process_serial_frame(ctx, frame, framesize);
-        }
-    }
+    return 0;
+#else
+    (void) n_events;
+    return SMP_ERROR_NOT_SUPPORTED;
+#endif
 }
 
 /**
  * \ingroup context
- * Wait for an event on the serial and process it.
+ * Write the recorded trace events to a file in the Chrome trace event format,
+ * which can be loaded in chrome://tracing or Perfetto. It can be called from
+ * another thread than the one processing the context.
  *
  * @param[in] ctx the SmpContext
- * @param[in] timeout_ms a timeout in milliseconds. A negative value means no
- *                       timeout
+ * @param[in] path the path of the file to write
  *
  * @return 0 on success, a SmpError otherwise.
  */
-int smp_context_wait_and_process(SmpContext *ctx, int timeout_ms)
+int smp_context_write_trace(SmpContext *ctx, const char *path)
 {
-    int ret;
+    return_val_if_fail(ctx != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(path != NULL, SMP_ERROR_INVALID_PARAM);
+
+#ifdef SMP_ENABLE_TRACE
+    if (ctx->trace == NULL)
+        return SMP_ERROR_INVALID_PARAM;
 
+    return smp_trace_write_chrome_json(ctx->trace, path);
+#else
+    return SMP_ERROR_NOT_SUPPORTED;
+#endif
+}
+
+/**
+ * \ingroup context
+ * Record the traffic of the serial device to a capture file: every chunk of
+ * bytes read or written is appended with its direction and a monotonic
+ * timestamp. The capture can be replayed with smp_context_replay_capture().
+ *
+ * Captures are only available on platforms with file support, otherwise
+ * this function returns SMP_ERROR_NOT_SUPPORTED.
+ *
+ * @param[in] ctx the SmpContext
+ * @param[in] path the capture file, records are appended if it exists
+ *
+ * @return 0 on success, a SmpError otherwise.
+ */
+int smp_context_start_capture(SmpContext *ctx, const char *path)
+{
     return_val_if_fail(ctx != NULL, SMP_ERROR_INVALID_PARAM);
-    return_val_if_fail(ctx->opened, SMP_ERROR_BAD_FD);
+    return_val_if_fail(path != NULL, SMP_ERROR_INVALID_PARAM);
 
-    ret = smp_serial_device_wait(&ctx->device, timeout_ms);
-    if (ret == 0)
-        ret = smp_context_process_fd(ctx);
+#ifdef SMP_ENABLE_CAPTURE
+    if (ctx->capture != NULL)
+        return SMP_ERROR_BUSY;
 
-    return ret;
+    ctx->capture = smp_capture_new(path);
+    if (ctx->capture == NULL)
+        return SMP_ERROR_IO;
+
+    return 0;
+#else
+    return SMP_ERROR_NOT_SUPPORTED;
+#endif
 }
 
 /**
  * \ingroup context
- * Set decoder buffer maximum capacity. This value is used as a limit when
- * reallocating memory for the decoder. If the value is lower than the current
- * capacity, the buffer won't be reallocated
+ * Stop recording the traffic and close the capture file. It is called when
+ * the context is closed.
  *
  * @param[in] ctx the SmpContext
- * @param[in] max the maximum buffer capacity in bytes
+ */
+void smp_context_stop_capture(SmpContext *ctx)
+{
+    return_if_fail(ctx != NULL);
+
+#ifdef SMP_ENABLE_CAPTURE
+    if (ctx->capture != NULL) {
+        smp_capture_free(ctx->capture);
+        ctx->capture = NULL;
+    }
+#endif
+}
+
+/**
+ * \ingroup context
+ * Feed the received data of a capture file to the context decoder, as if it
+ * was read from the device: messages and errors are passed to the callbacks.
+ * Transmitted data is skipped. The context doesn't need to be opened, but
+ * nothing can be sent while replaying.
+ *
+ * In real time, data is decoded with the timing it was recorded with and
+ * messages are timestamped with the current time. Otherwise the capture is
+ * decoded as fast as possible and messages keep their recorded timestamps,
+ * which makes replays deterministic.
+ *
+ * Messages with RX conflation are held as when processing incoming data,
+ * until the end of each record in real time, or until the end of the capture
+ * otherwise. The link layer doesn't answer the replayed frames.
+ *
+ * @param[in] ctx the SmpContext
+ * @param[in] path the capture file
+ * @param[in] realtime true to replay at the recorded timing
  *
  * @return 0 on success, a SmpError otherwise.
  */
-int smp_context_set_decoder_maximum_capacity(SmpContext *ctx, size_t max)
+int smp_context_replay_capture(SmpContext *ctx, const char *path,
+        bool realtime)
 {
+#ifdef SMP_ENABLE_CAPTURE
+    SmpCaptureReader reader;
+    SmpCaptureRecord record;
+    uint64_t origin = 0;
+    uint64_t start = 0;
+    bool nested;
+    int ret;
+#endif
+
     return_val_if_fail(ctx != NULL, SMP_ERROR_INVALID_PARAM);
-    return_val_if_fail(max > 16, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(path != NULL, SMP_ERROR_INVALID_PARAM);
 
-    return smp_serial_protocol_decoder_set_maximum_capacity(ctx->decoder, max);
+#ifdef SMP_ENABLE_CAPTURE
+    ret = smp_capture_reader_open(&reader, path);
+    if (ret < 0)
+        return ret;
+
+    /* the link layer answers received frames when it is flushed after
+     * processing, which a replay never does */
+    nested = smp_context_begin_processing(ctx);
+
+    while ((ret = smp_capture_reader_next(&reader, &record)) > 0) {
+        uint64_t time = record.time;
+
+        if (record.direction != SMP_CAPTURE_DIRECTION_RX)
+            continue;
+
+        if (realtime) {
+            if (start == 0) {
+                origin = record.time;
+                start = smp_clock_get_time_ns();
+            }
+
+            smp_clock_sleep_until(start + (record.time - origin));
+            time = smp_clock_get_time_ns();
+        }
+
+        smp_context_process_data(ctx, record.data, record.size, time, 0, NULL);
+        if (realtime)
+            smp_context_deliver_conflated(ctx);
+    }
+
+    smp_capture_reader_close(&reader);
+    smp_context_deliver_conflated(ctx);
+
+    /* only what the callbacks sent is left to flush */
+    if (ctx->opened)
+        return smp_context_end_processing(ctx, nested, ret);
+
+    if (!nested)
+        ctx->processing = false;
+
+    return ret;
+#else
+    (void) realtime;
+    return SMP_ERROR_NOT_SUPPORTED;
+#endif
 }
@@ -22,7 +22,15 @@
 
 #include <stdbool.h>
 
+#include "call.h"
+#include "capture.h"
+#include "conflation.h"
+#include "link.h"
+#include "schedule.h"
+#include "send-queue.h"
 #include "serial-protocol.h"
+#include "trace.h"
+#include "tx-scheduler.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -32,18 +40,67 @@ struct SmpContext
 {
     SmpSerialProtocolDecoder *decoder;
     SmpSerialDevice device;
+    SmpTransport *transport;    /* NULL to use device */
 
     SmpEventCallbacks cbs;
     void *userdata;
+    SmpFrameFunc frame_cb;
+    void *frame_userdata;
 
     bool opened;
+    bool processing;            /* writes are flushed once processing ends */
+    uint64_t busy_poll_ns;      /* 0 to always sleep while waiting */
+    bool busy_poll_pause;
+    SmpSerialChecksum checksum;
+    SmpLink *link;
+    SmpCallTable *calls;
+    SmpSendQueue *send_queue;   /* messages queued by other threads */
+    SmpTxScheduler *tx_sched;   /* NULL to send messages in call order */
+    SmpConflationTable *conflation;
+    SmpScheduleTable *schedule;
+
+    /* TX pacing, the device queue is estimated from the bytes written and the
+     * time one byte takes on the line when the device can't report it */
+    size_t tx_pacing_max;       /* 0 to write as long as the device takes it */
+    uint64_t tx_byte_ns;        /* 0 if the baudrate is unknown */
+    uint64_t tx_drain_time;     /* when the written bytes will be sent */
+    uint64_t tx_pacing_deadline;
+
+    /* decoder counters are kept in the decoder */
+    SmpContextStats stats;
+    SmpMessageStats *msg_stats;
+    SmpTrace *trace;
+
+    /* data read from the device, processed up to rx_chunk_offset when a
+     * processing budget ran out */
+    uint8_t rx_chunk[SMP_CONTEXT_PROCESS_CHUNK_SIZE];
+    size_t rx_chunk_size;
+    size_t rx_chunk_offset;
+    uint64_t rx_chunk_time;
+
+    /* reception times of the frame being delivered */
+    uint64_t rx_start_time;
+    uint64_t rx_end_time;
+
+    SmpCapture *capture;
 
     bool statically_allocated;
+    /* a real-time context and its buffers are a single block */
+    size_t realtime_size;       /* 0 for other contexts */
+    size_t realtime_max_message_size;
+    bool realtime_locked;
     SmpBuffer *msg_tx;
     SmpBuffer *serial_tx;
     SmpMessage *msg_rx;
 };
 
+/* used by the link layer */
+int smp_context_write_payload(SmpContext *ctx, const uint8_t *payload,
+        size_t size);
+void smp_context_deliver_payload(SmpContext *ctx, const uint8_t *payload,
+        size_t size);
+void smp_context_notify_error(SmpContext *ctx, SmpError err);
+
 #ifdef __cplusplus
 }
 #endif
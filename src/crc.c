@@ -0,0 +1,248 @@
+/* libsmp
+ * Copyright (C) 2026 Actronika SAS
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "config.h"
+
+#include "crc.h"
+
+#include <string.h>
+
+#ifdef __AVR
+#include <avr/pgmspace.h>
+#else
+#include "crc-tables.h"
+#endif
+
+#ifdef HAVE_SSE42_CRC32
+#include <nmmintrin.h>
+#endif
+
+#ifdef HAVE_ARMV8_CRC32
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+#ifdef __AVR
+/* On AVR, we can't afford kilobytes of tables so use 16 entries tables and
+ * process the data one nibble at a time. */
+static const uint16_t crc16_ccitt_nibble_table[16] PROGMEM = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+    0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+};
+
+static const uint32_t crc32c_nibble_table[16] PROGMEM = {
+    0x00000000, 0x105ec76f, 0x20bd8ede, 0x30e349b1,
+    0x417b1dbc, 0x5125dad3, 0x61c69362, 0x7198540d,
+    0x82f63b78, 0x92a8fc17, 0xa24bb5a6, 0xb21572c9,
+    0xc38d26c4, 0xd3d3e1ab, 0xe330a81a, 0xf36e6f75,
+};
+
+uint16_t smp_crc16_ccitt_update_byte(uint16_t crc, uint8_t byte)
+{
+    crc = (crc << 4) ^ pgm_read_word(&crc16_ccitt_nibble_table[
+            ((crc >> 12) ^ (byte >> 4)) & 0x0f]);
+    crc = (crc << 4) ^ pgm_read_word(&crc16_ccitt_nibble_table[
+            ((crc >> 12) ^ byte) & 0x0f]);
+
+    return crc;
+}
+
+uint32_t smp_crc32c_update_byte(uint32_t crc, uint8_t byte)
+{
+    crc = (crc >> 4) ^ pgm_read_dword(&crc32c_nibble_table[(crc ^ byte) & 0x0f]);
+    crc = (crc >> 4) ^ pgm_read_dword(&crc32c_nibble_table[
+            (crc ^ (byte >> 4)) & 0x0f]);
+
+    return crc;
+}
+
+uint16_t smp_crc16_ccitt_update(uint16_t crc, const uint8_t *buf, size_t size)
+{
+    size_t i;
+
+    for (i = 0; i < size; i++)
+        crc = smp_crc16_ccitt_update_byte(crc, buf[i]);
+
+    return crc;
+}
+
+uint32_t smp_crc32c_update(uint32_t crc, const uint8_t *buf, size_t size)
+{
+    size_t i;
+
+    for (i = 0; i < size; i++)
+        crc = smp_crc32c_update_byte(crc, buf[i]);
+
+    return crc;
+}
+
+#else /* __AVR */
+
+uint16_t smp_crc16_ccitt_update_byte(uint16_t crc, uint8_t byte)
+{
+    return (uint16_t) (crc << 8) ^ crc16_ccitt_table[0][(crc >> 8) ^ byte];
+}
+
+uint32_t smp_crc32c_update_byte(uint32_t crc, uint8_t byte)
+{
+    return (crc >> 8) ^ crc32c_table[0][(crc ^ byte) & 0xff];
+}
+
+/* slicing-by-8: table k holds the contribution of a byte followed by k zero
+ * bytes so we can fold 8 bytes per iteration */
+uint16_t smp_crc16_ccitt_update(uint16_t crc, const uint8_t *buf, size_t size)
+{
+    while (size >= 8) {
+        crc = crc16_ccitt_table[7][(crc >> 8) ^ buf[0]]
+            ^ crc16_ccitt_table[6][(crc & 0xff) ^ buf[1]]
+            ^ crc16_ccitt_table[5][buf[2]]
+            ^ crc16_ccitt_table[4][buf[3]]
+            ^ crc16_ccitt_table[3][buf[4]]
+            ^ crc16_ccitt_table[2][buf[5]]
+            ^ crc16_ccitt_table[1][buf[6]]
+            ^ crc16_ccitt_table[0][buf[7]];
+
+        buf += 8;
+        size -= 8;
+    }
+
+    while (size--)
+        crc = smp_crc16_ccitt_update_byte(crc, *buf++);
+
+    return crc;
+}
+
+static uint32_t crc32c_update_sliced(uint32_t crc, const uint8_t *buf,
+        size_t size)
+{
+    while (size >= 8) {
+        uint32_t lo = crc ^ ((uint32_t) buf[0] | ((uint32_t) buf[1] << 8)
+                | ((uint32_t) buf[2] << 16) | ((uint32_t) buf[3] << 24));
+
+        crc = crc32c_table[7][lo & 0xff]
+            ^ crc32c_table[6][(lo >> 8) & 0xff]
+            ^ crc32c_table[5][(lo >> 16) & 0xff]
+            ^ crc32c_table[4][lo >> 24]
+            ^ crc32c_table[3][buf[4]]
+            ^ crc32c_table[2][buf[5]]
+            ^ crc32c_table[1][buf[6]]
+            ^ crc32c_table[0][buf[7]];
+
+        buf += 8;
+        size -= 8;
+    }
+
+    while (size--)
+        crc = smp_crc32c_update_byte(crc, *buf++);
+
+    return crc;
+}
+
+#ifdef HAVE_SSE42_CRC32
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_update_sse42(uint32_t crc, const uint8_t *buf,
+        size_t size)
+{
+#ifdef __x86_64__
+    uint64_t crc64 = crc;
+
+    while (size >= 8) {
+        uint64_t v;
+
+        memcpy(&v, buf, sizeof(v));
+        crc64 = _mm_crc32_u64(crc64, v);
+        buf += 8;
+        size -= 8;
+    }
+
+    crc = (uint32_t) crc64;
+#endif
+
+    while (size >= 4) {
+        uint32_t v;
+
+        memcpy(&v, buf, sizeof(v));
+        crc = _mm_crc32_u32(crc, v);
+        buf += 4;
+        size -= 4;
+    }
+
+    while (size--)
+        crc = _mm_crc32_u8(crc, *buf++);
+
+    return crc;
+}
+#endif
+
+#ifdef HAVE_ARMV8_CRC32
+__attribute__((target("+crc")))
+static uint32_t crc32c_update_armv8(uint32_t crc, const uint8_t *buf,
+        size_t size)
+{
+    while (size >= 8) {
+        uint64_t v;
+
+        memcpy(&v, buf, sizeof(v));
+        crc = __crc32cd(crc, v);
+        buf += 8;
+        size -= 8;
+    }
+
+    while (size--)
+        crc = __crc32cb(crc, *buf++);
+
+    return crc;
+}
+#endif
+
+typedef uint32_t (*Crc32cUpdateFunc)(uint32_t crc, const uint8_t *buf,
+        size_t size);
+
+static uint32_t crc32c_update_resolve(uint32_t crc, const uint8_t *buf,
+        size_t size);
+
+/* the resolved implementation is cached on first use. Concurrent resolutions
+ * store the same value so there is no need to lock, the pointer is only
+ * accessed atomically so each thread reads either function. */
+static Crc32cUpdateFunc crc32c_update_func = crc32c_update_resolve;
+
+static uint32_t crc32c_update_resolve(uint32_t crc, const uint8_t *buf,
+        size_t size)
+{
+    Crc32cUpdateFunc func = crc32c_update_sliced;
+
+#if defined(HAVE_SSE42_CRC32)
+    if (__builtin_cpu_supports("sse4.2"))
+        func = crc32c_update_sse42;
+#elif defined(HAVE_ARMV8_CRC32)
+    if (getauxval(AT_HWCAP) & HWCAP_CRC32)
+        func = crc32c_update_armv8;
+#endif
+
+    __atomic_store_n(&crc32c_update_func, func, __ATOMIC_RELAXED);
+    return func(crc, buf, size);
+}
+
+uint32_t smp_crc32c_update(uint32_t crc, const uint8_t *buf, size_t size)
+{
+    Crc32cUpdateFunc func;
+
+    func = __atomic_load_n(&crc32c_update_func, __ATOMIC_RELAXED);
+    return func(crc, buf, size);
+}
+
+#endif /* __AVR */
@@ -0,0 +1,50 @@
+/* libsmp
+ * Copyright (C) 2026 Actronika SAS
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CRC_H
+#define CRC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* CRC-16/CCITT-FALSE: poly 0x1021, init 0xffff, no reflection, no final xor.
+ * Running the CRC over a payload followed by its big endian CRC gives 0. */
+#define SMP_CRC16_CCITT_INIT 0xffff
+#define SMP_CRC16_CCITT_RESIDUE 0x0000
+
+/* CRC-32C (Castagnoli): reflected poly 0x82f63b78, init and final xor
+ * 0xffffffff. The update functions work on the raw register so the caller
+ * has to apply the final xor. Running the CRC over a payload followed by its
+ * little endian CRC leaves the register set to the residue. */
+#define SMP_CRC32C_INIT 0xffffffff
+#define SMP_CRC32C_XOROUT 0xffffffff
+#define SMP_CRC32C_RESIDUE 0xb798b438
+
+uint16_t smp_crc16_ccitt_update_byte(uint16_t crc, uint8_t byte);
+uint16_t smp_crc16_ccitt_update(uint16_t crc, const uint8_t *buf, size_t size);
+
+uint32_t smp_crc32c_update_byte(uint32_t crc, uint8_t byte);
+uint32_t smp_crc32c_update(uint32_t crc, const uint8_t *buf, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
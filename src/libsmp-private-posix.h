@@ -0,0 +1,139 @@
+/* libsmp
+ * Copyright (C) 2026 Actronika SAS
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBSMP_PRIVATE_POSIX_H
+#define LIBSMP_PRIVATE_POSIX_H
+
+#include "config.h"
+
+#include <errno.h>
+#include <sys/uio.h>
+
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+
+#include "libsmp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static inline SmpError errno_to_smp_error(int err)
+{
+    switch (err) {
+        case EINVAL:
+            return SMP_ERROR_INVALID_PARAM;
+        case EBADMSG:
+            return SMP_ERROR_BAD_MESSAGE;
+        case E2BIG:
+            return SMP_ERROR_TOO_BIG;
+        case ENOMEM:
+            return SMP_ERROR_NO_MEM;
+        case ENOENT:
+            return SMP_ERROR_NO_DEVICE;
+        case ETIMEDOUT:
+            return SMP_ERROR_TIMEDOUT;
+        case EBADF:
+            return SMP_ERROR_BAD_FD;
+        case ENOSYS:
+            return SMP_ERROR_NOT_SUPPORTED;
+        case EBUSY:
+            return SMP_ERROR_BUSY;
+        case EPERM:
+            return SMP_ERROR_PERM;
+        case EAGAIN:
+            return SMP_ERROR_WOULD_BLOCK;
+        case EIO:
+            return SMP_ERROR_IO;
+        case EPIPE:
+            return SMP_ERROR_PIPE;
+        default:
+            return SMP_ERROR_OTHER;
+    }
+}
+
+/* wait for fd to be readable, negative timeout_ms means infinite */
+static inline int smp_fd_wait(int fd, int timeout_ms)
+{
+#ifdef HAVE_POLL_H
+    struct pollfd pfd;
+    int ret;
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    ret = poll(&pfd, 1, timeout_ms);
+    if (ret < 0)
+        return errno_to_smp_error(errno);
+    else if (ret == 0)
+        return SMP_ERROR_TIMEDOUT;
+
+    if (pfd.revents & POLLERR) {
+        /* we have an error on the fd, assume that it has been disconnected */
+        return SMP_ERROR_PIPE;
+    }
+
+    return 0;
+
+#else
+    return SMP_ERROR_NOT_SUPPORTED;
+#endif
+}
+
+#define SMP_FD_IOV_BATCH 64
+
+/* write the buffers to fd, stops at the first short write */
+static inline ssize_t smp_fd_writev(int fd, const SmpIoVec *iov, int iovcnt)
+{
+    ssize_t total = 0;
+
+    while (iovcnt > 0) {
+        struct iovec vecs[SMP_FD_IOV_BATCH];
+        size_t expected = 0;
+        ssize_t ret;
+        int n;
+        int i;
+
+        n = (iovcnt < SMP_FD_IOV_BATCH) ? iovcnt : SMP_FD_IOV_BATCH;
+        for (i = 0; i < n; i++) {
+            /* writev doesn't modify the buffers */
+            vecs[i].iov_base = (void *) (uintptr_t) iov[i].base;
+            vecs[i].iov_len = iov[i].size;
+            expected += iov[i].size;
+        }
+
+        ret = writev(fd, vecs, n);
+        if (ret < 0)
+            return (total > 0) ? total : errno_to_smp_error(errno);
+
+        total += ret;
+        if ((size_t) ret != expected)
+            break;
+
+        iov += n;
+        iovcnt -= n;
+    }
+
+    return total;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -67,11 +67,17 @@ struct SmpMessage
     SmpValue *values;
     size_t capacity;
 
+    /* reception times of the frame start and end, 0 if not received */
+    uint64_t rx_start_time;
+    uint64_t rx_end_time;
+
     bool statically_allocated;
 };
 
 int smp_message_build_from_buffer(SmpMessage *msg, const uint8_t *buffer,
         size_t size);
+size_t smp_value_compute_size(const SmpValue *value);
+ssize_t smp_message_encode_value(const SmpValue *value, uint8_t *buffer);
 
 #ifdef __cplusplus
 }
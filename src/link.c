@@ -0,0 +1,938 @@
+/* libsmp
+ * Copyright (C) 2026 Actronika SAS
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Link layer: optional per frame header carrying sequence numbers and
+ * acknowledgements used to provide reliable, in order delivery on top of the
+ * serial protocol.
+ *
+ * Each sent message gets a sequence number and is kept in a window slot until
+ * the peer acknowledges it. Acknowledgements are cumulative (next expected
+ * seq) with a bitmap of frames received out of order, and are piggybacked on
+ * every outgoing frame. A pure acknowledgement frame is only sent when there
+ * was nothing to carry it after processing incoming data. Unacknowledged
+ * frames are retransmitted when their timer, derived from the measured round
+ * trip time as in RFC 6298, expires.
+ *
+ * With flow control, the receiver grants the sender a cumulative limit of
+ * message bytes it can send, which moves forward as received messages are
+ * taken out of the device. Each message carries the number of bytes sent
+ * before it so the receiver count stays in sync if frames are lost. A sender
+ * out of credit probes the receiver until it gets a new limit.
+ *
+ * Frames also carry the id of the sender session, picked when its link state
+ * is reset, and the id of the peer session it knows. Sequence numbers and
+ * counters start over with each session. When an established peer shows up
+ * with a new session, it restarted and lost what we sent: our session starts
+ * over too, dropping the messages waiting for an acknowledgement. */
+
+#include "link.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "clock.h"
+#include "context.h"
+
+#define SMP_LINK_INITIAL_RTO (100 * SMP_NSEC_PER_MSEC)
+#define SMP_LINK_MIN_RTO (5 * SMP_NSEC_PER_MSEC)
+#define SMP_LINK_MAX_RTO (2 * SMP_NSEC_PER_SEC)
+
+static inline int16_t seq_diff(uint16_t a, uint16_t b)
+{
+    return (int16_t) (uint16_t) (a - b);
+}
+
+static inline int32_t count_diff(uint32_t a, uint32_t b)
+{
+    return (int32_t) (a - b);
+}
+
+static inline void write_le16(uint8_t *buf, uint16_t value)
+{
+    buf[0] = (uint8_t) value;
+    buf[1] = (uint8_t) (value >> 8);
+}
+
+static inline void write_le32(uint8_t *buf, uint32_t value)
+{
+    buf[0] = (uint8_t) value;
+    buf[1] = (uint8_t) (value >> 8);
+    buf[2] = (uint8_t) (value >> 16);
+    buf[3] = (uint8_t) (value >> 24);
+}
+
+static inline uint16_t read_le16(const uint8_t *buf)
+{
+    return (uint16_t) (buf[0] | (buf[1] << 8));
+}
+
+static inline uint32_t read_le32(const uint8_t *buf)
+{
+    return (uint32_t) buf[0] | ((uint32_t) buf[1] << 8)
+        | ((uint32_t) buf[2] << 16) | ((uint32_t) buf[3] << 24);
+}
+
+static int reserve(uint8_t **data, size_t *capacity, size_t size)
+{
+    uint8_t *new_data;
+
+    if (size <= *capacity)
+        return 0;
+
+    new_data = realloc(*data, size);
+    if (new_data == NULL)
+        return SMP_ERROR_NO_MEM;
+
+    *data = new_data;
+    *capacity = size;
+    return 0;
+}
+
+static void smp_link_reset_flow_control(SmpLink *link)
+{
+    link->tx_sent = 0;
+    link->tx_limit = 0;
+    link->tx_window = 0;
+    link->probe_deadline = 0;
+    link->probe_interval = SMP_LINK_INITIAL_RTO;
+
+    link->rx_received = 0;
+    link->rx_advertised = 0;
+    link->credit_pending = false;
+}
+
+/* a non zero id, different from the previous ones of this process and, as
+ * it depends on the time, of the previous runs */
+static uint16_t smp_link_new_session(void)
+{
+    static uint16_t counter;
+    uint64_t now = smp_clock_get_time_ns();
+    uint16_t session;
+
+    session = (uint16_t) (now ^ (now >> 16) ^ (now >> 32) ^ (now >> 48));
+    session += ++counter;
+    return (session != 0) ? session : 1;
+}
+
+static void smp_link_reset(SmpLink *link)
+{
+    link->session = smp_link_new_session();
+    link->peer_session = 0;
+    link->established = false;
+
+    link->snd_una = 0;
+    link->snd_nxt = 0;
+    link->rcv_nxt = 0;
+    link->ack_pending = false;
+
+    link->srtt = 0;
+    link->rttvar = 0;
+    link->rto = SMP_LINK_INITIAL_RTO;
+    link->have_rtt = false;
+}
+
+static void smp_link_free_slots(SmpLink *link)
+{
+    unsigned int i;
+
+    if (link->tx_slots != NULL) {
+        for (i = 0; i < link->window; i++)
+            free(link->tx_slots[i].data);
+    }
+
+    if (link->rx_slots != NULL) {
+        for (i = 0; i < link->window; i++)
+            free(link->rx_slots[i].data);
+    }
+
+    free(link->tx_slots);
+    free(link->rx_slots);
+    link->tx_slots = NULL;
+    link->rx_slots = NULL;
+}
+
+static uint32_t smp_link_get_sack(SmpLink *link)
+{
+    uint32_t sack = 0;
+    unsigned int i;
+
+    for (i = 0; i + 1 < link->window; i++) {
+        uint16_t seq = (uint16_t) (link->rcv_nxt + 1 + i);
+
+        if (link->rx_slots[seq & (link->window - 1)].used)
+            sack |= (uint32_t) 1 << i;
+    }
+
+    return sack;
+}
+
+static size_t smp_link_get_header_size(uint8_t flags)
+{
+    size_t size = 1;
+
+    if (flags & SMP_LINK_FLAG_SEQ)
+        size += 2;
+    if (flags & SMP_LINK_FLAG_ACK)
+        size += 6;
+    if (flags & SMP_LINK_FLAG_CREDIT)
+        size += 4;
+    if (flags & SMP_LINK_FLAG_OFFSET)
+        size += 4;
+    if (flags & SMP_LINK_FLAG_FRAGMENT)
+        size += 1;
+    if (flags & SMP_LINK_FLAG_SESSION)
+        size += 4;
+
+    return size;
+}
+
+/* flags of frames carrying a message */
+static uint8_t smp_link_get_data_flags(SmpLink *link)
+{
+    uint8_t flags = 0;
+
+    if (link->reliable)
+        flags |= SMP_LINK_FLAG_SEQ | SMP_LINK_FLAG_ACK;
+
+    if (link->flow_control)
+        flags |= SMP_LINK_FLAG_CREDIT | SMP_LINK_FLAG_OFFSET;
+
+    /* sequence numbers and counters are only valid within a session */
+    if (flags != 0)
+        flags |= SMP_LINK_FLAG_SESSION;
+
+    return flags;
+}
+
+/* write the header with our current ack and credit state and return its
+ * size */
+static size_t smp_link_write_header(SmpLink *link, uint8_t *buf, uint8_t flags,
+        uint16_t seq, uint32_t offset, int fragment)
+{
+    size_t i = 1;
+
+    buf[0] = flags;
+
+    if (flags & SMP_LINK_FLAG_SEQ) {
+        write_le16(buf + i, seq);
+        i += 2;
+    }
+
+    if (flags & SMP_LINK_FLAG_ACK) {
+        write_le16(buf + i, link->rcv_nxt);
+        write_le32(buf + i + 2, smp_link_get_sack(link));
+        i += 6;
+
+        /* the peer will get our state with this frame */
+        link->ack_pending = false;
+    }
+
+    if (flags & SMP_LINK_FLAG_CREDIT) {
+        link->rx_advertised = link->rx_received + link->rx_window;
+        write_le32(buf + i, link->rx_advertised);
+        i += 4;
+
+        link->credit_pending = false;
+    }
+
+    if (flags & SMP_LINK_FLAG_OFFSET) {
+        write_le32(buf + i, offset);
+        i += 4;
+    }
+
+    if (flags & SMP_LINK_FLAG_FRAGMENT)
+        buf[i++] = (uint8_t) fragment;
+
+    if (flags & SMP_LINK_FLAG_SESSION) {
+        write_le16(buf + i, link->session);
+        write_le16(buf + i + 2, link->peer_session);
+        i += 4;
+    }
+
+    return i;
+}
+
+/* send a frame without message carrying the given flags and our state */
+static int smp_link_send_control(SmpLink *link, SmpContext *ctx, uint8_t flags)
+{
+    uint8_t buf[SMP_LINK_MAX_HEADER_SIZE];
+    size_t size;
+
+    if (link->reliable)
+        flags |= SMP_LINK_FLAG_ACK;
+
+    if (link->flow_control)
+        flags |= SMP_LINK_FLAG_CREDIT;
+
+    if (link->reliable || link->flow_control)
+        flags |= SMP_LINK_FLAG_SESSION;
+
+    size = smp_link_write_header(link, buf, flags, 0, 0, -1);
+    return smp_context_write_payload(ctx, buf, size);
+}
+
+static void smp_link_update_rtt(SmpLink *link, uint64_t rtt)
+{
+    uint64_t rto;
+
+    if (!link->have_rtt) {
+        link->srtt = rtt;
+        link->rttvar = rtt / 2;
+        link->have_rtt = true;
+    } else {
+        uint64_t delta;
+
+        delta = (link->srtt > rtt) ? link->srtt - rtt : rtt - link->srtt;
+        link->rttvar = (3 * link->rttvar + delta) / 4;
+        link->srtt = (7 * link->srtt + rtt) / 8;
+    }
+
+    rto = link->srtt + 4 * link->rttvar;
+    if (rto < SMP_LINK_MIN_RTO)
+        rto = SMP_LINK_MIN_RTO;
+    else if (rto > SMP_LINK_MAX_RTO)
+        rto = SMP_LINK_MAX_RTO;
+
+    link->rto = rto;
+}
+
+/* slot data starts with room for the data header, rewritten on each
+ * transmission to carry our latest state */
+static int smp_link_transmit_slot(SmpLink *link, SmpContext *ctx,
+        SmpLinkTxSlot *slot, uint64_t now)
+{
+    uint8_t flags = smp_link_get_data_flags(link);
+
+    if (slot->fragment >= 0)
+        flags |= SMP_LINK_FLAG_FRAGMENT;
+
+    smp_link_write_header(link, slot->data, flags, slot->seq, slot->offset,
+            slot->fragment);
+
+    slot->sent_time = now;
+    slot->deadline = now + link->rto;
+
+    return smp_context_write_payload(ctx, slot->data, slot->size);
+}
+
+/* session is the one of the peer, peer_session the one of ours it knows */
+static void smp_link_handle_session(SmpLink *link, uint16_t session,
+        uint16_t peer_session)
+{
+    unsigned int i;
+
+    if (session != link->peer_session) {
+        /* the peer numbers its frames from the start again */
+        link->peer_session = session;
+        link->rcv_nxt = 0;
+        for (i = 0; i < link->window; i++)
+            link->rx_slots[i].used = false;
+        for (i = 0; i < SMP_LINK_FRAGMENT_STREAMS; i++)
+            link->fragments[i].used = false;
+
+        link->rx_received = 0;
+        link->rx_advertised = 0;
+        link->credit_pending = link->flow_control;
+
+        /* let the peer know we follow its session */
+        link->ack_pending = true;
+
+        if (link->established) {
+            /* the peer restarted and lost our frames, start over too */
+            link->session = smp_link_new_session();
+            link->established = false;
+
+            link->snd_una = 0;
+            link->snd_nxt = 0;
+            for (i = 0; i < link->window; i++)
+                link->tx_slots[i].in_flight = false;
+
+            link->tx_sent = 0;
+            link->tx_limit = 0;
+            link->tx_window = 0;
+            link->probe_deadline = 0;
+            link->probe_interval = SMP_LINK_INITIAL_RTO;
+        }
+    }
+
+    if (peer_session == link->session)
+        link->established = true;
+}
+
+static void smp_link_handle_ack(SmpLink *link, SmpContext *ctx, uint16_t ack,
+        uint32_t sack, uint64_t now)
+{
+    SmpLinkTxSlot *hole;
+    unsigned int i;
+
+    /* ignore acks which are stale or for frames we did not send yet */
+    if (seq_diff(ack, link->snd_una) < 0 || seq_diff(ack, link->snd_nxt) > 0)
+        return;
+
+    while (link->snd_una != ack) {
+        SmpLinkTxSlot *slot = &link->tx_slots[link->snd_una
+            & (link->window - 1)];
+
+        /* Karn's algorithm: don't sample retransmitted frames */
+        if (slot->in_flight && !slot->retransmitted && now != 0)
+            smp_link_update_rtt(link, now - slot->sent_time);
+
+        slot->in_flight = false;
+        link->snd_una++;
+    }
+
+    if (sack == 0)
+        return;
+
+    for (i = 0; i + 1 < link->window; i++) {
+        uint16_t seq = (uint16_t) (ack + 1 + i);
+        SmpLinkTxSlot *slot;
+
+        if (!(sack & ((uint32_t) 1 << i)))
+            continue;
+
+        if (seq_diff(seq, link->snd_nxt) >= 0)
+            break;
+
+        slot = &link->tx_slots[seq & (link->window - 1)];
+        if (slot->in_flight && slot->seq == seq)
+            slot->sacked = true;
+    }
+
+    /* the peer received frames after the first unacked one so it is likely
+     * lost, retransmit it without waiting for its timer if it had the time to
+     * be acknowledged */
+    hole = &link->tx_slots[ack & (link->window - 1)];
+    if (hole->in_flight && !hole->sacked && link->have_rtt
+            && now - hole->sent_time >= link->srtt) {
+        hole->retransmitted = true;
+        smp_link_transmit_slot(link, ctx, hole, now);
+    }
+}
+
+/* pass a payload received in order up, once complete if it is a fragment */
+static void smp_link_deliver(SmpLink *link, SmpContext *ctx, int fragment,
+        const uint8_t *payload, size_t size)
+{
+    SmpLinkRxSlot *slot;
+
+    if (fragment < 0) {
+        smp_context_deliver_payload(ctx, payload, size);
+        return;
+    }
+
+    slot = &link->fragments[fragment & SMP_LINK_FRAGMENT_STREAM_MASK];
+    if (fragment & SMP_LINK_FRAGMENT_FIRST) {
+        slot->size = 0;
+        slot->start_time = ctx->rx_start_time;
+        slot->used = true;
+    } else if (!slot->used) {
+        /* the beginning of the message was lost */
+        return;
+    }
+
+    if (reserve(&slot->data, &slot->capacity, slot->size + size) < 0) {
+        smp_context_notify_error(ctx, SMP_ERROR_NO_MEM);
+        slot->used = false;
+        return;
+    }
+
+    memcpy(slot->data + slot->size, payload, size);
+    slot->size += size;
+
+    if (!(fragment & SMP_LINK_FRAGMENT_LAST))
+        return;
+
+    slot->used = false;
+    ctx->rx_start_time = slot->start_time;
+    smp_context_deliver_payload(ctx, slot->data, slot->size);
+}
+
+static void smp_link_handle_data(SmpLink *link, SmpContext *ctx, uint16_t seq,
+        int fragment, const uint8_t *payload, size_t size)
+{
+    int16_t d = seq_diff(seq, link->rcv_nxt);
+    SmpLinkRxSlot *slot;
+
+    /* always answer, even to duplicates as our previous ack may be lost */
+    link->ack_pending = true;
+
+    if (d < 0 || (unsigned int) d >= link->window) {
+        /* duplicate or out of the window */
+        return;
+    }
+
+    if (d > 0) {
+        /* out of order, keep it until the missing frames arrive */
+        slot = &link->rx_slots[seq & (link->window - 1)];
+        if (slot->used)
+            return;
+
+        if (reserve(&slot->data, &slot->capacity, size) < 0) {
+            smp_context_notify_error(ctx, SMP_ERROR_NO_MEM);
+            return;
+        }
+
+        memcpy(slot->data, payload, size);
+        slot->size = size;
+        slot->start_time = ctx->rx_start_time;
+        slot->end_time = ctx->rx_end_time;
+        slot->fragment = fragment;
+        slot->used = true;
+        return;
+    }
+
+    link->rcv_nxt++;
+    smp_link_deliver(link, ctx, fragment, payload, size);
+
+    /* deliver frames that were waiting for this one */
+    while (1) {
+        slot = &link->rx_slots[link->rcv_nxt & (link->window - 1)];
+        if (!slot->used)
+            break;
+
+        link->rcv_nxt++;
+        ctx->rx_start_time = slot->start_time;
+        ctx->rx_end_time = slot->end_time;
+        slot->used = false;
+        smp_link_deliver(link, ctx, slot->fragment, slot->data, slot->size);
+    }
+}
+
+static void smp_link_handle_credit(SmpLink *link, uint32_t limit)
+{
+    int32_t credit = count_diff(limit, link->tx_sent);
+
+    /* the peer grants its whole window once it processed what we sent */
+    if (credit > 0 && (uint32_t) credit > link->tx_window)
+        link->tx_window = (uint32_t) credit;
+
+    if (count_diff(limit, link->tx_limit) <= 0)
+        return;
+
+    link->tx_limit = limit;
+
+    /* stop probing, we'll start again if still short of credit */
+    link->probe_deadline = 0;
+    link->probe_interval = SMP_LINK_INITIAL_RTO;
+}
+
+/* account bytes received, offset being the number of bytes the peer sent
+ * before them */
+static void smp_link_consume_credit(SmpLink *link, uint32_t offset, size_t size)
+{
+    uint32_t end = offset + (uint32_t) size;
+
+    if (count_diff(end, link->rx_received) > 0)
+        link->rx_received = end;
+
+    /* advertise once half of the window has been consumed */
+    if (count_diff(link->rx_received + link->rx_window, link->rx_advertised)
+            >= (int32_t) (link->rx_window / 2))
+        link->credit_pending = true;
+}
+
+static bool smp_link_has_credit(SmpLink *link, size_t size)
+{
+    return count_diff(link->tx_limit, link->tx_sent) >= (int32_t) size;
+}
+
+static void smp_link_probe(SmpLink *link, SmpContext *ctx, uint64_t now)
+{
+    if (link->probe_deadline != 0)
+        return;
+
+    smp_link_send_control(link, ctx, SMP_LINK_FLAG_PROBE);
+    link->probe_deadline = now + link->probe_interval;
+}
+
+/* Internal API */
+SmpLink *smp_link_new(void)
+{
+    SmpLink *link;
+
+    link = smp_new(SmpLink);
+    if (link == NULL)
+        return NULL;
+
+    smp_link_reset(link);
+    return link;
+}
+
+void smp_link_free(SmpLink *link)
+{
+    unsigned int i;
+
+    return_if_fail(link != NULL);
+
+    smp_link_free_slots(link);
+    for (i = 0; i < SMP_LINK_FRAGMENT_STREAMS; i++)
+        free(link->fragments[i].data);
+    free(link->tx_buf);
+    free(link);
+}
+
+bool smp_link_is_enabled(SmpLink *link)
+{
+    return link != NULL
+        && (link->reliable || link->flow_control || link->fragmentation);
+}
+
+/* window should be a power of two not larger than SMP_LINK_MAX_WINDOW, 0
+ * disables reliability */
+int smp_link_set_reliable(SmpLink *link, unsigned int window)
+{
+    return_val_if_fail(link != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(window <= SMP_LINK_MAX_WINDOW, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail((window & (window - 1)) == 0, SMP_ERROR_INVALID_PARAM);
+
+    smp_link_free_slots(link);
+    smp_link_reset(link);
+    link->reliable = false;
+    link->window = 0;
+
+    if (window == 0)
+        return 0;
+
+    link->tx_slots = calloc(window, sizeof(*link->tx_slots));
+    link->rx_slots = calloc(window, sizeof(*link->rx_slots));
+    if (link->tx_slots == NULL || link->rx_slots == NULL) {
+        smp_link_free_slots(link);
+        return SMP_ERROR_NO_MEM;
+    }
+
+    link->window = window;
+    link->reliable = true;
+    return 0;
+}
+
+/* rx_window is the number of message bytes we accept ahead, 0 disables flow
+ * control */
+int smp_link_set_flow_control(SmpLink *link, uint32_t rx_window)
+{
+    return_val_if_fail(link != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(rx_window <= INT32_MAX, SMP_ERROR_INVALID_PARAM);
+
+    /* lost probes and credits are only sent again after a delay */
+    if (rx_window > 0 && smp_clock_get_time_ns() == 0)
+        return SMP_ERROR_NOT_SUPPORTED;
+
+    smp_link_reset_flow_control(link);
+    link->rx_window = rx_window;
+    link->flow_control = (rx_window > 0);
+
+    /* let the peer know our window as soon as possible */
+    link->credit_pending = link->flow_control;
+    return 0;
+}
+
+/* send messages split in fragments with smp_link_send_fragment(), the
+ * reassembly of received fragments is always supported */
+int smp_link_set_fragmentation(SmpLink *link, bool enable)
+{
+    return_val_if_fail(link != NULL, SMP_ERROR_INVALID_PARAM);
+
+    link->fragmentation = enable;
+    return 0;
+}
+
+/* allocate the buffers for messages up to msg_size now, so sending and
+ * receiving them doesn't allocate */
+int smp_link_reserve(SmpLink *link, size_t msg_size)
+{
+    size_t size = msg_size + SMP_LINK_MAX_HEADER_SIZE;
+    unsigned int i;
+    int ret;
+
+    return_val_if_fail(link != NULL, SMP_ERROR_INVALID_PARAM);
+
+    ret = reserve(&link->tx_buf, &link->tx_buf_capacity, size);
+    if (ret < 0)
+        return ret;
+
+    for (i = 0; i < link->window; i++) {
+        ret = reserve(&link->tx_slots[i].data, &link->tx_slots[i].capacity,
+                size);
+        if (ret < 0)
+            return ret;
+
+        ret = reserve(&link->rx_slots[i].data, &link->rx_slots[i].capacity,
+                msg_size);
+        if (ret < 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+/* send data in a frame, fragment being the fragment byte or -1 */
+static int smp_link_send_data(SmpLink *link, SmpContext *ctx,
+        const uint8_t *data, size_t size, int fragment)
+{
+    uint8_t flags = smp_link_get_data_flags(link);
+    size_t header_size;
+    uint64_t now = smp_clock_get_time_ns();
+    SmpLinkTxSlot *slot;
+    int ret;
+
+    if (fragment >= 0)
+        flags |= SMP_LINK_FLAG_FRAGMENT;
+    header_size = smp_link_get_header_size(flags);
+
+    if (link->flow_control && !smp_link_has_credit(link, size)) {
+        /* waiting won't help if it doesn't fit in the peer window */
+        if (link->tx_window > 0 && size > link->tx_window)
+            return SMP_ERROR_OVERFLOW;
+
+        smp_link_probe(link, ctx, now);
+        return SMP_ERROR_WOULD_BLOCK;
+    }
+
+    if (!link->reliable) {
+        ret = reserve(&link->tx_buf, &link->tx_buf_capacity,
+                size + header_size);
+        if (ret < 0)
+            return ret;
+
+        smp_link_write_header(link, link->tx_buf, flags, 0, link->tx_sent,
+                fragment);
+        memcpy(link->tx_buf + header_size, data, size);
+        link->tx_sent += (uint32_t) size;
+
+        return smp_context_write_payload(ctx, link->tx_buf, size + header_size);
+    }
+
+    if ((uint16_t) (link->snd_nxt - link->snd_una) >= link->window)
+        return SMP_ERROR_WOULD_BLOCK;
+
+    slot = &link->tx_slots[link->snd_nxt & (link->window - 1)];
+    ret = reserve(&slot->data, &slot->capacity, size + header_size);
+    if (ret < 0)
+        return ret;
+
+    memcpy(slot->data + header_size, data, size);
+    slot->size = size + header_size;
+    slot->seq = link->snd_nxt++;
+    slot->offset = link->tx_sent;
+    slot->fragment = fragment;
+    slot->in_flight = true;
+    slot->sacked = false;
+    slot->retransmitted = false;
+    link->tx_sent += (uint32_t) size;
+
+    ret = smp_link_transmit_slot(link, ctx, slot, now);
+    if (ret == SMP_ERROR_WOULD_BLOCK || ret == SMP_ERROR_IO) {
+        /* the frame is queued in the window and will be retransmitted */
+        ret = 0;
+    }
+
+    return ret;
+}
+
+int smp_link_send_message(SmpLink *link, SmpContext *ctx, const uint8_t *msg,
+        size_t size)
+{
+    return smp_link_send_data(link, ctx, msg, size, -1);
+}
+
+/* send a part of a message on stream, first and last telling whether it
+ * starts and ends it */
+int smp_link_send_fragment(SmpLink *link, SmpContext *ctx,
+        const uint8_t *data, size_t size, unsigned int stream, bool first,
+        bool last)
+{
+    int fragment = (int) stream;
+
+    return_val_if_fail(stream < SMP_LINK_FRAGMENT_STREAMS,
+            SMP_ERROR_INVALID_PARAM);
+
+    if (first)
+        fragment |= SMP_LINK_FRAGMENT_FIRST;
+    if (last)
+        fragment |= SMP_LINK_FRAGMENT_LAST;
+
+    return smp_link_send_data(link, ctx, data, size, fragment);
+}
+
+int smp_link_process_frame(SmpLink *link, SmpContext *ctx,
+        const uint8_t *frame, size_t size)
+{
+    uint8_t flags;
+    uint16_t seq = 0;
+    uint32_t offset;
+    int fragment = -1;
+    const uint8_t *payload;
+    size_t payload_size;
+    size_t header_size;
+    bool current = true;
+
+    if (size < 1)
+        return SMP_ERROR_BAD_MESSAGE;
+
+    flags = frame[0];
+    if (flags & ~SMP_LINK_FLAGS_MASK)
+        return SMP_ERROR_BAD_MESSAGE;
+
+    header_size = smp_link_get_header_size(flags);
+    if (size < header_size)
+        return SMP_ERROR_BAD_MESSAGE;
+
+    /* the session comes last but the other fields depend on it, acks and
+     * credit are only valid for our current session */
+    if ((flags & SMP_LINK_FLAG_SESSION)
+            && (link->reliable || link->flow_control)) {
+        uint16_t peer_session = read_le16(frame + header_size - 2);
+
+        smp_link_handle_session(link, read_le16(frame + header_size - 4),
+                peer_session);
+        current = (peer_session == link->session);
+    }
+
+    frame++;
+
+    if (flags & SMP_LINK_FLAG_SEQ) {
+        seq = read_le16(frame);
+        frame += 2;
+    }
+
+    if (flags & SMP_LINK_FLAG_ACK) {
+        if (link->reliable && current) {
+            smp_link_handle_ack(link, ctx, read_le16(frame),
+                    read_le32(frame + 2), smp_clock_get_time_ns());
+        }
+        frame += 6;
+    }
+
+    if (flags & SMP_LINK_FLAG_CREDIT) {
+        if (link->flow_control && current)
+            smp_link_handle_credit(link, read_le32(frame));
+        frame += 4;
+    }
+
+    /* without offset, assume nothing was lost */
+    offset = link->rx_received;
+    if (flags & SMP_LINK_FLAG_OFFSET) {
+        offset = read_le32(frame);
+        frame += 4;
+    }
+
+    if (flags & SMP_LINK_FLAG_FRAGMENT) {
+        fragment = frame[0];
+        frame += 1;
+
+        if ((fragment & SMP_LINK_FRAGMENT_STREAM_MASK)
+                >= SMP_LINK_FRAGMENT_STREAMS)
+            return SMP_ERROR_BAD_MESSAGE;
+    }
+
+    if (flags & SMP_LINK_FLAG_SESSION)
+        frame += 4;
+
+    if ((flags & SMP_LINK_FLAG_PROBE) && link->flow_control)
+        link->credit_pending = true;
+
+    payload = frame;
+    payload_size = size - header_size;
+    if (payload_size == 0)
+        return 0;
+
+    if (link->flow_control)
+        smp_link_consume_credit(link, offset, payload_size);
+
+    if ((flags & SMP_LINK_FLAG_SEQ) && link->reliable)
+        smp_link_handle_data(link, ctx, seq, fragment, payload, payload_size);
+    else
+        smp_link_deliver(link, ctx, fragment, payload, payload_size);
+
+    return 0;
+}
+
+/* send a frame with our ack and credit state if incoming data was not
+ * acknowledged or credit not advertised by an outgoing frame yet */
+int smp_link_flush(SmpLink *link, SmpContext *ctx)
+{
+    if (!(link->reliable && link->ack_pending)
+            && !(link->flow_control && link->credit_pending))
+        return 0;
+
+    return smp_link_send_control(link, ctx, 0);
+}
+
+/* return the earliest retransmission or probe deadline or 0 if there is
+ * none */
+uint64_t smp_link_get_next_deadline(SmpLink *link)
+{
+    uint64_t deadline = link->probe_deadline;
+    uint16_t seq;
+
+    if (!link->reliable)
+        return deadline;
+
+    for (seq = link->snd_una; seq != link->snd_nxt; seq++) {
+        SmpLinkTxSlot *slot = &link->tx_slots[seq & (link->window - 1)];
+
+        if (!slot->in_flight || slot->sacked)
+            continue;
+
+        if (deadline == 0 || slot->deadline < deadline)
+            deadline = slot->deadline;
+    }
+
+    return deadline;
+}
+
+int smp_link_process_timers(SmpLink *link, SmpContext *ctx, uint64_t now)
+{
+    bool backoff = false;
+    uint16_t seq;
+    int ret = 0;
+
+    if (link->probe_deadline != 0 && link->probe_deadline <= now) {
+        link->probe_interval *= 2;
+        if (link->probe_interval > SMP_LINK_MAX_RTO)
+            link->probe_interval = SMP_LINK_MAX_RTO;
+
+        link->probe_deadline = 0;
+        smp_link_probe(link, ctx, now);
+    }
+
+    if (!link->reliable)
+        return 0;
+
+    for (seq = link->snd_una; seq != link->snd_nxt; seq++) {
+        SmpLinkTxSlot *slot = &link->tx_slots[seq & (link->window - 1)];
+        int err;
+
+        if (!slot->in_flight || slot->sacked || slot->deadline > now)
+            continue;
+
+        /* exponential backoff, once per expiration round */
+        if (!backoff) {
+            link->rto *= 2;
+            if (link->rto > SMP_LINK_MAX_RTO)
+                link->rto = SMP_LINK_MAX_RTO;
+
+            backoff = true;
+        }
+
+        slot->retransmitted = true;
+        err = smp_link_transmit_slot(link, ctx, slot, now);
+        if (err < 0 && err != SMP_ERROR_WOULD_BLOCK && err != SMP_ERROR_IO)
+            ret = err;
+    }
+
+    return ret;
+}
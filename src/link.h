@@ -0,0 +1,158 @@
+/* libsmp
+ * Copyright (C) 2026 Actronika SAS
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LINK_H
+#define LINK_H
+
+#include "libsmp.h"
+#include "libsmp-private.h"
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Link layer header, prepended to the frame payload when a link feature is
+ * enabled on the context. Fields are little endian and present in flag bit
+ * order. The remaining of the payload is the encoded message, if any. */
+#define SMP_LINK_FLAG_SEQ 0x01 /* u16 sequence number */
+#define SMP_LINK_FLAG_ACK 0x02 /* u16 next expected seq, u32 selective acks */
+#define SMP_LINK_FLAG_CREDIT 0x04 /* u32 message bytes limit granted to peer */
+#define SMP_LINK_FLAG_OFFSET 0x08 /* u32 message bytes sent before this one */
+#define SMP_LINK_FLAG_PROBE 0x10 /* ask the peer to advertise its credit */
+#define SMP_LINK_FLAG_FRAGMENT 0x20 /* u8 stream and position of a fragment */
+#define SMP_LINK_FLAG_SESSION 0x40 /* u16 sender session, u16 peer session */
+
+#define SMP_LINK_FLAGS_MASK (SMP_LINK_FLAG_SEQ | SMP_LINK_FLAG_ACK \
+        | SMP_LINK_FLAG_CREDIT | SMP_LINK_FLAG_OFFSET | SMP_LINK_FLAG_PROBE \
+        | SMP_LINK_FLAG_FRAGMENT | SMP_LINK_FLAG_SESSION)
+
+#define SMP_LINK_MAX_HEADER_SIZE (1 + 2 + 6 + 4 + 4 + 1 + 4)
+
+/* A message split in fragments is sent on a stream, fragments of different
+ * streams may be interleaved. The fragment byte holds the stream in its low
+ * bits and tells which fragments start and end the message. */
+#define SMP_LINK_FRAGMENT_STREAMS 4
+#define SMP_LINK_FRAGMENT_STREAM_MASK 0x0f
+#define SMP_LINK_FRAGMENT_FIRST 0x40
+#define SMP_LINK_FRAGMENT_LAST 0x80
+
+/* the selective ack bitmap covers 32 frames after the cumulative ack */
+#define SMP_LINK_MAX_WINDOW 32
+
+typedef struct
+{
+    uint8_t *data;      /* link header + encoded message */
+    size_t size;
+    size_t capacity;
+
+    uint16_t seq;
+    uint32_t offset;
+    int fragment;       /* fragment byte, -1 for a whole message */
+    bool in_flight;
+    bool sacked;
+    bool retransmitted;
+    uint64_t sent_time;
+    uint64_t deadline;
+} SmpLinkTxSlot;
+
+typedef struct
+{
+    uint8_t *data;      /* encoded message */
+    size_t size;
+    size_t capacity;
+    uint64_t start_time;    /* reception times of the frame */
+    uint64_t end_time;
+    int fragment;
+
+    bool used;
+} SmpLinkRxSlot;
+
+typedef struct
+{
+    bool reliable;
+    unsigned int window;
+
+    /* ids of our state and of the peer one, 0 if we didn't hear from it,
+     * established once the peer told us it knows our session */
+    uint16_t session;
+    uint16_t peer_session;
+    bool established;
+
+    /* transmission */
+    uint16_t snd_una;   /* oldest unacknowledged seq */
+    uint16_t snd_nxt;   /* next seq to send */
+    SmpLinkTxSlot *tx_slots;
+
+    uint64_t srtt;
+    uint64_t rttvar;
+    uint64_t rto;
+    bool have_rtt;
+
+    /* reception */
+    uint16_t rcv_nxt;   /* next expected seq */
+    SmpLinkRxSlot *rx_slots;
+    bool ack_pending;
+
+    /* flow control, counted in message bytes */
+    bool flow_control;
+    uint32_t tx_sent;       /* bytes sent to the peer */
+    uint32_t tx_limit;      /* limit granted by the peer */
+    uint32_t tx_window;     /* largest credit granted, 0 until we get one */
+    uint64_t probe_deadline;
+    uint64_t probe_interval;
+
+    uint32_t rx_window;     /* bytes we accept ahead of what we received */
+    uint32_t rx_received;   /* bytes received from the peer */
+    uint32_t rx_advertised; /* last limit sent to the peer */
+    bool credit_pending;
+
+    /* reassembly of fragmented messages, per stream */
+    bool fragmentation;
+    SmpLinkRxSlot fragments[SMP_LINK_FRAGMENT_STREAMS];
+
+    /* scratch buffer for frames not kept for retransmission */
+    uint8_t *tx_buf;
+    size_t tx_buf_capacity;
+} SmpLink;
+
+SmpLink *smp_link_new(void);
+void smp_link_free(SmpLink *link);
+
+bool smp_link_is_enabled(SmpLink *link);
+int smp_link_set_reliable(SmpLink *link, unsigned int window);
+int smp_link_set_flow_control(SmpLink *link, uint32_t rx_window);
+int smp_link_set_fragmentation(SmpLink *link, bool enable);
+int smp_link_reserve(SmpLink *link, size_t msg_size);
+
+int smp_link_send_message(SmpLink *link, SmpContext *ctx,
+        const uint8_t *msg, size_t size);
+int smp_link_send_fragment(SmpLink *link, SmpContext *ctx,
+        const uint8_t *data, size_t size, unsigned int stream, bool first,
+        bool last);
+int smp_link_process_frame(SmpLink *link, SmpContext *ctx,
+        const uint8_t *frame, size_t size);
+int smp_link_flush(SmpLink *link, SmpContext *ctx);
+
+uint64_t smp_link_get_next_deadline(SmpLink *link);
+int smp_link_process_timers(SmpLink *link, SmpContext *ctx, uint64_t now);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
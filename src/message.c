@@ -158,7 +158,7 @@ static size_t smp_type_size(SmpType type)
     return 0;
 }
 
-static size_t smp_value_compute_size(const SmpValue *value)
+size_t smp_value_compute_size(const SmpValue *value)
 {
     size_t size;
 
@@ -297,7 +297,9 @@ static ssize_t smp_message_decode_value(SmpValue *value, const uint8_t *buffer,
 }
 
 
-static ssize_t smp_message_encode_value(const SmpValue *value, uint8_t *buffer)
+/* write the type and the value, return the number of bytes written or 0 if
+ * the value can't be encoded */
+ssize_t smp_message_encode_value(const SmpValue *value, uint8_t *buffer)
 {
     buffer[0] = value->type;
     buffer++;
@@ -574,6 +576,8 @@ void smp_message_clear(SmpMessage *msg)
     return_if_fail(msg != NULL);
 
     msg->msgid = 0;
+    msg->rx_start_time = 0;
+    msg->rx_end_time = 0;
     memset(msg->values, 0, msg->capacity * sizeof(SmpValue));
 }
 
@@ -711,6 +715,40 @@ void smp_message_set_id(SmpMessage *msg, uint32_t id)
     msg->msgid = id;
 }
 
+/**
+ * \ingroup message-funcs
+ * Get the time at which a received message arrived, as read on a monotonic
+ * clock in nanoseconds. start_ns is the time of the read which returned the
+ * start of the frame and end_ns the one of the read which completed it, so
+ * the queueing delay before the callback is called can be measured against
+ * smp_context_get_time_ns().
+ *
+ * With reliable delivery, a message received out of order and kept until the
+ * missing ones arrive has the times of its own frame.
+ *
+ * @param[in] msg a SmpMessage
+ * @param[out] start_ns the time of the frame start, may be NULL
+ * @param[out] end_ns the time of the frame end, may be NULL
+ *
+ * @return 0 on success, SMP_ERROR_NOT_FOUND if the message wasn't received
+ * from a context or the platform has no clock, a SmpError otherwise.
+ */
+int smp_message_get_rx_timestamp(SmpMessage *msg, uint64_t *start_ns,
+        uint64_t *end_ns)
+{
+    return_val_if_fail(msg != NULL, SMP_ERROR_INVALID_PARAM);
+
+    if (msg->rx_end_time == 0)
+        return SMP_ERROR_NOT_FOUND;
+
+    if (start_ns != NULL)
+        *start_ns = msg->rx_start_time;
+    if (end_ns != NULL)
+        *end_ns = msg->rx_end_time;
+
+    return 0;
+}
+
 /**
  * \ingroup message-funcs
  * Get the number of valid arguments in a message.
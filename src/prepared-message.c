@@ -0,0 +1,477 @@
+/* libsmp
+ * Copyright (C) 2026 Actronika SAS
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/**
+ * @file
+ * \defgroup prepared_message PreparedMessage
+ *
+ * Messages encoded and framed once, with arguments patched in place.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "prepared-message.h"
+#include "serial-protocol.h"
+
+#define MSG_HEADER_SIZE 8
+
+/* biggest scalar value and its type */
+#define SMP_PREPARED_MAX_VALUE_SIZE 9
+
+static inline bool smp_type_is_scalar(SmpType type)
+{
+    return type != SMP_TYPE_STRING && type != SMP_TYPE_RAW;
+}
+
+/* size of the encoded value of arg, without its type */
+static size_t smp_prepared_message_get_value_size(SmpPreparedMessage *pm,
+        const SmpValue *value, size_t offset)
+{
+    uint8_t tmp[SMP_PREPARED_MAX_VALUE_SIZE];
+    uint16_t len;
+
+    if (smp_type_is_scalar(value->type))
+        return (size_t) smp_message_encode_value(value, tmp) - 1;
+
+    /* strings and raw data start with their size */
+    memcpy(&len, pm->payload + offset, sizeof(len));
+    return 2 + len;
+}
+
+/* frame the payload, keeping the position of each argument in the frame */
+static void smp_prepared_message_build_frame(SmpPreparedMessage *pm,
+        SmpSerialChecksum checksum)
+{
+    size_t pos = 0;
+    size_t arg = 0;
+    size_t i;
+
+    pm->frame[pos++] = SMP_SERIAL_PROTOCOL_START_BYTE;
+    for (i = 0; i < pm->payload_size; i++) {
+        uint8_t byte = pm->payload[i];
+
+        /* arguments are encoded in index order */
+        while (arg < pm->n_args && pm->args[arg].offset <= i) {
+            if (pm->args[arg].offset == i)
+                pm->args[arg].frame_offset = pos;
+            arg++;
+        }
+
+        if (smp_serial_protocol_is_magic_byte(byte))
+            pm->frame[pos++] = SMP_SERIAL_PROTOCOL_ESC_BYTE;
+        pm->frame[pos++] = byte;
+    }
+
+    pm->checksum = checksum;
+    pm->check_offset = pos;
+    pm->check_size = smp_serial_protocol_compute_check(checksum, pm->payload,
+            pm->payload_size, pm->check);
+    for (i = 0; i < pm->check_size; i++) {
+        if (smp_serial_protocol_is_magic_byte(pm->check[i]))
+            pm->frame[pos++] = SMP_SERIAL_PROTOCOL_ESC_BYTE;
+        pm->frame[pos++] = pm->check[i];
+    }
+
+    pm->frame[pos++] = SMP_SERIAL_PROTOCOL_END_BYTE;
+    pm->frame_size = pos;
+    pm->frame_valid = true;
+}
+
+/* rewrite the checksum of the frame and its end */
+static void smp_prepared_message_write_check(SmpPreparedMessage *pm)
+{
+    size_t pos = pm->check_offset;
+    size_t i;
+
+    for (i = 0; i < pm->check_size; i++) {
+        if (smp_serial_protocol_is_magic_byte(pm->check[i]))
+            pm->frame[pos++] = SMP_SERIAL_PROTOCOL_ESC_BYTE;
+        pm->frame[pos++] = pm->check[i];
+    }
+
+    pm->frame[pos++] = SMP_SERIAL_PROTOCOL_END_BYTE;
+    pm->frame_size = pos;
+}
+
+/* get the frame of the message with the given checksum, framing the payload
+ * again if needed */
+int smp_prepared_message_get_frame(SmpPreparedMessage *pm,
+        SmpSerialChecksum checksum, const uint8_t **frame, size_t *size)
+{
+    if (!pm->frame_valid || pm->checksum != checksum)
+        smp_prepared_message_build_frame(pm, checksum);
+
+    *frame = pm->frame;
+    *size = pm->frame_size;
+    return 0;
+}
+
+/**
+ * \ingroup prepared_message
+ * Create a prepared message from a message, for messages with a fixed layout
+ * sent again and again, like heartbeats or setpoints. The message is encoded
+ * and framed once; scalar arguments are then patched in the frame and
+ * sending it is a single write. See smp_context_send_prepared_message().
+ *
+ * The message is not referenced and may be freed afterwards.
+ *
+ * @param[in] msg the SmpMessage to prepare
+ *
+ * @return a new SmpPreparedMessage or NULL on error.
+ */
+SmpPreparedMessage *smp_prepared_message_new(SmpMessage *msg)
+{
+    SmpPreparedMessage *pm;
+    ssize_t encoded_size;
+    size_t msgsize;
+    size_t offset;
+    size_t i;
+
+    return_val_if_fail(msg != NULL, NULL);
+
+    pm = smp_new(SmpPreparedMessage);
+    if (pm == NULL)
+        return NULL;
+
+    /* the frame is at most twice the escaped message and checksum plus its
+     * start and end bytes */
+    msgsize = smp_message_get_encoded_size(msg);
+    pm->payload = malloc(msgsize + 2 * (msgsize + 4) + 2);
+    pm->args = calloc(msg->capacity > 0 ? msg->capacity : 1,
+            sizeof(SmpPreparedArg));
+    if (pm->payload == NULL || pm->args == NULL)
+        goto error;
+
+    pm->frame = pm->payload + msgsize;
+    encoded_size = smp_message_encode(msg, pm->payload, msgsize);
+    if (encoded_size < 0)
+        goto error;
+
+    pm->msgid = msg->msgid;
+    pm->payload_size = (size_t) encoded_size;
+    pm->n_args = msg->capacity;
+
+    offset = MSG_HEADER_SIZE;
+    for (i = 0; i < msg->capacity; i++) {
+        const SmpValue *value = &msg->values[i];
+
+        if (value->type == SMP_TYPE_NONE)
+            continue;
+
+        pm->args[i].type = value->type;
+        pm->args[i].offset = offset + 1;
+        offset += 1 + smp_prepared_message_get_value_size(pm, value,
+                offset + 1);
+    }
+
+    return pm;
+
+error:
+    smp_prepared_message_free(pm);
+    return NULL;
+}
+
+/**
+ * \ingroup prepared_message
+ * Free a prepared message.
+ *
+ * @param[in] pm the SmpPreparedMessage
+ */
+void smp_prepared_message_free(SmpPreparedMessage *pm)
+{
+    return_if_fail(pm != NULL);
+
+    free(pm->args);
+    free(pm->payload);
+    free(pm);
+}
+
+/**
+ * \ingroup prepared_message
+ * Set a scalar argument of a prepared message. The argument must have been
+ * set in the prepared message, with the same type. The bytes are patched in
+ * the frame and the XOR8 checksum is updated incrementally; the frame is only
+ * escaped again when a patched byte starts or stops needing an escape.
+ *
+ * @param[in] pm the SmpPreparedMessage
+ * @param[in] index index of the value
+ * @param[in] value a pointer to a SmpValue to set
+ *
+ * @return 0 on success, a SmpError otherwise.
+ */
+int smp_prepared_message_set_value(SmpPreparedMessage *pm, int index,
+        const SmpValue *value)
+{
+    uint8_t tmp[SMP_PREPARED_MAX_VALUE_SIZE];
+    SmpPreparedArg *arg;
+    const uint8_t *new_bytes;
+    uint8_t *old_bytes;
+    uint8_t delta = 0;
+    size_t size;
+    size_t pos;
+    size_t i;
+
+    return_val_if_fail(pm != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(index >= 0, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(value != NULL, SMP_ERROR_INVALID_PARAM);
+
+    if ((size_t) index >= pm->n_args || pm->args[index].offset == 0)
+        return SMP_ERROR_NOT_FOUND;
+
+    arg = &pm->args[index];
+    if (!smp_type_is_scalar(arg->type))
+        return SMP_ERROR_NOT_SUPPORTED;
+    if (value->type != arg->type)
+        return SMP_ERROR_BAD_TYPE;
+
+    size = (size_t) smp_message_encode_value(value, tmp) - 1;
+    new_bytes = tmp + 1;
+    old_bytes = pm->payload + arg->offset;
+
+    for (i = 0; i < size && pm->frame_valid; i++) {
+        if (smp_serial_protocol_is_magic_byte(old_bytes[i])
+                != smp_serial_protocol_is_magic_byte(new_bytes[i]))
+            pm->frame_valid = false;
+
+        delta ^= old_bytes[i] ^ new_bytes[i];
+    }
+
+    memcpy(old_bytes, new_bytes, size);
+    if (!pm->frame_valid)
+        return 0;
+
+    /* the escape bytes stay where they are */
+    pos = arg->frame_offset;
+    for (i = 0; i < size; i++) {
+        if (smp_serial_protocol_is_magic_byte(new_bytes[i]))
+            pos++;
+        pm->frame[pos++] = new_bytes[i];
+    }
+
+    if (pm->checksum == SMP_SERIAL_CHECKSUM_XOR8) {
+        pm->check[0] ^= delta;
+    } else {
+        smp_serial_protocol_compute_check(pm->checksum, pm->payload,
+                pm->payload_size, pm->check);
+    }
+    smp_prepared_message_write_check(pm);
+
+    return 0;
+}
+
+/**
+ * \ingroup prepared_message
+ * Set the prepared message value pointed by index to given uint8 value.
+ *
+ * @param[in] pm the SmpPreparedMessage
+ * @param[in] index index of the value
+ * @param[in] value the uint8 to set
+ *
+ * @return 0 on success, a SmpError otherwise.
+ */
+int smp_prepared_message_set_uint8(SmpPreparedMessage *pm, int index,
+        uint8_t value)
+{
+    SmpValue val;
+
+    val.type = SMP_TYPE_UINT8;
+    val.value.u8 = value;
+    return smp_prepared_message_set_value(pm, index, &val);
+}
+
+/**
+ * \ingroup prepared_message
+ * Set the prepared message value pointed by index to given int8 value.
+ *
+ * @param[in] pm the SmpPreparedMessage
+ * @param[in] index index of the value
+ * @param[in] value the int8 to set
+ *
+ * @return 0 on success, a SmpError otherwise.
+ */
+int smp_prepared_message_set_int8(SmpPreparedMessage *pm, int index,
+        int8_t value)
+{
+    SmpValue val;
+
+    val.type = SMP_TYPE_INT8;
+    val.value.i8 = value;
+    return smp_prepared_message_set_value(pm, index, &val);
+}
+
+/**
+ * \ingroup prepared_message
+ * Set the prepared message value pointed by index to given uint16 value.
+ *
+ * @param[in] pm the SmpPreparedMessage
+ * @param[in] index index of the value
+ * @param[in] value the uint16 to set
+ *
+ * @return 0 on success, a SmpError otherwise.
+ */
+int smp_prepared_message_set_uint16(SmpPreparedMessage *pm, int index,
+        uint16_t value)
+{
+    SmpValue val;
+
+    val.type = SMP_TYPE_UINT16;
+    val.value.u16 = value;
+    return smp_prepared_message_set_value(pm, index, &val);
+}
+
+/**
+ * \ingroup prepared_message
+ * Set the prepared message value pointed by index to given int16 value.
+ *
+ * @param[in] pm the SmpPreparedMessage
+ * @param[in] index index of the value
+ * @param[in] value the int16 to set
+ *
+ * @return 0 on success, a SmpError otherwise.
+ */
+int smp_prepared_message_set_int16(SmpPreparedMessage *pm, int index,
+        int16_t value)
+{
+    SmpValue val;
+
+    val.type = SMP_TYPE_INT16;
+    val.value.i16 = value;
+    return smp_prepared_message_set_value(pm, index, &val);
+}
+
+/**
+ * \ingroup prepared_message
+ * Set the prepared message value pointed by index to given uint32 value.
+ *
+ * @param[in] pm the SmpPreparedMessage
+ * @param[in] index index of the value
+ * @param[in] value the uint32 to set
+ *
+ * @return 0 on success, a SmpError otherwise.
+ */
+int smp_prepared_message_set_uint32(SmpPreparedMessage *pm, int index,
+        uint32_t value)
+{
+    SmpValue val;
+
+    val.type = SMP_TYPE_UINT32;
+    val.value.u32 = value;
+    return smp_prepared_message_set_value(pm, index, &val);
+}
+
+/**
+ * \ingroup prepared_message
+ * Set the prepared message value pointed by index to given int32 value.
+ *
+ * @param[in] pm the SmpPreparedMessage
+ * @param[in] index index of the value
+ * @param[in] value the int32 to set
+ *
+ * @return 0 on success, a SmpError otherwise.
+ */
+int smp_prepared_message_set_int32(SmpPreparedMessage *pm, int index,
+        int32_t value)
+{
+    SmpValue val;
+
+    val.type = SMP_TYPE_INT32;
+    val.value.i32 = value;
+    return smp_prepared_message_set_value(pm, index, &val);
+}
+
+/**
+ * \ingroup prepared_message
+ * Set the prepared message value pointed by index to given uint64 value.
+ *
+ * @param[in] pm the SmpPreparedMessage
+ * @param[in] index index of the value
+ * @param[in] value the uint64 to set
+ *
+ * @return 0 on success, a SmpError otherwise.
+ */
+int smp_prepared_message_set_uint64(SmpPreparedMessage *pm, int index,
+        uint64_t value)
+{
+    SmpValue val;
+
+    val.type = SMP_TYPE_UINT64;
+    val.value.u64 = value;
+    return smp_prepared_message_set_value(pm, index, &val);
+}
+
+/**
+ * \ingroup prepared_message
+ * Set the prepared message value pointed by index to given int64 value.
+ *
+ * @param[in] pm the SmpPreparedMessage
+ * @param[in] index index of the value
+ * @param[in] value the int64 to set
+ *
+ * @return 0 on success, a SmpError otherwise.
+ */
+int smp_prepared_message_set_int64(SmpPreparedMessage *pm, int index,
+        int64_t value)
+{
+    SmpValue val;
+
+    val.type = SMP_TYPE_INT64;
+    val.value.i64 = value;
+    return smp_prepared_message_set_value(pm, index, &val);
+}
+
+/**
+ * \ingroup prepared_message
+ * Set the prepared message value pointed by index to given float value.
+ *
+ * @param[in] pm the SmpPreparedMessage
+ * @param[in] index index of the value
+ * @param[in] value the float to set
+ *
+ * @return 0 on success, a SmpError otherwise.
+ */
+int smp_prepared_message_set_float(SmpPreparedMessage *pm, int index,
+        float value)
+{
+    SmpValue val;
+
+    val.type = SMP_TYPE_F32;
+    val.value.f32 = value;
+    return smp_prepared_message_set_value(pm, index, &val);
+}
+
+/**
+ * \ingroup prepared_message
+ * Set the prepared message value pointed by index to given double value.
+ *
+ * @param[in] pm the SmpPreparedMessage
+ * @param[in] index index of the value
+ * @param[in] value the double to set
+ *
+ * @return 0 on success, a SmpError otherwise.
+ */
+int smp_prepared_message_set_double(SmpPreparedMessage *pm, int index,
+        double value)
+{
+    SmpValue val;
+
+    val.type = SMP_TYPE_F64;
+    val.value.f64 = value;
+    return smp_prepared_message_set_value(pm, index, &val);
+}
@@ -0,0 +1,65 @@
+/* libsmp
+ * Copyright (C) 2026 Actronika SAS
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef PREPARED_MESSAGE_H
+#define PREPARED_MESSAGE_H
+
+#include "libsmp.h"
+#include "libsmp-private.h"
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* position of an argument value, offset is 0 for unset arguments */
+typedef struct
+{
+    SmpType type;
+    size_t offset;          /* in the payload */
+    size_t frame_offset;    /* in the frame */
+} SmpPreparedArg;
+
+struct SmpPreparedMessage
+{
+    uint32_t msgid;
+    uint8_t *payload;       /* the encoded message */
+    size_t payload_size;
+
+    SmpPreparedArg *args;   /* indexed like the message arguments */
+    size_t n_args;
+
+    /* the framed payload, patched in place as long as the escaping of the
+     * patched bytes doesn't change */
+    uint8_t *frame;
+    size_t frame_size;
+    bool frame_valid;
+    SmpSerialChecksum checksum;
+    size_t check_offset;    /* offset of the checksum in the frame */
+    uint8_t check[4];
+    size_t check_size;
+};
+
+int smp_prepared_message_get_frame(SmpPreparedMessage *pm,
+        SmpSerialChecksum checksum, const uint8_t **frame, size_t *size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,153 @@
+/* libsmp
+ * Copyright (C) 2026 Actronika SAS
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "schedule.h"
+
+#include <limits.h>
+#include <stdlib.h>
+
+SmpScheduleTable *smp_schedule_table_new(void)
+{
+    return smp_new(SmpScheduleTable);
+}
+
+void smp_schedule_table_free(SmpScheduleTable *table)
+{
+    return_if_fail(table != NULL);
+
+    while (table->head != NULL) {
+        SmpScheduledMessage *sm = table->head;
+
+        table->head = sm->next;
+        smp_scheduled_message_free(sm);
+    }
+
+    free(table);
+}
+
+/* allocate a message with a new id, ids are positive */
+SmpScheduledMessage *smp_scheduled_message_new(SmpScheduleTable *table)
+{
+    SmpScheduledMessage *sm;
+
+    sm = smp_new(SmpScheduledMessage);
+    if (sm == NULL)
+        return NULL;
+
+    do {
+        table->last_id = (table->last_id == INT_MAX) ? 1 : table->last_id + 1;
+    } while (smp_schedule_table_lookup(table, table->last_id) != NULL);
+
+    sm->id = table->last_id;
+    return sm;
+}
+
+void smp_scheduled_message_free(SmpScheduledMessage *sm)
+{
+    free(sm->data);
+    free(sm->spare);
+    free(sm);
+}
+
+/* return a buffer of at least size bytes for the next data of the message,
+ * the current data is kept until smp_scheduled_message_commit() */
+uint8_t *smp_scheduled_message_reserve(SmpScheduledMessage *sm, size_t size)
+{
+    if (size > sm->spare_capacity) {
+        uint8_t *data = realloc(sm->spare, size);
+
+        if (data == NULL)
+            return NULL;
+
+        sm->spare = data;
+        sm->spare_capacity = size;
+    }
+
+    return sm->spare;
+}
+
+/* make the buffer filled after smp_scheduled_message_reserve() the data of
+ * the message, the previous one is reused by the next reservation */
+void smp_scheduled_message_commit(SmpScheduledMessage *sm)
+{
+    uint8_t *data = sm->data;
+    size_t capacity = sm->capacity;
+
+    sm->data = sm->spare;
+    sm->capacity = sm->spare_capacity;
+    sm->spare = data;
+    sm->spare_capacity = capacity;
+}
+
+/* insert after the messages with the same time so they go out in order */
+void smp_schedule_table_insert(SmpScheduleTable *table,
+        SmpScheduledMessage *sm)
+{
+    SmpScheduledMessage **link = &table->head;
+
+    while (*link != NULL && (*link)->time <= sm->time)
+        link = &(*link)->next;
+
+    sm->next = *link;
+    *link = sm;
+}
+
+SmpScheduledMessage *smp_schedule_table_lookup(SmpScheduleTable *table,
+        int id)
+{
+    SmpScheduledMessage *sm;
+
+    for (sm = table->head; sm != NULL; sm = sm->next) {
+        if (sm->id == id)
+            return sm;
+    }
+
+    return NULL;
+}
+
+/* unlink the message with the given id, NULL if there is none */
+SmpScheduledMessage *smp_schedule_table_remove(SmpScheduleTable *table,
+        int id)
+{
+    SmpScheduledMessage **link;
+
+    for (link = &table->head; *link != NULL; link = &(*link)->next) {
+        SmpScheduledMessage *sm = *link;
+
+        if (sm->id == id) {
+            *link = sm->next;
+            sm->next = NULL;
+            return sm;
+        }
+    }
+
+    return NULL;
+}
+
+/* unlink the first message if its time has come */
+SmpScheduledMessage *smp_schedule_table_pop_expired(SmpScheduleTable *table,
+        uint64_t now)
+{
+    SmpScheduledMessage *sm = table->head;
+
+    if (sm == NULL || sm->time > now)
+        return NULL;
+
+    table->head = sm->next;
+    sm->next = NULL;
+    return sm;
+}
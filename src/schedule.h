@@ -0,0 +1,86 @@
+/* libsmp
+ * Copyright (C) 2026 Actronika SAS
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include "libsmp.h"
+#include "libsmp-private.h"
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct SmpScheduledMessage SmpScheduledMessage;
+
+/* A message encoded in advance and written at a given time */
+struct SmpScheduledMessage
+{
+    SmpScheduledMessage *next;
+    int id;
+
+    uint64_t time;      /* next send time */
+    uint64_t period;    /* 0 to send once */
+
+    uint32_t msgid;
+    size_t msg_size;    /* size of the encoded message */
+    uint8_t *data;      /* the encoded message, then its frame */
+    size_t capacity;
+    size_t frame_size;  /* 0 until the frame is built */
+    SmpSerialChecksum frame_checksum;
+    uint8_t *spare;     /* where the next content is encoded */
+    size_t spare_capacity;
+};
+
+/* Scheduled messages, sorted by send time */
+typedef struct
+{
+    SmpScheduledMessage *head;
+    int last_id;
+} SmpScheduleTable;
+
+SmpScheduleTable *smp_schedule_table_new(void);
+void smp_schedule_table_free(SmpScheduleTable *table);
+
+SmpScheduledMessage *smp_scheduled_message_new(SmpScheduleTable *table);
+void smp_scheduled_message_free(SmpScheduledMessage *sm);
+uint8_t *smp_scheduled_message_reserve(SmpScheduledMessage *sm, size_t size);
+void smp_scheduled_message_commit(SmpScheduledMessage *sm);
+
+void smp_schedule_table_insert(SmpScheduleTable *table,
+        SmpScheduledMessage *sm);
+SmpScheduledMessage *smp_schedule_table_lookup(SmpScheduleTable *table,
+        int id);
+SmpScheduledMessage *smp_schedule_table_remove(SmpScheduleTable *table,
+        int id);
+SmpScheduledMessage *smp_schedule_table_pop_expired(SmpScheduleTable *table,
+        uint64_t now);
+
+/* send time of the first message, 0 if there is none */
+static inline uint64_t smp_schedule_table_get_next_time(
+        SmpScheduleTable *table)
+{
+    return (table->head != NULL) ? table->head->time : 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
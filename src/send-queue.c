@@ -0,0 +1,246 @@
+/* libsmp
+ * Copyright (C) 2026 Actronika SAS
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "config.h"
+
+#include "send-queue.h"
+
+#ifdef SMP_ENABLE_POSIX_TRANSPORTS
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef HAVE_EVENTFD
+#include <sys/eventfd.h>
+#endif
+
+#include "libsmp-private-posix.h"
+
+SmpSendQueue *smp_send_queue_new(void)
+{
+    SmpSendQueue *queue;
+
+    queue = smp_new(SmpSendQueue);
+    if (queue == NULL)
+        return NULL;
+
+#ifdef HAVE_EVENTFD
+    queue->read_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (queue->read_fd < 0) {
+        free(queue);
+        return NULL;
+    }
+    queue->write_fd = queue->read_fd;
+#else
+    {
+        int fds[2];
+
+        if (pipe(fds) < 0) {
+            free(queue);
+            return NULL;
+        }
+
+        fcntl(fds[0], F_SETFL, O_NONBLOCK);
+        fcntl(fds[1], F_SETFL, O_NONBLOCK);
+        fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+        fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+        queue->read_fd = fds[0];
+        queue->write_fd = fds[1];
+    }
+#endif
+
+    queue->head = &queue->stub;
+    queue->tail = &queue->stub;
+    return queue;
+}
+
+void smp_send_queue_free(SmpSendQueue *queue)
+{
+    SmpSendQueueNode *node;
+
+    return_if_fail(queue != NULL);
+
+    free(queue->retry);
+    while ((node = queue->batch_nodes) != NULL) {
+        queue->batch_nodes = node->next;
+        free(node);
+    }
+    while ((node = smp_send_queue_pop(queue)) != NULL)
+        free(node);
+
+    close(queue->read_fd);
+    if (queue->write_fd != queue->read_fd)
+        close(queue->write_fd);
+
+    free(queue);
+}
+
+static void smp_send_queue_link(SmpSendQueue *queue, SmpSendQueueNode *node)
+{
+    SmpSendQueueNode *prev;
+
+    __atomic_store_n(&node->next, NULL, __ATOMIC_RELAXED);
+    prev = __atomic_exchange_n(&queue->head, node, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+}
+
+/* thread-safe, the queue takes the node */
+void smp_send_queue_push(SmpSendQueue *queue, SmpSendQueueNode *node)
+{
+    smp_send_queue_link(queue, node);
+
+    /* signal after the node is linked, so a consumer clearing the wakeup
+     * before popping can't miss it */
+    if (!__atomic_exchange_n(&queue->signaled, 1, __ATOMIC_ACQ_REL)) {
+        uint64_t one = 1;
+        ssize_t ret;
+
+        do {
+            ret = write(queue->write_fd, &one,
+                    (queue->write_fd == queue->read_fd) ? sizeof(one) : 1);
+        } while (ret < 0 && errno == EINTR);
+    }
+}
+
+/* consumer only, return NULL when the queue is empty or a producer is
+ * between its exchange and its link, which signals again */
+SmpSendQueueNode *smp_send_queue_pop(SmpSendQueue *queue)
+{
+    SmpSendQueueNode *tail = queue->tail;
+    SmpSendQueueNode *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+
+    if (tail == &queue->stub) {
+        if (next == NULL)
+            return NULL;
+
+        queue->tail = next;
+        tail = next;
+        next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+    }
+
+    if (next != NULL) {
+        queue->tail = next;
+        return tail;
+    }
+
+    if (tail != __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE))
+        return NULL;
+
+    /* tail is the last node, put the stub behind it to take it */
+    smp_send_queue_link(queue, &queue->stub);
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (next != NULL) {
+        queue->tail = next;
+        return tail;
+    }
+
+    return NULL;
+}
+
+intptr_t smp_send_queue_get_fd(SmpSendQueue *queue)
+{
+    return queue->read_fd;
+}
+
+/* Consumer only, to call before popping the nodes. fd_ready tells the fd was
+ * polled readable: a producer may set the flag and write the fd after the
+ * consumer cleared it for the previous wakeup, and the fd must not stay
+ * readable. The fd is drained before the flag is cleared so a push racing
+ * with this either finds the flag cleared and signals again, or is linked
+ * before the nodes are popped. */
+void smp_send_queue_clear_wakeup(SmpSendQueue *queue, bool fd_ready)
+{
+    uint8_t buf[64];
+
+    if (!fd_ready && !__atomic_load_n(&queue->signaled, __ATOMIC_ACQUIRE))
+        return;
+
+    while (read(queue->read_fd, buf, sizeof(buf)) > 0);
+    __atomic_exchange_n(&queue->signaled, 0, __ATOMIC_ACQ_REL);
+}
+
+/* wait for the device or the queue, device_fd may be negative if the device
+ * can't be polled */
+int smp_send_queue_wait(SmpSendQueue *queue, intptr_t device_fd,
+        int timeout_ms, bool *queue_ready, bool *device_ready)
+{
+    struct pollfd pfds[2];
+    nfds_t n = 0;
+    int ret;
+
+    pfds[n].fd = queue->read_fd;
+    pfds[n].events = POLLIN;
+    pfds[n].revents = 0;
+    n++;
+
+    if (device_fd >= 0) {
+        pfds[n].fd = (int) device_fd;
+        pfds[n].events = POLLIN;
+        pfds[n].revents = 0;
+        n++;
+    }
+
+    ret = poll(pfds, n, timeout_ms);
+    if (ret < 0)
+        return errno_to_smp_error(errno);
+    else if (ret == 0)
+        return SMP_ERROR_TIMEDOUT;
+
+    *queue_ready = (pfds[0].revents != 0);
+    *device_ready = (n > 1 && pfds[1].revents != 0);
+    return 0;
+}
+
+#else
+
+SmpSendQueue *smp_send_queue_new(void)
+{
+    return NULL;
+}
+
+void smp_send_queue_free(SmpSendQueue *queue)
+{
+}
+
+void smp_send_queue_push(SmpSendQueue *queue, SmpSendQueueNode *node)
+{
+}
+
+SmpSendQueueNode *smp_send_queue_pop(SmpSendQueue *queue)
+{
+    return NULL;
+}
+
+intptr_t smp_send_queue_get_fd(SmpSendQueue *queue)
+{
+    return SMP_ERROR_NOT_SUPPORTED;
+}
+
+void smp_send_queue_clear_wakeup(SmpSendQueue *queue, bool fd_ready)
+{
+}
+
+int smp_send_queue_wait(SmpSendQueue *queue, intptr_t device_fd,
+        int timeout_ms, bool *queue_ready, bool *device_ready)
+{
+    return SMP_ERROR_NOT_SUPPORTED;
+}
+
+#endif /* SMP_ENABLE_POSIX_TRANSPORTS */
@@ -0,0 +1,84 @@
+/* libsmp
+ * Copyright (C) 2026 Actronika SAS
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SEND_QUEUE_H
+#define SEND_QUEUE_H
+
+#include "libsmp.h"
+#include "libsmp-private.h"
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* frames written at once by the consumer */
+#define SMP_SEND_QUEUE_BATCH_SIZE 4096
+
+typedef struct SmpSendQueueNode SmpSendQueueNode;
+
+/* A message encoded by a producer thread */
+struct SmpSendQueueNode
+{
+    SmpSendQueueNode *next;
+
+    uint32_t msgid;
+    size_t msg_size;    /* size of the encoded message */
+    bool framed;        /* data is a serial frame, or the encoded message */
+    size_t size;
+    uint8_t data[];
+};
+
+/* Intrusive multi-producer single-consumer queue. Producers push with an
+ * atomic exchange and wake the consumer through a file descriptor, which is
+ * signaled once until the consumer clears it. */
+typedef struct
+{
+    SmpSendQueueNode *head;     /* last pushed node, shared by producers */
+    SmpSendQueueNode *tail;     /* next node to pop, owned by the consumer */
+    SmpSendQueueNode stub;
+    int signaled;
+
+    int read_fd;
+    int write_fd;
+
+    /* owned by the consumer: a node the link layer couldn't take yet and
+     * the frames gathered for a single write */
+    SmpSendQueueNode *retry;
+    uint8_t batch[SMP_SEND_QUEUE_BATCH_SIZE];
+    size_t batch_size;
+    unsigned int batch_frames;
+    SmpSendQueueNode *batch_nodes;
+} SmpSendQueue;
+
+SmpSendQueue *smp_send_queue_new(void);
+void smp_send_queue_free(SmpSendQueue *queue);
+
+void smp_send_queue_push(SmpSendQueue *queue, SmpSendQueueNode *node);
+SmpSendQueueNode *smp_send_queue_pop(SmpSendQueue *queue);
+
+intptr_t smp_send_queue_get_fd(SmpSendQueue *queue);
+void smp_send_queue_clear_wakeup(SmpSendQueue *queue, bool fd_ready);
+int smp_send_queue_wait(SmpSendQueue *queue, intptr_t device_fd,
+        int timeout_ms, bool *queue_ready, bool *device_ready);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
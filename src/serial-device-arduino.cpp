@@ -366,3 +366,15 @@ int smp_serial_device_wait(SmpSerialDevice *device, int timeout_ms)
         return SMP_ERROR_TIMEDOUT;
     }
 }
+
+ssize_t smp_serial_device_writev(SmpSerialDevice *sdev, const SmpIoVec *iov,
+        int iovcnt)
+{
+    return smp_serial_device_write_each(sdev, iov, iovcnt);
+}
+
+ssize_t smp_serial_device_get_output_queue(SmpSerialDevice *sdev)
+{
+    /* the Stream interface does not expose the TX buffer fill level */
+    return SMP_ERROR_NOT_SUPPORTED;
+}
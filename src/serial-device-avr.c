@@ -19,6 +19,7 @@
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <stdbool.h>
 #include <string.h>
 #include <util/delay.h>
 
@@ -44,6 +45,7 @@ typedef struct
     uint8_t cbuf[SMP_SERIAL_DEVICE_AVR_CBUF_SIZE];
     volatile uint8_t rindex;
     volatile uint8_t windex;
+    volatile bool overflow;
 } UARTDevice;
 
 static void rx_interrupt_handler(UARTDevice *dev);
@@ -153,10 +155,21 @@ static UARTDevice *get_device_from_fd(int fd)
 
 static void rx_interrupt_handler(UARTDevice *dev)
 {
-    dev->cbuf[dev->windex] = *(dev->regs.dr);
-    dev->windex++;
-    if (dev->windex >= SMP_SERIAL_DEVICE_AVR_CBUF_SIZE)
-        dev->windex = 0;
+    uint8_t byte = *(dev->regs.dr);
+    uint8_t next = dev->windex + 1;
+
+    if (next >= SMP_SERIAL_DEVICE_AVR_CBUF_SIZE)
+        next = 0;
+
+    /* buffer is full, drop the byte instead of overwriting unread ones and
+     * report it on next read */
+    if (next == dev->rindex) {
+        dev->overflow = true;
+        return;
+    }
+
+    dev->cbuf[dev->windex] = byte;
+    dev->windex = next;
 }
 
 #pragma GCC diagnostic push
@@ -565,6 +578,11 @@ ssize_t smp_serial_device_read(SmpSerialDevice *sdev, void *buf, size_t size)
     if (dev == NULL)
         return SMP_ERROR_NO_DEVICE;
 
+    if (dev->overflow) {
+        dev->overflow = false;
+        return SMP_ERROR_OVERFLOW;
+    }
+
     for (i = 0; i < size; i++) {
         if (dev->rindex == dev->windex)
             break;
@@ -611,3 +629,15 @@ int smp_serial_device_wait(SmpSerialDevice *sdev, int timeout_ms)
         return SMP_ERROR_TIMEDOUT;
     }
 }
+
+ssize_t smp_serial_device_writev(SmpSerialDevice *sdev, const SmpIoVec *iov,
+        int iovcnt)
+{
+    return smp_serial_device_write_each(sdev, iov, iovcnt);
+}
+
+ssize_t smp_serial_device_get_output_queue(SmpSerialDevice *sdev)
+{
+    /* writes wait for each byte to be taken by the UART */
+    return 0;
+}
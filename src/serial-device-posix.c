@@ -19,51 +19,16 @@
 
 #include "serial-device.h"
 
-#include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
 
-#ifdef HAVE_POLL_H
-#include <poll.h>
-#endif
-
 #ifdef HAVE_TERMIOS_H
+#include <sys/ioctl.h>
 #include <termios.h>
 #endif
 
 #include "libsmp-private.h"
-
-static SmpError errno_to_smp_error(int err)
-{
-    switch (err) {
-        case EINVAL:
-            return SMP_ERROR_INVALID_PARAM;
-        case EBADMSG:
-            return SMP_ERROR_BAD_MESSAGE;
-        case E2BIG:
-            return SMP_ERROR_TOO_BIG;
-        case ENOMEM:
-            return SMP_ERROR_NO_MEM;
-        case ENOENT:
-            return SMP_ERROR_NO_DEVICE;
-        case ETIMEDOUT:
-            return SMP_ERROR_TIMEDOUT;
-        case EBADF:
-            return SMP_ERROR_BAD_FD;
-        case ENOSYS:
-            return SMP_ERROR_NOT_SUPPORTED;
-        case EBUSY:
-            return SMP_ERROR_BUSY;
-        case EPERM:
-            return SMP_ERROR_PERM;
-        case EAGAIN:
-            return SMP_ERROR_WOULD_BLOCK;
-        case EIO:
-            return SMP_ERROR_IO;
-        default:
-            return SMP_ERROR_OTHER;
-    }
-}
+#include "libsmp-private-posix.h"
 
 void smp_serial_device_init(SmpSerialDevice *device)
 {
@@ -225,6 +190,12 @@ ssize_t smp_serial_device_write(SmpSerialDevice *device, const void *buf,
     return (ret < 0) ? errno_to_smp_error(errno) : ret;
 }
 
+ssize_t smp_serial_device_writev(SmpSerialDevice *device, const SmpIoVec *iov,
+        int iovcnt)
+{
+    return smp_fd_writev(device->fd, iov, iovcnt);
+}
+
 ssize_t smp_serial_device_read(SmpSerialDevice *device, void *buf, size_t size)
 {
     ssize_t ret;
@@ -240,27 +211,19 @@ ssize_t smp_serial_device_read(SmpSerialDevice *device, void *buf, size_t size)
 
 int smp_serial_device_wait(SmpSerialDevice *device, int timeout_ms)
 {
-#ifdef HAVE_POLL_H
-    struct pollfd pfd;
-    int ret;
-
-    pfd.fd = device->fd;
-    pfd.events = POLLIN;
-    pfd.revents = 0;
-
-    ret = poll(&pfd, 1, timeout_ms);
-    if (ret < 0)
-        return errno_to_smp_error(errno);
-    else if (ret == 0)
-        return SMP_ERROR_TIMEDOUT;
+    return smp_fd_wait(device->fd, timeout_ms);
+}
 
-    if (pfd.revents & POLLERR) {
-        /* we have an error on the fd, assume that it has been disconnected */
-        return SMP_ERROR_PIPE;
-    }
+ssize_t smp_serial_device_get_output_queue(SmpSerialDevice *device)
+{
+#if defined(HAVE_TERMIOS_H) && defined(TIOCOUTQ)
+    int queued;
 
-    return 0;
+    /* fails on descriptors other than ttys */
+    if (ioctl(device->fd, TIOCOUTQ, &queued) < 0)
+        return SMP_ERROR_NOT_SUPPORTED;
 
+    return queued;
 #else
     return SMP_ERROR_NOT_SUPPORTED;
 #endif
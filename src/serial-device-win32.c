@@ -290,3 +290,20 @@ int smp_serial_device_wait(SmpSerialDevice *device, int timeout_ms)
             return SMP_ERROR_OTHER;
     }
 }
+
+ssize_t smp_serial_device_writev(SmpSerialDevice *device, const SmpIoVec *iov,
+        int iovcnt)
+{
+    return smp_serial_device_write_each(device, iov, iovcnt);
+}
+
+ssize_t smp_serial_device_get_output_queue(SmpSerialDevice *device)
+{
+    COMSTAT stat;
+    DWORD errors;
+
+    if (!ClearCommError(device->handle, &errors, &stat))
+        return get_last_error_as_smp_error();
+
+    return stat.cbOutQue;
+}
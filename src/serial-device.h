@@ -26,6 +26,8 @@
 extern "C" {
 #endif
 
+#define SMP_SERIAL_DEVICE_IOV_MAX 64
+
 void smp_serial_device_init(SmpSerialDevice *device);
 int smp_serial_device_open(SmpSerialDevice *device, const char *path);
 void smp_serial_device_close(SmpSerialDevice *device);
@@ -36,6 +38,36 @@ ssize_t smp_serial_device_write(SmpSerialDevice *device, const void *buf,
         size_t size);
 ssize_t smp_serial_device_read(SmpSerialDevice *device, void *buf, size_t size);
 
+/* at most SMP_SERIAL_DEVICE_IOV_MAX buffers */
+ssize_t smp_serial_device_writev(SmpSerialDevice *device, const SmpIoVec *iov,
+        int iovcnt);
+
+/* writev of the devices without scatter-gather writes, stops at the first
+ * short write */
+static inline ssize_t smp_serial_device_write_each(SmpSerialDevice *device,
+        const SmpIoVec *iov, int iovcnt)
+{
+    ssize_t total = 0;
+    int i;
+
+    for (i = 0; i < iovcnt; i++) {
+        ssize_t ret = smp_serial_device_write(device, iov[i].base,
+                iov[i].size);
+
+        if (ret < 0)
+            return (total > 0) ? total : ret;
+
+        total += ret;
+        if ((size_t) ret != iov[i].size)
+            break;
+    }
+
+    return total;
+}
+
+/* number of bytes written but not sent yet */
+ssize_t smp_serial_device_get_output_queue(SmpSerialDevice *device);
+
 /* negative timeout_ms means infinite */
 int smp_serial_device_wait(SmpSerialDevice *device, int timeout_ms);
 
@@ -30,10 +30,12 @@
 
 #include "libsmp.h"
 #include "libsmp-private.h"
+#include "crc.h"
+#include "stats.h"
 
-#define START_BYTE 0x10
-#define END_BYTE 0xFF
-#define ESC_BYTE 0x1B
+#define START_BYTE SMP_SERIAL_PROTOCOL_START_BYTE
+#define END_BYTE SMP_SERIAL_PROTOCOL_END_BYTE
+#define ESC_BYTE SMP_SERIAL_PROTOCOL_ESC_BYTE
 
 #define DEFAULT_BUFFER_SIZE 1024
 
@@ -46,23 +48,32 @@
 SMP_STATIC_ASSERT(sizeof(SmpSerialProtocolDecoder)
         == sizeof(SmpStaticSerialProtocolDecoder));
 
-static inline int is_magic_byte(uint8_t byte)
+static size_t checksum_size(SmpSerialChecksum checksum)
 {
-    return (byte == START_BYTE || byte == END_BYTE || byte == ESC_BYTE);
+    switch (checksum) {
+        case SMP_SERIAL_CHECKSUM_CRC16_CCITT:
+            return 2;
+        case SMP_SERIAL_CHECKSUM_CRC32C:
+            return 4;
+        case SMP_SERIAL_CHECKSUM_XOR8:
+        default:
+            return 1;
+    }
 }
 
-static size_t compute_payload_size(const uint8_t *buf, size_t size)
+static size_t compute_payload_size(const uint8_t *buf, size_t size,
+        SmpSerialChecksum checksum)
 {
     size_t ret;
     size_t i;
 
-    /* We need at least three extra bytes (START, END and CRC) and 1 extra
-     * byte in case the checksum has to be escaped */
-    ret = size + 4;
+    /* We need at least two extra bytes (START and END), the checksum and
+     * room to escape each checksum byte */
+    ret = size + 2 + 2 * checksum_size(checksum);
 
     /* count the number of extra bytes */
     for (i = 0; i < size; i++) {
-        if (is_magic_byte(buf[i]))
+        if (smp_serial_protocol_is_magic_byte(buf[i]))
             ret++;
     }
 
@@ -81,6 +92,157 @@ static uint8_t compute_checksum(const uint8_t *buf, size_t size)
     return checksum;
 }
 
+/* The frame check of a payload given in several pieces: start with
+ * smp_serial_protocol_check_init(), update it with each piece and write it
+ * with smp_serial_protocol_check_finish() */
+uint32_t smp_serial_protocol_check_init(SmpSerialChecksum checksum)
+{
+    switch (checksum) {
+        case SMP_SERIAL_CHECKSUM_CRC16_CCITT:
+            return SMP_CRC16_CCITT_INIT;
+        case SMP_SERIAL_CHECKSUM_CRC32C:
+            return SMP_CRC32C_INIT;
+        case SMP_SERIAL_CHECKSUM_XOR8:
+        default:
+            return 0;
+    }
+}
+
+uint32_t smp_serial_protocol_check_update(SmpSerialChecksum checksum,
+        uint32_t check, const uint8_t *buf, size_t size)
+{
+    switch (checksum) {
+        case SMP_SERIAL_CHECKSUM_CRC16_CCITT:
+            return smp_crc16_ccitt_update((uint16_t) check, buf, size);
+        case SMP_SERIAL_CHECKSUM_CRC32C:
+            return smp_crc32c_update(check, buf, size);
+        case SMP_SERIAL_CHECKSUM_XOR8:
+        default:
+            return check ^ compute_checksum(buf, size);
+    }
+}
+
+/* write the check in dest in transmission order and return its size */
+size_t smp_serial_protocol_check_finish(SmpSerialChecksum checksum,
+        uint32_t check, uint8_t *dest)
+{
+    switch (checksum) {
+        case SMP_SERIAL_CHECKSUM_CRC16_CCITT:
+            dest[0] = (uint8_t) (check >> 8);
+            dest[1] = (uint8_t) check;
+            return 2;
+        case SMP_SERIAL_CHECKSUM_CRC32C:
+            check ^= SMP_CRC32C_XOROUT;
+            dest[0] = (uint8_t) check;
+            dest[1] = (uint8_t) (check >> 8);
+            dest[2] = (uint8_t) (check >> 16);
+            dest[3] = (uint8_t) (check >> 24);
+            return 4;
+        case SMP_SERIAL_CHECKSUM_XOR8:
+        default:
+            dest[0] = (uint8_t) check;
+            return 1;
+    }
+}
+
+/* write the checksum of buf in dest in transmission order and return its
+ * size */
+size_t smp_serial_protocol_compute_check(SmpSerialChecksum checksum,
+        const uint8_t *buf, size_t size, uint8_t *dest)
+{
+    uint32_t check;
+
+    check = smp_serial_protocol_check_init(checksum);
+    check = smp_serial_protocol_check_update(checksum, check, buf, size);
+    return smp_serial_protocol_check_finish(checksum, check, dest);
+}
+
+#define SMP_REPEAT_BYTE(byte) ((uint64_t) (byte) * 0x0101010101010101ULL)
+
+/* non zero if one of the bytes of word is zero */
+static inline uint64_t has_zero_byte(uint64_t word)
+{
+    return (word - SMP_REPEAT_BYTE(0x01)) & ~word & SMP_REPEAT_BYTE(0x80);
+}
+
+/* Return the offset of the first byte of buf which has to be escaped, size if
+ * there is none. Eight bytes are checked at once. */
+size_t smp_serial_protocol_find_magic_byte(const uint8_t *buf, size_t size)
+{
+    size_t i = 0;
+
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t word;
+
+        memcpy(&word, buf + i, sizeof(word));
+        if (has_zero_byte(word ^ SMP_REPEAT_BYTE(START_BYTE))
+                | has_zero_byte(word ^ SMP_REPEAT_BYTE(END_BYTE))
+                | has_zero_byte(word ^ SMP_REPEAT_BYTE(ESC_BYTE)))
+            break;
+    }
+
+    for (; i < size; i++) {
+        if (smp_serial_protocol_is_magic_byte(buf[i]))
+            return i;
+    }
+
+    return size;
+}
+
+/* The decoder runs the frame check over the payload and the received
+ * checksum as bytes arrive, so a valid frame ends with a known residue and no
+ * extra pass over the payload is needed on END_BYTE. */
+static void
+smp_serial_protocol_decoder_reset_check(SmpSerialProtocolDecoder *decoder)
+{
+    switch (decoder->checksum) {
+        case SMP_SERIAL_CHECKSUM_CRC16_CCITT:
+            decoder->check = SMP_CRC16_CCITT_INIT;
+            break;
+        case SMP_SERIAL_CHECKSUM_CRC32C:
+            decoder->check = SMP_CRC32C_INIT;
+            break;
+        case SMP_SERIAL_CHECKSUM_XOR8:
+        default:
+            decoder->check = 0;
+            break;
+    }
+}
+
+static void
+smp_serial_protocol_decoder_update_check(SmpSerialProtocolDecoder *decoder,
+        uint8_t byte)
+{
+    switch (decoder->checksum) {
+        case SMP_SERIAL_CHECKSUM_CRC16_CCITT:
+            decoder->check = smp_crc16_ccitt_update_byte(
+                    (uint16_t) decoder->check, byte);
+            break;
+        case SMP_SERIAL_CHECKSUM_CRC32C:
+            decoder->check = smp_crc32c_update_byte(decoder->check, byte);
+            break;
+        case SMP_SERIAL_CHECKSUM_XOR8:
+        default:
+            decoder->check ^= byte;
+            break;
+    }
+}
+
+static bool
+smp_serial_protocol_decoder_check_is_valid(SmpSerialProtocolDecoder *decoder)
+{
+    switch (decoder->checksum) {
+        case SMP_SERIAL_CHECKSUM_CRC16_CCITT:
+            return decoder->check == SMP_CRC16_CCITT_RESIDUE;
+        case SMP_SERIAL_CHECKSUM_CRC32C:
+            return decoder->check == SMP_CRC32C_RESIDUE;
+        case SMP_SERIAL_CHECKSUM_XOR8:
+        default:
+            /* payload xor its checksum */
+            return decoder->check == 0;
+    }
+}
+
 static int
 smp_serial_protocol_decoder_set_capacity(SmpSerialProtocolDecoder *decoder,
         size_t capacity)
@@ -118,11 +280,18 @@ smp_serial_protocol_decoder_put_byte(SmpSerialProtocolDecoder *decoder,
             return SMP_ERROR_OVERFLOW;
 
         ret = smp_serial_protocol_decoder_set_capacity(decoder, new_size);
-        if (ret < 0)
+        if (ret < 0) {
+            if (ret == SMP_ERROR_TOO_BIG)
+                SMP_STATS_INC(decoder->n_oversize_frames);
+
             return ret;
+        }
+
+        SMP_STATS_INC(decoder->n_reallocs);
     }
 
     decoder->buf[decoder->offset++] = byte;
+    smp_serial_protocol_decoder_update_check(decoder, byte);
     return 0;
 }
 
@@ -133,7 +302,7 @@ static int smp_serial_protocol_write_byte(uint8_t *dest, uint8_t byte)
     int offset = 0;
 
     /* escape special byte */
-    if (is_magic_byte(byte))
+    if (smp_serial_protocol_is_magic_byte(byte))
         dest[offset++] = ESC_BYTE;
 
     dest[offset++] = byte;
@@ -152,6 +321,9 @@ smp_serial_protocol_decoder_process_byte_inframe(
         case START_BYTE:
             /* we are in a frame without end byte, resync on current byte */
             decoder->offset = 0;
+            decoder->frame_start_time = decoder->rx_time;
+            smp_serial_protocol_decoder_reset_check(decoder);
+            SMP_STATS_INC(decoder->n_resyncs);
             ret = SMP_ERROR_BAD_MESSAGE;
             break;
         case ESC_BYTE:
@@ -159,23 +331,22 @@ smp_serial_protocol_decoder_process_byte_inframe(
             ret = 0;
             break;
         case END_BYTE: {
-           uint8_t cs;
+           size_t cssize = checksum_size(decoder->checksum);
 
            /* we should at least have the CRC */
-           if (decoder->offset < 1) {
+           if (decoder->offset < cssize) {
                decoder->state = SMP_SERIAL_PROTOCOL_DECODER_STATE_WAIT_HEADER;
                ret = SMP_ERROR_BAD_MESSAGE;
                break;
            }
 
-           /* framesize is without the CRC */
-           *framesize = decoder->offset - 1;
-
-           /* frame complete, check crc and call user callback */
-           cs = compute_checksum(decoder->buf, *framesize);
-           if (cs != decoder->buf[decoder->offset - 1]) {
+           /* frame complete, the check already covers the CRC bytes */
+           if (!smp_serial_protocol_decoder_check_is_valid(decoder)) {
+               SMP_STATS_INC(decoder->n_checksum_errors);
                ret = SMP_ERROR_BAD_MESSAGE;
            } else {
+               /* framesize is without the CRC */
+               *framesize = decoder->offset - cssize;
                *frame = decoder->buf;
                ret = 0;
            }
@@ -198,6 +369,11 @@ static int smp_serial_protocol_decoder_init(SmpSerialProtocolDecoder *decoder,
 
     decoder->state = SMP_SERIAL_PROTOCOL_DECODER_STATE_WAIT_HEADER;
     decoder->statically_allocated = statically_allocated;
+    decoder->checksum = SMP_SERIAL_CHECKSUM_XOR8;
+    decoder->rx_time = 0;
+    decoder->frame_start_time = 0;
+    smp_serial_protocol_decoder_reset_check(decoder);
+    smp_serial_protocol_decoder_reset_stats(decoder);
 
     if (buf == NULL) {
         decoder->maxsize = DEFAULT_MAXIMUM_DECODER_BUFFER_SIZE;
@@ -293,6 +469,8 @@ int smp_serial_protocol_decoder_process_byte(SmpSerialProtocolDecoder *decoder,
             if (byte == START_BYTE) {
                 decoder->state = SMP_SERIAL_PROTOCOL_DECODER_STATE_IN_FRAME;
                 decoder->offset = 0;
+                decoder->frame_start_time = decoder->rx_time;
+                smp_serial_protocol_decoder_reset_check(decoder);
             }
             ret = 0;
             break;
@@ -334,11 +512,53 @@ int smp_serial_protocol_decoder_set_maximum_capacity(
     return 0;
 }
 
+int smp_serial_protocol_decoder_set_checksum(SmpSerialProtocolDecoder *decoder,
+        SmpSerialChecksum checksum)
+{
+    return_val_if_fail(decoder != NULL, SMP_ERROR_INVALID_PARAM);
+
+    switch (checksum) {
+        case SMP_SERIAL_CHECKSUM_XOR8:
+        case SMP_SERIAL_CHECKSUM_CRC16_CCITT:
+        case SMP_SERIAL_CHECKSUM_CRC32C:
+            break;
+        default:
+            return SMP_ERROR_INVALID_PARAM;
+    }
+
+    /* drop any frame in progress, it was checked using the old algorithm */
+    decoder->checksum = checksum;
+    decoder->state = SMP_SERIAL_PROTOCOL_DECODER_STATE_WAIT_HEADER;
+    smp_serial_protocol_decoder_reset_check(decoder);
+    return 0;
+}
+
+void smp_serial_protocol_decoder_reset_stats(SmpSerialProtocolDecoder *decoder)
+{
+    return_if_fail(decoder != NULL);
+
+    SMP_STATS_STORE(decoder->n_checksum_errors, 0);
+    SMP_STATS_STORE(decoder->n_resyncs, 0);
+    SMP_STATS_STORE(decoder->n_oversize_frames, 0);
+    SMP_STATS_STORE(decoder->n_reallocs, 0);
+}
+
 /* if *outbuf == NULL, it will be allocated */
 ssize_t smp_serial_protocol_encode(const uint8_t *inbuf, size_t insize,
         uint8_t **outbuf, size_t outsize)
+{
+    return smp_serial_protocol_encode_with_checksum(inbuf, insize, outbuf,
+            outsize, SMP_SERIAL_CHECKSUM_XOR8);
+}
+
+/* if *outbuf == NULL, it will be allocated */
+ssize_t smp_serial_protocol_encode_with_checksum(const uint8_t *inbuf,
+        size_t insize, uint8_t **outbuf, size_t outsize,
+        SmpSerialChecksum checksum)
 {
     uint8_t *txbuf;
+    uint8_t cs[4];
+    size_t cssize;
     size_t payload_size;
     size_t offset = 0;
     size_t i;
@@ -348,7 +568,7 @@ ssize_t smp_serial_protocol_encode(const uint8_t *inbuf, size_t insize,
     return_val_if_fail(*outbuf == NULL || (*outbuf != NULL && outsize > 0),
             SMP_ERROR_INVALID_PARAM);
 
-    payload_size = compute_payload_size(inbuf, insize);
+    payload_size = compute_payload_size(inbuf, insize, checksum);
     if (*outbuf == NULL) {
         txbuf = malloc(payload_size);
         if (txbuf == NULL)
@@ -364,8 +584,10 @@ ssize_t smp_serial_protocol_encode(const uint8_t *inbuf, size_t insize,
     for (i = 0; i < insize; i++)
         offset += smp_serial_protocol_write_byte(txbuf + offset, inbuf[i]);
 
-    offset += smp_serial_protocol_write_byte(txbuf + offset,
-            compute_checksum(inbuf, insize));
+    cssize = smp_serial_protocol_compute_check(checksum, inbuf, insize, cs);
+    for (i = 0; i < cssize; i++)
+        offset += smp_serial_protocol_write_byte(txbuf + offset, cs[i]);
+
     txbuf[offset++] = END_BYTE;
 
     *outbuf = txbuf;
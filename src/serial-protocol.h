@@ -27,6 +27,12 @@
 extern "C" {
 #endif
 
+/* Framing bytes. Escaped bytes are sent as is after ESC_BYTE, so a
+ * START_BYTE preceded by an even number of ESC_BYTE always starts a frame. */
+#define SMP_SERIAL_PROTOCOL_START_BYTE 0x10
+#define SMP_SERIAL_PROTOCOL_END_BYTE 0xFF
+#define SMP_SERIAL_PROTOCOL_ESC_BYTE 0x1B
+
 /* Decoder API */
 typedef enum
 {
@@ -44,6 +50,20 @@ struct SmpSerialProtocolDecoder
     size_t offset;
     size_t maxsize;
 
+    SmpSerialChecksum checksum;
+    uint32_t check;
+
+    /* time of the data being processed, set by the caller, and the one it
+     * had when the current frame started */
+    uint64_t rx_time;
+    uint64_t frame_start_time;
+
+    /* statistics, see stats.h */
+    uint64_t n_checksum_errors;
+    uint64_t n_resyncs;
+    uint64_t n_oversize_frames;
+    uint64_t n_reallocs;
+
     bool statically_allocated;
 };
 
@@ -53,10 +73,37 @@ int smp_serial_protocol_decoder_process_byte(SmpSerialProtocolDecoder *decoder,
         uint8_t byte, uint8_t **frame, size_t *framesize);
 int smp_serial_protocol_decoder_set_maximum_capacity(SmpSerialProtocolDecoder *decoder,
         size_t max);
+int smp_serial_protocol_decoder_set_checksum(SmpSerialProtocolDecoder *decoder,
+        SmpSerialChecksum checksum);
+void smp_serial_protocol_decoder_reset_stats(SmpSerialProtocolDecoder *decoder);
+
+static inline void smp_serial_protocol_decoder_set_rx_time(
+        SmpSerialProtocolDecoder *decoder, uint64_t time)
+{
+    decoder->rx_time = time;
+}
 
 /* Encoder API */
+static inline bool smp_serial_protocol_is_magic_byte(uint8_t byte)
+{
+    return (byte == SMP_SERIAL_PROTOCOL_START_BYTE
+            || byte == SMP_SERIAL_PROTOCOL_END_BYTE
+            || byte == SMP_SERIAL_PROTOCOL_ESC_BYTE);
+}
+
+size_t smp_serial_protocol_find_magic_byte(const uint8_t *buf, size_t size);
+uint32_t smp_serial_protocol_check_init(SmpSerialChecksum checksum);
+uint32_t smp_serial_protocol_check_update(SmpSerialChecksum checksum,
+        uint32_t check, const uint8_t *buf, size_t size);
+size_t smp_serial_protocol_check_finish(SmpSerialChecksum checksum,
+        uint32_t check, uint8_t *dest);
+size_t smp_serial_protocol_compute_check(SmpSerialChecksum checksum,
+        const uint8_t *buf, size_t size, uint8_t *dest);
 ssize_t smp_serial_protocol_encode(const uint8_t *inbuf, size_t insize,
         uint8_t **outbuf, size_t outsize);
+ssize_t smp_serial_protocol_encode_with_checksum(const uint8_t *inbuf,
+        size_t insize, uint8_t **outbuf, size_t outsize,
+        SmpSerialChecksum checksum);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,41 @@
+/* libsmp
+ * Copyright (C) 2026 Actronika SAS
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+/* Statistics counters are only written by the thread processing the context
+ * so a relaxed load and store is enough to update them without a locked
+ * read-modify-write, while other threads still read them without tearing.
+ * Platforms without lock-free 64 bits atomics (e.g. AVR) don't have threads
+ * reading them concurrently so plain accesses are used. */
+#if defined(__GCC_ATOMIC_LLONG_LOCK_FREE) && __GCC_ATOMIC_LLONG_LOCK_FREE == 2
+#define SMP_STATS_LOAD(counter) __atomic_load_n(&(counter), __ATOMIC_RELAXED)
+#define SMP_STATS_STORE(counter, value) \
+    __atomic_store_n(&(counter), (value), __ATOMIC_RELAXED)
+#else
+#define SMP_STATS_LOAD(counter) (counter)
+#define SMP_STATS_STORE(counter, value) ((counter) = (value))
+#endif
+
+#define SMP_STATS_ADD(counter, value) \
+    SMP_STATS_STORE(counter, SMP_STATS_LOAD(counter) + (uint64_t) (value))
+
+#define SMP_STATS_INC(counter) SMP_STATS_ADD(counter, 1)
+
+#endif
@@ -0,0 +1,163 @@
+/* libsmp
+ * Copyright (C) 2026 Actronika SAS
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "config.h"
+
+#include "trace.h"
+
+#ifdef SMP_ENABLE_TRACE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clock.h"
+#include "libsmp-private.h"
+
+static const char *stage_names[SMP_TRACE_STAGE_COUNT] = {
+    [SMP_TRACE_STAGE_READ] = "read",
+    [SMP_TRACE_STAGE_DECODE] = "decode",
+    [SMP_TRACE_STAGE_BUILD_MESSAGE] = "build-message",
+    [SMP_TRACE_STAGE_CALLBACK] = "callback",
+    [SMP_TRACE_STAGE_ENCODE_MESSAGE] = "encode-message",
+    [SMP_TRACE_STAGE_ENCODE_FRAME] = "encode-frame",
+    [SMP_TRACE_STAGE_WRITE] = "write",
+};
+
+SmpTrace *smp_trace_new(size_t n_events)
+{
+    SmpTrace *trace;
+    size_t capacity = 1;
+
+    while (capacity < n_events)
+        capacity *= 2;
+
+    trace = smp_new(SmpTrace);
+    if (trace == NULL)
+        return NULL;
+
+    trace->events = calloc(capacity, sizeof(*trace->events));
+    if (trace->events == NULL) {
+        free(trace);
+        return NULL;
+    }
+
+    trace->capacity = capacity;
+    trace->origin_ticks = smp_trace_now();
+    trace->origin_ns = smp_clock_get_time_ns();
+    return trace;
+}
+
+void smp_trace_free(SmpTrace *trace)
+{
+    return_if_fail(trace != NULL);
+
+    free(trace->events);
+    free(trace);
+}
+
+/* copy the events still in the ring, return the number of events copied and
+ * the index of the first one */
+static size_t smp_trace_snapshot(SmpTrace *trace, SmpTraceEvent *events,
+        uint64_t *first)
+{
+    uint64_t head;
+    uint64_t head_after;
+    uint64_t start;
+    uint64_t valid;
+    uint64_t i;
+
+    head = __atomic_load_n(&trace->head, __ATOMIC_ACQUIRE);
+    start = (head > trace->capacity) ? head - trace->capacity : 0;
+
+    for (i = start; i < head; i++)
+        events[i - start] = trace->events[i & (trace->capacity - 1)];
+
+    /* the producer may have overwritten the oldest events while copying,
+     * including the slot of the event it is writing right now */
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    head_after = __atomic_load_n(&trace->head, __ATOMIC_RELAXED);
+    valid = (head_after + 1 > trace->capacity) ?
+        head_after + 1 - trace->capacity : 0;
+    if (valid < start)
+        valid = start;
+
+    if (valid >= head) {
+        *first = 0;
+        return 0;
+    }
+
+    *first = valid - start;
+    return (size_t) (head - valid);
+}
+
+int smp_trace_write_chrome_json(SmpTrace *trace, const char *path)
+{
+    SmpTraceEvent *events;
+    uint64_t first;
+    double ns_per_tick = 1.0;
+    size_t n_events;
+    size_t i;
+    FILE *f;
+    int ret = 0;
+
+    events = malloc(trace->capacity * sizeof(*events));
+    if (events == NULL)
+        return SMP_ERROR_NO_MEM;
+
+    n_events = smp_trace_snapshot(trace, events, &first);
+
+#ifdef SMP_TRACE_HAVE_TSC
+    {
+        uint64_t ticks = smp_trace_now() - trace->origin_ticks;
+        uint64_t ns = smp_clock_get_time_ns() - trace->origin_ns;
+
+        if (ticks > 0 && ns > 0)
+            ns_per_tick = (double) ns / (double) ticks;
+    }
+#endif
+
+    f = fopen(path, "w");
+    if (f == NULL) {
+        free(events);
+        return SMP_ERROR_IO;
+    }
+
+    /* complete events, timestamps in microseconds */
+    fprintf(f, "{\"traceEvents\":[");
+    for (i = 0; i < n_events; i++) {
+        const SmpTraceEvent *event = &events[first + i];
+        double ts = (double) (event->start - trace->origin_ticks) * ns_per_tick;
+        double dur = (double) (event->end - event->start) * ns_per_tick;
+
+        fprintf(f, "%s\n{\"name\":\"%s\",\"cat\":\"smp\",\"ph\":\"X\","
+                "\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1}",
+                (i > 0) ? "," : "", stage_names[event->stage], ts / 1000.0,
+                dur / 1000.0);
+    }
+    fprintf(f, "\n],\"displayTimeUnit\":\"ns\"}\n");
+
+    if (ferror(f))
+        ret = SMP_ERROR_IO;
+
+    if (fclose(f) != 0)
+        ret = SMP_ERROR_IO;
+
+    free(events);
+    return ret;
+}
+
+#endif /* SMP_ENABLE_TRACE */
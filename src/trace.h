@@ -0,0 +1,133 @@
+/* libsmp
+ * Copyright (C) 2026 Actronika SAS
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "config.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef SMP_ENABLE_TRACE
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define SMP_TRACE_HAVE_TSC 1
+#else
+#include "clock.h"
+#endif
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* stages of the hot path, see the SMP_TRACE_* macros */
+typedef enum
+{
+    SMP_TRACE_STAGE_READ,           /* device read */
+    SMP_TRACE_STAGE_DECODE,         /* unescaping and frame check */
+    SMP_TRACE_STAGE_BUILD_MESSAGE,  /* smp_message_build_from_buffer */
+    SMP_TRACE_STAGE_CALLBACK,       /* user callback */
+    SMP_TRACE_STAGE_ENCODE_MESSAGE, /* smp_message_encode */
+    SMP_TRACE_STAGE_ENCODE_FRAME,   /* escaping and frame check */
+    SMP_TRACE_STAGE_WRITE,          /* device write */
+
+    SMP_TRACE_STAGE_COUNT
+} SmpTraceStage;
+
+#ifdef SMP_ENABLE_TRACE
+
+typedef struct
+{
+    uint64_t start;
+    uint64_t end;
+    uint32_t stage;
+} SmpTraceEvent;
+
+/* Single producer ring of events. Only the thread processing the context
+ * writes and publishes events by incrementing head; readers copy the events
+ * and drop those which may have been overwritten meanwhile. */
+typedef struct
+{
+    SmpTraceEvent *events;
+    size_t capacity;    /* always a power of two */
+    uint64_t head;      /* number of events ever recorded */
+
+    /* reference points to convert timestamps to nanoseconds */
+    uint64_t origin_ticks;
+    uint64_t origin_ns;
+} SmpTrace;
+
+/* timestamp in ticks of the TSC on x86, in nanoseconds elsewhere */
+static inline uint64_t smp_trace_now(void)
+{
+#ifdef SMP_TRACE_HAVE_TSC
+    return __rdtsc();
+#else
+    return smp_clock_get_time_ns();
+#endif
+}
+
+static inline void smp_trace_record(SmpTrace *trace, SmpTraceStage stage,
+        uint64_t start, uint64_t end)
+{
+    uint64_t head = trace->head;
+    SmpTraceEvent *event = &trace->events[head & (trace->capacity - 1)];
+
+    event->start = start;
+    event->end = end;
+    event->stage = stage;
+
+    __atomic_store_n(&trace->head, head + 1, __ATOMIC_RELEASE);
+}
+
+SmpTrace *smp_trace_new(size_t n_events);
+void smp_trace_free(SmpTrace *trace);
+int smp_trace_write_chrome_json(SmpTrace *trace, const char *path);
+
+/* Trace points: a stage is timed from SMP_TRACE_BEGIN to SMP_TRACE_END and
+ * timestamps are only taken when tracing is enabled on the context. */
+#define SMP_TRACE_BEGIN(ctx, var) \
+    uint64_t var = ((ctx)->trace != NULL) ? smp_trace_now() : 0
+
+#define SMP_TRACE_RESTART(ctx, var) \
+    do { \
+        if ((ctx)->trace != NULL) \
+            var = smp_trace_now(); \
+    } while (0)
+
+#define SMP_TRACE_END(ctx, stage, var) \
+    do { \
+        if ((ctx)->trace != NULL) \
+            smp_trace_record((ctx)->trace, (stage), var, smp_trace_now()); \
+    } while (0)
+
+#else /* SMP_ENABLE_TRACE */
+
+typedef struct SmpTrace SmpTrace;
+
+#define SMP_TRACE_BEGIN(ctx, var) do {} while (0)
+#define SMP_TRACE_RESTART(ctx, var) do {} while (0)
+#define SMP_TRACE_END(ctx, stage, var) do {} while (0)
+
+#endif /* SMP_ENABLE_TRACE */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,700 @@
+/* libsmp
+ * Copyright (C) 2026 Actronika SAS
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "config.h"
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "libsmp-private.h"
+#include "libsmp-private-posix.h"
+
+#ifdef MSG_NOSIGNAL
+#define SMP_TRANSPORT_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SMP_TRANSPORT_SEND_FLAGS 0
+#endif
+
+static int smp_fd_set_nonblock(int fd)
+{
+    int flags;
+
+    flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+        return errno_to_smp_error(errno);
+
+    return 0;
+}
+
+static ssize_t smp_fd_read(int fd, void *buf, size_t size)
+{
+    ssize_t ret;
+
+    ret = read(fd, buf, size);
+    if (ret == 0) {
+        /* the other end has been closed */
+        return SMP_ERROR_PIPE;
+    }
+
+    return (ret < 0) ? errno_to_smp_error(errno) : ret;
+}
+
+/* File descriptor transport: a pipe pair, a socketpair or any descriptors
+ * owned by the caller */
+typedef struct
+{
+    SmpTransport parent;
+    int read_fd;
+    int write_fd;
+    bool opened;
+} SmpTransportFd;
+
+static int smp_transport_fd_open(SmpTransport *transport, const char *path)
+{
+    SmpTransportFd *t = (SmpTransportFd *) transport;
+    int ret;
+
+    if (t->opened)
+        return SMP_ERROR_BUSY;
+
+    ret = smp_fd_set_nonblock(t->read_fd);
+    if (ret < 0)
+        return ret;
+
+    if (t->write_fd != t->read_fd) {
+        ret = smp_fd_set_nonblock(t->write_fd);
+        if (ret < 0)
+            return ret;
+    }
+
+    t->opened = true;
+    return 0;
+}
+
+static void smp_transport_fd_close(SmpTransport *transport)
+{
+    SmpTransportFd *t = (SmpTransportFd *) transport;
+
+    /* the descriptors belong to the caller */
+    t->opened = false;
+}
+
+static ssize_t smp_transport_fd_read(SmpTransport *transport, void *buf,
+        size_t size)
+{
+    SmpTransportFd *t = (SmpTransportFd *) transport;
+
+    if (!t->opened)
+        return SMP_ERROR_BAD_FD;
+
+    return smp_fd_read(t->read_fd, buf, size);
+}
+
+static ssize_t smp_transport_fd_write(SmpTransport *transport, const void *buf,
+        size_t size)
+{
+    SmpTransportFd *t = (SmpTransportFd *) transport;
+    ssize_t ret;
+
+    if (!t->opened)
+        return SMP_ERROR_BAD_FD;
+
+    ret = write(t->write_fd, buf, size);
+
+    return (ret < 0) ? errno_to_smp_error(errno) : ret;
+}
+
+static ssize_t smp_transport_fd_writev(SmpTransport *transport,
+        const SmpIoVec *iov, int iovcnt)
+{
+    SmpTransportFd *t = (SmpTransportFd *) transport;
+
+    if (!t->opened)
+        return SMP_ERROR_BAD_FD;
+
+    return smp_fd_writev(t->write_fd, iov, iovcnt);
+}
+
+static int smp_transport_fd_wait(SmpTransport *transport, int timeout_ms)
+{
+    SmpTransportFd *t = (SmpTransportFd *) transport;
+
+    if (!t->opened)
+        return SMP_ERROR_BAD_FD;
+
+    return smp_fd_wait(t->read_fd, timeout_ms);
+}
+
+static intptr_t smp_transport_fd_get_fd(SmpTransport *transport)
+{
+    SmpTransportFd *t = (SmpTransportFd *) transport;
+
+    return t->opened ? t->read_fd : SMP_ERROR_BAD_FD;
+}
+
+static ssize_t smp_transport_fd_get_output_queue(SmpTransport *transport)
+{
+#ifdef TIOCOUTQ
+    SmpTransportFd *t = (SmpTransportFd *) transport;
+    int queued;
+
+    /* only ttys and sockets can tell */
+    if (!t->opened || ioctl(t->write_fd, TIOCOUTQ, &queued) < 0)
+        return SMP_ERROR_NOT_SUPPORTED;
+
+    return queued;
+#else
+    return SMP_ERROR_NOT_SUPPORTED;
+#endif
+}
+
+static const SmpTransportVTable smp_transport_fd_vtable = {
+    .open = smp_transport_fd_open,
+    .close = smp_transport_fd_close,
+    .read = smp_transport_fd_read,
+    .write = smp_transport_fd_write,
+    .wait = smp_transport_fd_wait,
+    .get_fd = smp_transport_fd_get_fd,
+    .set_config = NULL,
+    .free = NULL,
+    .get_output_queue = smp_transport_fd_get_output_queue,
+    .writev = smp_transport_fd_writev,
+};
+
+/**
+ * \ingroup transport
+ * Create a transport reading from and writing to existing file descriptors,
+ * like both ends of a pipe pair or one end of a socketpair used for both.
+ * The path given to open is ignored and the descriptors are switched to
+ * non-blocking mode. They are not closed by the transport.
+ *
+ * @param[in] read_fd the descriptor to read from
+ * @param[in] write_fd the descriptor to write to
+ *
+ * @return a new SmpTransport or NULL on error.
+ */
+SmpTransport *smp_transport_new_fd(intptr_t read_fd, intptr_t write_fd)
+{
+    SmpTransportFd *t;
+
+    return_val_if_fail(read_fd >= 0, NULL);
+    return_val_if_fail(write_fd >= 0, NULL);
+
+    t = smp_new(SmpTransportFd);
+    if (t == NULL)
+        return NULL;
+
+    t->parent.vtable = &smp_transport_fd_vtable;
+    t->read_fd = (int) read_fd;
+    t->write_fd = (int) write_fd;
+    return &t->parent;
+}
+
+/* Unix socket transport: a stream connection to a local socket */
+typedef struct
+{
+    SmpTransport parent;
+    int fd;
+} SmpTransportUnixSocket;
+
+static int smp_transport_unix_socket_open(SmpTransport *transport,
+        const char *path)
+{
+    SmpTransportUnixSocket *t = (SmpTransportUnixSocket *) transport;
+    struct sockaddr_un addr;
+    int fd;
+    int ret;
+
+    if (t->fd >= 0)
+        return SMP_ERROR_BUSY;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return SMP_ERROR_INVALID_PARAM;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return errno_to_smp_error(errno);
+
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        ret = errno_to_smp_error(errno);
+        close(fd);
+        return ret;
+    }
+
+    ret = smp_fd_set_nonblock(fd);
+    if (ret < 0) {
+        close(fd);
+        return ret;
+    }
+
+    t->fd = fd;
+    return 0;
+}
+
+static void smp_transport_unix_socket_close(SmpTransport *transport)
+{
+    SmpTransportUnixSocket *t = (SmpTransportUnixSocket *) transport;
+
+    if (t->fd >= 0)
+        close(t->fd);
+
+    t->fd = -1;
+}
+
+static ssize_t smp_transport_unix_socket_read(SmpTransport *transport,
+        void *buf, size_t size)
+{
+    SmpTransportUnixSocket *t = (SmpTransportUnixSocket *) transport;
+
+    return smp_fd_read(t->fd, buf, size);
+}
+
+static ssize_t smp_transport_unix_socket_write(SmpTransport *transport,
+        const void *buf, size_t size)
+{
+    SmpTransportUnixSocket *t = (SmpTransportUnixSocket *) transport;
+    ssize_t ret;
+
+    /* a closed peer must be reported as an error, not a signal */
+    ret = send(t->fd, buf, size, SMP_TRANSPORT_SEND_FLAGS);
+
+    return (ret < 0) ? errno_to_smp_error(errno) : ret;
+}
+
+static int smp_transport_unix_socket_wait(SmpTransport *transport,
+        int timeout_ms)
+{
+    SmpTransportUnixSocket *t = (SmpTransportUnixSocket *) transport;
+
+    return smp_fd_wait(t->fd, timeout_ms);
+}
+
+static intptr_t smp_transport_unix_socket_get_fd(SmpTransport *transport)
+{
+    SmpTransportUnixSocket *t = (SmpTransportUnixSocket *) transport;
+
+    return (t->fd < 0) ? SMP_ERROR_BAD_FD : t->fd;
+}
+
+static const SmpTransportVTable smp_transport_unix_socket_vtable = {
+    .open = smp_transport_unix_socket_open,
+    .close = smp_transport_unix_socket_close,
+    .read = smp_transport_unix_socket_read,
+    .write = smp_transport_unix_socket_write,
+    .wait = smp_transport_unix_socket_wait,
+    .get_fd = smp_transport_unix_socket_get_fd,
+    .set_config = NULL,
+    .free = smp_transport_unix_socket_close,
+};
+
+/**
+ * \ingroup transport
+ * Create a transport connecting to a Unix stream socket, the path given to
+ * open being the socket path.
+ *
+ * @return a new SmpTransport or NULL on error.
+ */
+SmpTransport *smp_transport_new_unix_socket(void)
+{
+    SmpTransportUnixSocket *t;
+
+    t = smp_new(SmpTransportUnixSocket);
+    if (t == NULL)
+        return NULL;
+
+    t->parent.vtable = &smp_transport_unix_socket_vtable;
+    t->fd = -1;
+    return &t->parent;
+}
+
+#ifdef HAVE_SHM_OPEN
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#endif
+
+#include "clock.h"
+
+#define SMP_TRANSPORT_SHM_MAGIC 0x504d5353 /* "SSMP" */
+#define SMP_TRANSPORT_SHM_VERSION 1
+#define SMP_TRANSPORT_SHM_DEFAULT_CAPACITY (64 * 1024)
+
+/* polling period when there is no futex */
+#define SMP_TRANSPORT_SHM_POLL_NS (100 * 1000)
+
+/* Single producer, single consumer ring in the shared region. Positions are
+ * free running byte counters, each written by one side only and kept on its
+ * own cache line. */
+typedef struct
+{
+    uint64_t head;      /* written by the producer */
+    uint32_t futex;     /* bumped when the ring stops being empty */
+    uint32_t waiting;   /* the consumer is about to sleep */
+    uint8_t pad0[48];
+
+    uint64_t tail;      /* written by the consumer */
+    uint8_t pad1[56];
+} SmpTransportShmRing;
+
+/* Shared region: this header then the data of both rings. Ring 0 goes from
+ * the creator to the other process, ring 1 the other way. */
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;
+    uint8_t pad[48];
+
+    SmpTransportShmRing rings[2];
+} SmpTransportShmHeader;
+
+typedef struct
+{
+    SmpTransport parent;
+    size_t capacity;
+    bool create;
+
+    char *name;
+    SmpTransportShmHeader *header;
+    size_t size;
+    SmpTransportShmRing *tx;
+    SmpTransportShmRing *rx;
+    uint8_t *tx_data;
+    uint8_t *rx_data;
+} SmpTransportShm;
+
+static void smp_transport_shm_futex_wait(uint32_t *futex, uint32_t val,
+        int timeout_ms)
+{
+#ifdef __linux__
+    struct timespec ts;
+
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (long) (timeout_ms % 1000) * 1000000L;
+
+    syscall(SYS_futex, futex, FUTEX_WAIT, val,
+            (timeout_ms < 0) ? NULL : &ts, NULL, 0);
+#else
+    smp_clock_sleep_until(smp_clock_get_time_ns() + SMP_TRANSPORT_SHM_POLL_NS);
+#endif
+}
+
+static void smp_transport_shm_futex_wake(uint32_t *futex)
+{
+#ifdef __linux__
+    syscall(SYS_futex, futex, FUTEX_WAKE, 1, NULL, NULL, 0);
+#endif
+}
+
+static int smp_transport_shm_open(SmpTransport *transport, const char *path)
+{
+    SmpTransportShm *t = (SmpTransportShm *) transport;
+    SmpTransportShmHeader *header;
+    struct stat st;
+    size_t size;
+    int ret;
+    int fd;
+
+    if (t->header != NULL)
+        return SMP_ERROR_BUSY;
+
+    if (t->create) {
+        fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0)
+            return (errno == EEXIST) ? SMP_ERROR_BUSY :
+                errno_to_smp_error(errno);
+
+        size = sizeof(*header) + 2 * t->capacity;
+        if (ftruncate(fd, (off_t) size) < 0) {
+            ret = errno_to_smp_error(errno);
+            goto error_unlink;
+        }
+    } else {
+        fd = shm_open(path, O_RDWR, 0);
+        if (fd < 0)
+            return errno_to_smp_error(errno);
+
+        if (fstat(fd, &st) < 0) {
+            ret = errno_to_smp_error(errno);
+            goto error_close;
+        }
+
+        size = (size_t) st.st_size;
+        if (size < sizeof(*header)) {
+            ret = SMP_ERROR_NO_DEVICE;
+            goto error_close;
+        }
+    }
+
+    header = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (header == MAP_FAILED) {
+        ret = errno_to_smp_error(errno);
+        goto error_unlink;
+    }
+    close(fd);
+    fd = -1;
+
+    if (t->create) {
+        /* the region is zero filled, publish it once set up */
+        header->version = SMP_TRANSPORT_SHM_VERSION;
+        header->capacity = t->capacity;
+        __atomic_store_n(&header->magic, SMP_TRANSPORT_SHM_MAGIC,
+                __ATOMIC_RELEASE);
+    } else {
+        if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE)
+                    != SMP_TRANSPORT_SHM_MAGIC
+                || header->version != SMP_TRANSPORT_SHM_VERSION
+                || (header->capacity & (header->capacity - 1)) != 0
+                || sizeof(*header) + 2 * header->capacity != size) {
+            munmap(header, size);
+            return SMP_ERROR_NO_DEVICE;
+        }
+        t->capacity = header->capacity;
+    }
+
+    t->name = strdup(path);
+    if (t->name == NULL) {
+        munmap(header, size);
+        ret = SMP_ERROR_NO_MEM;
+        goto error_unlink;
+    }
+
+    t->header = header;
+    t->size = size;
+    t->tx = &header->rings[t->create ? 0 : 1];
+    t->rx = &header->rings[t->create ? 1 : 0];
+    t->tx_data = (uint8_t *) (header + 1) + (t->create ? 0 : t->capacity);
+    t->rx_data = (uint8_t *) (header + 1) + (t->create ? t->capacity : 0);
+    return 0;
+
+error_unlink:
+    if (t->create)
+        shm_unlink(path);
+error_close:
+    if (fd >= 0)
+        close(fd);
+    return ret;
+}
+
+static void smp_transport_shm_close(SmpTransport *transport)
+{
+    SmpTransportShm *t = (SmpTransportShm *) transport;
+
+    if (t->header == NULL)
+        return;
+
+    /* the other process keeps its mapping until it closes */
+    if (t->create)
+        shm_unlink(t->name);
+
+    munmap(t->header, t->size);
+    free(t->name);
+    t->header = NULL;
+    t->name = NULL;
+}
+
+static ssize_t smp_transport_shm_read(SmpTransport *transport, void *buf,
+        size_t size)
+{
+    SmpTransportShm *t = (SmpTransportShm *) transport;
+    uint64_t head;
+    uint64_t tail;
+    size_t offset;
+    size_t first;
+    size_t n;
+
+    if (t->header == NULL)
+        return SMP_ERROR_BAD_FD;
+
+    head = __atomic_load_n(&t->rx->head, __ATOMIC_ACQUIRE);
+    tail = t->rx->tail;
+    if (head == tail)
+        return SMP_ERROR_WOULD_BLOCK;
+
+    n = (size_t) (head - tail);
+    if (n > size)
+        n = size;
+
+    offset = (size_t) (tail & (t->capacity - 1));
+    first = t->capacity - offset;
+    if (first > n)
+        first = n;
+
+    memcpy(buf, t->rx_data + offset, first);
+    memcpy((uint8_t *) buf + first, t->rx_data, n - first);
+
+    __atomic_store_n(&t->rx->tail, tail + n, __ATOMIC_RELEASE);
+    return (ssize_t) n;
+}
+
+static ssize_t smp_transport_shm_write(SmpTransport *transport,
+        const void *buf, size_t size)
+{
+    SmpTransportShm *t = (SmpTransportShm *) transport;
+    uint64_t head;
+    uint64_t tail;
+    size_t offset;
+    size_t first;
+    size_t n;
+
+    if (t->header == NULL)
+        return SMP_ERROR_BAD_FD;
+
+    head = t->tx->head;
+    tail = __atomic_load_n(&t->tx->tail, __ATOMIC_ACQUIRE);
+
+    n = t->capacity - (size_t) (head - tail);
+    if (n == 0)
+        return SMP_ERROR_WOULD_BLOCK;
+    if (n > size)
+        n = size;
+
+    offset = (size_t) (head & (t->capacity - 1));
+    first = t->capacity - offset;
+    if (first > n)
+        first = n;
+
+    memcpy(t->tx_data + offset, buf, first);
+    memcpy(t->tx_data, (const uint8_t *) buf + first, n - first);
+
+    __atomic_store_n(&t->tx->head, head + n, __ATOMIC_SEQ_CST);
+
+    /* the consumer can only be sleeping if the ring was empty */
+    if (head == tail) {
+        __atomic_add_fetch(&t->tx->futex, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&t->tx->waiting, __ATOMIC_SEQ_CST))
+            smp_transport_shm_futex_wake(&t->tx->futex);
+    }
+
+    return (ssize_t) n;
+}
+
+static bool smp_transport_shm_rx_empty(SmpTransportShm *t)
+{
+    return __atomic_load_n(&t->rx->head, __ATOMIC_SEQ_CST) == t->rx->tail;
+}
+
+static int smp_transport_shm_wait(SmpTransport *transport, int timeout_ms)
+{
+    SmpTransportShm *t = (SmpTransportShm *) transport;
+    uint64_t deadline = 0;
+
+    if (t->header == NULL)
+        return SMP_ERROR_BAD_FD;
+
+    if (timeout_ms > 0)
+        deadline = smp_clock_get_time_ns()
+            + (uint64_t) timeout_ms * SMP_NSEC_PER_MSEC;
+
+    while (smp_transport_shm_rx_empty(t)) {
+        uint32_t futex;
+        int wait_ms = timeout_ms;
+
+        if (timeout_ms == 0)
+            return SMP_ERROR_TIMEDOUT;
+
+        if (timeout_ms > 0) {
+            uint64_t now = smp_clock_get_time_ns();
+
+            if (now >= deadline)
+                return SMP_ERROR_TIMEDOUT;
+
+            wait_ms = (int) ((deadline - now + SMP_NSEC_PER_MSEC - 1)
+                    / SMP_NSEC_PER_MSEC);
+        }
+
+        /* announce the sleep then check again, a producer making the ring
+         * non empty after that sees the flag and wakes us up */
+        __atomic_store_n(&t->rx->waiting, 1, __ATOMIC_SEQ_CST);
+        futex = __atomic_load_n(&t->rx->futex, __ATOMIC_SEQ_CST);
+        if (smp_transport_shm_rx_empty(t))
+            smp_transport_shm_futex_wait(&t->rx->futex, futex, wait_ms);
+        __atomic_store_n(&t->rx->waiting, 0, __ATOMIC_SEQ_CST);
+    }
+
+    return 0;
+}
+
+static void smp_transport_shm_free(SmpTransport *transport)
+{
+    smp_transport_shm_close(transport);
+}
+
+static const SmpTransportVTable smp_transport_shm_vtable = {
+    .open = smp_transport_shm_open,
+    .close = smp_transport_shm_close,
+    .read = smp_transport_shm_read,
+    .write = smp_transport_shm_write,
+    .wait = smp_transport_shm_wait,
+    .get_fd = NULL,
+    .set_config = NULL,
+    .free = smp_transport_shm_free,
+};
+
+/**
+ * \ingroup transport
+ * Create a transport exchanging bytes with another process of the same host
+ * through a pair of lock-free rings in a POSIX shared memory object, the path
+ * given to open being the object name, like "/my-device". One process
+ * creates the object, which is removed when it closes, and the other one
+ * attaches to it. Data is copied once in each direction and a waiting peer is
+ * only woken up when a ring stops being empty.
+ *
+ * @param[in] capacity the size of each ring in bytes, rounded up to a power
+ *                     of two, 0 for a default of 64 KiB. Ignored when
+ *                     attaching.
+ * @param[in] create true to create the shared memory object, false to attach
+ *                   to an existing one
+ *
+ * @return a new SmpTransport or NULL on error.
+ */
+SmpTransport *smp_transport_new_shm(size_t capacity, bool create)
+{
+    SmpTransportShm *t;
+    size_t pow2 = 64;
+
+    if (capacity == 0)
+        capacity = SMP_TRANSPORT_SHM_DEFAULT_CAPACITY;
+
+    while (pow2 < capacity)
+        pow2 *= 2;
+
+    t = smp_new(SmpTransportShm);
+    if (t == NULL)
+        return NULL;
+
+    t->parent.vtable = &smp_transport_shm_vtable;
+    t->capacity = pow2;
+    t->create = create;
+    return &t->parent;
+}
+
+#endif /* HAVE_SHM_OPEN */
@@ -0,0 +1,698 @@
+/* libsmp
+ * Copyright (C) 2026 Actronika SAS
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* io_uring transport, using the kernel interface directly.
+ *
+ * Reception keeps a multishot read armed on the descriptor, filling buffers
+ * of a provided buffer ring, so received data is picked from the completion
+ * queue without any system call. Kernels without multishot reads get a
+ * single shot read re-armed after each completion. Writes are copied and
+ * queued as linked SQEs, keeping their order, and the queue is submitted by
+ * flush or by the next wait, which is the only call entering the kernel. */
+
+#include "config.h"
+
+#ifdef HAVE_IO_URING
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "clock.h"
+#include "libsmp-private.h"
+#include "libsmp-private-posix.h"
+#include "serial-device.h"
+
+#define SMP_URING_ENTRIES 64
+#define SMP_URING_N_RX_BUFS 16      /* power of two */
+#define SMP_URING_RX_BUF_SIZE 4096
+#define SMP_URING_BGID 0
+
+/* user_data of the read request, writes use their buffer address */
+#define SMP_URING_RX_TAG 1
+
+/* a copy of the data of a write, kept until its completion */
+typedef struct
+{
+    uint32_t len;
+    uint8_t data[];
+} SmpUringTxBuf;
+
+typedef struct
+{
+    uint16_t bid;
+    uint32_t len;
+    uint32_t offset;
+} SmpUringRxChunk;
+
+typedef struct
+{
+    SmpTransport parent;
+    intptr_t user_fd;
+    SmpSerialDevice device;
+    int fd;
+    int ring_fd;
+
+    /* submission queue */
+    void *sq_ptr;
+    size_t sq_size;
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int sq_mask;
+    unsigned int *sq_array;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned int to_submit;
+    struct io_uring_sqe *last_write;    /* linked to the next write */
+
+    /* completion queue */
+    void *cq_ptr;
+    size_t cq_size;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int cq_mask;
+    struct io_uring_cqe *cqes;
+
+    /* provided buffers for reception */
+    struct io_uring_buf_ring *buf_ring;
+    size_t buf_ring_size;
+    uint8_t *rx_bufs;
+    uint16_t buf_tail;
+
+    bool multishot;
+    bool rx_armed;
+    int rx_error;
+    SmpUringRxChunk rx_chunks[SMP_URING_N_RX_BUFS];
+    unsigned int rx_first;
+    unsigned int rx_count;
+
+    int tx_error;
+    unsigned int tx_in_flight;
+} SmpTransportUring;
+
+static int smp_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+    return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int smp_uring_enter(int fd, unsigned int to_submit,
+        unsigned int min_complete, unsigned int flags, void *arg, size_t argsz)
+{
+    return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+            flags, arg, argsz);
+}
+
+static int smp_uring_register(int fd, unsigned int opcode, void *arg,
+        unsigned int n_args)
+{
+    return (int) syscall(__NR_io_uring_register, fd, opcode, arg, n_args);
+}
+
+static void smp_uring_unmap(SmpTransportUring *t)
+{
+    if (t->buf_ring != NULL)
+        munmap(t->buf_ring, t->buf_ring_size);
+    if (t->sqes != NULL)
+        munmap(t->sqes, t->sqes_size);
+    if (t->cq_ptr != NULL && t->cq_ptr != t->sq_ptr)
+        munmap(t->cq_ptr, t->cq_size);
+    if (t->sq_ptr != NULL)
+        munmap(t->sq_ptr, t->sq_size);
+    if (t->ring_fd >= 0)
+        close(t->ring_fd);
+
+    free(t->rx_bufs);
+    t->buf_ring = NULL;
+    t->sqes = NULL;
+    t->cq_ptr = NULL;
+    t->sq_ptr = NULL;
+    t->rx_bufs = NULL;
+    t->ring_fd = -1;
+}
+
+static void smp_uring_provide_buffer(SmpTransportUring *t, uint16_t bid)
+{
+    struct io_uring_buf *buf;
+
+    buf = &t->buf_ring->bufs[t->buf_tail & (SMP_URING_N_RX_BUFS - 1)];
+    buf->addr = (uint64_t) (uintptr_t) (t->rx_bufs
+            + (size_t) bid * SMP_URING_RX_BUF_SIZE);
+    buf->len = SMP_URING_RX_BUF_SIZE;
+    buf->bid = bid;
+    t->buf_tail++;
+
+    __atomic_store_n(&t->buf_ring->tail, t->buf_tail, __ATOMIC_RELEASE);
+}
+
+static int smp_uring_map(SmpTransportUring *t)
+{
+    struct io_uring_params p;
+    struct io_uring_buf_reg reg;
+    uint16_t i;
+
+    memset(&p, 0, sizeof(p));
+    t->ring_fd = smp_uring_setup(SMP_URING_ENTRIES, &p);
+    if (t->ring_fd < 0)
+        return errno_to_smp_error(errno);
+
+    /* waiting with a timeout needs the extended arguments */
+    if (!(p.features & IORING_FEAT_EXT_ARG)) {
+        close(t->ring_fd);
+        t->ring_fd = -1;
+        return SMP_ERROR_NOT_SUPPORTED;
+    }
+
+    t->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    t->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (t->cq_size > t->sq_size)
+            t->sq_size = t->cq_size;
+        t->cq_size = t->sq_size;
+    }
+
+    t->sq_ptr = mmap(NULL, t->sq_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, t->ring_fd, IORING_OFF_SQ_RING);
+    if (t->sq_ptr == MAP_FAILED) {
+        t->sq_ptr = NULL;
+        goto error;
+    }
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        t->cq_ptr = t->sq_ptr;
+    } else {
+        t->cq_ptr = mmap(NULL, t->cq_size, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, t->ring_fd, IORING_OFF_CQ_RING);
+        if (t->cq_ptr == MAP_FAILED) {
+            t->cq_ptr = NULL;
+            goto error;
+        }
+    }
+
+    t->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    t->sqes = mmap(NULL, t->sqes_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, t->ring_fd, IORING_OFF_SQES);
+    if (t->sqes == MAP_FAILED) {
+        t->sqes = NULL;
+        goto error;
+    }
+
+    t->sq_head = (unsigned int *) ((uint8_t *) t->sq_ptr + p.sq_off.head);
+    t->sq_tail = (unsigned int *) ((uint8_t *) t->sq_ptr + p.sq_off.tail);
+    t->sq_mask = *(unsigned int *) ((uint8_t *) t->sq_ptr + p.sq_off.ring_mask);
+    t->sq_array = (unsigned int *) ((uint8_t *) t->sq_ptr + p.sq_off.array);
+    t->cq_head = (unsigned int *) ((uint8_t *) t->cq_ptr + p.cq_off.head);
+    t->cq_tail = (unsigned int *) ((uint8_t *) t->cq_ptr + p.cq_off.tail);
+    t->cq_mask = *(unsigned int *) ((uint8_t *) t->cq_ptr + p.cq_off.ring_mask);
+    t->cqes = (struct io_uring_cqe *) ((uint8_t *) t->cq_ptr + p.cq_off.cqes);
+
+    /* provided buffer ring for reception */
+    t->rx_bufs = malloc((size_t) SMP_URING_N_RX_BUFS * SMP_URING_RX_BUF_SIZE);
+    if (t->rx_bufs == NULL) {
+        smp_uring_unmap(t);
+        return SMP_ERROR_NO_MEM;
+    }
+
+    t->buf_ring_size = SMP_URING_N_RX_BUFS * sizeof(struct io_uring_buf);
+    t->buf_ring = mmap(NULL, t->buf_ring_size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (t->buf_ring == MAP_FAILED) {
+        t->buf_ring = NULL;
+        goto error;
+    }
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t) (uintptr_t) t->buf_ring;
+    reg.ring_entries = SMP_URING_N_RX_BUFS;
+    reg.bgid = SMP_URING_BGID;
+    if (smp_uring_register(t->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        /* kernel older than 5.19 */
+        if (errno == EINVAL)
+            errno = ENOSYS;
+        goto error;
+    }
+
+    t->buf_tail = 0;
+    for (i = 0; i < SMP_URING_N_RX_BUFS; i++)
+        smp_uring_provide_buffer(t, i);
+
+    return 0;
+
+error:
+    {
+        int ret = errno_to_smp_error(errno);
+
+        smp_uring_unmap(t);
+        return ret;
+    }
+}
+
+static int smp_uring_submit(SmpTransportUring *t, unsigned int min_complete,
+        int timeout_ms)
+{
+    struct io_uring_getevents_arg arg;
+    struct timespec ts;
+    unsigned int flags = IORING_ENTER_EXT_ARG;
+    int ret;
+
+    memset(&arg, 0, sizeof(arg));
+    arg.sigmask_sz = _NSIG / 8;
+    if (min_complete > 0) {
+        flags |= IORING_ENTER_GETEVENTS;
+        if (timeout_ms >= 0) {
+            ts.tv_sec = timeout_ms / 1000;
+            ts.tv_nsec = (long) (timeout_ms % 1000) * 1000000L;
+            arg.ts = (uint64_t) (uintptr_t) &ts;
+        }
+    }
+
+    ret = smp_uring_enter(t->ring_fd, t->to_submit, min_complete, flags, &arg,
+            sizeof(arg));
+    if (ret < 0) {
+        if (errno == ETIME)
+            return SMP_ERROR_TIMEDOUT;
+        else if (errno == EINTR)
+            return 0;
+
+        return errno_to_smp_error(errno);
+    }
+
+    /* writes are linked only within a submission */
+    t->to_submit -= (unsigned int) ret;
+    t->last_write = NULL;
+    return 0;
+}
+
+static struct io_uring_sqe *smp_uring_get_sqe(SmpTransportUring *t)
+{
+    struct io_uring_sqe *sqe;
+    unsigned int tail = *t->sq_tail;
+    unsigned int index;
+
+    if (tail - __atomic_load_n(t->sq_head, __ATOMIC_ACQUIRE) > t->sq_mask) {
+        if (smp_uring_submit(t, 0, 0) < 0)
+            return NULL;
+
+        if (tail - __atomic_load_n(t->sq_head, __ATOMIC_ACQUIRE) > t->sq_mask)
+            return NULL;
+    }
+
+    index = tail & t->sq_mask;
+    sqe = &t->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    t->sq_array[index] = index;
+    __atomic_store_n(t->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    t->to_submit++;
+
+    return sqe;
+}
+
+static void smp_uring_arm_rx(SmpTransportUring *t)
+{
+    struct io_uring_sqe *sqe;
+
+    sqe = smp_uring_get_sqe(t);
+    if (sqe == NULL)
+        return;
+
+#ifdef HAVE_IORING_OP_READ_MULTISHOT
+    if (t->multishot) {
+        sqe->opcode = IORING_OP_READ_MULTISHOT;
+        sqe->len = 0;
+    } else
+#endif
+    {
+        sqe->opcode = IORING_OP_READ;
+        sqe->len = SMP_URING_RX_BUF_SIZE;
+    }
+
+    sqe->fd = t->fd;
+    sqe->off = (uint64_t) -1;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = SMP_URING_BGID;
+    sqe->user_data = SMP_URING_RX_TAG;
+    t->rx_armed = true;
+}
+
+/* handle the completions, without entering the kernel */
+static void smp_uring_reap(SmpTransportUring *t)
+{
+    unsigned int head = *t->cq_head;
+    unsigned int tail = __atomic_load_n(t->cq_tail, __ATOMIC_ACQUIRE);
+
+    for (; head != tail; head++) {
+        struct io_uring_cqe *cqe = &t->cqes[head & t->cq_mask];
+
+        if (cqe->user_data != SMP_URING_RX_TAG) {
+            SmpUringTxBuf *buf = (SmpUringTxBuf *) (uintptr_t) cqe->user_data;
+
+            /* a short write loses the end of the frame and breaks the chain,
+             * next writes are canceled */
+            if (cqe->res < 0 && t->tx_error == 0) {
+                t->tx_error = (cqe->res == -ECANCELED) ? SMP_ERROR_IO :
+                    errno_to_smp_error(-cqe->res);
+            } else if (cqe->res >= 0 && (uint32_t) cqe->res < buf->len
+                    && t->tx_error == 0) {
+                t->tx_error = SMP_ERROR_IO;
+            }
+
+            free(buf);
+            t->tx_in_flight--;
+            continue;
+        }
+
+        if (!(cqe->flags & IORING_CQE_F_MORE))
+            t->rx_armed = false;
+
+        if (cqe->res > 0 && (cqe->flags & IORING_CQE_F_BUFFER)) {
+            SmpUringRxChunk *chunk;
+
+            chunk = &t->rx_chunks[(t->rx_first + t->rx_count)
+                % SMP_URING_N_RX_BUFS];
+            chunk->bid = (uint16_t) (cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+            chunk->len = (uint32_t) cqe->res;
+            chunk->offset = 0;
+            t->rx_count++;
+        } else if (cqe->res == 0) {
+            t->rx_error = SMP_ERROR_PIPE;
+        } else if (cqe->res == -EINVAL && t->multishot) {
+            /* no multishot read on this kernel */
+            t->multishot = false;
+        } else if (cqe->res < 0 && cqe->res != -ENOBUFS) {
+            t->rx_error = errno_to_smp_error(-cqe->res);
+        }
+    }
+
+    __atomic_store_n(t->cq_head, head, __ATOMIC_RELEASE);
+
+    /* re-arm once buffers are available again */
+    if (!t->rx_armed && t->rx_error == 0 && t->rx_count < SMP_URING_N_RX_BUFS)
+        smp_uring_arm_rx(t);
+}
+
+static int smp_transport_uring_open(SmpTransport *transport, const char *path)
+{
+    SmpTransportUring *t = (SmpTransportUring *) transport;
+    int flags;
+    int ret;
+
+    if (t->fd >= 0)
+        return SMP_ERROR_BUSY;
+
+    if (t->user_fd >= 0) {
+        t->fd = (int) t->user_fd;
+    } else {
+        ret = smp_serial_device_open(&t->device, path);
+        if (ret < 0)
+            return ret;
+        t->fd = t->device.fd;
+    }
+
+    /* io_uring returns EAGAIN on non-blocking descriptors instead of waiting
+     * for them to be ready */
+    flags = fcntl(t->fd, F_GETFL);
+    if (flags < 0 || fcntl(t->fd, F_SETFL, flags & ~O_NONBLOCK) < 0) {
+        ret = errno_to_smp_error(errno);
+        goto error;
+    }
+
+    ret = smp_uring_map(t);
+    if (ret < 0)
+        goto error;
+
+#ifdef HAVE_IORING_OP_READ_MULTISHOT
+    t->multishot = true;
+#else
+    t->multishot = false;
+#endif
+    t->rx_error = 0;
+    t->tx_error = 0;
+    t->rx_first = 0;
+    t->rx_count = 0;
+    smp_uring_arm_rx(t);
+
+    ret = smp_uring_submit(t, 0, 0);
+    if (ret < 0) {
+        smp_uring_unmap(t);
+        goto error;
+    }
+
+    return 0;
+
+error:
+    if (t->user_fd < 0)
+        smp_serial_device_close(&t->device);
+    t->fd = -1;
+    return ret;
+}
+
+static void smp_transport_uring_close(SmpTransport *transport)
+{
+    SmpTransportUring *t = (SmpTransportUring *) transport;
+
+    if (t->fd < 0)
+        return;
+
+    /* wait for the writes, they use buffers we own */
+    smp_uring_reap(t);
+    while (t->tx_in_flight > 0) {
+        if (smp_uring_submit(t, 1, 1000) < 0)
+            break;
+        smp_uring_reap(t);
+    }
+
+    /* closing the ring cancels the read */
+    smp_uring_unmap(t);
+
+    if (t->user_fd < 0)
+        smp_serial_device_close(&t->device);
+    t->fd = -1;
+    t->to_submit = 0;
+    t->last_write = NULL;
+    t->rx_armed = false;
+}
+
+static ssize_t smp_transport_uring_read(SmpTransport *transport, void *buf,
+        size_t size)
+{
+    SmpTransportUring *t = (SmpTransportUring *) transport;
+    size_t n = 0;
+
+    if (t->fd < 0)
+        return SMP_ERROR_BAD_FD;
+
+    smp_uring_reap(t);
+
+    while (n < size && t->rx_count > 0) {
+        SmpUringRxChunk *chunk = &t->rx_chunks[t->rx_first];
+        size_t len = chunk->len - chunk->offset;
+
+        if (len > size - n)
+            len = size - n;
+
+        memcpy((uint8_t *) buf + n, t->rx_bufs
+                + (size_t) chunk->bid * SMP_URING_RX_BUF_SIZE + chunk->offset,
+                len);
+        chunk->offset += len;
+        n += len;
+
+        if (chunk->offset == chunk->len) {
+            smp_uring_provide_buffer(t, chunk->bid);
+            t->rx_first = (t->rx_first + 1) % SMP_URING_N_RX_BUFS;
+            t->rx_count--;
+        }
+    }
+
+    /* the read stops when it runs out of buffers */
+    if (!t->rx_armed && t->rx_error == 0)
+        smp_uring_arm_rx(t);
+
+    if (n > 0)
+        return (ssize_t) n;
+    else if (t->rx_error != 0)
+        return t->rx_error;
+
+    return SMP_ERROR_WOULD_BLOCK;
+}
+
+static ssize_t smp_transport_uring_write(SmpTransport *transport,
+        const void *buf, size_t size)
+{
+    SmpTransportUring *t = (SmpTransportUring *) transport;
+    struct io_uring_sqe *sqe;
+    SmpUringTxBuf *copy;
+    int ret;
+
+    if (t->fd < 0)
+        return SMP_ERROR_BAD_FD;
+
+    smp_uring_reap(t);
+    if (t->tx_error != 0) {
+        ret = t->tx_error;
+        t->tx_error = 0;
+        return ret;
+    }
+
+    copy = malloc(sizeof(SmpUringTxBuf) + size);
+    if (copy == NULL)
+        return SMP_ERROR_NO_MEM;
+    copy->len = (uint32_t) size;
+    memcpy(copy->data, buf, size);
+
+    sqe = smp_uring_get_sqe(t);
+    if (sqe == NULL) {
+        free(copy);
+        return SMP_ERROR_WOULD_BLOCK;
+    }
+
+    /* keep the writes of a submission in order */
+    if (t->last_write != NULL)
+        t->last_write->flags |= IOSQE_IO_LINK;
+
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = t->fd;
+    sqe->addr = (uint64_t) (uintptr_t) copy->data;
+    sqe->len = (uint32_t) size;
+    sqe->off = (uint64_t) -1;
+    sqe->user_data = (uint64_t) (uintptr_t) copy;
+    t->last_write = sqe;
+    t->tx_in_flight++;
+
+    return (ssize_t) size;
+}
+
+static int smp_transport_uring_wait(SmpTransport *transport, int timeout_ms)
+{
+    SmpTransportUring *t = (SmpTransportUring *) transport;
+    uint64_t deadline = 0;
+    int ret;
+
+    if (t->fd < 0)
+        return SMP_ERROR_BAD_FD;
+
+    smp_uring_reap(t);
+    if (t->rx_count > 0 || t->rx_error != 0)
+        return 0;
+
+    if (timeout_ms > 0) {
+        deadline = smp_clock_get_time_ns()
+            + (uint64_t) timeout_ms * SMP_NSEC_PER_MSEC;
+    }
+
+    /* submit the queued requests and wait in a single call, the completion
+     * of a write doesn't end the wait */
+    while (1) {
+        uint64_t now;
+
+        ret = smp_uring_submit(t, (timeout_ms == 0) ? 0 : 1, timeout_ms);
+        if (ret < 0)
+            return ret;
+
+        smp_uring_reap(t);
+        if (t->rx_count > 0 || t->rx_error != 0)
+            return 0;
+
+        if (timeout_ms == 0)
+            return SMP_ERROR_TIMEDOUT;
+        else if (timeout_ms < 0)
+            continue;
+
+        now = smp_clock_get_time_ns();
+        if (now >= deadline)
+            return SMP_ERROR_TIMEDOUT;
+
+        /* round up so we don't wake up just before the deadline */
+        timeout_ms = (int) ((deadline - now + SMP_NSEC_PER_MSEC - 1)
+                / SMP_NSEC_PER_MSEC);
+    }
+}
+
+static int smp_transport_uring_flush(SmpTransport *transport)
+{
+    SmpTransportUring *t = (SmpTransportUring *) transport;
+
+    if (t->fd < 0)
+        return SMP_ERROR_BAD_FD;
+
+    if (t->to_submit == 0)
+        return 0;
+
+    return smp_uring_submit(t, 0, 0);
+}
+
+static intptr_t smp_transport_uring_get_fd(SmpTransport *transport)
+{
+    SmpTransportUring *t = (SmpTransportUring *) transport;
+
+    /* the ring is readable when completions are available */
+    return (t->fd < 0) ? SMP_ERROR_BAD_FD : t->ring_fd;
+}
+
+static void smp_transport_uring_free(SmpTransport *transport)
+{
+    smp_transport_uring_close(transport);
+}
+
+static const SmpTransportVTable smp_transport_uring_vtable = {
+    .open = smp_transport_uring_open,
+    .close = smp_transport_uring_close,
+    .read = smp_transport_uring_read,
+    .write = smp_transport_uring_write,
+    .wait = smp_transport_uring_wait,
+    .get_fd = smp_transport_uring_get_fd,
+    .set_config = NULL,
+    .free = smp_transport_uring_free,
+    .flush = smp_transport_uring_flush,
+};
+
+/**
+ * \ingroup transport
+ * Create a transport using io_uring on Linux. A read stays armed on the
+ * descriptor so received data costs no system call, and writes are queued
+ * and submitted together with the next flush or wait. The context flushes
+ * after sending outside of processing, so the answers sent from callbacks are
+ * submitted at once.
+ *
+ * @param[in] fd a descriptor to use, like a pty or a socket, which is
+ *               switched to blocking mode and not closed by the transport, or
+ *               -1 to open the serial device given to open
+ *
+ * @return a new SmpTransport or NULL on error.
+ */
+SmpTransport *smp_transport_new_uring(intptr_t fd)
+{
+    SmpTransportUring *t;
+
+    t = smp_new(SmpTransportUring);
+    if (t == NULL)
+        return NULL;
+
+    t->parent.vtable = &smp_transport_uring_vtable;
+    t->user_fd = fd;
+    t->fd = -1;
+    t->ring_fd = -1;
+    smp_serial_device_init(&t->device);
+    return &t->parent;
+}
+
+#endif /* HAVE_IO_URING */
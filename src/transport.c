@@ -0,0 +1,347 @@
+/* libsmp
+ * Copyright (C) 2026 Actronika SAS
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file
+ * \defgroup transport Transport
+ *
+ * Byte transports used by a context in place of its serial device.
+ */
+
+#include "config.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clock.h"
+#include "libsmp-private.h"
+#include "serial-device.h"
+
+#define SMP_TRANSPORT_LOOPBACK_DEFAULT_CAPACITY (64 * 1024)
+
+/* Serial transport: the built-in serial device of the platform */
+typedef struct
+{
+    SmpTransport parent;
+    SmpSerialDevice device;
+} SmpTransportSerial;
+
+static int smp_transport_serial_open(SmpTransport *transport, const char *path)
+{
+    SmpTransportSerial *serial = (SmpTransportSerial *) transport;
+
+    return smp_serial_device_open(&serial->device, path);
+}
+
+static void smp_transport_serial_close(SmpTransport *transport)
+{
+    SmpTransportSerial *serial = (SmpTransportSerial *) transport;
+
+    smp_serial_device_close(&serial->device);
+}
+
+static ssize_t smp_transport_serial_read(SmpTransport *transport, void *buf,
+        size_t size)
+{
+    SmpTransportSerial *serial = (SmpTransportSerial *) transport;
+
+    return smp_serial_device_read(&serial->device, buf, size);
+}
+
+static ssize_t smp_transport_serial_write(SmpTransport *transport,
+        const void *buf, size_t size)
+{
+    SmpTransportSerial *serial = (SmpTransportSerial *) transport;
+
+    return smp_serial_device_write(&serial->device, buf, size);
+}
+
+static int smp_transport_serial_wait(SmpTransport *transport, int timeout_ms)
+{
+    SmpTransportSerial *serial = (SmpTransportSerial *) transport;
+
+    return smp_serial_device_wait(&serial->device, timeout_ms);
+}
+
+static intptr_t smp_transport_serial_get_fd(SmpTransport *transport)
+{
+    SmpTransportSerial *serial = (SmpTransportSerial *) transport;
+
+    return smp_serial_device_get_fd(&serial->device);
+}
+
+static int smp_transport_serial_set_config(SmpTransport *transport,
+        SmpSerialBaudrate baudrate, SmpSerialParity parity, int flow_control)
+{
+    SmpTransportSerial *serial = (SmpTransportSerial *) transport;
+
+    return smp_serial_device_set_config(&serial->device, baudrate, parity,
+            flow_control);
+}
+
+static ssize_t smp_transport_serial_get_output_queue(SmpTransport *transport)
+{
+    SmpTransportSerial *serial = (SmpTransportSerial *) transport;
+
+    return smp_serial_device_get_output_queue(&serial->device);
+}
+
+static ssize_t smp_transport_serial_writev(SmpTransport *transport,
+        const SmpIoVec *iov, int iovcnt)
+{
+    SmpTransportSerial *serial = (SmpTransportSerial *) transport;
+
+    return smp_serial_device_writev(&serial->device, iov, iovcnt);
+}
+
+static const SmpTransportVTable smp_transport_serial_vtable = {
+    .open = smp_transport_serial_open,
+    .close = smp_transport_serial_close,
+    .read = smp_transport_serial_read,
+    .write = smp_transport_serial_write,
+    .wait = smp_transport_serial_wait,
+    .get_fd = smp_transport_serial_get_fd,
+    .set_config = smp_transport_serial_set_config,
+    .free = NULL,
+    .get_output_queue = smp_transport_serial_get_output_queue,
+    .writev = smp_transport_serial_writev,
+};
+
+/**
+ * \ingroup transport
+ * Create a transport using the serial device of the platform, behaving like
+ * a context without transport.
+ *
+ * @return a new SmpTransport or NULL on error.
+ */
+SmpTransport *smp_transport_new_serial(void)
+{
+    SmpTransportSerial *serial;
+
+    serial = smp_new(SmpTransportSerial);
+    if (serial == NULL)
+        return NULL;
+
+    serial->parent.vtable = &smp_transport_serial_vtable;
+    smp_serial_device_init(&serial->device);
+    return &serial->parent;
+}
+
+/* Loopback transport: bytes written are read back from a ring buffer, without
+ * any system call */
+typedef struct
+{
+    SmpTransport parent;
+    uint8_t *buf;
+    size_t capacity;
+    size_t head;    /* next byte to read */
+    size_t used;
+    bool opened;
+} SmpTransportLoopback;
+
+static int smp_transport_loopback_open(SmpTransport *transport,
+        const char *path)
+{
+    SmpTransportLoopback *loopback = (SmpTransportLoopback *) transport;
+
+    if (loopback->opened)
+        return SMP_ERROR_BUSY;
+
+    loopback->head = 0;
+    loopback->used = 0;
+    loopback->opened = true;
+    return 0;
+}
+
+static void smp_transport_loopback_close(SmpTransport *transport)
+{
+    SmpTransportLoopback *loopback = (SmpTransportLoopback *) transport;
+
+    loopback->opened = false;
+}
+
+static ssize_t smp_transport_loopback_read(SmpTransport *transport, void *buf,
+        size_t size)
+{
+    SmpTransportLoopback *loopback = (SmpTransportLoopback *) transport;
+    size_t n;
+    size_t first;
+
+    if (!loopback->opened)
+        return SMP_ERROR_BAD_FD;
+
+    if (loopback->used == 0)
+        return SMP_ERROR_WOULD_BLOCK;
+
+    n = (size < loopback->used) ? size : loopback->used;
+    first = loopback->capacity - loopback->head;
+    if (first > n)
+        first = n;
+
+    memcpy(buf, loopback->buf + loopback->head, first);
+    memcpy((uint8_t *) buf + first, loopback->buf, n - first);
+
+    loopback->head = (loopback->head + n) % loopback->capacity;
+    loopback->used -= n;
+    return (ssize_t) n;
+}
+
+static ssize_t smp_transport_loopback_write(SmpTransport *transport,
+        const void *buf, size_t size)
+{
+    SmpTransportLoopback *loopback = (SmpTransportLoopback *) transport;
+    size_t tail;
+    size_t n;
+    size_t first;
+
+    if (!loopback->opened)
+        return SMP_ERROR_BAD_FD;
+
+    n = loopback->capacity - loopback->used;
+    if (n == 0)
+        return SMP_ERROR_WOULD_BLOCK;
+    if (n > size)
+        n = size;
+
+    tail = (loopback->head + loopback->used) % loopback->capacity;
+    first = loopback->capacity - tail;
+    if (first > n)
+        first = n;
+
+    memcpy(loopback->buf + tail, buf, first);
+    memcpy(loopback->buf, (const uint8_t *) buf + first, n - first);
+
+    loopback->used += n;
+    return (ssize_t) n;
+}
+
+static int smp_transport_loopback_wait(SmpTransport *transport, int timeout_ms)
+{
+    SmpTransportLoopback *loopback = (SmpTransportLoopback *) transport;
+
+    if (!loopback->opened)
+        return SMP_ERROR_BAD_FD;
+
+    if (loopback->used > 0)
+        return 0;
+
+    /* nobody else can write while we are waiting */
+    if (timeout_ms < 0)
+        return SMP_ERROR_WOULD_BLOCK;
+
+    smp_clock_sleep_until(smp_clock_get_time_ns() +
+            (uint64_t) timeout_ms * SMP_NSEC_PER_MSEC);
+    return SMP_ERROR_TIMEDOUT;
+}
+
+static void smp_transport_loopback_free(SmpTransport *transport)
+{
+    SmpTransportLoopback *loopback = (SmpTransportLoopback *) transport;
+
+    free(loopback->buf);
+}
+
+static const SmpTransportVTable smp_transport_loopback_vtable = {
+    .open = smp_transport_loopback_open,
+    .close = smp_transport_loopback_close,
+    .read = smp_transport_loopback_read,
+    .write = smp_transport_loopback_write,
+    .wait = smp_transport_loopback_wait,
+    .get_fd = NULL,
+    .set_config = NULL,
+    .free = smp_transport_loopback_free,
+};
+
+/**
+ * \ingroup transport
+ * Create an in-memory transport where written bytes are read back by the same
+ * context, without any system call. The path given to open is ignored. Writes
+ * are partial when the buffer is full.
+ *
+ * @param[in] capacity the buffer size in bytes, 0 for a default of 64 KiB
+ *
+ * @return a new SmpTransport or NULL on error.
+ */
+SmpTransport *smp_transport_new_loopback(size_t capacity)
+{
+    SmpTransportLoopback *loopback;
+
+    if (capacity == 0)
+        capacity = SMP_TRANSPORT_LOOPBACK_DEFAULT_CAPACITY;
+
+    loopback = smp_new(SmpTransportLoopback);
+    if (loopback == NULL)
+        return NULL;
+
+    loopback->buf = malloc(capacity);
+    if (loopback->buf == NULL) {
+        free(loopback);
+        return NULL;
+    }
+
+    loopback->parent.vtable = &smp_transport_loopback_vtable;
+    loopback->capacity = capacity;
+    return &loopback->parent;
+}
+
+#ifndef SMP_ENABLE_POSIX_TRANSPORTS
+
+SmpTransport *smp_transport_new_fd(intptr_t read_fd, intptr_t write_fd)
+{
+    return NULL;
+}
+
+SmpTransport *smp_transport_new_unix_socket(void)
+{
+    return NULL;
+}
+
+#endif /* SMP_ENABLE_POSIX_TRANSPORTS */
+
+#if !defined(SMP_ENABLE_POSIX_TRANSPORTS) || !defined(HAVE_SHM_OPEN)
+
+SmpTransport *smp_transport_new_shm(size_t capacity, bool create)
+{
+    return NULL;
+}
+
+#endif
+
+#if !defined(SMP_ENABLE_POSIX_TRANSPORTS) || !defined(HAVE_IO_URING)
+
+SmpTransport *smp_transport_new_uring(intptr_t fd)
+{
+    return NULL;
+}
+
+#endif
+
+/**
+ * \ingroup transport
+ * Free a transport. It must not be used by a context anymore.
+ *
+ * @param[in] transport the SmpTransport
+ */
+void smp_transport_free(SmpTransport *transport)
+{
+    return_if_fail(transport != NULL);
+
+    if (transport->vtable->free != NULL)
+        transport->vtable->free(transport);
+
+    free(transport);
+}
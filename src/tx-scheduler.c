@@ -0,0 +1,182 @@
+/* libsmp
+ * Copyright (C) 2026 Actronika SAS
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "tx-scheduler.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+SmpTxScheduler *smp_tx_scheduler_new(size_t fragment_size)
+{
+    SmpTxScheduler *sched;
+
+    sched = smp_new(SmpTxScheduler);
+    if (sched == NULL)
+        return NULL;
+
+    sched->fragment_size = fragment_size;
+    return sched;
+}
+
+void smp_tx_scheduler_free(SmpTxScheduler *sched)
+{
+    unsigned int i;
+
+    return_if_fail(sched != NULL);
+
+    for (i = 0; i < SMP_TX_SCHEDULER_LEVELS; i++) {
+        while (sched->heads[i] != NULL)
+            smp_tx_scheduler_pop(sched, (SmpPriority) i);
+    }
+
+    free(sched->backlog);
+    free(sched);
+}
+
+/* copy the encoded message at the end of its priority queue */
+int smp_tx_scheduler_push(SmpTxScheduler *sched, SmpPriority priority,
+        uint32_t msgid, const uint8_t *data, size_t size)
+{
+    SmpTxMessage *txmsg;
+
+    return_val_if_fail(sched != NULL, SMP_ERROR_INVALID_PARAM);
+    return_val_if_fail(priority < SMP_TX_SCHEDULER_LEVELS,
+            SMP_ERROR_INVALID_PARAM);
+
+    txmsg = malloc(sizeof(SmpTxMessage) + size);
+    if (txmsg == NULL)
+        return SMP_ERROR_NO_MEM;
+
+    txmsg->next = NULL;
+    txmsg->msgid = msgid;
+    txmsg->size = size;
+    txmsg->offset = 0;
+    memcpy(txmsg->data, data, size);
+
+    if (sched->tails[priority] != NULL)
+        sched->tails[priority]->next = txmsg;
+    else
+        sched->heads[priority] = txmsg;
+    sched->tails[priority] = txmsg;
+
+    return 0;
+}
+
+/* return the next message of the most urgent priority, NULL if there is
+ * none */
+SmpTxMessage *smp_tx_scheduler_peek(SmpTxScheduler *sched,
+        SmpPriority *priority)
+{
+    unsigned int i;
+
+    for (i = 0; i < SMP_TX_SCHEDULER_LEVELS; i++) {
+        if (sched->heads[i] != NULL) {
+            *priority = (SmpPriority) i;
+            return sched->heads[i];
+        }
+    }
+
+    return NULL;
+}
+
+void smp_tx_scheduler_pop(SmpTxScheduler *sched, SmpPriority priority)
+{
+    SmpTxMessage *txmsg = sched->heads[priority];
+
+    return_if_fail(txmsg != NULL);
+
+    sched->heads[priority] = txmsg->next;
+    if (sched->heads[priority] == NULL)
+        sched->tails[priority] = NULL;
+
+    free(txmsg);
+}
+
+/* Replace the data of a queued message with the same id which wasn't started
+ * yet, keeping its place. Return 1 if a message was replaced, 0 if there is
+ * none or a SmpError. */
+int smp_tx_scheduler_replace(SmpTxScheduler *sched, uint32_t msgid,
+        const uint8_t *data, size_t size)
+{
+    unsigned int i;
+
+    for (i = 0; i < SMP_TX_SCHEDULER_LEVELS; i++) {
+        SmpTxMessage **link;
+
+        for (link = &sched->heads[i]; *link != NULL; link = &(*link)->next) {
+            SmpTxMessage *txmsg = *link;
+
+            if (txmsg->msgid != msgid || txmsg->offset > 0)
+                continue;
+
+            if (size != txmsg->size) {
+                txmsg = realloc(txmsg, sizeof(SmpTxMessage) + size);
+                if (txmsg == NULL)
+                    return SMP_ERROR_NO_MEM;
+
+                if (sched->tails[i] == *link)
+                    sched->tails[i] = txmsg;
+                *link = txmsg;
+                txmsg->size = size;
+            }
+
+            memcpy(txmsg->data, data, size);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* keep bytes the device didn't take, to write before anything else */
+int smp_tx_scheduler_append_backlog(SmpTxScheduler *sched,
+        const uint8_t *data, size_t size)
+{
+    size_t pending = sched->backlog_size - sched->backlog_offset;
+
+    /* move the pending bytes at the start first */
+    if (sched->backlog_offset > 0) {
+        memmove(sched->backlog, sched->backlog + sched->backlog_offset,
+                pending);
+        sched->backlog_size = pending;
+        sched->backlog_offset = 0;
+    }
+
+    if (pending + size > sched->backlog_capacity) {
+        uint8_t *backlog = realloc(sched->backlog, pending + size);
+
+        if (backlog == NULL)
+            return SMP_ERROR_NO_MEM;
+
+        sched->backlog = backlog;
+        sched->backlog_capacity = pending + size;
+    }
+
+    memcpy(sched->backlog + pending, data, size);
+    sched->backlog_size = pending + size;
+    return 0;
+}
+
+/* size bytes of the backlog were written */
+void smp_tx_scheduler_consume_backlog(SmpTxScheduler *sched, size_t size)
+{
+    sched->backlog_offset += size;
+    if (sched->backlog_offset >= sched->backlog_size) {
+        sched->backlog_size = 0;
+        sched->backlog_offset = 0;
+    }
+}
@@ -0,0 +1,83 @@
+/* libsmp
+ * Copyright (C) 2026 Actronika SAS
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef TX_SCHEDULER_H
+#define TX_SCHEDULER_H
+
+#include "libsmp.h"
+#include "libsmp-private.h"
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SMP_TX_SCHEDULER_LEVELS (SMP_PRIORITY_LOW + 1)
+
+typedef struct SmpTxMessage SmpTxMessage;
+
+/* An encoded message waiting to be sent, possibly in several fragments */
+struct SmpTxMessage
+{
+    SmpTxMessage *next;
+
+    uint32_t msgid;
+    size_t size;
+    size_t offset;      /* bytes already sent */
+    uint8_t data[];
+};
+
+/* Outgoing messages in one FIFO per priority, the most urgent non-empty one
+ * being served first, and the bytes of frames the device didn't take yet */
+typedef struct
+{
+    SmpTxMessage *heads[SMP_TX_SCHEDULER_LEVELS];
+    SmpTxMessage *tails[SMP_TX_SCHEDULER_LEVELS];
+    size_t fragment_size;   /* 0 to send whole messages */
+
+    uint8_t *backlog;
+    size_t backlog_size;
+    size_t backlog_offset;
+    size_t backlog_capacity;
+} SmpTxScheduler;
+
+SmpTxScheduler *smp_tx_scheduler_new(size_t fragment_size);
+void smp_tx_scheduler_free(SmpTxScheduler *sched);
+
+int smp_tx_scheduler_push(SmpTxScheduler *sched, SmpPriority priority,
+        uint32_t msgid, const uint8_t *data, size_t size);
+SmpTxMessage *smp_tx_scheduler_peek(SmpTxScheduler *sched,
+        SmpPriority *priority);
+void smp_tx_scheduler_pop(SmpTxScheduler *sched, SmpPriority priority);
+int smp_tx_scheduler_replace(SmpTxScheduler *sched, uint32_t msgid,
+        const uint8_t *data, size_t size);
+
+static inline bool smp_tx_scheduler_has_backlog(SmpTxScheduler *sched)
+{
+    return sched->backlog_offset < sched->backlog_size;
+}
+
+int smp_tx_scheduler_append_backlog(SmpTxScheduler *sched,
+        const uint8_t *data, size_t size);
+void smp_tx_scheduler_consume_backlog(SmpTxScheduler *sched, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,9 +1,19 @@
+#define _GNU_SOURCE /* ptsname_r() */
 #include <CUnit/CUnit.h>
 #include <unistd.h>
+#include <sys/ioctl.h>
 #include <sys/types.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #define SMP_ENABLE_STATIC_API
 #include <libsmp.h>
 
@@ -164,11 +174,19 @@ static void on_new_message(SmpContext *ctx, SmpMessage *msg,
     switch (test_smp_context_receive_message_case) {
         case VALID_PAYLOAD: {
             uint32_t val;
+            uint64_t start_ns;
+            uint64_t end_ns;
 
             CU_ASSERT_EQUAL(smp_message_get_msgid(msg), 1);
             ret = smp_message_get_uint32(msg, 0, &val);
             CU_ASSERT_EQUAL(ret, 0);
             CU_ASSERT_EQUAL(val, 0xabcdef42);
+
+            ret = smp_message_get_rx_timestamp(msg, &start_ns, &end_ns);
+            CU_ASSERT_EQUAL(ret, 0);
+            CU_ASSERT(start_ns > 0);
+            CU_ASSERT(start_ns <= end_ns);
+            CU_ASSERT(end_ns <= smp_context_get_time_ns());
             break;
         }
         default:
@@ -216,6 +234,8 @@ static void test_smp_context_receive_valid_message(void)
     smp_message_set_uint32(msg, 0, 0xabcdef42);
     ret = smp_context_send_message(ctx, msg);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL(smp_message_get_rx_timestamp(msg, NULL, NULL),
+            SMP_ERROR_NOT_FOUND);
 
     test_smp_context_on_message_called = false;
     test_smp_context_on_error_called = false;
@@ -260,6 +280,2371 @@ static void test_smp_context_receive_corrupted_message(void)
     test_teardown(&tctx);
 }
 
+static void test_smp_context_checksum(void)
+{
+    TestCtx tctx;
+    SmpContext *ctx;
+    SmpMessage *msg;
+    int ret;
+
+    test_setup(&tctx);
+    ctx = smp_context_new(&test_cbs, &test_smp_context_receive_message_case);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(ctx);
+
+    CU_ASSERT_EQUAL(smp_context_set_checksum(NULL, SMP_SERIAL_CHECKSUM_CRC32C),
+            SMP_ERROR_INVALID_PARAM);
+    CU_ASSERT_EQUAL(smp_context_set_checksum(ctx, (SmpSerialChecksum) 42),
+            SMP_ERROR_INVALID_PARAM);
+    CU_ASSERT_EQUAL(smp_context_set_checksum(ctx, SMP_SERIAL_CHECKSUM_CRC32C),
+            0);
+
+    CU_ASSERT_EQUAL_FATAL(smp_context_open(ctx, FIFO_PATH), 0);
+
+    test_smp_context_receive_message_case = VALID_PAYLOAD;
+    msg = smp_message_new_with_id(1);
+    smp_message_set_uint32(msg, 0, 0xabcdef42);
+    ret = smp_context_send_message(ctx, msg);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    test_smp_context_on_message_called = false;
+    test_smp_context_on_error_called = false;
+    ret = smp_context_process_fd(ctx);
+    CU_ASSERT_EQUAL(ret, 0);
+    CU_ASSERT_TRUE(test_smp_context_on_message_called);
+    CU_ASSERT_FALSE(test_smp_context_on_error_called);
+
+    smp_message_free(msg);
+    smp_context_close(ctx);
+    smp_context_free(ctx);
+    test_teardown(&tctx);
+}
+
+static uint32_t test_smp_context_received_ids[8];
+static size_t test_smp_context_n_received;
+
+static void on_new_message_record(SmpContext *ctx, SmpMessage *msg,
+        void *userdata)
+{
+    if (test_smp_context_n_received < SMP_N_ELEMENTS(test_smp_context_received_ids)) {
+        test_smp_context_received_ids[test_smp_context_n_received] =
+            smp_message_get_msgid(msg);
+    }
+
+    test_smp_context_n_received++;
+}
+
+static const SmpEventCallbacks record_cbs = {
+    .new_message_cb = on_new_message_record,
+    .error_cb = on_error_simple
+};
+
+/* read the next frame pending in the fifo, simulating its loss */
+static size_t read_frame(int fd, uint8_t *buf, size_t size)
+{
+    size_t i = 0;
+    bool escaped = false;
+
+    while (i < size && read(fd, &buf[i], 1) == 1) {
+        uint8_t c = buf[i++];
+
+        if (escaped)
+            escaped = false;
+        else if (c == 0x1B)
+            escaped = true;
+        else if (c == END_BYTE)
+            break;
+    }
+
+    return i;
+}
+
+static int send_simple_message(SmpContext *ctx, uint32_t msgid)
+{
+    SmpMessage *msg;
+    int ret;
+
+    msg = smp_message_new_with_id(msgid);
+    smp_message_set_uint32(msg, 0, msgid);
+    ret = smp_context_send_message(ctx, msg);
+    smp_message_free(msg);
+
+    return ret;
+}
+
+static void test_smp_context_reliability_window(void)
+{
+    TestCtx tctx;
+    SmpContext *ctx;
+
+    test_setup(&tctx);
+    ctx = smp_context_new(&record_cbs, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(ctx);
+
+    CU_ASSERT_EQUAL(smp_context_enable_reliability(NULL, 2),
+            SMP_ERROR_INVALID_PARAM);
+    CU_ASSERT_EQUAL(smp_context_enable_reliability(ctx, 3),
+            SMP_ERROR_INVALID_PARAM);
+    CU_ASSERT_EQUAL(smp_context_enable_reliability(ctx, 64),
+            SMP_ERROR_INVALID_PARAM);
+    CU_ASSERT_EQUAL(smp_context_enable_reliability(ctx, 2), 0);
+    CU_ASSERT_EQUAL(smp_context_get_next_timeout(ctx), -1);
+
+    CU_ASSERT_EQUAL_FATAL(smp_context_open(ctx, FIFO_PATH), 0);
+
+    /* the context is its own peer through the fifo */
+    test_smp_context_n_received = 0;
+    CU_ASSERT_EQUAL(send_simple_message(ctx, 1), 0);
+    CU_ASSERT_EQUAL(send_simple_message(ctx, 2), 0);
+    CU_ASSERT_EQUAL(send_simple_message(ctx, 3), SMP_ERROR_WOULD_BLOCK);
+    CU_ASSERT(smp_context_get_next_timeout(ctx) >= 0);
+
+    /* receive the messages and send the ack */
+    CU_ASSERT_EQUAL(smp_context_process_fd(ctx), 0);
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 2);
+    CU_ASSERT_EQUAL(test_smp_context_received_ids[0], 1);
+    CU_ASSERT_EQUAL(test_smp_context_received_ids[1], 2);
+
+    /* receive the ack, window is free again */
+    CU_ASSERT_EQUAL(smp_context_process_fd(ctx), 0);
+    CU_ASSERT_EQUAL(smp_context_get_next_timeout(ctx), -1);
+    CU_ASSERT_EQUAL(send_simple_message(ctx, 3), 0);
+
+    /* disabling it goes back to plain frames */
+    CU_ASSERT_EQUAL(smp_context_enable_reliability(ctx, 0), 0);
+    CU_ASSERT_EQUAL(smp_context_get_next_timeout(ctx), -1);
+
+    smp_context_close(ctx);
+    smp_context_free(ctx);
+    test_teardown(&tctx);
+}
+
+static void test_smp_context_reliability_retransmit(void)
+{
+    TestCtx tctx;
+    SmpContext *ctx;
+    uint8_t frame[64];
+    size_t framesize;
+
+    test_setup(&tctx);
+    ctx = smp_context_new(&record_cbs, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(ctx);
+    CU_ASSERT_EQUAL(smp_context_enable_reliability(ctx, 4), 0);
+    CU_ASSERT_EQUAL_FATAL(smp_context_open(ctx, FIFO_PATH), 0);
+
+    test_smp_context_n_received = 0;
+    CU_ASSERT_EQUAL(send_simple_message(ctx, 1), 0);
+    CU_ASSERT_EQUAL(send_simple_message(ctx, 2), 0);
+
+    /* lose the first frame */
+    framesize = read_frame(tctx.fd, frame, sizeof(frame));
+    CU_ASSERT(framesize > 0);
+
+    /* the second one is kept until the first one is retransmitted */
+    CU_ASSERT_EQUAL(smp_context_process_fd(ctx), 0);
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 0);
+    CU_ASSERT_EQUAL(smp_context_process_fd(ctx), 0);
+
+    /* wait for the retransmission timer and receive the missing frame */
+    CU_ASSERT(smp_context_get_next_timeout(ctx) > 0);
+    CU_ASSERT_EQUAL(smp_context_wait_and_process(ctx, 5000), 0);
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 2);
+    CU_ASSERT_EQUAL(test_smp_context_received_ids[0], 1);
+    CU_ASSERT_EQUAL(test_smp_context_received_ids[1], 2);
+
+    CU_ASSERT_EQUAL(smp_context_process_fd(ctx), 0);
+    CU_ASSERT_EQUAL(smp_context_get_next_timeout(ctx), -1);
+
+    /* a duplicate is acked but not delivered again */
+    CU_ASSERT_EQUAL(write(tctx.fd, frame, framesize), (ssize_t) framesize);
+    CU_ASSERT_EQUAL(smp_context_process_fd(ctx), 0);
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 2);
+
+    smp_context_close(ctx);
+    smp_context_free(ctx);
+    test_teardown(&tctx);
+}
+
+static void test_smp_context_flow_control(void)
+{
+    uint8_t big[40] = { 0 };
+    TestCtx tctx;
+    SmpMessage *msg;
+    SmpContext *ctx;
+    int ret;
+
+    test_setup(&tctx);
+    ctx = smp_context_new(&record_cbs, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(ctx);
+
+    CU_ASSERT_EQUAL(smp_context_enable_flow_control(NULL, 32),
+            SMP_ERROR_INVALID_PARAM);
+
+    /* a message takes 13 bytes so we accept two of them */
+    ret = smp_context_enable_flow_control(ctx, 32);
+    if (ret == SMP_ERROR_NOT_SUPPORTED) {
+        /* no clock on this platform */
+        CU_ASSERT_EQUAL(smp_context_get_time_ns(), 0);
+        smp_context_free(ctx);
+        test_teardown(&tctx);
+        return;
+    }
+    CU_ASSERT_EQUAL(ret, 0);
+    CU_ASSERT_EQUAL_FATAL(smp_context_open(ctx, FIFO_PATH), 0);
+
+    /* no credit yet, ask for it */
+    test_smp_context_n_received = 0;
+    CU_ASSERT_EQUAL(send_simple_message(ctx, 1), SMP_ERROR_WOULD_BLOCK);
+    CU_ASSERT(smp_context_get_next_timeout(ctx) >= 0);
+
+    /* receive the probe and the credit */
+    CU_ASSERT_EQUAL(smp_context_process_fd(ctx), 0);
+    CU_ASSERT_EQUAL(smp_context_process_fd(ctx), 0);
+    CU_ASSERT_EQUAL(smp_context_get_next_timeout(ctx), -1);
+
+    /* a message bigger than the whole window can't be sent */
+    msg = smp_message_new_with_id(1);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(msg);
+    CU_ASSERT_EQUAL(smp_message_set_craw(msg, 0, big, sizeof(big)), 0);
+    CU_ASSERT_EQUAL(smp_context_send_message(ctx, msg), SMP_ERROR_OVERFLOW);
+    CU_ASSERT_EQUAL(smp_context_get_next_timeout(ctx), -1);
+    smp_message_free(msg);
+
+    CU_ASSERT_EQUAL(send_simple_message(ctx, 1), 0);
+    CU_ASSERT_EQUAL(send_simple_message(ctx, 2), 0);
+    CU_ASSERT_EQUAL(send_simple_message(ctx, 3), SMP_ERROR_WOULD_BLOCK);
+
+    /* processing the messages gives credit back */
+    CU_ASSERT_EQUAL(smp_context_process_fd(ctx), 0);
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 2);
+    CU_ASSERT_EQUAL(smp_context_process_fd(ctx), 0);
+    CU_ASSERT_EQUAL(send_simple_message(ctx, 3), 0);
+    CU_ASSERT_EQUAL(smp_context_process_fd(ctx), 0);
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 3);
+
+    /* works along reliable delivery */
+    CU_ASSERT_EQUAL(smp_context_enable_reliability(ctx, 4), 0);
+    CU_ASSERT_EQUAL(smp_context_process_fd(ctx), 0);
+    CU_ASSERT_EQUAL(send_simple_message(ctx, 4), 0);
+    CU_ASSERT_EQUAL(smp_context_process_fd(ctx), 0);
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 4);
+    CU_ASSERT_EQUAL(test_smp_context_received_ids[3], 4);
+
+    smp_context_close(ctx);
+    smp_context_free(ctx);
+    test_teardown(&tctx);
+}
+
+static SmpContext *new_link_context(SmpTransport *transport)
+{
+    SmpContext *ctx;
+
+    ctx = smp_context_new(&record_cbs, NULL);
+    if (ctx == NULL)
+        return NULL;
+
+    if (smp_context_set_transport(ctx, transport) < 0
+            || smp_context_open(ctx, "") < 0
+            || smp_context_enable_reliability(ctx, 4) < 0
+            || smp_context_enable_flow_control(ctx, 256) < 0) {
+        smp_context_free(ctx);
+        return NULL;
+    }
+
+    return ctx;
+}
+
+static void exchange_link_frames(SmpContext *ctxs[2])
+{
+    int i;
+
+    for (i = 0; i < 6; i++) {
+        smp_context_wait_and_process(ctxs[0], 5);
+        smp_context_wait_and_process(ctxs[1], 5);
+    }
+}
+
+/* the credit of a new peer is asked for on the first message */
+static int send_link_message(SmpContext *ctxs[2], int i, uint32_t msgid)
+{
+    int ret;
+
+    ret = send_simple_message(ctxs[i], msgid);
+    if (ret == SMP_ERROR_WOULD_BLOCK) {
+        exchange_link_frames(ctxs);
+        ret = send_simple_message(ctxs[i], msgid);
+    }
+
+    return ret;
+}
+
+static void test_smp_context_link_restart(void)
+{
+    SmpTransport *transports[2];
+    SmpContext *ctxs[2];
+    int fds[2];
+    int i;
+
+    /* flow control needs a clock */
+    if (smp_context_get_time_ns() == 0)
+        return;
+
+    CU_ASSERT_EQUAL_FATAL(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    for (i = 0; i < 2; i++) {
+        transports[i] = smp_transport_new_fd(fds[i], fds[i]);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(transports[i]);
+        ctxs[i] = new_link_context(transports[i]);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(ctxs[i]);
+    }
+
+    test_smp_context_n_received = 0;
+    CU_ASSERT_EQUAL(send_link_message(ctxs, 0, 1), 0);
+    CU_ASSERT_EQUAL(send_link_message(ctxs, 1, 2), 0);
+    exchange_link_frames(ctxs);
+    CU_ASSERT_EQUAL_FATAL(test_smp_context_n_received, 2);
+
+    /* the second context restarts while a message is on its way, the frame
+     * is dropped and the first context starts over */
+    CU_ASSERT_EQUAL(send_link_message(ctxs, 0, 3), 0);
+    smp_context_close(ctxs[1]);
+    smp_context_free(ctxs[1]);
+    ctxs[1] = new_link_context(transports[1]);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(ctxs[1]);
+    exchange_link_frames(ctxs);
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 2);
+    CU_ASSERT_EQUAL(smp_context_get_next_timeout(ctxs[0]), -1);
+
+    CU_ASSERT_EQUAL(send_link_message(ctxs, 0, 4), 0);
+    CU_ASSERT_EQUAL(send_link_message(ctxs, 0, 5), 0);
+    exchange_link_frames(ctxs);
+    CU_ASSERT_EQUAL(send_link_message(ctxs, 1, 6), 0);
+    exchange_link_frames(ctxs);
+    CU_ASSERT_EQUAL_FATAL(test_smp_context_n_received, 5);
+    CU_ASSERT_EQUAL(test_smp_context_received_ids[2], 4);
+    CU_ASSERT_EQUAL(test_smp_context_received_ids[3], 5);
+    CU_ASSERT_EQUAL(test_smp_context_received_ids[4], 6);
+
+    /* the restarted context speaks first */
+    smp_context_close(ctxs[1]);
+    smp_context_free(ctxs[1]);
+    ctxs[1] = new_link_context(transports[1]);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(ctxs[1]);
+    exchange_link_frames(ctxs);
+    CU_ASSERT_EQUAL(send_link_message(ctxs, 1, 7), 0);
+    exchange_link_frames(ctxs);
+    CU_ASSERT_EQUAL(send_link_message(ctxs, 0, 8), 0);
+    exchange_link_frames(ctxs);
+    CU_ASSERT_EQUAL_FATAL(test_smp_context_n_received, 7);
+    CU_ASSERT_EQUAL(test_smp_context_received_ids[5], 7);
+    CU_ASSERT_EQUAL(test_smp_context_received_ids[6], 8);
+
+    for (i = 0; i < 2; i++) {
+        CU_ASSERT_EQUAL(smp_context_get_next_timeout(ctxs[i]), -1);
+        smp_context_free(ctxs[i]);
+        smp_transport_free(transports[i]);
+        close(fds[i]);
+    }
+}
+
+#define TEST_CALL_REQUEST_ID 10
+#define TEST_CALL_RESPONSE_ID 11
+#define TEST_CALL_NOTIFICATION_ID 12
+
+static int test_call_n_notifications;
+
+typedef struct
+{
+    int n_completed;
+    SmpError status;
+    uint32_t value;
+} TestCall;
+
+static void on_new_message_call(SmpContext *ctx, SmpMessage *msg,
+        void *userdata)
+{
+    SmpMessage *response;
+    uint32_t value;
+
+    if (smp_message_get_msgid(msg) == TEST_CALL_NOTIFICATION_ID) {
+        test_call_n_notifications++;
+        return;
+    }
+
+    /* serve requests, we should never see responses here */
+    CU_ASSERT_EQUAL_FATAL(smp_message_get_msgid(msg), TEST_CALL_REQUEST_ID);
+    CU_ASSERT_EQUAL(smp_message_n_args(msg), 2);
+    CU_ASSERT_EQUAL(smp_message_get_uint32(msg, 0, &value), 0);
+
+    response = smp_message_new_with_id(TEST_CALL_RESPONSE_ID);
+    smp_message_set_uint32(response, 0, value * 2);
+    CU_ASSERT_EQUAL(smp_context_reply(ctx, msg, response), 0);
+    CU_ASSERT_EQUAL(smp_message_n_args(response), 1);
+    smp_message_free(response);
+}
+
+static const SmpEventCallbacks call_cbs = {
+    .new_message_cb = on_new_message_call,
+    .error_cb = on_error_simple
+};
+
+static void on_call_completed(SmpContext *ctx, SmpMessage *response,
+        SmpError status, void *userdata)
+{
+    TestCall *call = userdata;
+
+    call->n_completed++;
+    call->status = status;
+
+    if (status == SMP_ERROR_NONE) {
+        CU_ASSERT_EQUAL(smp_message_get_msgid(response), TEST_CALL_RESPONSE_ID);
+        CU_ASSERT_EQUAL(smp_message_n_args(response), 1);
+        smp_message_get_uint32(response, 0, &call->value);
+    } else {
+        CU_ASSERT_PTR_NULL(response);
+    }
+}
+
+static void test_smp_context_call(void)
+{
+    TestCtx tctx;
+    SmpContext *ctx;
+    SmpMessage *notification;
+    SmpMessage *request;
+    TestCall calls[3];
+    uint8_t frame[64];
+    int timeout;
+    size_t i;
+    int ret;
+
+    memset(calls, 0, sizeof(calls));
+    test_call_n_notifications = 0;
+
+    test_setup(&tctx);
+    ctx = smp_context_new(&call_cbs, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(ctx);
+    CU_ASSERT_EQUAL_FATAL(smp_context_open(ctx, FIFO_PATH), 0);
+
+    request = smp_message_new_with_id(TEST_CALL_REQUEST_ID);
+    CU_ASSERT_EQUAL(smp_context_call(ctx, NULL, -1, on_call_completed, NULL),
+            SMP_ERROR_INVALID_PARAM);
+    CU_ASSERT_EQUAL(smp_context_call(ctx, request, -1, NULL, NULL),
+            SMP_ERROR_INVALID_PARAM);
+
+    /* pipeline the calls, the context answers its own requests */
+    timeout = (smp_context_get_time_ns() != 0) ? 1000 : -1;
+    for (i = 0; i < SMP_N_ELEMENTS(calls); i++) {
+        smp_message_set_uint32(request, 0, (uint32_t) i + 1);
+        CU_ASSERT_EQUAL(smp_context_call(ctx, request, timeout,
+                    on_call_completed, &calls[i]), 0);
+        CU_ASSERT_EQUAL(smp_message_n_args(request), 1);
+    }
+
+    CU_ASSERT_EQUAL(smp_context_process_fd(ctx), 0);
+    CU_ASSERT_EQUAL(smp_context_process_fd(ctx), 0);
+    for (i = 0; i < SMP_N_ELEMENTS(calls); i++) {
+        CU_ASSERT_EQUAL(calls[i].n_completed, 1);
+        CU_ASSERT_EQUAL(calls[i].status, SMP_ERROR_NONE);
+        CU_ASSERT_EQUAL(calls[i].value, 2 * (i + 1));
+    }
+    CU_ASSERT_EQUAL(smp_context_get_next_timeout(ctx), -1);
+
+    /* messages ending like a response to the 4th call but not answering its
+     * request are not taken for it */
+    memset(calls, 0, sizeof(calls));
+    CU_ASSERT_EQUAL(smp_context_call(ctx, request, -1, on_call_completed,
+                &calls[1]), 0);
+    CU_ASSERT(read_frame(tctx.fd, frame, sizeof(frame)) > 0);
+    notification = smp_message_new_with_id(TEST_CALL_NOTIFICATION_ID);
+    smp_message_set_uint32(notification, 0, 4 | 0x80000000u);
+    CU_ASSERT_EQUAL(smp_context_send_message(ctx, notification), 0);
+    smp_message_set_uint64(notification, 0,
+            ((uint64_t) TEST_CALL_NOTIFICATION_ID << 32) | 4 | 0x80000000u);
+    CU_ASSERT_EQUAL(smp_context_send_message(ctx, notification), 0);
+    CU_ASSERT_EQUAL(smp_context_process_fd(ctx), 0);
+    CU_ASSERT_EQUAL(test_call_n_notifications, 2);
+    CU_ASSERT_EQUAL(calls[1].n_completed, 0);
+    smp_message_free(notification);
+
+    /* a lost request times out, timeouts need a clock */
+    ret = smp_context_call(ctx, request, 10, on_call_completed, &calls[0]);
+    if (ret == SMP_ERROR_NOT_SUPPORTED) {
+        CU_ASSERT_EQUAL(smp_context_get_time_ns(), 0);
+    } else {
+        CU_ASSERT_EQUAL(ret, 0);
+        CU_ASSERT(read_frame(tctx.fd, frame, sizeof(frame)) > 0);
+        CU_ASSERT_EQUAL(smp_context_wait_and_process(ctx, 100),
+                SMP_ERROR_TIMEDOUT);
+        CU_ASSERT_EQUAL(calls[0].n_completed, 1);
+        CU_ASSERT_EQUAL(calls[0].status, SMP_ERROR_TIMEDOUT);
+    }
+
+    /* closing the context completes outstanding calls */
+    CU_ASSERT_EQUAL(smp_context_call(ctx, request, -1, on_call_completed,
+                &calls[2]), 0);
+    smp_context_close(ctx);
+    CU_ASSERT_EQUAL(calls[1].n_completed, 1);
+    CU_ASSERT_EQUAL(calls[1].status, SMP_ERROR_BAD_FD);
+    CU_ASSERT_EQUAL(calls[2].n_completed, 1);
+    CU_ASSERT_EQUAL(calls[2].status, SMP_ERROR_BAD_FD);
+
+    smp_message_free(request);
+    smp_context_free(ctx);
+    test_teardown(&tctx);
+}
+
+static void test_smp_context_stats(void)
+{
+    TestCtx tctx;
+    SmpContext *ctx;
+    SmpContextStats stats;
+    SmpMessageStats msg_stats[4];
+    uint8_t frame[64];
+    size_t framesize;
+    ssize_t n;
+    ssize_t i;
+
+    test_setup(&tctx);
+    ctx = smp_context_new(&record_cbs, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(ctx);
+    CU_ASSERT_EQUAL_FATAL(smp_context_open(ctx, FIFO_PATH), 0);
+
+    CU_ASSERT_EQUAL(smp_context_get_stats(ctx, NULL), SMP_ERROR_INVALID_PARAM);
+    CU_ASSERT_EQUAL(smp_context_get_stats(ctx, &stats), 0);
+    CU_ASSERT_EQUAL(stats.rx_frames, 0);
+    CU_ASSERT_EQUAL(stats.tx_frames, 0);
+
+    CU_ASSERT_EQUAL(send_simple_message(ctx, 1), 0);
+    CU_ASSERT_EQUAL(send_simple_message(ctx, 1), 0);
+    CU_ASSERT_EQUAL(send_simple_message(ctx, 2), 0);
+    CU_ASSERT_EQUAL(smp_context_process_fd(ctx), 0);
+
+    CU_ASSERT_EQUAL(smp_context_get_stats(ctx, &stats), 0);
+    CU_ASSERT_EQUAL(stats.tx_frames, 3);
+    CU_ASSERT_EQUAL(stats.rx_frames, 3);
+    CU_ASSERT(stats.tx_bytes > 0);
+    CU_ASSERT_EQUAL(stats.rx_bytes, stats.tx_bytes);
+    CU_ASSERT_EQUAL(stats.checksum_errors, 0);
+    CU_ASSERT_EQUAL(stats.short_writes, 0);
+
+    n = smp_context_get_message_stats(ctx, msg_stats,
+            SMP_N_ELEMENTS(msg_stats));
+    if (n != SMP_ERROR_NOT_SUPPORTED) {
+        CU_ASSERT_EQUAL_FATAL(n, 2);
+
+        for (i = 0; i < n; i++) {
+            uint64_t count = (msg_stats[i].msgid == 1) ? 2 : 1;
+
+            CU_ASSERT_EQUAL(msg_stats[i].tx_messages, count);
+            CU_ASSERT_EQUAL(msg_stats[i].rx_messages, count);
+            CU_ASSERT_EQUAL(msg_stats[i].rx_bytes, msg_stats[i].tx_bytes);
+        }
+    }
+
+    /* corrupt the checksum, then interrupt a frame by a new one */
+    CU_ASSERT_EQUAL(send_simple_message(ctx, 1), 0);
+    framesize = read_frame(tctx.fd, frame, sizeof(frame));
+    CU_ASSERT_FATAL(framesize > 3);
+    frame[framesize - 2] ^= 0x01;
+    CU_ASSERT_EQUAL(write(tctx.fd, frame, framesize), (ssize_t) framesize);
+    CU_ASSERT_EQUAL(write(tctx.fd, frame, 4), 4);
+    CU_ASSERT_EQUAL(send_simple_message(ctx, 1), 0);
+    CU_ASSERT_EQUAL(smp_context_process_fd(ctx), 0);
+
+    CU_ASSERT_EQUAL(smp_context_get_stats(ctx, &stats), 0);
+    CU_ASSERT_EQUAL(stats.checksum_errors, 1);
+    CU_ASSERT_EQUAL(stats.resyncs, 1);
+    CU_ASSERT_EQUAL(stats.rx_frames, 4);
+
+    smp_context_reset_stats(ctx);
+    CU_ASSERT_EQUAL(smp_context_get_stats(ctx, &stats), 0);
+    CU_ASSERT_EQUAL(stats.rx_bytes, 0);
+    CU_ASSERT_EQUAL(stats.tx_frames, 0);
+    CU_ASSERT_EQUAL(stats.checksum_errors, 0);
+    n = smp_context_get_message_stats(ctx, msg_stats,
+            SMP_N_ELEMENTS(msg_stats));
+    CU_ASSERT(n == 0 || n == SMP_ERROR_NOT_SUPPORTED);
+
+    smp_context_close(ctx);
+    smp_context_free(ctx);
+    test_teardown(&tctx);
+}
+
+static void test_smp_context_tracing(void)
+{
+    TestCtx tctx;
+    SmpContext *ctx;
+    char path[] = "/tmp/libsmp-trace-XXXXXX";
+    char buf[256];
+    ssize_t rbytes;
+    int fd;
+    int ret;
+
+    test_setup(&tctx);
+    ctx = smp_context_new(&record_cbs, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(ctx);
+    CU_ASSERT_EQUAL_FATAL(smp_context_open(ctx, FIFO_PATH), 0);
+
+    ret = smp_context_enable_tracing(ctx, 64);
+    if (ret == SMP_ERROR_NOT_SUPPORTED) {
+        CU_ASSERT_EQUAL(smp_context_write_trace(ctx, path),
+                SMP_ERROR_NOT_SUPPORTED);
+        goto done;
+    }
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    CU_ASSERT_EQUAL(send_simple_message(ctx, 1), 0);
+    CU_ASSERT_EQUAL(smp_context_process_fd(ctx), 0);
+
+    fd = mkstemp(path);
+    CU_ASSERT_FATAL(fd >= 0);
+    close(fd);
+
+    CU_ASSERT_EQUAL(smp_context_write_trace(ctx, NULL),
+            SMP_ERROR_INVALID_PARAM);
+    CU_ASSERT_EQUAL(smp_context_write_trace(ctx, path), 0);
+
+    fd = open(path, O_RDONLY);
+    CU_ASSERT_FATAL(fd >= 0);
+    rbytes = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    unlink(path);
+
+    CU_ASSERT_FATAL(rbytes > 0);
+    buf[rbytes] = '\0';
+    CU_ASSERT_PTR_NOT_NULL(strstr(buf, "\"traceEvents\""));
+    CU_ASSERT_PTR_NOT_NULL(strstr(buf, "\"ph\":\"X\""));
+
+    CU_ASSERT_EQUAL(smp_context_enable_tracing(ctx, 0), 0);
+    CU_ASSERT_EQUAL(smp_context_write_trace(ctx, path),
+            SMP_ERROR_INVALID_PARAM);
+
+done:
+    smp_context_close(ctx);
+    smp_context_free(ctx);
+    test_teardown(&tctx);
+}
+
+static void test_smp_context_capture(void)
+{
+    TestCtx tctx;
+    SmpContext *ctx;
+    SmpContext *replay_ctx;
+    char path[] = "/tmp/libsmp-capture-XXXXXX";
+    uint8_t header[8];
+    int fd;
+    int ret;
+
+    test_setup(&tctx);
+    ctx = smp_context_new(&record_cbs, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(ctx);
+    CU_ASSERT_EQUAL_FATAL(smp_context_open(ctx, FIFO_PATH), 0);
+
+    fd = mkstemp(path);
+    CU_ASSERT_FATAL(fd >= 0);
+    close(fd);
+    unlink(path);
+
+    ret = smp_context_start_capture(ctx, path);
+    if (ret == SMP_ERROR_NOT_SUPPORTED)
+        goto done;
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL(smp_context_start_capture(ctx, path), SMP_ERROR_BUSY);
+
+    test_smp_context_n_received = 0;
+    CU_ASSERT_EQUAL(send_simple_message(ctx, 1), 0);
+    CU_ASSERT_EQUAL(send_simple_message(ctx, 2), 0);
+    CU_ASSERT_EQUAL(send_simple_message(ctx, 1), 0);
+    CU_ASSERT_EQUAL(smp_context_process_fd(ctx), 0);
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 3);
+    smp_context_stop_capture(ctx);
+
+    fd = open(path, O_RDONLY);
+    CU_ASSERT_FATAL(fd >= 0);
+    CU_ASSERT_EQUAL(read(fd, header, sizeof(header)), sizeof(header));
+    CU_ASSERT_EQUAL(memcmp(header, "SMPCAP\r\n", sizeof(header)), 0);
+    close(fd);
+
+    /* received data is decoded again, without any device */
+    replay_ctx = smp_context_new(&record_cbs, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(replay_ctx);
+
+    test_smp_context_n_received = 0;
+    CU_ASSERT_EQUAL(smp_context_replay_capture(replay_ctx, path, false), 0);
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 3);
+    CU_ASSERT_EQUAL(test_smp_context_received_ids[0], 1);
+    CU_ASSERT_EQUAL(test_smp_context_received_ids[1], 2);
+    CU_ASSERT_EQUAL(test_smp_context_received_ids[2], 1);
+
+    test_smp_context_n_received = 0;
+    CU_ASSERT_EQUAL(smp_context_replay_capture(replay_ctx, path, true), 0);
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 3);
+
+    /* conflated messages are held until the end of a fast replay */
+    CU_ASSERT_EQUAL(smp_context_set_conflation(replay_ctx, 1,
+                SMP_CONFLATION_RX), 0);
+    test_smp_context_n_received = 0;
+    CU_ASSERT_EQUAL(smp_context_replay_capture(replay_ctx, path, false), 0);
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 2);
+    CU_ASSERT_EQUAL(test_smp_context_received_ids[0], 2);
+    CU_ASSERT_EQUAL(test_smp_context_received_ids[1], 1);
+
+    CU_ASSERT_EQUAL(smp_context_replay_capture(replay_ctx,
+                "/tmp/libsmp-no-such-capture", false), SMP_ERROR_NOT_FOUND);
+
+    smp_context_free(replay_ctx);
+    unlink(path);
+
+done:
+    smp_context_close(ctx);
+    smp_context_free(ctx);
+    test_teardown(&tctx);
+}
+
+#define TEST_CAPTURE_N_MESSAGES 2000
+
+static uint32_t test_capture_next_id;
+static bool test_capture_in_order;
+
+static void on_capture_message(SmpMessage *msg, void *userdata)
+{
+    uint32_t val = 0;
+
+    smp_message_get_uint32(msg, 0, &val);
+    if (smp_message_get_msgid(msg) != test_capture_next_id
+            || val != (0x1b10ff1b ^ test_capture_next_id)
+            || smp_message_get_rx_timestamp(msg, NULL, NULL) != 0)
+        test_capture_in_order = false;
+
+    test_capture_next_id++;
+}
+
+static void test_smp_capture_decode(void)
+{
+    static const unsigned int n_threads[] = { 1, 3, 0 };
+    TestCtx tctx;
+    SmpContext *ctx;
+    char path[] = "/tmp/libsmp-capture-XXXXXX";
+    uint32_t i;
+    size_t j;
+    int fd;
+    int ret;
+
+    test_setup(&tctx);
+    ctx = smp_context_new(&record_cbs, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(ctx);
+    CU_ASSERT_EQUAL_FATAL(smp_context_open(ctx, FIFO_PATH), 0);
+
+    fd = mkstemp(path);
+    CU_ASSERT_FATAL(fd >= 0);
+    close(fd);
+    unlink(path);
+
+    ret = smp_context_start_capture(ctx, path);
+    if (ret == SMP_ERROR_NOT_SUPPORTED) {
+        CU_ASSERT_EQUAL(smp_capture_decode(path, SMP_SERIAL_CHECKSUM_XOR8, 0,
+                    on_capture_message, NULL), SMP_ERROR_NOT_SUPPORTED);
+        goto done;
+    }
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    /* use values full of framing bytes so chunks are split around escapes,
+     * and receive in batches to not fill the fifo */
+    for (i = 0; i < TEST_CAPTURE_N_MESSAGES; i++) {
+        SmpMessage *msg = smp_message_new_with_id(i);
+
+        smp_message_set_uint32(msg, 0, 0x1b10ff1b ^ i);
+        CU_ASSERT_EQUAL(smp_context_send_message(ctx, msg), 0);
+        smp_message_free(msg);
+
+        if (i % 100 == 99)
+            CU_ASSERT_EQUAL(smp_context_process_fd(ctx), 0);
+    }
+    smp_context_stop_capture(ctx);
+
+    for (j = 0; j < SMP_N_ELEMENTS(n_threads); j++) {
+        test_capture_next_id = 0;
+        test_capture_in_order = true;
+        CU_ASSERT_EQUAL(smp_capture_decode(path, SMP_SERIAL_CHECKSUM_XOR8,
+                    n_threads[j], on_capture_message, NULL),
+                TEST_CAPTURE_N_MESSAGES);
+        CU_ASSERT_EQUAL(test_capture_next_id, TEST_CAPTURE_N_MESSAGES);
+        CU_ASSERT_TRUE(test_capture_in_order);
+    }
+
+    CU_ASSERT_EQUAL(smp_capture_decode("/tmp/libsmp-no-such-capture",
+                SMP_SERIAL_CHECKSUM_XOR8, 0, on_capture_message, NULL),
+            SMP_ERROR_NOT_FOUND);
+
+    unlink(path);
+
+done:
+    smp_context_close(ctx);
+    smp_context_free(ctx);
+    test_teardown(&tctx);
+}
+
+static void test_smp_context_transport_loopback(void)
+{
+    SmpTransport *transport;
+    SmpContext *ctx;
+
+    transport = smp_transport_new_loopback(0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(transport);
+
+    ctx = smp_context_new(&record_cbs, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(ctx);
+    CU_ASSERT_EQUAL(smp_context_set_transport(ctx, transport), 0);
+    CU_ASSERT_EQUAL_FATAL(smp_context_open(ctx, "loopback"), 0);
+    CU_ASSERT_EQUAL(smp_context_set_transport(ctx, NULL), SMP_ERROR_BUSY);
+
+    CU_ASSERT_EQUAL(smp_context_get_fd(ctx), SMP_ERROR_NOT_SUPPORTED);
+    CU_ASSERT_EQUAL(smp_context_set_serial_config(ctx, SMP_SERIAL_BAUDRATE_9600,
+                SMP_SERIAL_PARITY_NONE, 0), SMP_ERROR_NOT_SUPPORTED);
+    CU_ASSERT_EQUAL(smp_context_wait_and_process(ctx, 0), SMP_ERROR_TIMEDOUT);
+
+    /* sent messages are received back by the same context */
+    test_smp_context_n_received = 0;
+    CU_ASSERT_EQUAL(send_simple_message(ctx, 1), 0);
+    CU_ASSERT_EQUAL(send_simple_message(ctx, 2), 0);
+    CU_ASSERT_EQUAL(smp_context_wait_and_process(ctx, 0), 0);
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 2);
+    CU_ASSERT_EQUAL(test_smp_context_received_ids[0], 1);
+    CU_ASSERT_EQUAL(test_smp_context_received_ids[1], 2);
+
+    smp_context_close(ctx);
+    CU_ASSERT_EQUAL(smp_context_set_transport(ctx, NULL), 0);
+    smp_context_free(ctx);
+    smp_transport_free(transport);
+
+    /* a full buffer leads to a short write */
+    transport = smp_transport_new_loopback(8);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(transport);
+
+    ctx = smp_context_new(&record_cbs, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(ctx);
+    CU_ASSERT_EQUAL(smp_context_set_transport(ctx, transport), 0);
+    CU_ASSERT_EQUAL_FATAL(smp_context_open(ctx, "loopback"), 0);
+    CU_ASSERT_EQUAL(send_simple_message(ctx, 1), SMP_ERROR_IO);
+
+    smp_context_free(ctx);
+    smp_transport_free(transport);
+}
+
+static void test_smp_context_transport_socket(void)
+{
+    SmpTransport *transports[2];
+    SmpTransport *unix_transport;
+    SmpContext *ctxs[2];
+    struct sockaddr_un addr;
+    const char *path = "/tmp/smp-test-socket";
+    int fds[2];
+    int server_fd;
+    int peer_fd;
+    int i;
+
+    /* two contexts talking over a socketpair */
+    CU_ASSERT_EQUAL_FATAL(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+    for (i = 0; i < 2; i++) {
+        transports[i] = smp_transport_new_fd(fds[i], fds[i]);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(transports[i]);
+
+        ctxs[i] = smp_context_new(&record_cbs, NULL);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(ctxs[i]);
+        CU_ASSERT_EQUAL(smp_context_set_transport(ctxs[i], transports[i]), 0);
+        CU_ASSERT_EQUAL_FATAL(smp_context_open(ctxs[i], ""), 0);
+        CU_ASSERT_EQUAL(smp_context_get_fd(ctxs[i]), fds[i]);
+    }
+
+    test_smp_context_n_received = 0;
+    CU_ASSERT_EQUAL(send_simple_message(ctxs[0], 3), 0);
+    CU_ASSERT_EQUAL(smp_context_process_fd(ctxs[0]), 0);
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 0);
+    CU_ASSERT_EQUAL(smp_context_wait_and_process(ctxs[1], 1000), 0);
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 1);
+    CU_ASSERT_EQUAL(test_smp_context_received_ids[0], 3);
+
+    /* the caller keeps ownership of the descriptors */
+    for (i = 0; i < 2; i++) {
+        smp_context_free(ctxs[i]);
+        smp_transport_free(transports[i]);
+        CU_ASSERT_EQUAL(fcntl(fds[i], F_GETFD), 0);
+        close(fds[i]);
+    }
+
+    /* connection to a Unix socket */
+    unlink(path);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    server_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    CU_ASSERT_FATAL(server_fd >= 0);
+    CU_ASSERT_EQUAL_FATAL(bind(server_fd, (struct sockaddr *) &addr,
+                sizeof(addr)), 0);
+    CU_ASSERT_EQUAL_FATAL(listen(server_fd, 1), 0);
+
+    unix_transport = smp_transport_new_unix_socket();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(unix_transport);
+    ctxs[0] = smp_context_new(&record_cbs, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(ctxs[0]);
+    CU_ASSERT_EQUAL(smp_context_set_transport(ctxs[0], unix_transport), 0);
+    CU_ASSERT_EQUAL(smp_context_open(ctxs[0], "/tmp/smp-no-such-socket"),
+            SMP_ERROR_NO_DEVICE);
+    CU_ASSERT_EQUAL_FATAL(smp_context_open(ctxs[0], path), 0);
+
+    peer_fd = accept(server_fd, NULL, NULL);
+    CU_ASSERT_FATAL(peer_fd >= 0);
+
+    test_smp_context_n_received = 0;
+    CU_ASSERT_EQUAL(send_simple_message(ctxs[0], 4), 0);
+    {
+        uint8_t buf[64];
+        ssize_t n = read(peer_fd, buf, sizeof(buf));
+
+        CU_ASSERT_FATAL(n > 0);
+        CU_ASSERT_EQUAL(write(peer_fd, buf, n), n);
+    }
+    CU_ASSERT_EQUAL(smp_context_wait_and_process(ctxs[0], 1000), 0);
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 1);
+    CU_ASSERT_EQUAL(test_smp_context_received_ids[0], 4);
+
+    /* the peer going away is reported */
+    close(peer_fd);
+    CU_ASSERT_EQUAL(smp_context_process_fd(ctxs[0]), SMP_ERROR_PIPE);
+    CU_ASSERT_EQUAL(send_simple_message(ctxs[0], 5), SMP_ERROR_PIPE);
+
+    smp_context_free(ctxs[0]);
+    smp_transport_free(unix_transport);
+    close(server_fd);
+    unlink(path);
+}
+
+static void test_smp_context_transport_shm(void)
+{
+    SmpTransport *transports[2];
+    SmpContext *ctxs[2];
+    const char *name = "/smp-test-shm";
+    pid_t pid;
+    int status;
+    int i;
+
+    transports[0] = smp_transport_new_shm(0, true);
+    if (transports[0] == NULL)
+        return; /* not supported on this platform */
+    transports[1] = smp_transport_new_shm(0, false);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(transports[1]);
+
+    for (i = 0; i < 2; i++) {
+        ctxs[i] = smp_context_new(&record_cbs, NULL);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(ctxs[i]);
+        CU_ASSERT_EQUAL(smp_context_set_transport(ctxs[i], transports[i]), 0);
+    }
+
+    CU_ASSERT_EQUAL(smp_context_open(ctxs[1], name), SMP_ERROR_NO_DEVICE);
+    CU_ASSERT_EQUAL_FATAL(smp_context_open(ctxs[0], name), 0);
+    CU_ASSERT_EQUAL_FATAL(smp_context_open(ctxs[1], name), 0);
+    CU_ASSERT_EQUAL(smp_context_get_fd(ctxs[0]), SMP_ERROR_NOT_SUPPORTED);
+    CU_ASSERT_EQUAL(smp_context_wait_and_process(ctxs[0], 0),
+            SMP_ERROR_TIMEDOUT);
+
+    /* both directions */
+    test_smp_context_n_received = 0;
+    CU_ASSERT_EQUAL(send_simple_message(ctxs[0], 1), 0);
+    CU_ASSERT_EQUAL(send_simple_message(ctxs[0], 2), 0);
+    CU_ASSERT_EQUAL(smp_context_wait_and_process(ctxs[1], 0), 0);
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 2);
+    CU_ASSERT_EQUAL(test_smp_context_received_ids[0], 1);
+    CU_ASSERT_EQUAL(test_smp_context_received_ids[1], 2);
+
+    test_smp_context_n_received = 0;
+    CU_ASSERT_EQUAL(send_simple_message(ctxs[1], 3), 0);
+    CU_ASSERT_EQUAL(smp_context_wait_and_process(ctxs[0], 0), 0);
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 1);
+    CU_ASSERT_EQUAL(test_smp_context_received_ids[0], 3);
+
+    /* a sleeping peer is woken up by another process */
+    pid = fork();
+    CU_ASSERT_FATAL(pid >= 0);
+    if (pid == 0) {
+        usleep(50000);
+        _exit(send_simple_message(ctxs[1], 4) == 0 ? 0 : 1);
+    }
+
+    test_smp_context_n_received = 0;
+    CU_ASSERT_EQUAL(smp_context_wait_and_process(ctxs[0], 5000), 0);
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 1);
+    CU_ASSERT_EQUAL(test_smp_context_received_ids[0], 4);
+    CU_ASSERT_EQUAL(waitpid(pid, &status, 0), pid);
+    CU_ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    for (i = 0; i < 2; i++) {
+        smp_context_free(ctxs[i]);
+        smp_transport_free(transports[i]);
+    }
+}
+
+static uint64_t get_monotonic_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* read everything written to the socket, after letting the writer block */
+static void *uring_drain_thread(void *data)
+{
+    int fd = *(int *) data;
+    uint8_t buf[4096];
+    struct pollfd pfd;
+
+    usleep(50000);
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    while (poll(&pfd, 1, 100) > 0) {
+        if (read(fd, buf, sizeof(buf)) <= 0)
+            break;
+    }
+
+    return NULL;
+}
+
+static void test_smp_context_transport_uring(void)
+{
+    SmpTransport *transport;
+    SmpTransport *peer_transport;
+    SmpContext *ctx;
+    SmpContext *peer;
+    uint8_t filler[4096];
+    pthread_t thread;
+    uint64_t start;
+    int fds[2];
+    int ret;
+    int i;
+
+    CU_ASSERT_EQUAL_FATAL(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+    transport = smp_transport_new_uring(fds[0]);
+    if (transport == NULL)
+        goto out; /* not supported on this platform */
+    peer_transport = smp_transport_new_fd(fds[1], fds[1]);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(peer_transport);
+
+    ctx = smp_context_new(&record_cbs, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(ctx);
+    peer = smp_context_new(&record_cbs, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(peer);
+    CU_ASSERT_EQUAL(smp_context_set_transport(ctx, transport), 0);
+    CU_ASSERT_EQUAL(smp_context_set_transport(peer, peer_transport), 0);
+
+    ret = smp_context_open(ctx, "");
+    if (ret == SMP_ERROR_NOT_SUPPORTED || ret == SMP_ERROR_PERM) {
+        /* io_uring is missing or disabled on this kernel */
+        smp_context_free(ctx);
+        smp_transport_free(transport);
+        goto out_peer;
+    }
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL_FATAL(smp_context_open(peer, ""), 0);
+    CU_ASSERT(smp_context_get_fd(ctx) >= 0);
+    CU_ASSERT_EQUAL(smp_context_wait_and_process(ctx, 0), SMP_ERROR_TIMEDOUT);
+
+    /* writes sent outside of processing are flushed in order */
+    test_smp_context_n_received = 0;
+    for (i = 0; i < 8; i++)
+        CU_ASSERT_EQUAL(send_simple_message(ctx, i), 0);
+    while (test_smp_context_n_received < 8) {
+        if (smp_context_wait_and_process(peer, 1000) < 0)
+            break;
+    }
+    CU_ASSERT_EQUAL_FATAL(test_smp_context_n_received, 8);
+    for (i = 0; i < 8; i++)
+        CU_ASSERT_EQUAL(test_smp_context_received_ids[i], i);
+
+    /* reception from the read kept armed in the ring */
+    test_smp_context_n_received = 0;
+    CU_ASSERT_EQUAL(send_simple_message(peer, 20), 0);
+    CU_ASSERT_EQUAL(send_simple_message(peer, 21), 0);
+    while (test_smp_context_n_received < 2) {
+        if (smp_context_wait_and_process(ctx, 1000) < 0)
+            break;
+    }
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 2);
+    CU_ASSERT_EQUAL(test_smp_context_received_ids[0], 20);
+    CU_ASSERT_EQUAL(test_smp_context_received_ids[1], 21);
+
+    /* the completion of a write doesn't end a wait early: fill the socket so
+     * a write stays pending until another thread drains it */
+    memset(filler, 0, sizeof(filler));
+    while (send(fds[0], filler, sizeof(filler), MSG_DONTWAIT) > 0)
+        ;
+    CU_ASSERT_EQUAL(send_simple_message(ctx, 30), 0);
+    CU_ASSERT_EQUAL_FATAL(pthread_create(&thread, NULL, uring_drain_thread,
+                &fds[1]), 0);
+    start = get_monotonic_ms();
+    CU_ASSERT_EQUAL(smp_context_wait_and_process(ctx, 300),
+            SMP_ERROR_TIMEDOUT);
+    CU_ASSERT(get_monotonic_ms() - start >= 290);
+    pthread_join(thread, NULL);
+
+    /* the peer going away is reported */
+    smp_context_free(peer);
+    smp_transport_free(peer_transport);
+    close(fds[1]);
+    CU_ASSERT_EQUAL(smp_context_wait_and_process(ctx, 1000), SMP_ERROR_PIPE);
+
+    smp_context_free(ctx);
+    smp_transport_free(transport);
+    close(fds[0]);
+    return;
+
+out_peer:
+    smp_context_free(peer);
+    smp_transport_free(peer_transport);
+out:
+    close(fds[0]);
+    close(fds[1]);
+}
+
+static void test_smp_context_busy_poll(void)
+{
+    SmpTransport *transport;
+    SmpContextStats stats;
+    SmpContext *ctx;
+    SmpContext *peer;
+    int fds[2];
+    pid_t pid;
+    int status;
+
+    transport = smp_transport_new_loopback(0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(transport);
+    ctx = smp_context_new(&record_cbs, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(ctx);
+    CU_ASSERT_EQUAL(smp_context_set_transport(ctx, transport), 0);
+    CU_ASSERT_EQUAL_FATAL(smp_context_open(ctx, "loopback"), 0);
+    CU_ASSERT_EQUAL(smp_context_set_busy_poll(ctx, 2000, true), 0);
+
+    /* data already there is a hit */
+    test_smp_context_n_received = 0;
+    CU_ASSERT_EQUAL(send_simple_message(ctx, 1), 0);
+    CU_ASSERT_EQUAL(smp_context_wait_and_process(ctx, 100), 0);
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 1);
+    CU_ASSERT_EQUAL(smp_context_get_stats(ctx, &stats), 0);
+    CU_ASSERT_EQUAL(stats.busy_poll_hits, 1);
+    CU_ASSERT_EQUAL(stats.busy_poll_misses, 0);
+
+    /* nothing comes, the budget runs out before the wait times out */
+    CU_ASSERT_EQUAL(smp_context_wait_and_process(ctx, 10), SMP_ERROR_TIMEDOUT);
+    CU_ASSERT_EQUAL(smp_context_get_stats(ctx, &stats), 0);
+    CU_ASSERT_EQUAL(stats.busy_poll_hits, 1);
+    CU_ASSERT_EQUAL(stats.busy_poll_misses, 1);
+
+    /* a zero timeout doesn't spin */
+    CU_ASSERT_EQUAL(smp_context_wait_and_process(ctx, 0), SMP_ERROR_TIMEDOUT);
+    CU_ASSERT_EQUAL(smp_context_get_stats(ctx, &stats), 0);
+    CU_ASSERT_EQUAL(stats.busy_poll_misses, 1);
+
+    smp_context_free(ctx);
+    smp_transport_free(transport);
+
+    /* data sent by another process while spinning */
+    CU_ASSERT_EQUAL_FATAL(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    ctx = smp_context_new(&record_cbs, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(ctx);
+    transport = smp_transport_new_fd(fds[0], fds[0]);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(transport);
+    CU_ASSERT_EQUAL(smp_context_set_transport(ctx, transport), 0);
+    CU_ASSERT_EQUAL_FATAL(smp_context_open(ctx, ""), 0);
+    CU_ASSERT_EQUAL(smp_context_set_busy_poll(ctx, 1000000, false), 0);
+
+    pid = fork();
+    CU_ASSERT_FATAL(pid >= 0);
+    if (pid == 0) {
+        SmpTransport *peer_transport = smp_transport_new_fd(fds[1], fds[1]);
+
+        peer = smp_context_new(&record_cbs, NULL);
+        if (peer_transport == NULL || peer == NULL
+                || smp_context_set_transport(peer, peer_transport) < 0
+                || smp_context_open(peer, "") < 0)
+            _exit(1);
+
+        usleep(1000);
+        _exit(send_simple_message(peer, 2) == 0 ? 0 : 1);
+    }
+
+    test_smp_context_n_received = 0;
+    while (test_smp_context_n_received == 0) {
+        if (smp_context_wait_and_process(ctx, 5000) < 0)
+            break;
+    }
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 1);
+    CU_ASSERT_EQUAL(test_smp_context_received_ids[0], 2);
+    CU_ASSERT_EQUAL(smp_context_get_stats(ctx, &stats), 0);
+    CU_ASSERT(stats.busy_poll_hits >= 1);
+    CU_ASSERT_EQUAL(stats.busy_poll_misses, 0);
+    CU_ASSERT_EQUAL(waitpid(pid, &status, 0), pid);
+    CU_ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    CU_ASSERT_EQUAL(smp_context_set_busy_poll(ctx, 0, false), 0);
+    smp_context_free(ctx);
+    smp_transport_free(transport);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+static void test_smp_context_process_budget(void)
+{
+    SmpTransport *transport;
+    SmpContext *ctx;
+    int i;
+
+    transport = smp_transport_new_loopback(0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(transport);
+    ctx = smp_context_new(&record_cbs, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(ctx);
+    CU_ASSERT_EQUAL(smp_context_set_transport(ctx, transport), 0);
+    CU_ASSERT_EQUAL(smp_context_process_budget(ctx, 1, 0), SMP_ERROR_BAD_FD);
+    CU_ASSERT_EQUAL_FATAL(smp_context_open(ctx, "loopback"), 0);
+    CU_ASSERT_EQUAL(smp_context_process_budget(ctx, 1, 0), 0);
+
+    /* frames are processed two at a time */
+    test_smp_context_n_received = 0;
+    for (i = 0; i < 5; i++)
+        CU_ASSERT_EQUAL(send_simple_message(ctx, i), 0);
+    CU_ASSERT_EQUAL(smp_context_process_budget(ctx, 2, 0), 1);
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 2);
+    CU_ASSERT_EQUAL(smp_context_get_next_timeout(ctx), 0);
+    CU_ASSERT_EQUAL(smp_context_process_budget(ctx, 2, 0), 1);
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 4);
+    CU_ASSERT_EQUAL(smp_context_process_budget(ctx, 2, 0), 0);
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 5);
+    CU_ASSERT_EQUAL(smp_context_get_next_timeout(ctx), -1);
+    for (i = 0; i < 5; i++)
+        CU_ASSERT_EQUAL(test_smp_context_received_ids[i], i);
+
+    /* the data left is processed without waiting */
+    test_smp_context_n_received = 0;
+    for (i = 0; i < 3; i++)
+        CU_ASSERT_EQUAL(send_simple_message(ctx, i), 0);
+    CU_ASSERT_EQUAL(smp_context_process_budget(ctx, 1, 0), 1);
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 1);
+    CU_ASSERT_EQUAL(smp_context_wait_and_process(ctx, -1), 0);
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 3);
+
+    /* an expired time budget still processes one frame */
+    test_smp_context_n_received = 0;
+    for (i = 0; i < 3; i++)
+        CU_ASSERT_EQUAL(send_simple_message(ctx, i), 0);
+    CU_ASSERT_EQUAL(smp_context_process_budget(ctx, 0, 1), 1);
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 1);
+    CU_ASSERT_EQUAL(smp_context_process_fd(ctx), 0);
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 3);
+
+    /* closing drops the data left */
+    CU_ASSERT_EQUAL(send_simple_message(ctx, 1), 0);
+    CU_ASSERT_EQUAL(send_simple_message(ctx, 2), 0);
+    CU_ASSERT_EQUAL(smp_context_process_budget(ctx, 1, 0), 1);
+    smp_context_close(ctx);
+    CU_ASSERT_EQUAL(smp_context_get_next_timeout(ctx), -1);
+
+    smp_context_free(ctx);
+    smp_transport_free(transport);
+}
+
+#define SEND_QUEUE_PRODUCERS 4
+#define SEND_QUEUE_MESSAGES 250
+
+static uint32_t test_send_queue_next[SEND_QUEUE_PRODUCERS];
+static unsigned int test_send_queue_n_received;
+static bool test_send_queue_in_order;
+
+/* each producer sends its id with a sequence number */
+static void on_new_message_send_queue(SmpContext *ctx, SmpMessage *msg,
+        void *userdata)
+{
+    uint32_t id = smp_message_get_msgid(msg);
+    uint32_t seq;
+
+    test_send_queue_n_received++;
+    if (id >= SEND_QUEUE_PRODUCERS
+            || smp_message_get_uint32(msg, 0, &seq) < 0
+            || seq != test_send_queue_next[id])
+        test_send_queue_in_order = false;
+    else
+        test_send_queue_next[id]++;
+}
+
+static const SmpEventCallbacks send_queue_cbs = {
+    .new_message_cb = on_new_message_send_queue,
+    .error_cb = on_error_simple
+};
+
+typedef struct
+{
+    SmpContext *ctx;
+    uint32_t id;
+    unsigned int n_messages;
+    useconds_t delay;
+    int ret;
+} SendQueueProducer;
+
+static int test_send_queue_n_done;
+
+static void *send_queue_producer(void *data)
+{
+    SendQueueProducer *producer = data;
+    SmpMessage *msg;
+    unsigned int i;
+
+    producer->ret = 0;
+    usleep(producer->delay);
+
+    msg = smp_message_new_with_id(producer->id);
+    for (i = 0; i < producer->n_messages && producer->ret == 0; i++) {
+        smp_message_set_uint32(msg, 0, i);
+        producer->ret = smp_context_queue_message(producer->ctx, msg);
+    }
+    smp_message_free(msg);
+
+    __atomic_add_fetch(&test_send_queue_n_done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static void test_smp_context_send_queue(void)
+{
+    SendQueueProducer producers[SEND_QUEUE_PRODUCERS];
+    pthread_t threads[SEND_QUEUE_PRODUCERS];
+    SmpTransport *transport;
+    SmpTransport *peer_transport;
+    SmpContextStats stats;
+    SmpMessage *msg;
+    SmpContext *ctx;
+    SmpContext *peer;
+    uint64_t start;
+    int fds[2];
+    int ret;
+    int i;
+
+    CU_ASSERT_EQUAL_FATAL(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    ctx = smp_context_new(&record_cbs, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(ctx);
+    transport = smp_transport_new_fd(fds[0], fds[0]);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(transport);
+    CU_ASSERT_EQUAL(smp_context_set_transport(ctx, transport), 0);
+    CU_ASSERT_EQUAL_FATAL(smp_context_open(ctx, ""), 0);
+
+    peer = smp_context_new(&send_queue_cbs, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(peer);
+    peer_transport = smp_transport_new_fd(fds[1], fds[1]);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(peer_transport);
+    CU_ASSERT_EQUAL(smp_context_set_transport(peer, peer_transport), 0);
+    CU_ASSERT_EQUAL_FATAL(smp_context_open(peer, ""), 0);
+
+    msg = smp_message_new_with_id(0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(msg);
+    CU_ASSERT_EQUAL(smp_context_queue_message(ctx, msg),
+            SMP_ERROR_NOT_SUPPORTED);
+    CU_ASSERT_EQUAL(smp_context_get_queue_fd(ctx), SMP_ERROR_NOT_SUPPORTED);
+    CU_ASSERT_EQUAL(smp_context_process_queue(ctx), SMP_ERROR_NOT_SUPPORTED);
+
+    ret = smp_context_enable_send_queue(ctx);
+    if (ret == SMP_ERROR_NOT_SUPPORTED) {
+        smp_message_free(msg);
+        goto done;
+    }
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL(smp_context_enable_send_queue(ctx), SMP_ERROR_BUSY);
+    CU_ASSERT(smp_context_get_queue_fd(ctx) >= 0);
+
+    /* messages queued from this thread are sent by the next processing */
+    memset(test_send_queue_next, 0, sizeof(test_send_queue_next));
+    test_send_queue_n_received = 0;
+    test_send_queue_in_order = true;
+    smp_message_set_uint32(msg, 0, 0);
+    CU_ASSERT_EQUAL(smp_context_queue_message(ctx, msg), 0);
+    smp_message_set_uint32(msg, 0, 1);
+    CU_ASSERT_EQUAL(smp_context_queue_message(ctx, msg), 0);
+    smp_message_free(msg);
+    CU_ASSERT_EQUAL(smp_context_process_queue(ctx), 0);
+    CU_ASSERT_EQUAL(smp_context_get_stats(ctx, &stats), 0);
+    CU_ASSERT_EQUAL(stats.tx_frames, 2);
+    CU_ASSERT_EQUAL(smp_context_wait_and_process(peer, 100), 0);
+    CU_ASSERT_EQUAL(test_send_queue_n_received, 2);
+    CU_ASSERT(test_send_queue_in_order);
+
+    /* producers running concurrently keep their own order */
+    memset(test_send_queue_next, 0, sizeof(test_send_queue_next));
+    test_send_queue_n_received = 0;
+    test_send_queue_n_done = 0;
+    for (i = 0; i < SEND_QUEUE_PRODUCERS; i++) {
+        producers[i].ctx = ctx;
+        producers[i].id = i;
+        producers[i].n_messages = SEND_QUEUE_MESSAGES;
+        producers[i].delay = 0;
+        CU_ASSERT_EQUAL_FATAL(pthread_create(&threads[i], NULL,
+                    send_queue_producer, &producers[i]), 0);
+    }
+
+    while (__atomic_load_n(&test_send_queue_n_done, __ATOMIC_ACQUIRE)
+            < SEND_QUEUE_PRODUCERS) {
+        ret = smp_context_wait_and_process(ctx, 100);
+        if (ret < 0 && ret != SMP_ERROR_TIMEDOUT)
+            break;
+    }
+
+    for (i = 0; i < SEND_QUEUE_PRODUCERS; i++) {
+        pthread_join(threads[i], NULL);
+        CU_ASSERT_EQUAL(producers[i].ret, 0);
+    }
+    CU_ASSERT_EQUAL(smp_context_process_queue(ctx), 0);
+
+    while (test_send_queue_n_received
+            < SEND_QUEUE_PRODUCERS * SEND_QUEUE_MESSAGES) {
+        if (smp_context_wait_and_process(peer, 1000) < 0)
+            break;
+    }
+    CU_ASSERT_EQUAL(test_send_queue_n_received,
+            SEND_QUEUE_PRODUCERS * SEND_QUEUE_MESSAGES);
+    CU_ASSERT(test_send_queue_in_order);
+    for (i = 0; i < SEND_QUEUE_PRODUCERS; i++)
+        CU_ASSERT_EQUAL(test_send_queue_next[i], SEND_QUEUE_MESSAGES);
+
+    /* a thread waiting for the device is woken up by a queued message */
+    memset(test_send_queue_next, 0, sizeof(test_send_queue_next));
+    test_send_queue_n_received = 0;
+    test_send_queue_n_done = 0;
+    producers[0].n_messages = 1;
+    producers[0].delay = 10000;
+    CU_ASSERT_EQUAL_FATAL(pthread_create(&threads[0], NULL,
+                send_queue_producer, &producers[0]), 0);
+
+    start = smp_context_get_time_ns();
+    CU_ASSERT_EQUAL(smp_context_wait_and_process(ctx, 5000), 0);
+    CU_ASSERT(smp_context_get_time_ns() - start < 4000000000ull);
+    pthread_join(threads[0], NULL);
+
+    CU_ASSERT_EQUAL(smp_context_wait_and_process(peer, 1000), 0);
+    CU_ASSERT_EQUAL(test_send_queue_n_received, 1);
+
+done:
+    smp_context_free(peer);
+    smp_transport_free(peer_transport);
+    smp_context_free(ctx);
+    smp_transport_free(transport);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+static SmpContext *test_relay_target;
+static unsigned int test_relay_n_frames;
+
+static bool on_relay_frame(SmpContext *ctx, const uint8_t *payload,
+        size_t size, void *userdata)
+{
+    test_relay_n_frames++;
+
+    /* forward message 1, let the context decode the others */
+    if (payload[0] != 1)
+        return false;
+
+    CU_ASSERT_EQUAL(smp_context_send_frame(test_relay_target, payload, size,
+                SMP_FRAME_FORMAT_PAYLOAD), 0);
+    return true;
+}
+
+static void test_smp_context_send_frame(void)
+{
+    SmpTransport *transports[2];
+    SmpContext *ctxs[2];
+    uint8_t relayed[64];
+    uint8_t frame[64];
+    int fds[2];
+    ssize_t n;
+    ssize_t m;
+    int i;
+
+    CU_ASSERT_EQUAL_FATAL(pipe(fds), 0);
+    transports[0] = smp_transport_new_loopback(0);
+    transports[1] = smp_transport_new_fd(fds[0], fds[1]);
+    for (i = 0; i < 2; i++) {
+        CU_ASSERT_PTR_NOT_NULL_FATAL(transports[i]);
+        ctxs[i] = smp_context_new(&record_cbs, NULL);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(ctxs[i]);
+        CU_ASSERT_EQUAL(smp_context_set_transport(ctxs[i], transports[i]), 0);
+        CU_ASSERT_EQUAL_FATAL(smp_context_open(ctxs[i], ""), 0);
+    }
+
+    /* frames received by ctxs[0] are relayed to the pipe of ctxs[1] */
+    test_relay_target = ctxs[1];
+    test_relay_n_frames = 0;
+    CU_ASSERT_EQUAL(smp_context_set_frame_cb(ctxs[0], on_relay_frame, NULL),
+            0);
+
+    test_smp_context_n_received = 0;
+    CU_ASSERT_EQUAL(send_simple_message(ctxs[0], 1), 0);
+    CU_ASSERT_EQUAL(send_simple_message(ctxs[0], 2), 0);
+    CU_ASSERT_EQUAL(smp_context_process_fd(ctxs[0]), 0);
+    CU_ASSERT_EQUAL(test_relay_n_frames, 2);
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 1);
+    CU_ASSERT_EQUAL(test_smp_context_received_ids[0], 2);
+
+    /* the relayed frame is the one a message would give */
+    n = read(fds[0], frame, sizeof(frame));
+    CU_ASSERT_FATAL(n > 0);
+    CU_ASSERT_EQUAL(send_simple_message(ctxs[1], 1), 0);
+    CU_ASSERT_EQUAL(read(fds[0], frame + n, sizeof(frame) - n), n);
+    CU_ASSERT_EQUAL(memcmp(frame, frame + n, n), 0);
+
+    /* relayed frames go through the priorities of the target, which add a
+     * link header, as messages do */
+    CU_ASSERT_EQUAL(smp_context_enable_priorities(ctxs[1], 0), 0);
+    CU_ASSERT_EQUAL(send_simple_message(ctxs[0], 1), 0);
+    CU_ASSERT_EQUAL(smp_context_process_fd(ctxs[0]), 0);
+    CU_ASSERT_EQUAL(test_relay_n_frames, 3);
+    m = read(fds[0], relayed, sizeof(relayed));
+    CU_ASSERT_FATAL(m > n);
+    CU_ASSERT_EQUAL(send_simple_message(ctxs[1], 1), 0);
+    CU_ASSERT_EQUAL(read(fds[0], relayed + m, sizeof(relayed) - m), m);
+    CU_ASSERT_EQUAL(memcmp(relayed, relayed + m, m), 0);
+
+    /* a complete frame is sent as is */
+    CU_ASSERT_EQUAL(smp_context_set_frame_cb(ctxs[0], NULL, NULL), 0);
+    test_smp_context_n_received = 0;
+    CU_ASSERT_EQUAL(smp_context_send_frame(ctxs[0], frame, n,
+                SMP_FRAME_FORMAT_SERIAL), 0);
+    CU_ASSERT_EQUAL(smp_context_process_fd(ctxs[0]), 0);
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 1);
+    CU_ASSERT_EQUAL(test_smp_context_received_ids[0], 1);
+
+    CU_ASSERT_EQUAL(smp_context_send_frame(ctxs[0], frame, 4,
+                SMP_FRAME_FORMAT_PAYLOAD), SMP_ERROR_BAD_MESSAGE);
+    CU_ASSERT_EQUAL(smp_context_enable_reliability(ctxs[0], 4), 0);
+    CU_ASSERT_EQUAL(smp_context_send_frame(ctxs[0], frame, n,
+                SMP_FRAME_FORMAT_SERIAL), SMP_ERROR_NOT_SUPPORTED);
+
+    for (i = 0; i < 2; i++) {
+        smp_context_free(ctxs[i]);
+        smp_transport_free(transports[i]);
+    }
+    close(fds[0]);
+    close(fds[1]);
+}
+
+static int open_pty(char *name, size_t size)
+{
+    int fd;
+
+    fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (fd < 0)
+        return -1;
+
+    if (grantpt(fd) < 0 || unlockpt(fd) < 0
+            || ptsname_r(fd, name, size) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static void test_smp_bridge(void)
+{
+    SmpTransport *transports[2];
+    SmpContext *ctxs[2];
+    SmpBridgeStats stats;
+    SmpBridge *bridge;
+    char names[2][64];
+    int masters[2];
+    int i;
+
+    bridge = smp_bridge_new();
+    if (bridge == NULL)
+        return; /* not supported on this platform */
+
+    /* the bridge links two ptys, contexts sit on the other side */
+    for (i = 0; i < 2; i++) {
+        masters[i] = open_pty(names[i], sizeof(names[i]));
+        CU_ASSERT_FATAL(masters[i] >= 0);
+
+        transports[i] = smp_transport_new_fd(masters[i], masters[i]);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(transports[i]);
+        ctxs[i] = smp_context_new(&record_cbs, NULL);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(ctxs[i]);
+        CU_ASSERT_EQUAL(smp_context_set_transport(ctxs[i], transports[i]), 0);
+        CU_ASSERT_EQUAL_FATAL(smp_context_open(ctxs[i], ""), 0);
+    }
+
+    CU_ASSERT_EQUAL_FATAL(smp_bridge_open(bridge, names[0], names[1]), 0);
+    CU_ASSERT_EQUAL(smp_bridge_open(bridge, names[0], names[1]),
+            SMP_ERROR_BUSY);
+    CU_ASSERT_EQUAL(smp_bridge_process(bridge, 0), SMP_ERROR_TIMEDOUT);
+
+    test_smp_context_n_received = 0;
+    CU_ASSERT_EQUAL(send_simple_message(ctxs[0], 1), 0);
+    CU_ASSERT_EQUAL(send_simple_message(ctxs[0], 2), 0);
+    CU_ASSERT_EQUAL(smp_bridge_process(bridge, 1000), 0);
+    CU_ASSERT_EQUAL(smp_context_wait_and_process(ctxs[1], 1000), 0);
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 2);
+    CU_ASSERT_EQUAL(test_smp_context_received_ids[0], 1);
+    CU_ASSERT_EQUAL(test_smp_context_received_ids[1], 2);
+
+    test_smp_context_n_received = 0;
+    CU_ASSERT_EQUAL(send_simple_message(ctxs[1], 3), 0);
+    CU_ASSERT_EQUAL(smp_bridge_process(bridge, 1000), 0);
+    CU_ASSERT_EQUAL(smp_context_wait_and_process(ctxs[0], 1000), 0);
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 1);
+    CU_ASSERT_EQUAL(test_smp_context_received_ids[0], 3);
+
+    CU_ASSERT_EQUAL(smp_bridge_get_stats(bridge, &stats), 0);
+    CU_ASSERT_EQUAL(stats.a_to_b_frames, 2);
+    CU_ASSERT_EQUAL(stats.b_to_a_frames, 1);
+    CU_ASSERT_EQUAL(stats.a_to_b_bytes, 2 * stats.b_to_a_bytes);
+    CU_ASSERT(stats.b_to_a_bytes > 0);
+
+    smp_bridge_close(bridge);
+    for (i = 0; i < 2; i++) {
+        smp_context_free(ctxs[i]);
+        smp_transport_free(transports[i]);
+        close(masters[i]);
+    }
+
+    /* between caller owned descriptors */
+    {
+        int in[2];
+        int out[2];
+        uint8_t buf[8];
+
+        CU_ASSERT_EQUAL_FATAL(pipe(in), 0);
+        CU_ASSERT_EQUAL_FATAL(pipe(out), 0);
+
+        CU_ASSERT_EQUAL_FATAL(smp_bridge_open_fds(bridge, in[0], out[1]), 0);
+        CU_ASSERT_EQUAL(write(in[1], "\x10\x1b\xff\xff", 4), 4);
+        CU_ASSERT_EQUAL(smp_bridge_process(bridge, 1000), 0);
+        CU_ASSERT_EQUAL(read(out[0], buf, sizeof(buf)), 4);
+        CU_ASSERT_EQUAL(memcmp(buf, "\x10\x1b\xff\xff", 4), 0);
+
+        CU_ASSERT_EQUAL(smp_bridge_get_stats(bridge, &stats), 0);
+        CU_ASSERT_EQUAL(stats.a_to_b_bytes, 4);
+        CU_ASSERT_EQUAL(stats.a_to_b_frames, 1);
+
+        close(in[1]);
+        CU_ASSERT_EQUAL(smp_bridge_process(bridge, 1000), SMP_ERROR_PIPE);
+
+        smp_bridge_free(bridge);
+        close(in[0]);
+        close(out[0]);
+        close(out[1]);
+    }
+}
+
+#define PRIORITY_BULK_SIZE (60 * 1024)
+
+static size_t test_priority_bulk_size;
+static bool test_priority_bulk_ok;
+
+/* record message ids and check the content of bulk transfers */
+static void on_new_message_priority(SmpContext *ctx, SmpMessage *msg,
+        void *userdata)
+{
+    const uint8_t *raw;
+    size_t size;
+    size_t i;
+
+    on_new_message_record(ctx, msg, userdata);
+    if (smp_message_get_craw(msg, 0, &raw, &size) < 0)
+        return;
+
+    test_priority_bulk_size = size;
+    test_priority_bulk_ok = true;
+    for (i = 0; i < size && test_priority_bulk_ok; i++)
+        test_priority_bulk_ok = (raw[i] == (uint8_t) i);
+}
+
+static const SmpEventCallbacks priority_cbs = {
+    .new_message_cb = on_new_message_priority,
+    .error_cb = on_error_simple
+};
+
+static SmpMessage *new_bulk_message(uint32_t msgid, uint8_t *data,
+        size_t size)
+{
+    SmpMessage *msg;
+    size_t i;
+
+    for (i = 0; i < size; i++)
+        data[i] = (uint8_t) i;
+
+    msg = smp_message_new_with_id(msgid);
+    if (msg != NULL)
+        smp_message_set_craw(msg, 0, data, size);
+
+    return msg;
+}
+
+static void test_smp_context_priorities(void)
+{
+    static uint8_t bulk[PRIORITY_BULK_SIZE];
+    SmpTransport *transports[2];
+    SmpContextStats stats;
+    SmpMessage *msg;
+    SmpContext *ctx;
+    SmpContext *peer;
+    char name[64];
+    int master;
+    int fds[2];
+    int i;
+
+    ctx = smp_context_new(&record_cbs, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(ctx);
+    msg = smp_message_new_with_id(2);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(msg);
+    CU_ASSERT_EQUAL(smp_context_send_message_with_priority(ctx, msg,
+                SMP_PRIORITY_HIGH), SMP_ERROR_BAD_FD);
+
+    /* the sender opens the pty like a serial port, the receiver reads the
+     * master side */
+    master = open_pty(name, sizeof(name));
+    CU_ASSERT_FATAL(master >= 0);
+    CU_ASSERT_EQUAL_FATAL(smp_context_open(ctx, name), 0);
+    CU_ASSERT_EQUAL(smp_context_send_message_with_priority(ctx, msg,
+                SMP_PRIORITY_HIGH), SMP_ERROR_NOT_SUPPORTED);
+    CU_ASSERT_EQUAL(smp_context_enable_priorities(ctx, 256), 0);
+    CU_ASSERT_EQUAL(smp_context_enable_priorities(ctx, 256), SMP_ERROR_BUSY);
+
+    transports[0] = smp_transport_new_fd(master, master);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(transports[0]);
+    peer = smp_context_new(&priority_cbs, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(peer);
+    CU_ASSERT_EQUAL(smp_context_set_transport(peer, transports[0]), 0);
+    CU_ASSERT_EQUAL_FATAL(smp_context_open(peer, ""), 0);
+    CU_ASSERT_EQUAL(smp_context_enable_priorities(peer, 0), 0);
+
+    /* the bulk transfer doesn't fit in the pty buffer, the stop command
+     * queued after it overtakes what is left */
+    test_smp_context_n_received = 0;
+    test_priority_bulk_ok = false;
+    smp_message_free(msg);
+    msg = new_bulk_message(1, bulk, sizeof(bulk));
+    CU_ASSERT_PTR_NOT_NULL_FATAL(msg);
+    CU_ASSERT_EQUAL(smp_context_send_message_with_priority(ctx, msg,
+                SMP_PRIORITY_LOW), 0);
+    smp_message_free(msg);
+
+    msg = smp_message_new_with_id(2);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(msg);
+    CU_ASSERT_EQUAL(smp_context_send_message_with_priority(ctx, msg,
+                SMP_PRIORITY_HIGH), 0);
+    smp_message_free(msg);
+    CU_ASSERT(smp_context_get_next_timeout(ctx) >= 0);
+
+    for (i = 0; i < 1000 && test_smp_context_n_received < 2; i++) {
+        CU_ASSERT_EQUAL(smp_context_process_timers(ctx), 0);
+        smp_context_wait_and_process(peer, 10);
+    }
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 2);
+    CU_ASSERT_EQUAL(test_smp_context_received_ids[0], 2);
+    CU_ASSERT_EQUAL(test_smp_context_received_ids[1], 1);
+    CU_ASSERT_EQUAL(test_priority_bulk_size, PRIORITY_BULK_SIZE);
+    CU_ASSERT(test_priority_bulk_ok);
+
+    CU_ASSERT_EQUAL(smp_context_get_stats(ctx, &stats), 0);
+    CU_ASSERT_EQUAL(stats.short_writes, 0);
+    CU_ASSERT(stats.tx_frames > PRIORITY_BULK_SIZE / 256);
+    CU_ASSERT_EQUAL(smp_context_get_next_timeout(ctx), -1);
+
+    smp_context_free(peer);
+    smp_transport_free(transports[0]);
+    smp_context_free(ctx);
+    close(master);
+
+    /* fragments are retransmitted and reassembled with reliable delivery */
+    CU_ASSERT_EQUAL_FATAL(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    for (i = 0; i < 2; i++) {
+        transports[i] = smp_transport_new_fd(fds[i], fds[i]);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(transports[i]);
+    }
+
+    ctx = smp_context_new(&record_cbs, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(ctx);
+    CU_ASSERT_EQUAL(smp_context_set_transport(ctx, transports[0]), 0);
+    CU_ASSERT_EQUAL_FATAL(smp_context_open(ctx, ""), 0);
+    CU_ASSERT_EQUAL(smp_context_enable_reliability(ctx, 4), 0);
+    CU_ASSERT_EQUAL(smp_context_enable_priorities(ctx, 100), 0);
+
+    peer = smp_context_new(&priority_cbs, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(peer);
+    CU_ASSERT_EQUAL(smp_context_set_transport(peer, transports[1]), 0);
+    CU_ASSERT_EQUAL_FATAL(smp_context_open(peer, ""), 0);
+    CU_ASSERT_EQUAL(smp_context_enable_reliability(peer, 4), 0);
+    CU_ASSERT_EQUAL(smp_context_enable_priorities(peer, 100), 0);
+
+    test_smp_context_n_received = 0;
+    test_priority_bulk_ok = false;
+    msg = new_bulk_message(1, bulk, 4096);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(msg);
+    CU_ASSERT_EQUAL(smp_context_send_message(ctx, msg), 0);
+    smp_message_free(msg);
+
+    /* the window holds 4 fragments, acks let the next ones go */
+    for (i = 0; i < 1000 && test_smp_context_n_received < 1; i++) {
+        smp_context_wait_and_process(peer, 10);
+        smp_context_wait_and_process(ctx, 0);
+    }
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 1);
+    CU_ASSERT_EQUAL(test_smp_context_received_ids[0], 1);
+    CU_ASSERT_EQUAL(test_priority_bulk_size, 4096);
+    CU_ASSERT(test_priority_bulk_ok);
+
+    for (i = 0; i < 2; i++) {
+        smp_context_free(i == 0 ? ctx : peer);
+        smp_transport_free(transports[i]);
+        close(fds[i]);
+    }
+}
+
+static uint32_t test_conflation_last_value;
+
+static void on_new_message_conflation(SmpContext *ctx, SmpMessage *msg,
+        void *userdata)
+{
+    on_new_message_record(ctx, msg, userdata);
+    smp_message_get_uint32(msg, 0, &test_conflation_last_value);
+}
+
+static const SmpEventCallbacks conflation_cbs = {
+    .new_message_cb = on_new_message_conflation,
+    .error_cb = on_error_simple
+};
+
+static int send_value_message(SmpContext *ctx, uint32_t msgid,
+        uint32_t value)
+{
+    SmpMessage *msg;
+    int ret;
+
+    msg = smp_message_new_with_id(msgid);
+    smp_message_set_uint32(msg, 0, value);
+    ret = smp_context_send_message(ctx, msg);
+    smp_message_free(msg);
+
+    return ret;
+}
+
+static void test_smp_context_conflation(void)
+{
+    SmpTransport *transports[2];
+    SmpContextStats stats;
+    SmpContext *ctx;
+    SmpContext *peer;
+    int fds[2];
+    int i;
+
+    CU_ASSERT_EQUAL_FATAL(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    for (i = 0; i < 2; i++) {
+        transports[i] = smp_transport_new_fd(fds[i], fds[i]);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(transports[i]);
+    }
+
+    ctx = smp_context_new(&record_cbs, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(ctx);
+    CU_ASSERT_EQUAL(smp_context_set_transport(ctx, transports[0]), 0);
+    CU_ASSERT_EQUAL_FATAL(smp_context_open(ctx, ""), 0);
+    peer = smp_context_new(&conflation_cbs, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(peer);
+    CU_ASSERT_EQUAL(smp_context_set_transport(peer, transports[1]), 0);
+    CU_ASSERT_EQUAL_FATAL(smp_context_open(peer, ""), 0);
+
+    CU_ASSERT_EQUAL(smp_context_set_conflation(NULL, 7, SMP_CONFLATION_RX),
+            SMP_ERROR_INVALID_PARAM);
+    CU_ASSERT_EQUAL(smp_context_set_conflation(ctx, 7, 0x80),
+            SMP_ERROR_INVALID_PARAM);
+
+    /* the receiver only gets the newest state, after the other messages */
+    CU_ASSERT_EQUAL(smp_context_set_conflation(peer, 7, SMP_CONFLATION_RX), 0);
+    test_smp_context_n_received = 0;
+    for (i = 0; i < 5; i++)
+        CU_ASSERT_EQUAL(send_value_message(ctx, 7, i), 0);
+    CU_ASSERT_EQUAL(send_value_message(ctx, 3, 100), 0);
+    CU_ASSERT_EQUAL(smp_context_process_fd(peer), 0);
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 2);
+    CU_ASSERT_EQUAL(test_smp_context_received_ids[0], 3);
+    CU_ASSERT_EQUAL(test_smp_context_received_ids[1], 7);
+    CU_ASSERT_EQUAL(test_conflation_last_value, 4);
+    CU_ASSERT_EQUAL(smp_context_get_stats(peer, &stats), 0);
+    CU_ASSERT_EQUAL(stats.rx_conflated, 4);
+
+    /* every message once disabled */
+    CU_ASSERT_EQUAL(smp_context_set_conflation(peer, 7, SMP_CONFLATION_NONE),
+            0);
+    test_smp_context_n_received = 0;
+    CU_ASSERT_EQUAL(send_value_message(ctx, 7, 0), 0);
+    CU_ASSERT_EQUAL(send_value_message(ctx, 7, 1), 0);
+    CU_ASSERT_EQUAL(smp_context_process_fd(peer), 0);
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 2);
+
+    /* a full window keeps messages queued, newer states replace the queued
+     * one */
+    CU_ASSERT_EQUAL(smp_context_enable_reliability(ctx, 2), 0);
+    CU_ASSERT_EQUAL(smp_context_enable_priorities(ctx, 0), 0);
+    CU_ASSERT_EQUAL(smp_context_set_conflation(ctx, 7, SMP_CONFLATION_TX), 0);
+    CU_ASSERT_EQUAL(smp_context_enable_reliability(peer, 2), 0);
+    CU_ASSERT_EQUAL(smp_context_enable_priorities(peer, 0), 0);
+
+    test_smp_context_n_received = 0;
+    CU_ASSERT_EQUAL(send_value_message(ctx, 1, 0), 0);
+    CU_ASSERT_EQUAL(send_value_message(ctx, 1, 1), 0);
+    for (i = 0; i < 10; i++)
+        CU_ASSERT_EQUAL(send_value_message(ctx, 7, i), 0);
+    CU_ASSERT_EQUAL(smp_context_get_stats(ctx, &stats), 0);
+    CU_ASSERT_EQUAL(stats.tx_conflated, 9);
+
+    for (i = 0; i < 100 && test_smp_context_n_received < 3; i++) {
+        smp_context_wait_and_process(peer, 10);
+        smp_context_wait_and_process(ctx, 0);
+    }
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 3);
+    CU_ASSERT_EQUAL(test_smp_context_received_ids[2], 7);
+    CU_ASSERT_EQUAL(test_conflation_last_value, 9);
+
+    for (i = 0; i < 2; i++) {
+        smp_context_free(i == 0 ? ctx : peer);
+        smp_transport_free(transports[i]);
+        close(fds[i]);
+    }
+}
+
+#define PACING_BULK_SIZE 4096
+
+static void test_smp_context_tx_pacing(void)
+{
+    static uint8_t bulk[PACING_BULK_SIZE];
+    SmpTransport *transport;
+    SmpContextStats stats;
+    SmpMessage *msg;
+    SmpContext *ctx;
+    SmpContext *peer;
+    uint64_t tx_bytes;
+    uint64_t start;
+    char name[64];
+    int master;
+    int queued;
+    int ret;
+    int i;
+
+    master = open_pty(name, sizeof(name));
+    CU_ASSERT_FATAL(master >= 0);
+    ctx = smp_context_new(&record_cbs, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(ctx);
+    CU_ASSERT_EQUAL_FATAL(smp_context_open(ctx, name), 0);
+    CU_ASSERT_EQUAL(smp_context_set_tx_pacing(ctx, 64),
+            SMP_ERROR_NOT_SUPPORTED);
+    CU_ASSERT_EQUAL(smp_context_enable_priorities(ctx, 32), 0);
+    CU_ASSERT_EQUAL(smp_context_set_serial_config(ctx,
+                SMP_SERIAL_BAUDRATE_921600, SMP_SERIAL_PARITY_NONE, 0), 0);
+
+    /* pacing needs a clock */
+    ret = smp_context_set_tx_pacing(ctx, 64);
+    if (ret == SMP_ERROR_NOT_SUPPORTED) {
+        CU_ASSERT_EQUAL(smp_context_get_time_ns(), 0);
+        smp_context_free(ctx);
+        close(master);
+        return;
+    }
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    transport = smp_transport_new_fd(master, master);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(transport);
+    peer = smp_context_new(&priority_cbs, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(peer);
+    CU_ASSERT_EQUAL(smp_context_set_transport(peer, transport), 0);
+    CU_ASSERT_EQUAL_FATAL(smp_context_open(peer, ""), 0);
+    CU_ASSERT_EQUAL(smp_context_enable_priorities(peer, 0), 0);
+
+    /* the pty reports an empty queue, the baudrate keeps it short anyway */
+    test_smp_context_n_received = 0;
+    test_priority_bulk_ok = false;
+    start = get_monotonic_ms();
+    msg = new_bulk_message(1, bulk, sizeof(bulk));
+    CU_ASSERT_PTR_NOT_NULL_FATAL(msg);
+    CU_ASSERT_EQUAL(smp_context_send_message_with_priority(ctx, msg,
+                SMP_PRIORITY_LOW), 0);
+    smp_message_free(msg);
+
+    CU_ASSERT_EQUAL(ioctl(master, FIONREAD, &queued), 0);
+    CU_ASSERT(queued < 256);
+    CU_ASSERT(smp_context_get_next_timeout(ctx) >= 0);
+
+    for (i = 0; i < 1000 && test_smp_context_n_received < 1; i++) {
+        smp_context_wait_and_process(ctx, smp_context_get_next_timeout(ctx));
+        smp_context_wait_and_process(peer, 0);
+    }
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 1);
+    CU_ASSERT_EQUAL(test_priority_bulk_size, PACING_BULK_SIZE);
+    CU_ASSERT(test_priority_bulk_ok);
+
+    /* about 11 us per byte at 921600 bauds */
+    CU_ASSERT(get_monotonic_ms() - start >= 30);
+    CU_ASSERT_EQUAL(smp_context_get_stats(ctx, &stats), 0);
+    CU_ASSERT(stats.tx_paced > 0);
+    CU_ASSERT_EQUAL(stats.short_writes, 0);
+
+    /* disabled, everything is written at once */
+    CU_ASSERT_EQUAL(smp_context_set_tx_pacing(ctx, 0), 0);
+    msg = new_bulk_message(1, bulk, sizeof(bulk));
+    CU_ASSERT_PTR_NOT_NULL_FATAL(msg);
+    CU_ASSERT_EQUAL(smp_context_send_message_with_priority(ctx, msg,
+                SMP_PRIORITY_LOW), 0);
+    smp_message_free(msg);
+    tx_bytes = stats.tx_bytes;
+    CU_ASSERT_EQUAL(smp_context_get_stats(ctx, &stats), 0);
+    CU_ASSERT(stats.tx_bytes - tx_bytes > PACING_BULK_SIZE);
+
+    smp_context_free(peer);
+    smp_transport_free(transport);
+    smp_context_free(ctx);
+    close(master);
+}
+
+static uint32_t test_schedule_last_value;
+static uint64_t test_schedule_rx_time;
+
+static void on_new_message_schedule(SmpContext *ctx, SmpMessage *msg,
+        void *userdata)
+{
+    uint64_t end_ns;
+
+    on_new_message_record(ctx, msg, userdata);
+    smp_message_get_uint32(msg, 0, &test_schedule_last_value);
+    if (test_schedule_rx_time == 0)
+        smp_message_get_rx_timestamp(msg, &test_schedule_rx_time, &end_ns);
+}
+
+static const SmpEventCallbacks schedule_cbs = {
+    .new_message_cb = on_new_message_schedule,
+    .error_cb = on_error_simple
+};
+
+static void test_smp_context_schedule(void)
+{
+    SmpTransport *transports[2];
+    SmpContextStats stats;
+    SmpMessage *msg;
+    SmpContext *ctx;
+    SmpContext *peer;
+    uint64_t start;
+    size_t n_received;
+    int fds[2];
+    int id;
+    int i;
+
+    CU_ASSERT_EQUAL_FATAL(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    for (i = 0; i < 2; i++) {
+        transports[i] = smp_transport_new_fd(fds[i], fds[i]);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(transports[i]);
+    }
+
+    ctx = smp_context_new(&record_cbs, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(ctx);
+    CU_ASSERT_EQUAL(smp_context_set_transport(ctx, transports[0]), 0);
+    CU_ASSERT_EQUAL_FATAL(smp_context_open(ctx, ""), 0);
+    peer = smp_context_new(&schedule_cbs, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(peer);
+    CU_ASSERT_EQUAL(smp_context_set_transport(peer, transports[1]), 0);
+    CU_ASSERT_EQUAL_FATAL(smp_context_open(peer, ""), 0);
+
+    msg = smp_message_new_with_id(4);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(msg);
+    CU_ASSERT_EQUAL(smp_context_schedule_message(ctx, NULL, 0, 0),
+            SMP_ERROR_INVALID_PARAM);
+    CU_ASSERT_EQUAL(smp_context_cancel_scheduled_message(ctx, 1),
+            SMP_ERROR_NOT_FOUND);
+
+    /* a single message is written at its time, not before */
+    test_smp_context_n_received = 0;
+    test_schedule_rx_time = 0;
+    start = smp_context_get_time_ns() + 5 * 1000000ULL;
+    smp_message_set_uint32(msg, 0, 1);
+    id = smp_context_schedule_message(ctx, msg, start, 0);
+    if (id == SMP_ERROR_NOT_SUPPORTED) {
+        /* no clock on this platform */
+        CU_ASSERT_EQUAL(smp_context_get_time_ns(), 0);
+        goto done;
+    }
+    CU_ASSERT(id > 0);
+    CU_ASSERT(smp_context_get_next_timeout(ctx) > 0);
+    CU_ASSERT_EQUAL(smp_context_process_timers(ctx), 0);
+    CU_ASSERT_EQUAL(smp_context_wait_and_process(peer, 0),
+            SMP_ERROR_TIMEDOUT);
+
+    while (test_smp_context_n_received < 1 && smp_context_get_time_ns()
+            < start + 1000 * 1000000ULL) {
+        smp_context_wait_and_process(ctx, 20);
+        smp_context_wait_and_process(peer, 0);
+    }
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 1);
+    CU_ASSERT(test_schedule_rx_time >= start);
+    CU_ASSERT_EQUAL(smp_context_cancel_scheduled_message(ctx, id),
+            SMP_ERROR_NOT_FOUND);
+    CU_ASSERT_EQUAL(smp_context_get_next_timeout(ctx), -1);
+
+    CU_ASSERT_EQUAL(smp_context_get_stats(ctx, &stats), 0);
+    CU_ASSERT_EQUAL(stats.tx_scheduled, 1);
+    CU_ASSERT_EQUAL(stats.tx_schedule_delay_ns,
+            stats.tx_schedule_max_delay_ns);
+
+    /* a periodic message is sent until canceled, with its new content once
+     * updated */
+    test_smp_context_n_received = 0;
+    smp_message_set_uint32(msg, 0, 2);
+    id = smp_context_schedule_message(ctx, msg, 0, 2 * 1000000ULL);
+    CU_ASSERT(id > 0);
+    for (i = 0; i < 1000 && test_smp_context_n_received < 5; i++) {
+        smp_context_wait_and_process(ctx, 1);
+        smp_context_wait_and_process(peer, 0);
+    }
+    CU_ASSERT(test_smp_context_n_received >= 5);
+    CU_ASSERT_EQUAL(test_schedule_last_value, 2);
+
+    smp_message_set_uint32(msg, 0, 3);
+    CU_ASSERT_EQUAL(smp_context_update_scheduled_message(ctx, id, msg), 0);
+    n_received = test_smp_context_n_received;
+    for (i = 0; i < 1000 && test_smp_context_n_received < n_received + 2;
+            i++) {
+        smp_context_wait_and_process(ctx, 1);
+        smp_context_wait_and_process(peer, 0);
+    }
+    CU_ASSERT_EQUAL(test_schedule_last_value, 3);
+
+    CU_ASSERT_EQUAL(smp_context_cancel_scheduled_message(ctx, id), 0);
+    CU_ASSERT_EQUAL(smp_context_update_scheduled_message(ctx, id, msg),
+            SMP_ERROR_NOT_FOUND);
+    CU_ASSERT_EQUAL(smp_context_get_next_timeout(ctx), -1);
+    CU_ASSERT_EQUAL(smp_context_get_stats(ctx, &stats), 0);
+    CU_ASSERT(stats.tx_scheduled >= 8);
+
+    /* the prebuilt frame follows a checksum change */
+    smp_message_set_uint32(msg, 0, 5);
+    id = smp_context_schedule_message(ctx, msg, 0, 2 * 1000000ULL);
+    CU_ASSERT(id > 0);
+    CU_ASSERT_EQUAL(smp_context_set_checksum(ctx,
+            SMP_SERIAL_CHECKSUM_CRC32C), 0);
+    CU_ASSERT_EQUAL(smp_context_set_checksum(peer,
+            SMP_SERIAL_CHECKSUM_CRC32C), 0);
+    for (i = 0; i < 1000 && test_schedule_last_value != 5; i++) {
+        smp_context_wait_and_process(ctx, 1);
+        smp_context_wait_and_process(peer, 0);
+    }
+    CU_ASSERT_EQUAL(test_schedule_last_value, 5);
+    CU_ASSERT_EQUAL(smp_context_cancel_scheduled_message(ctx, id), 0);
+
+    /* messages scheduled before the link layer is enabled go through it */
+    smp_message_set_uint32(msg, 0, 4);
+    id = smp_context_schedule_message(ctx, msg, 0, 2 * 1000000ULL);
+    CU_ASSERT(id > 0);
+    CU_ASSERT_EQUAL(smp_context_enable_reliability(ctx, 4), 0);
+    CU_ASSERT_EQUAL(smp_context_enable_reliability(peer, 4), 0);
+    for (i = 0; i < 1000 && test_schedule_last_value != 4; i++) {
+        smp_context_wait_and_process(ctx, 1);
+        smp_context_wait_and_process(peer, 0);
+    }
+    CU_ASSERT_EQUAL(test_schedule_last_value, 4);
+    CU_ASSERT_EQUAL(smp_context_cancel_scheduled_message(ctx, id), 0);
+
+done:
+    smp_message_free(msg);
+    for (i = 0; i < 2; i++) {
+        smp_context_free(i == 0 ? ctx : peer);
+        smp_transport_free(transports[i]);
+        close(fds[i]);
+    }
+}
+
+static uint32_t test_prepared_last_value;
+
+static void on_new_message_prepared(SmpContext *ctx, SmpMessage *msg,
+        void *userdata)
+{
+    on_new_message_record(ctx, msg, userdata);
+    smp_message_get_uint32(msg, 0, &test_prepared_last_value);
+}
+
+static const SmpEventCallbacks prepared_cbs = {
+    .new_message_cb = on_new_message_prepared,
+    .error_cb = on_error_simple
+};
+
+static void test_smp_context_prepared_message(void)
+{
+    SmpTransport *transports[2];
+    SmpPreparedMessage *pm;
+    SmpContextStats stats;
+    SmpMessage *msg;
+    SmpContext *ctx;
+    SmpContext *peer;
+    int fds[2];
+    int i;
+
+    CU_ASSERT_EQUAL_FATAL(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    for (i = 0; i < 2; i++) {
+        transports[i] = smp_transport_new_fd(fds[i], fds[i]);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(transports[i]);
+    }
+
+    ctx = smp_context_new(&record_cbs, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(ctx);
+    CU_ASSERT_EQUAL(smp_context_set_transport(ctx, transports[0]), 0);
+    peer = smp_context_new(&prepared_cbs, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(peer);
+    CU_ASSERT_EQUAL(smp_context_set_transport(peer, transports[1]), 0);
+    CU_ASSERT_EQUAL_FATAL(smp_context_open(peer, ""), 0);
+
+    msg = smp_message_new_with_id(9);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(msg);
+    smp_message_set_uint32(msg, 0, 0);
+    pm = smp_prepared_message_new(msg);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(pm);
+    smp_message_free(msg);
+
+    CU_ASSERT_EQUAL(smp_context_send_prepared_message(ctx, pm),
+            SMP_ERROR_BAD_FD);
+    CU_ASSERT_EQUAL_FATAL(smp_context_open(ctx, ""), 0);
+
+    /* the frame is written as is and follows the checksum of the context */
+    test_smp_context_n_received = 0;
+    for (i = 1; i <= 3; i++) {
+        CU_ASSERT_EQUAL(smp_prepared_message_set_uint32(pm, 0, i * 0x1b), 0);
+        CU_ASSERT_EQUAL(smp_context_send_prepared_message(ctx, pm), 0);
+        CU_ASSERT_EQUAL(smp_context_process_fd(peer), 0);
+        CU_ASSERT_EQUAL(test_prepared_last_value, i * 0x1b);
+    }
+    CU_ASSERT_EQUAL(smp_context_set_checksum(ctx,
+                SMP_SERIAL_CHECKSUM_CRC32C), 0);
+    CU_ASSERT_EQUAL(smp_context_set_checksum(peer,
+                SMP_SERIAL_CHECKSUM_CRC32C), 0);
+    CU_ASSERT_EQUAL(smp_context_send_prepared_message(ctx, pm), 0);
+    CU_ASSERT_EQUAL(smp_context_process_fd(peer), 0);
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 4);
+    CU_ASSERT_EQUAL(smp_context_get_stats(peer, &stats), 0);
+    CU_ASSERT_EQUAL(stats.checksum_errors, 0);
+
+    /* the encoded message goes through the link layer */
+    CU_ASSERT_EQUAL(smp_context_enable_reliability(ctx, 4), 0);
+    CU_ASSERT_EQUAL(smp_context_enable_reliability(peer, 4), 0);
+    CU_ASSERT_EQUAL(smp_prepared_message_set_uint32(pm, 0, 100), 0);
+    CU_ASSERT_EQUAL(smp_context_send_prepared_message(ctx, pm), 0);
+    CU_ASSERT_EQUAL(smp_context_process_fd(peer), 0);
+    CU_ASSERT_EQUAL(test_smp_context_n_received, 5);
+    CU_ASSERT_EQUAL(test_prepared_last_value, 100);
+
+    smp_prepared_message_free(pm);
+    for (i = 0; i < 2; i++) {
+        smp_context_free(i == 0 ? ctx : peer);
+        smp_transport_free(transports[i]);
+        close(fds[i]);
+    }
+}
+
+static size_t test_zerocopy_bulk_size;
+static bool test_zerocopy_bulk_ok;
+static uint32_t test_zerocopy_value;
+
+/* check the content of the bulk data and the value after it */
+static void on_new_message_zerocopy(SmpContext *ctx, SmpMessage *msg,
+        void *userdata)
+{
+    const uint8_t *raw;
+    size_t size;
+    size_t i;
+
+    on_new_message_record(ctx, msg, userdata);
+    if (smp_message_get_craw(msg, 0, &raw, &size) < 0)
+        return;
+
+    test_zerocopy_bulk_size = size;
+    test_zerocopy_bulk_ok = true;
+    for (i = 0; i < size && test_zerocopy_bulk_ok; i++)
+        test_zerocopy_bulk_ok = (raw[i] == (uint8_t) i);
+
+    smp_message_get_uint32(msg, 1, &test_zerocopy_value);
+}
+
+static const SmpEventCallbacks zerocopy_cbs = {
+    .new_message_cb = on_new_message_zerocopy,
+    .error_cb = on_error_simple
+};
+
+static void test_smp_context_zerocopy(void)
+{
+    static uint8_t bulk[4096];
+    SmpTransport *transports[2];
+    SmpContextStats stats;
+    SmpMessage *msg;
+    SmpContext *ctx;
+    SmpContext *peer;
+    size_t j;
+    int fds[2];
+    int i;
+
+    CU_ASSERT_EQUAL_FATAL(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    for (i = 0; i < 2; i++) {
+        transports[i] = smp_transport_new_fd(fds[i], fds[i]);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(transports[i]);
+    }
+
+    ctx = smp_context_new(&record_cbs, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(ctx);
+    CU_ASSERT_EQUAL(smp_context_set_transport(ctx, transports[0]), 0);
+    CU_ASSERT_EQUAL_FATAL(smp_context_open(ctx, ""), 0);
+    peer = smp_context_new(&zerocopy_cbs, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(peer);
+    CU_ASSERT_EQUAL(smp_context_set_transport(peer, transports[1]), 0);
+    CU_ASSERT_EQUAL_FATAL(smp_context_open(peer, ""), 0);
+
+    /* a few magic bytes are escaped between the segments of the data, too
+     * many of them, a small argument or the link layer go through a copy */
+    test_smp_context_n_received = 0;
+    for (j = 0; j < 5; j++) {
+        static const size_t sizes[] = { 1024, 1024, 4096, 100, 1024 };
+
+        if (j == 1) {
+            CU_ASSERT_EQUAL(smp_context_set_checksum(ctx,
+                        SMP_SERIAL_CHECKSUM_CRC32C), 0);
+            CU_ASSERT_EQUAL(smp_context_set_checksum(peer,
+                        SMP_SERIAL_CHECKSUM_CRC32C), 0);
+        } else if (j == 4) {
+            CU_ASSERT_EQUAL(smp_context_enable_reliability(ctx, 4), 0);
+            CU_ASSERT_EQUAL(smp_context_enable_reliability(peer, 4), 0);
+        }
+
+        test_zerocopy_bulk_ok = false;
+        msg = new_bulk_message(1, bulk, sizes[j]);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(msg);
+        smp_message_set_uint32(msg, 1, 0x10ff1b00 + j);
+        CU_ASSERT_EQUAL(smp_context_send_message(ctx, msg), 0);
+        smp_message_free(msg);
+
+        for (i = 0; i < 1000 && test_smp_context_n_received < j + 1; i++)
+            smp_context_wait_and_process(peer, 10);
+        CU_ASSERT_EQUAL(test_smp_context_n_received, j + 1);
+        CU_ASSERT_EQUAL(test_zerocopy_bulk_size, sizes[j]);
+        CU_ASSERT(test_zerocopy_bulk_ok);
+        CU_ASSERT_EQUAL(test_zerocopy_value, 0x10ff1b00 + j);
+    }
+
+    CU_ASSERT_EQUAL(smp_context_get_stats(ctx, &stats), 0);
+    CU_ASSERT_EQUAL(stats.tx_zerocopy, 2);
+    CU_ASSERT_EQUAL(stats.short_writes, 0);
+    CU_ASSERT_EQUAL(smp_context_get_stats(peer, &stats), 0);
+    CU_ASSERT_EQUAL(stats.checksum_errors, 0);
+
+    for (i = 0; i < 2; i++) {
+        smp_context_free(i == 0 ? ctx : peer);
+        smp_transport_free(transports[i]);
+        close(fds[i]);
+    }
+}
+
 static void test_smp_context_static_api(void)
 {
     TestCtx tctx;
@@ -417,6 +2802,31 @@ static Test tests[] = {
     DEFINE_TEST(test_smp_context_send_message),
     DEFINE_TEST(test_smp_context_receive_valid_message),
     DEFINE_TEST(test_smp_context_receive_corrupted_message),
+    DEFINE_TEST(test_smp_context_checksum),
+    DEFINE_TEST(test_smp_context_reliability_window),
+    DEFINE_TEST(test_smp_context_reliability_retransmit),
+    DEFINE_TEST(test_smp_context_flow_control),
+    DEFINE_TEST(test_smp_context_link_restart),
+    DEFINE_TEST(test_smp_context_call),
+    DEFINE_TEST(test_smp_context_stats),
+    DEFINE_TEST(test_smp_context_tracing),
+    DEFINE_TEST(test_smp_context_capture),
+    DEFINE_TEST(test_smp_capture_decode),
+    DEFINE_TEST(test_smp_context_transport_loopback),
+    DEFINE_TEST(test_smp_context_transport_socket),
+    DEFINE_TEST(test_smp_context_transport_shm),
+    DEFINE_TEST(test_smp_context_transport_uring),
+    DEFINE_TEST(test_smp_context_busy_poll),
+    DEFINE_TEST(test_smp_context_process_budget),
+    DEFINE_TEST(test_smp_context_send_queue),
+    DEFINE_TEST(test_smp_context_send_frame),
+    DEFINE_TEST(test_smp_bridge),
+    DEFINE_TEST(test_smp_context_priorities),
+    DEFINE_TEST(test_smp_context_conflation),
+    DEFINE_TEST(test_smp_context_tx_pacing),
+    DEFINE_TEST(test_smp_context_schedule),
+    DEFINE_TEST(test_smp_context_prepared_message),
+    DEFINE_TEST(test_smp_context_zerocopy),
     DEFINE_TEST(test_smp_context_static_api),
     DEFINE_TEST(test_smp_context_static_macro_helper),
     { NULL, NULL }
@@ -19,6 +19,7 @@
 #include <CUnit/Automated.h>
 #include <CUnit/Basic.h>
 #include <stdlib.h>
+#include "config.h"
 #include "tests.h"
 
 int main(int argc, char *argv[])
@@ -31,6 +32,13 @@ int main(int argc, char *argv[])
     if (ret != CUE_SUCCESS)
         return CU_get_error();
 
+#ifdef TESTS_REALTIME
+    /* the realtime tests replace the allocator, they get a binary of their
+     * own */
+    ret = realtime_test_register();
+    if (ret != CUE_SUCCESS)
+        return ret;
+#else
     ret = context_test_register();
     if (ret != CUE_SUCCESS)
         return ret;
@@ -43,12 +51,23 @@ int main(int argc, char *argv[])
     if (ret != CUE_SUCCESS)
         return ret;
 
+#ifdef SMP_ENABLE_POSIX_TRANSPORTS
+    ret = muxd_test_register();
+    if (ret != CUE_SUCCESS)
+        return ret;
+#endif
+#endif /* TESTS_REALTIME */
+
     env_automated = getenv("SMP_TEST_AUTOMATED");
     if (env_automated == NULL) {
         /* Run tests using Basic interface */
         CU_basic_run_tests();
     } else {
+#ifdef TESTS_REALTIME
+        CU_set_output_filename("test-realtime");
+#else
         CU_set_output_filename("test-all");
+#endif
         CU_list_tests_to_file();
         CU_automated_run_tests();
     }
@@ -20,8 +20,12 @@
 #define SMP_ENABLE_STATIC_API
 #include <libsmp.h>
 #include "libsmp-private.h"
+#include "prepared-message.h"
+#include "serial-protocol.h"
 #include "tests.h"
 
+#include <string.h>
+
 /* use static variable to be sure while comparing */
 static const float f32_orig_value = 1.42f;
 static const double f64_orig_value = 3.14;
@@ -982,6 +986,90 @@ static void test_smp_message_static_helper_macro(void)
     CU_ASSERT_EQUAL(smp_message_get_msgid(message), 42);
 }
 
+/* the frame of pm must be the one of msg framed from scratch */
+static void check_prepared_frame(SmpPreparedMessage *pm, SmpMessage *msg,
+        SmpSerialChecksum checksum)
+{
+    uint8_t payload[64];
+    uint8_t buf[160];
+    uint8_t *expected = buf;
+    const uint8_t *frame;
+    ssize_t payload_size;
+    ssize_t expected_size;
+    size_t size;
+
+    payload_size = smp_message_encode(msg, payload, sizeof(payload));
+    CU_ASSERT_FATAL(payload_size > 0);
+    expected_size = smp_serial_protocol_encode_with_checksum(payload,
+            payload_size, &expected, sizeof(buf), checksum);
+    CU_ASSERT_FATAL(expected_size > 0);
+
+    CU_ASSERT_EQUAL(smp_prepared_message_get_frame(pm, checksum, &frame,
+                &size), 0);
+    CU_ASSERT_EQUAL_FATAL(size, (size_t) expected_size);
+    CU_ASSERT_EQUAL(memcmp(frame, expected, size), 0);
+}
+
+static void test_smp_prepared_message(void)
+{
+    static const SmpSerialChecksum checksums[] = {
+        SMP_SERIAL_CHECKSUM_XOR8,
+        SMP_SERIAL_CHECKSUM_CRC16_CCITT,
+        SMP_SERIAL_CHECKSUM_CRC32C,
+    };
+    /* values with and without bytes to escape, odd ones are patched in
+     * place */
+    static const uint32_t values[] = {
+        0x01020304, 0x05060708, 0x1b1b1b1b, 0x10ff1b10, 0x01020304, 0,
+    };
+    SmpPreparedMessage *pm;
+    SmpMessage *msg;
+    size_t i;
+    size_t j;
+
+    msg = smp_message_new_with_id(0x10);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(msg);
+    smp_message_set_uint8(msg, 0, 0x1b);
+    smp_message_set_uint32(msg, 1, 42);
+    smp_message_set_cstring(msg, 3, "heartbeat");
+    smp_message_set_double(msg, 4, 1.5);
+
+    CU_ASSERT_PTR_NULL(smp_prepared_message_new(NULL));
+    pm = smp_prepared_message_new(msg);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(pm);
+
+    CU_ASSERT_EQUAL(smp_prepared_message_set_uint32(pm, 2, 1),
+            SMP_ERROR_NOT_FOUND);
+    CU_ASSERT_EQUAL(smp_prepared_message_set_uint32(pm, 100, 1),
+            SMP_ERROR_NOT_FOUND);
+    CU_ASSERT_EQUAL(smp_prepared_message_set_int32(pm, 1, 1),
+            SMP_ERROR_BAD_TYPE);
+    CU_ASSERT_EQUAL(smp_prepared_message_set_uint8(pm, 3, 1),
+            SMP_ERROR_NOT_SUPPORTED);
+
+    for (i = 0; i < SMP_N_ELEMENTS(checksums); i++) {
+        check_prepared_frame(pm, msg, checksums[i]);
+
+        for (j = 0; j < SMP_N_ELEMENTS(values); j++) {
+            CU_ASSERT_EQUAL(smp_prepared_message_set_uint32(pm, 1, values[j]),
+                    0);
+            CU_ASSERT_EQUAL(smp_prepared_message_set_uint8(pm, 0,
+                        (uint8_t) values[j]), 0);
+            CU_ASSERT_EQUAL(smp_prepared_message_set_double(pm, 4, j * 0.5),
+                    0);
+            if (j % 2 == 1)
+                CU_ASSERT(pm->frame_valid);
+            smp_message_set_uint32(msg, 1, values[j]);
+            smp_message_set_uint8(msg, 0, (uint8_t) values[j]);
+            smp_message_set_double(msg, 4, j * 0.5);
+            check_prepared_frame(pm, msg, checksums[i]);
+        }
+    }
+
+    smp_prepared_message_free(pm);
+    smp_message_free(msg);
+}
+
 typedef struct
 {
     const char *name;
@@ -1025,6 +1113,7 @@ static Test tests[] = {
     DEFINE_TEST(test_smp_message_encode),
     DEFINE_TEST(test_smp_message_build_from_buffer),
     DEFINE_TEST(test_smp_message_static_helper_macro),
+    DEFINE_TEST(test_smp_prepared_message),
     { NULL, NULL }
 };
 
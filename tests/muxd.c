@@ -0,0 +1,196 @@
+/* libsmp
+ * Copyright (C) 2026 Actronika SAS
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _XOPEN_SOURCE 600
+
+#include <CUnit/CUnit.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <libsmp.h>
+
+#include "muxd.h"
+#include "tests.h"
+
+#define SOCKET_PATH "/tmp/smp-test-muxd"
+
+typedef struct
+{
+    unsigned int n_received;
+    uint32_t ids[8];
+} TestPeer;
+
+static void on_new_message(SmpContext *ctx, SmpMessage *msg, void *userdata)
+{
+    TestPeer *peer = userdata;
+
+    if (peer->n_received < SMP_N_ELEMENTS(peer->ids))
+        peer->ids[peer->n_received] = smp_message_get_msgid(msg);
+
+    peer->n_received++;
+}
+
+static void on_error(SmpContext *ctx, SmpError error, void *userdata)
+{
+}
+
+static const SmpEventCallbacks cbs = {
+    .new_message_cb = on_new_message,
+    .error_cb = on_error,
+};
+
+static int send_message(SmpContext *ctx, uint32_t msgid, uint32_t arg)
+{
+    SmpMessage *msg;
+    int ret;
+
+    msg = smp_message_new_with_id(msgid);
+    smp_message_set_uint32(msg, 0, arg);
+    ret = smp_context_send_message(ctx, msg);
+    smp_message_free(msg);
+
+    return ret;
+}
+
+/* process until the daemon has nothing left to do */
+static void pump(SmpMuxd *muxd)
+{
+    int i;
+
+    for (i = 0; i < 100; i++) {
+        if (smp_muxd_iterate(muxd, 50) != 0)
+            break;
+    }
+}
+
+static void test_smp_muxd(void)
+{
+    SmpTransport *transports[3];
+    SmpContext *ctxs[3];
+    TestPeer peers[3];
+    SmpMuxdStats stats;
+    SmpMuxd *muxd;
+    int master;
+    int i;
+
+    /* a pty stands for the device, the test writing on the master side */
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    CU_ASSERT_FATAL(master >= 0);
+    CU_ASSERT_EQUAL_FATAL(grantpt(master), 0);
+    CU_ASSERT_EQUAL_FATAL(unlockpt(master), 0);
+
+    muxd = smp_muxd_new();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(muxd);
+    CU_ASSERT_EQUAL_FATAL(smp_muxd_open(muxd, ptsname(master), SOCKET_PATH),
+            0);
+    CU_ASSERT_EQUAL(smp_muxd_iterate(muxd, 0), SMP_ERROR_TIMEDOUT);
+
+    memset(peers, 0, sizeof(peers));
+
+    /* peer 0 is the device, peers 1 and 2 are clients */
+    transports[0] = smp_transport_new_fd(master, master);
+    transports[1] = smp_transport_new_unix_socket();
+    transports[2] = smp_transport_new_unix_socket();
+    for (i = 0; i < 3; i++) {
+        CU_ASSERT_PTR_NOT_NULL_FATAL(transports[i]);
+        ctxs[i] = smp_context_new(&cbs, &peers[i]);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(ctxs[i]);
+        CU_ASSERT_EQUAL(smp_context_set_transport(ctxs[i], transports[i]), 0);
+        CU_ASSERT_EQUAL_FATAL(smp_context_open(ctxs[i], SOCKET_PATH), 0);
+    }
+
+    pump(muxd);
+    CU_ASSERT_EQUAL(smp_muxd_get_n_clients(muxd), 2);
+
+    /* client 2 only wants message 2 */
+    CU_ASSERT_EQUAL(send_message(ctxs[2], SMP_MUXD_MSGID_SUBSCRIBE, 2), 0);
+    pump(muxd);
+
+    CU_ASSERT_EQUAL(send_message(ctxs[0], 1, 0x1b10ff1b), 0);
+    CU_ASSERT_EQUAL(send_message(ctxs[0], 2, 0x1b10ff1b), 0);
+    pump(muxd);
+
+    CU_ASSERT_EQUAL(smp_context_wait_and_process(ctxs[1], 1000), 0);
+    CU_ASSERT_EQUAL(smp_context_wait_and_process(ctxs[2], 1000), 0);
+    CU_ASSERT_EQUAL(peers[1].n_received, 2);
+    CU_ASSERT_EQUAL(peers[1].ids[0], 1);
+    CU_ASSERT_EQUAL(peers[1].ids[1], 2);
+    CU_ASSERT_EQUAL(peers[2].n_received, 1);
+    CU_ASSERT_EQUAL(peers[2].ids[0], 2);
+
+    /* clients frames reach the device, the control frame doesn't */
+    CU_ASSERT_EQUAL(send_message(ctxs[1], 10, 0), 0);
+    CU_ASSERT_EQUAL(send_message(ctxs[1], 11, 0), 0);
+    CU_ASSERT_EQUAL(send_message(ctxs[2], 20, 0), 0);
+    pump(muxd);
+
+    CU_ASSERT_EQUAL(smp_context_wait_and_process(ctxs[0], 1000), 0);
+    CU_ASSERT_EQUAL(peers[0].n_received, 3);
+    /* one frame per client and per round */
+    CU_ASSERT_EQUAL(peers[0].ids[0], 10);
+    CU_ASSERT_EQUAL(peers[0].ids[1], 20);
+    CU_ASSERT_EQUAL(peers[0].ids[2], 11);
+
+    smp_muxd_get_stats(muxd, &stats);
+    CU_ASSERT_EQUAL(stats.rx_frames, 2);
+    CU_ASSERT_EQUAL(stats.tx_frames, 3);
+    CU_ASSERT_EQUAL(stats.forwarded_frames, 3);
+    CU_ASSERT_EQUAL(stats.dropped_frames, 0);
+
+    for (i = 0; i < 3; i++) {
+        smp_context_free(ctxs[i]);
+        smp_transport_free(transports[i]);
+    }
+
+    pump(muxd);
+    CU_ASSERT_EQUAL(smp_muxd_get_n_clients(muxd), 0);
+
+    smp_muxd_free(muxd);
+    CU_ASSERT_EQUAL(access(SOCKET_PATH, F_OK), -1);
+    close(master);
+}
+
+typedef struct
+{
+    const char *name;
+    CU_TestFunc func;
+} Test;
+
+static Test tests[] = {
+    DEFINE_TEST(test_smp_muxd),
+    { NULL, NULL }
+};
+
+CU_ErrorCode muxd_test_register(void)
+{
+    CU_pSuite suite = NULL;
+    Test *t;
+
+    suite = CU_add_suite("Muxd Test Suite", NULL, NULL);
+    if (suite == NULL) {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
+    for (t = tests; t->name != NULL; t++) {
+        CU_pTest tret = CU_add_test(suite, t->name, t->func);
+        if (tret == NULL)
+            return CU_get_error();
+    }
+
+    return CUE_SUCCESS;
+}
@@ -0,0 +1,300 @@
+/* libsmp
+ * Copyright (C) 2026 Actronika SAS
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#define SMP_ENABLE_STATIC_API
+
+#include <CUnit/CUnit.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libsmp.h>
+
+#include "tests.h"
+
+#define TEST_REALTIME_N_CYCLES 1000000
+
+/* Count the heap calls made while test_alloc_check is set, by replacing the
+ * allocator of the C library with a wrapper around its own functions. This
+ * affects the whole binary, so these tests are built in an executable of
+ * their own and the counter is only enabled during the measured loop. */
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+#define TEST_HAVE_ALLOC_CHECK 1
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void *ptr);
+
+static volatile bool test_alloc_check;
+static volatile unsigned long test_n_heap_calls;
+
+void *malloc(size_t size)
+{
+    if (test_alloc_check)
+        test_n_heap_calls++;
+
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    if (test_alloc_check)
+        test_n_heap_calls++;
+
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    if (test_alloc_check)
+        test_n_heap_calls++;
+
+    return __libc_realloc(ptr, size);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    void *ptr;
+
+    if (test_alloc_check)
+        test_n_heap_calls++;
+
+    if (alignment < sizeof(void *) || (alignment & (alignment - 1)) != 0)
+        return EINVAL;
+
+    ptr = __libc_memalign(alignment, size);
+    if (ptr == NULL)
+        return ENOMEM;
+
+    *memptr = ptr;
+    return 0;
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    if (test_alloc_check)
+        test_n_heap_calls++;
+
+    return __libc_memalign(alignment, size);
+}
+
+char *strdup(const char *s)
+{
+    size_t size = strlen(s) + 1;
+    char *copy;
+
+    if (test_alloc_check)
+        test_n_heap_calls++;
+
+    copy = __libc_malloc(size);
+    if (copy != NULL)
+        memcpy(copy, s, size);
+
+    return copy;
+}
+
+void free(void *ptr)
+{
+    if (test_alloc_check && ptr != NULL)
+        test_n_heap_calls++;
+
+    __libc_free(ptr);
+}
+#endif
+
+static unsigned long test_realtime_n_received;
+static uint32_t test_realtime_last_value;
+
+static void on_new_message(SmpContext *ctx, SmpMessage *msg, void *userdata)
+{
+    smp_message_get_uint32(msg, 0, &test_realtime_last_value);
+    test_realtime_n_received++;
+}
+
+static void on_error(SmpContext *ctx, SmpError error, void *userdata)
+{
+}
+
+static const SmpEventCallbacks cbs = {
+    .new_message_cb = on_new_message,
+    .error_cb = on_error,
+};
+
+static void on_call_done(SmpContext *ctx, SmpMessage *response, int status,
+        void *userdata)
+{
+}
+
+static SmpContext *test_realtime_new(size_t max_calls)
+{
+    SmpContextRealtimeConfig config = {
+        .max_message_size = 64,
+        .max_values = 8,
+        .max_calls = max_calls,
+        .lock_memory = true,
+    };
+    SmpContext *ctx;
+
+    ctx = smp_context_new_realtime(&cbs, NULL, &config);
+    if (ctx == NULL) {
+        /* locking may be forbidden by the limits of the process */
+        config.lock_memory = false;
+        ctx = smp_context_new_realtime(&cbs, NULL, &config);
+    }
+
+    return ctx;
+}
+
+static void test_smp_context_realtime_new(void)
+{
+    SmpContextRealtimeConfig config = {
+        .max_message_size = 64,
+        .max_values = 8,
+    };
+    SmpTransport *transport;
+    SmpMessage *msg;
+    SmpContext *ctx;
+    int i;
+
+    CU_ASSERT_PTR_NULL(smp_context_new_realtime(NULL, NULL, &config));
+    CU_ASSERT_PTR_NULL(smp_context_new_realtime(&cbs, NULL, NULL));
+    config.max_values = 0;
+    CU_ASSERT_PTR_NULL(smp_context_new_realtime(&cbs, NULL, &config));
+
+    /* calls need to be sized at creation */
+    ctx = test_realtime_new(0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(ctx);
+    transport = smp_transport_new_loopback(0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(transport);
+    CU_ASSERT_EQUAL(smp_context_set_transport(ctx, transport), 0);
+    CU_ASSERT_EQUAL_FATAL(smp_context_open(ctx, "loopback"), 0);
+
+    msg = smp_message_new_with_id(1);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(msg);
+    CU_ASSERT_EQUAL(smp_context_call(ctx, msg, -1, on_call_done, NULL),
+            SMP_ERROR_NOT_SUPPORTED);
+
+    /* messages bigger than the buffers are refused */
+    for (i = 0; i < 8; i++)
+        CU_ASSERT_EQUAL(smp_message_set_uint64(msg, i, i), 0);
+    CU_ASSERT_EQUAL(smp_context_send_message(ctx, msg), SMP_ERROR_OVERFLOW);
+    smp_message_free(msg);
+
+    smp_context_free(ctx);
+    smp_transport_free(transport);
+
+    /* a bounded number of outstanding calls */
+    ctx = test_realtime_new(4);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(ctx);
+    transport = smp_transport_new_loopback(0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(transport);
+    CU_ASSERT_EQUAL(smp_context_set_transport(ctx, transport), 0);
+    CU_ASSERT_EQUAL_FATAL(smp_context_open(ctx, "loopback"), 0);
+
+    msg = smp_message_new_with_id(1);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(msg);
+    for (i = 0; i < 4; i++) {
+        CU_ASSERT_EQUAL(smp_context_call(ctx, msg, -1, on_call_done, NULL),
+                0);
+    }
+    CU_ASSERT_EQUAL(smp_context_call(ctx, msg, -1, on_call_done, NULL),
+            SMP_ERROR_BUSY);
+    smp_message_free(msg);
+
+    smp_context_free(ctx);
+    smp_transport_free(transport);
+}
+
+static void test_smp_context_realtime_no_alloc(void)
+{
+    SmpTransport *transport;
+    SmpMessage *msg;
+    SmpContext *ctx;
+    unsigned long n_sent = 0;
+    uint32_t i;
+
+    ctx = test_realtime_new(0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(ctx);
+    transport = smp_transport_new_loopback(0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(transport);
+    CU_ASSERT_EQUAL(smp_context_set_transport(ctx, transport), 0);
+    CU_ASSERT_EQUAL(smp_context_enable_reliability(ctx, 4), 0);
+    CU_ASSERT_EQUAL_FATAL(smp_context_open(ctx, "loopback"), 0);
+
+    msg = smp_message_new_with_id(42);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(msg);
+
+    test_realtime_n_received = 0;
+#ifdef TEST_HAVE_ALLOC_CHECK
+    test_n_heap_calls = 0;
+    test_alloc_check = true;
+#endif
+
+    for (i = 0; i < TEST_REALTIME_N_CYCLES; i++) {
+        smp_message_set_uint32(msg, 0, i);
+        if (smp_context_send_message(ctx, msg) == 0)
+            n_sent++;
+        smp_context_process_fd(ctx);
+    }
+
+#ifdef TEST_HAVE_ALLOC_CHECK
+    test_alloc_check = false;
+    CU_ASSERT_EQUAL(test_n_heap_calls, 0);
+#endif
+
+    CU_ASSERT_EQUAL(n_sent, TEST_REALTIME_N_CYCLES);
+    CU_ASSERT_EQUAL(test_realtime_n_received, TEST_REALTIME_N_CYCLES);
+    CU_ASSERT_EQUAL(test_realtime_last_value, TEST_REALTIME_N_CYCLES - 1);
+
+    smp_message_free(msg);
+    smp_context_free(ctx);
+    smp_transport_free(transport);
+}
+
+typedef struct
+{
+    const char *name;
+    CU_TestFunc func;
+} Test;
+
+static Test tests[] = {
+    DEFINE_TEST(test_smp_context_realtime_new),
+    DEFINE_TEST(test_smp_context_realtime_no_alloc),
+    { NULL, NULL }
+};
+
+CU_ErrorCode realtime_test_register(void)
+{
+    CU_pSuite suite = NULL;
+    Test *t;
+
+    suite = CU_add_suite("Realtime Test Suite", NULL, NULL);
+    if (suite == NULL) {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
+    for (t = tests; t->name != NULL; t++) {
+        CU_pTest tret = CU_add_test(suite, t->name, t->func);
+        if (tret == NULL)
+            return CU_get_error();
+    }
+
+    return CUE_SUCCESS;
+}
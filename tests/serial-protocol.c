@@ -24,7 +24,9 @@
 #include <fcntl.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <string.h>
 
+#include "crc.h"
 #include "serial-protocol.h"
 #include "tests.h"
 
@@ -551,12 +553,176 @@ static void test_smp_serial_protocol_decoder_resize_decoder_limit(void)
     test_decoder_free(ctx);
 }
 
+static void test_smp_crc_check_values(void)
+{
+    const uint8_t check[] = "123456789";
+    uint8_t data[300];
+    uint32_t crc32c;
+    uint16_t crc16;
+    size_t i;
+
+    CU_ASSERT_EQUAL(smp_crc16_ccitt_update(SMP_CRC16_CCITT_INIT, check, 9),
+            0x29b1);
+    CU_ASSERT_EQUAL(smp_crc32c_update(SMP_CRC32C_INIT, check, 9)
+            ^ SMP_CRC32C_XOROUT, 0xe3069283);
+
+    /* sliced and hardware implementations should match byte by byte updates
+     * whatever the length and alignment */
+    for (i = 0; i < sizeof(data); i++)
+        data[i] = (uint8_t) (i * 37 + 11);
+
+    for (i = 0; i < 32; i++) {
+        size_t len = sizeof(data) - 2 * i;
+        size_t j;
+
+        crc16 = SMP_CRC16_CCITT_INIT;
+        crc32c = SMP_CRC32C_INIT;
+        for (j = 0; j < len; j++) {
+            crc16 = smp_crc16_ccitt_update_byte(crc16, data[i + j]);
+            crc32c = smp_crc32c_update_byte(crc32c, data[i + j]);
+        }
+
+        CU_ASSERT_EQUAL(smp_crc16_ccitt_update(SMP_CRC16_CCITT_INIT,
+                    data + i, len), crc16);
+        CU_ASSERT_EQUAL(smp_crc32c_update(SMP_CRC32C_INIT, data + i, len),
+                crc32c);
+    }
+}
+
+static void test_smp_serial_protocol_crc_roundtrip(void)
+{
+    const SmpSerialChecksum checksums[] = {
+        SMP_SERIAL_CHECKSUM_XOR8,
+        SMP_SERIAL_CHECKSUM_CRC16_CCITT,
+        SMP_SERIAL_CHECKSUM_CRC32C,
+    };
+    uint8_t payload[64];
+    size_t i;
+
+    for (i = 0; i < sizeof(payload); i++)
+        payload[i] = (uint8_t) (i * 13);
+
+    /* make sure magic bytes are there */
+    payload[3] = START_BYTE;
+    payload[4] = ESC_BYTE;
+    payload[5] = END_BYTE;
+
+    for (i = 0; i < SMP_N_ELEMENTS(checksums); i++) {
+        SmpSerialProtocolDecoder *decoder;
+        uint8_t *outbuf = NULL;
+        uint8_t *frame = NULL;
+        size_t framesize = 0;
+        ssize_t ret;
+        ssize_t j;
+
+        ret = smp_serial_protocol_encode_with_checksum(payload,
+                sizeof(payload), &outbuf, 0, checksums[i]);
+        CU_ASSERT_TRUE_FATAL(ret > 0);
+
+        decoder = smp_serial_protocol_decoder_new(0);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(decoder);
+        CU_ASSERT_EQUAL(smp_serial_protocol_decoder_set_checksum(decoder,
+                    checksums[i]), 0);
+
+        for (j = 0; j < ret; j++) {
+            CU_ASSERT_EQUAL(smp_serial_protocol_decoder_process_byte(decoder,
+                        outbuf[j], &frame, &framesize), 0);
+        }
+
+        CU_ASSERT_PTR_NOT_NULL_FATAL(frame);
+        CU_ASSERT_EQUAL(framesize, sizeof(payload));
+        CU_ASSERT_EQUAL(memcmp(frame, payload, sizeof(payload)), 0);
+
+        smp_serial_protocol_decoder_free(decoder);
+        free(outbuf);
+    }
+}
+
+static void test_smp_serial_protocol_crc_swapped_bytes(void)
+{
+    uint8_t payload[] = { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08 };
+    SmpSerialProtocolDecoder *decoder;
+    uint8_t *outbuf = NULL;
+    uint8_t *frame = NULL;
+    size_t framesize = 0;
+    uint8_t tmp;
+    ssize_t ret;
+    ssize_t i;
+    int err = 0;
+
+    ret = smp_serial_protocol_encode_with_checksum(payload, sizeof(payload),
+            &outbuf, 0, SMP_SERIAL_CHECKSUM_CRC16_CCITT);
+    CU_ASSERT_EQUAL_FATAL(ret, 1 + sizeof(payload) + 2 + 1);
+
+    /* swapping two payload bytes is not detected by the XOR checksum */
+    tmp = outbuf[2];
+    outbuf[2] = outbuf[3];
+    outbuf[3] = tmp;
+
+    decoder = smp_serial_protocol_decoder_new(0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(decoder);
+
+    /* invalid checksum should be rejected */
+    CU_ASSERT_EQUAL(smp_serial_protocol_decoder_set_checksum(NULL,
+                SMP_SERIAL_CHECKSUM_CRC32C), SMP_ERROR_INVALID_PARAM);
+    CU_ASSERT_EQUAL(smp_serial_protocol_decoder_set_checksum(decoder,
+                (SmpSerialChecksum) 42), SMP_ERROR_INVALID_PARAM);
+
+    CU_ASSERT_EQUAL(smp_serial_protocol_decoder_set_checksum(decoder,
+                SMP_SERIAL_CHECKSUM_CRC16_CCITT), 0);
+
+    for (i = 0; i < ret; i++) {
+        int r = smp_serial_protocol_decoder_process_byte(decoder, outbuf[i],
+                &frame, &framesize);
+        if (r < 0)
+            err = r;
+
+        CU_ASSERT_PTR_NULL(frame);
+    }
+    CU_ASSERT_EQUAL(err, SMP_ERROR_BAD_MESSAGE);
+
+    smp_serial_protocol_decoder_free(decoder);
+    free(outbuf);
+}
+
 typedef struct
 {
     const char *name;
     CU_TestFunc func;
 } Test;
 
+static void test_smp_serial_protocol_find_magic_byte(void)
+{
+    static const uint8_t magic[] = { 0x10, 0xff, 0x1b };
+    uint8_t buf[40];
+    size_t i;
+    size_t j;
+
+    memset(buf, 0x42, sizeof(buf));
+    CU_ASSERT_EQUAL(smp_serial_protocol_find_magic_byte(buf, 0), 0);
+    CU_ASSERT_EQUAL(smp_serial_protocol_find_magic_byte(buf, sizeof(buf)),
+            sizeof(buf));
+
+    /* bytes close to the magic ones don't match */
+    for (i = 0; i < sizeof(buf); i++)
+        buf[i] = (uint8_t) (magic[i % 3] ^ (1 << (i % 8)));
+    CU_ASSERT_EQUAL(smp_serial_protocol_find_magic_byte(buf, sizeof(buf)),
+            sizeof(buf));
+
+    /* in the words and in the tail */
+    for (i = 0; i < sizeof(buf); i++) {
+        for (j = 0; j < SMP_N_ELEMENTS(magic); j++) {
+            uint8_t tmp = buf[i];
+
+            buf[i] = magic[j];
+            CU_ASSERT_EQUAL(smp_serial_protocol_find_magic_byte(buf,
+                        sizeof(buf)), i);
+            CU_ASSERT_EQUAL(smp_serial_protocol_find_magic_byte(buf, i), i);
+            buf[i] = tmp;
+        }
+    }
+}
+
 static Test tests[] = {
     DEFINE_TEST(test_smp_serial_protocol_encode_simple),
     DEFINE_TEST(test_smp_serial_protocol_encode_magic_bytes),
@@ -573,6 +739,10 @@ static Test tests[] = {
     DEFINE_TEST(test_smp_serial_protocol_decoder_start_end),
     DEFINE_TEST(test_smp_serial_protocol_decoder_resize_decoder),
     DEFINE_TEST(test_smp_serial_protocol_decoder_resize_decoder_limit),
+    DEFINE_TEST(test_smp_crc_check_values),
+    DEFINE_TEST(test_smp_serial_protocol_crc_roundtrip),
+    DEFINE_TEST(test_smp_serial_protocol_crc_swapped_bytes),
+    DEFINE_TEST(test_smp_serial_protocol_find_magic_byte),
     { NULL, NULL }
 };
 
@@ -29,5 +29,7 @@
 CU_ErrorCode context_test_register(void);
 CU_ErrorCode serial_protocol_test_register(void);
 CU_ErrorCode message_test_register(void);
+CU_ErrorCode muxd_test_register(void);
+CU_ErrorCode realtime_test_register(void);
 
 #endif
@@ -0,0 +1,986 @@
+/* libsmp
+ * Copyright (C) 2026 Actronika SAS
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Serial multiplexer: one process owns the device and shares it among local
+ * clients connected to a Unix stream socket. Clients talk plain serial
+ * frames, so a context using smp_transport_new_unix_socket() works as if it
+ * had the device.
+ *
+ * Frames read from the device are located once and forwarded as is to the
+ * clients whose filter accepts their message id, straight from the read
+ * buffer. Only the part a client socket can't take right now is copied to
+ * its backlog. Client frames are written to the device one per client and
+ * per round, so a busy client can't starve the others. */
+
+#include "config.h"
+
+#include "muxd.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "libsmp-private-posix.h"
+#include "serial-protocol.h"
+
+#define SMP_MUXD_RX_BUFSIZE (64 * 1024)
+#define SMP_MUXD_CLIENT_INBUF_SIZE (16 * 1024)
+#define SMP_MUXD_CLIENT_BACKLOG_SIZE (256 * 1024)
+#define SMP_MUXD_MAX_CLIENTS 64
+#define SMP_MUXD_MAX_IOV 64
+
+#define SMP_MUXD_HEADER_SIZE 8
+#define SMP_MUXD_MAX_CONTROL_IDS 256
+
+#ifdef MSG_NOSIGNAL
+#define SMP_MUXD_SEND_FLAGS (MSG_NOSIGNAL | MSG_DONTWAIT)
+#else
+#define SMP_MUXD_SEND_FLAGS MSG_DONTWAIT
+#endif
+
+/* Locates frames in a byte stream, keeping the unescaped message header to
+ * know the message id. Checksums are left to the receivers. */
+typedef struct
+{
+    bool in_frame;
+    bool esc;
+    size_t start;   /* offset of the START byte of the current frame */
+    uint8_t header[SMP_MUXD_HEADER_SIZE];
+    size_t n_header;
+} SmpMuxdScanner;
+
+typedef struct
+{
+    size_t offset;
+    size_t size;
+    uint32_t msgid;
+} SmpMuxdFrame;
+
+typedef struct
+{
+    int fd;
+    bool dead;
+
+    /* bytes received from the client, frames are written from here */
+    uint8_t inbuf[SMP_MUXD_CLIENT_INBUF_SIZE];
+    size_t in_len;
+    size_t in_pos;
+    SmpMuxdScanner scanner;
+    bool has_frame;
+    SmpMuxdFrame frame;     /* next frame to write to the device */
+
+    /* frames the socket couldn't take yet */
+    uint8_t *backlog;
+    size_t backlog_len;
+
+    /* message ids filter */
+    bool all_ids;
+    uint32_t *ids;
+    size_t n_ids;
+    size_t ids_capacity;
+} SmpMuxdClient;
+
+struct SmpMuxd
+{
+    SmpTransport *device;
+    int device_fd;
+    int listen_fd;
+    char *socket_path;
+
+    uint8_t rx_buf[SMP_MUXD_RX_BUFSIZE];
+    size_t rx_len;
+    size_t rx_pos;
+    SmpMuxdScanner rx_scanner;
+    SmpMuxdFrame *frames;
+    size_t frames_capacity;
+
+    /* remaining of a frame partially written to the device */
+    uint8_t tx_backlog[SMP_MUXD_CLIENT_INBUF_SIZE];
+    size_t tx_backlog_len;
+    size_t next_client;
+
+    SmpMuxdClient *clients[SMP_MUXD_MAX_CLIENTS];
+    size_t n_clients;
+
+    SmpMuxdStats stats;
+};
+
+/* message fields are in host order, like smp_message_decode() reads them */
+static uint32_t smp_muxd_read_uint32(const uint8_t *data)
+{
+    uint32_t value;
+
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static void smp_muxd_scanner_reset(SmpMuxdScanner *scanner)
+{
+    scanner->in_frame = false;
+    scanner->esc = false;
+    scanner->n_header = 0;
+}
+
+/* scan data from *pos and stop after the first complete frame */
+static bool smp_muxd_scanner_next(SmpMuxdScanner *scanner,
+        const uint8_t *data, size_t len, size_t *pos, SmpMuxdFrame *frame)
+{
+    size_t i;
+
+    for (i = *pos; i < len; i++) {
+        uint8_t byte = data[i];
+
+        if (!scanner->in_frame) {
+            if (byte == SMP_SERIAL_PROTOCOL_START_BYTE) {
+                scanner->in_frame = true;
+                scanner->start = i;
+                scanner->n_header = 0;
+            }
+            continue;
+        }
+
+        if (scanner->esc) {
+            scanner->esc = false;
+        } else if (byte == SMP_SERIAL_PROTOCOL_ESC_BYTE) {
+            scanner->esc = true;
+            continue;
+        } else if (byte == SMP_SERIAL_PROTOCOL_START_BYTE) {
+            /* unterminated frame, resync like the decoder */
+            scanner->start = i;
+            scanner->n_header = 0;
+            continue;
+        } else if (byte == SMP_SERIAL_PROTOCOL_END_BYTE) {
+            scanner->in_frame = false;
+
+            /* too short to hold a message */
+            if (scanner->n_header < SMP_MUXD_HEADER_SIZE)
+                continue;
+
+            frame->offset = scanner->start;
+            frame->size = i + 1 - scanner->start;
+            frame->msgid = smp_muxd_read_uint32(scanner->header);
+            *pos = i + 1;
+            return true;
+        }
+
+        if (scanner->n_header < SMP_MUXD_HEADER_SIZE)
+            scanner->header[scanner->n_header++] = byte;
+    }
+
+    *pos = len;
+    return false;
+}
+
+/* Clients */
+static bool smp_muxd_client_wants(SmpMuxdClient *client, uint32_t msgid)
+{
+    size_t i;
+
+    if (client->all_ids)
+        return true;
+
+    for (i = 0; i < client->n_ids; i++) {
+        if (client->ids[i] == msgid)
+            return true;
+    }
+
+    return false;
+}
+
+static int smp_muxd_client_add_id(SmpMuxdClient *client, uint32_t msgid)
+{
+    if (smp_muxd_client_wants(client, msgid))
+        return 0;
+
+    if (client->n_ids == client->ids_capacity) {
+        size_t capacity = (client->ids_capacity == 0) ? 8 :
+            client->ids_capacity * 2;
+        uint32_t *ids;
+
+        ids = realloc(client->ids, capacity * sizeof(*ids));
+        if (ids == NULL)
+            return SMP_ERROR_NO_MEM;
+
+        client->ids = ids;
+        client->ids_capacity = capacity;
+    }
+
+    client->ids[client->n_ids++] = msgid;
+    return 0;
+}
+
+static void smp_muxd_client_remove_id(SmpMuxdClient *client, uint32_t msgid)
+{
+    size_t i;
+
+    for (i = 0; i < client->n_ids; i++) {
+        if (client->ids[i] == msgid) {
+            client->ids[i] = client->ids[--client->n_ids];
+            return;
+        }
+    }
+}
+
+/* update the client filter from a subscribe or unsubscribe frame */
+static void smp_muxd_client_control(SmpMuxdClient *client,
+        const SmpMuxdFrame *frame)
+{
+    uint8_t payload[SMP_MUXD_HEADER_SIZE + 5 * SMP_MUXD_MAX_CONTROL_IDS];
+    const uint8_t *data = client->inbuf + frame->offset;
+    size_t len = 0;
+    size_t end;
+    size_t off;
+    size_t i;
+    bool subscribe = (frame->msgid == SMP_MUXD_MSGID_SUBSCRIBE);
+    bool any = false;
+
+    /* unescape the frame between START and END */
+    for (i = 1; i + 1 < frame->size && len < sizeof(payload); i++) {
+        if (data[i] == SMP_SERIAL_PROTOCOL_ESC_BYTE)
+            i++;
+        payload[len++] = data[i];
+    }
+
+    end = SMP_MUXD_HEADER_SIZE + smp_muxd_read_uint32(payload + 4);
+    if (end > len)
+        end = len;
+
+    for (off = SMP_MUXD_HEADER_SIZE; off + 5 <= end; off += 5) {
+        uint32_t msgid;
+
+        if (payload[off] != SMP_TYPE_UINT32)
+            break;
+
+        msgid = smp_muxd_read_uint32(payload + off + 1);
+        if (subscribe) {
+            if (client->all_ids) {
+                client->all_ids = false;
+                client->n_ids = 0;
+            }
+
+            if (smp_muxd_client_add_id(client, msgid) < 0)
+                client->dead = true;
+        } else {
+            smp_muxd_client_remove_id(client, msgid);
+        }
+        any = true;
+    }
+
+    if (subscribe && !any)
+        client->all_ids = true;
+}
+
+/* find the next frame to write to the device, handling control frames */
+static void smp_muxd_client_parse(SmpMuxdClient *client)
+{
+    while (!client->has_frame) {
+        SmpMuxdFrame frame;
+
+        if (!smp_muxd_scanner_next(&client->scanner, client->inbuf,
+                    client->in_len, &client->in_pos, &frame))
+            break;
+
+        if (frame.msgid == SMP_MUXD_MSGID_SUBSCRIBE
+                || frame.msgid == SMP_MUXD_MSGID_UNSUBSCRIBE) {
+            smp_muxd_client_control(client, &frame);
+            continue;
+        }
+
+        client->frame = frame;
+        client->has_frame = true;
+    }
+}
+
+/* drop the bytes which are not needed anymore */
+static void smp_muxd_client_compact(SmpMuxdClient *client)
+{
+    size_t base;
+
+    if (client->has_frame)
+        base = client->frame.offset;
+    else if (client->scanner.in_frame)
+        base = client->scanner.start;
+    else
+        base = client->in_pos;
+
+    if (base == 0)
+        return;
+
+    memmove(client->inbuf, client->inbuf + base, client->in_len - base);
+    client->in_len -= base;
+    client->in_pos -= base;
+    if (client->has_frame)
+        client->frame.offset -= base;
+    if (client->scanner.in_frame)
+        client->scanner.start -= base;
+}
+
+static void smp_muxd_client_read(SmpMuxd *muxd, SmpMuxdClient *client)
+{
+    ssize_t ret;
+
+    smp_muxd_client_compact(client);
+
+    if (client->in_len == sizeof(client->inbuf)) {
+        /* wait for the pending frame to be written */
+        if (client->has_frame)
+            return;
+
+        /* a single frame is larger than the buffer */
+        muxd->stats.oversize_frames++;
+        client->in_len = 0;
+        client->in_pos = 0;
+        smp_muxd_scanner_reset(&client->scanner);
+    }
+
+    ret = read(client->fd, client->inbuf + client->in_len,
+            sizeof(client->inbuf) - client->in_len);
+    if (ret <= 0) {
+        if (ret == 0 || (errno != EAGAIN && errno != EINTR))
+            client->dead = true;
+        return;
+    }
+
+    client->in_len += ret;
+    smp_muxd_client_parse(client);
+}
+
+/* send frames to the client, keeping what the socket doesn't take in the
+ * backlog */
+static void smp_muxd_client_queue(SmpMuxd *muxd, SmpMuxdClient *client,
+        struct iovec *iov, size_t n_iov)
+{
+    size_t sent = 0;
+    size_t i;
+
+    if (client->backlog_len == 0) {
+        struct msghdr msg;
+        ssize_t ret;
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = n_iov;
+
+        ret = sendmsg(client->fd, &msg, SMP_MUXD_SEND_FLAGS);
+        if (ret < 0) {
+            if (errno != EAGAIN && errno != EINTR) {
+                client->dead = true;
+                return;
+            }
+        } else {
+            sent = ret;
+        }
+    }
+
+    for (i = 0; i < n_iov; i++) {
+        size_t skip = 0;
+        size_t size;
+
+        if (sent >= iov[i].iov_len) {
+            sent -= iov[i].iov_len;
+            continue;
+        }
+
+        /* the rest of a partially sent frame is always kept to keep the
+         * stream framed, next frames are dropped if they don't fit */
+        skip = sent;
+        sent = 0;
+        size = iov[i].iov_len - skip;
+        if (skip == 0 && client->backlog_len + size
+                > SMP_MUXD_CLIENT_BACKLOG_SIZE) {
+            muxd->stats.dropped_frames++;
+            continue;
+        }
+
+        memcpy(client->backlog + client->backlog_len,
+                (const uint8_t *) iov[i].iov_base + skip, size);
+        client->backlog_len += size;
+    }
+}
+
+static void smp_muxd_client_flush(SmpMuxdClient *client)
+{
+    ssize_t ret;
+
+    ret = send(client->fd, client->backlog, client->backlog_len,
+            SMP_MUXD_SEND_FLAGS);
+    if (ret < 0) {
+        if (errno != EAGAIN && errno != EINTR)
+            client->dead = true;
+        return;
+    }
+
+    memmove(client->backlog, client->backlog + ret, client->backlog_len - ret);
+    client->backlog_len -= ret;
+}
+
+static void smp_muxd_client_free(SmpMuxdClient *client)
+{
+    close(client->fd);
+    free(client->backlog);
+    free(client->ids);
+    free(client);
+}
+
+static void smp_muxd_accept(SmpMuxd *muxd)
+{
+    SmpMuxdClient *client;
+    int fd;
+
+    fd = accept(muxd->listen_fd, NULL, NULL);
+    if (fd < 0)
+        return;
+
+    if (muxd->n_clients == SMP_MUXD_MAX_CLIENTS
+            || fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0) {
+        close(fd);
+        return;
+    }
+
+    client = calloc(1, sizeof(*client));
+    if (client == NULL) {
+        close(fd);
+        return;
+    }
+
+    client->backlog = malloc(SMP_MUXD_CLIENT_BACKLOG_SIZE);
+    if (client->backlog == NULL) {
+        close(fd);
+        free(client);
+        return;
+    }
+
+    client->fd = fd;
+    client->all_ids = true;
+    muxd->clients[muxd->n_clients++] = client;
+}
+
+static void smp_muxd_remove_dead_clients(SmpMuxd *muxd)
+{
+    size_t i = 0;
+
+    while (i < muxd->n_clients) {
+        SmpMuxdClient *client = muxd->clients[i];
+
+        if (!client->dead) {
+            i++;
+            continue;
+        }
+
+        smp_muxd_client_free(client);
+        memmove(&muxd->clients[i], &muxd->clients[i + 1],
+                (muxd->n_clients - i - 1) * sizeof(muxd->clients[0]));
+        muxd->n_clients--;
+    }
+
+    if (muxd->next_client >= muxd->n_clients)
+        muxd->next_client = 0;
+}
+
+/* Device */
+static int smp_muxd_add_frame(SmpMuxd *muxd, size_t n_frames,
+        const SmpMuxdFrame *frame)
+{
+    if (n_frames == muxd->frames_capacity) {
+        size_t capacity = (muxd->frames_capacity == 0) ? 64 :
+            muxd->frames_capacity * 2;
+        SmpMuxdFrame *frames;
+
+        frames = realloc(muxd->frames, capacity * sizeof(*frames));
+        if (frames == NULL)
+            return SMP_ERROR_NO_MEM;
+
+        muxd->frames = frames;
+        muxd->frames_capacity = capacity;
+    }
+
+    muxd->frames[n_frames] = *frame;
+    return 0;
+}
+
+/* forward the frames found in the read buffer to the interested clients */
+static void smp_muxd_dispatch(SmpMuxd *muxd, size_t n_frames)
+{
+    struct iovec iov[SMP_MUXD_MAX_IOV];
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < muxd->n_clients; i++) {
+        SmpMuxdClient *client = muxd->clients[i];
+        size_t n_iov = 0;
+
+        for (j = 0; j < n_frames && !client->dead; j++) {
+            const SmpMuxdFrame *frame = &muxd->frames[j];
+
+            if (!smp_muxd_client_wants(client, frame->msgid))
+                continue;
+
+            iov[n_iov].iov_base = muxd->rx_buf + frame->offset;
+            iov[n_iov].iov_len = frame->size;
+            n_iov++;
+            muxd->stats.forwarded_frames++;
+
+            if (n_iov == SMP_MUXD_MAX_IOV) {
+                smp_muxd_client_queue(muxd, client, iov, n_iov);
+                n_iov = 0;
+            }
+        }
+
+        if (n_iov > 0 && !client->dead)
+            smp_muxd_client_queue(muxd, client, iov, n_iov);
+    }
+}
+
+static int smp_muxd_read_device(SmpMuxd *muxd)
+{
+    while (1) {
+        SmpMuxdFrame frame;
+        size_t n_frames = 0;
+        ssize_t ret;
+
+        ret = muxd->device->vtable->read(muxd->device,
+                muxd->rx_buf + muxd->rx_len,
+                sizeof(muxd->rx_buf) - muxd->rx_len);
+        if (ret == SMP_ERROR_WOULD_BLOCK)
+            return 0;
+        else if (ret < 0)
+            return (int) ret;
+
+        muxd->rx_len += ret;
+        while (smp_muxd_scanner_next(&muxd->rx_scanner, muxd->rx_buf,
+                    muxd->rx_len, &muxd->rx_pos, &frame)) {
+            if (smp_muxd_add_frame(muxd, n_frames, &frame) < 0)
+                return SMP_ERROR_NO_MEM;
+            n_frames++;
+        }
+
+        muxd->stats.rx_frames += n_frames;
+        smp_muxd_dispatch(muxd, n_frames);
+
+        /* keep the incomplete frame at the start of the buffer */
+        if (muxd->rx_scanner.in_frame) {
+            size_t start = muxd->rx_scanner.start;
+
+            memmove(muxd->rx_buf, muxd->rx_buf + start, muxd->rx_len - start);
+            muxd->rx_len -= start;
+            muxd->rx_scanner.start = 0;
+
+            if (muxd->rx_len == sizeof(muxd->rx_buf)) {
+                muxd->stats.oversize_frames++;
+                muxd->rx_len = 0;
+                smp_muxd_scanner_reset(&muxd->rx_scanner);
+            }
+        } else {
+            muxd->rx_len = 0;
+        }
+        muxd->rx_pos = muxd->rx_len;
+    }
+}
+
+static bool smp_muxd_has_tx_pending(SmpMuxd *muxd)
+{
+    size_t i;
+
+    if (muxd->tx_backlog_len > 0)
+        return true;
+
+    for (i = 0; i < muxd->n_clients; i++) {
+        if (muxd->clients[i]->has_frame)
+            return true;
+    }
+
+    return false;
+}
+
+/* write the buffers to the device in order, one by one if its transport
+ * can't gather them */
+static ssize_t smp_muxd_device_writev(SmpMuxd *muxd, const SmpIoVec *iov,
+        int iovcnt)
+{
+    SmpTransport *device = muxd->device;
+    ssize_t total = 0;
+    int i;
+
+    if (device->vtable->writev != NULL)
+        return device->vtable->writev(device, iov, iovcnt);
+
+    for (i = 0; i < iovcnt; i++) {
+        ssize_t wbytes;
+
+        wbytes = device->vtable->write(device, iov[i].base, iov[i].size);
+        if (wbytes < 0)
+            return total > 0 ? total : wbytes;
+
+        total += wbytes;
+        if ((size_t) wbytes != iov[i].size)
+            break;
+    }
+
+    return total;
+}
+
+/* write one frame of each client per round, until the device is full */
+static int smp_muxd_write_device_frames(SmpMuxd *muxd)
+{
+    while (1) {
+        SmpIoVec iov[SMP_MUXD_MAX_CLIENTS];
+        SmpMuxdClient *owners[SMP_MUXD_MAX_CLIENTS];
+        size_t n_iov = 0;
+        size_t written;
+        ssize_t ret;
+        size_t i;
+
+        if (muxd->tx_backlog_len > 0) {
+            ret = muxd->device->vtable->write(muxd->device, muxd->tx_backlog,
+                    muxd->tx_backlog_len);
+            if (ret == SMP_ERROR_WOULD_BLOCK)
+                return 0;
+            else if (ret < 0)
+                return (int) ret;
+
+            memmove(muxd->tx_backlog, muxd->tx_backlog + ret,
+                    muxd->tx_backlog_len - ret);
+            muxd->tx_backlog_len -= ret;
+            if (muxd->tx_backlog_len > 0)
+                return 0;
+        }
+
+        for (i = 0; i < muxd->n_clients; i++) {
+            SmpMuxdClient *client;
+
+            client = muxd->clients[(muxd->next_client + i) % muxd->n_clients];
+            if (!client->has_frame)
+                continue;
+
+            iov[n_iov].base = client->inbuf + client->frame.offset;
+            iov[n_iov].size = client->frame.size;
+            owners[n_iov] = client;
+            n_iov++;
+        }
+
+        if (n_iov == 0)
+            return 0;
+
+        /* the next round starts with another client */
+        muxd->next_client = (muxd->next_client + 1) % muxd->n_clients;
+
+        ret = smp_muxd_device_writev(muxd, iov, (int) n_iov);
+        if (ret == SMP_ERROR_WOULD_BLOCK)
+            return 0;
+        else if (ret < 0)
+            return (int) ret;
+
+        written = ret;
+        for (i = 0; i < n_iov && written > 0; i++) {
+            if (written < iov[i].size) {
+                muxd->tx_backlog_len = iov[i].size - written;
+                memcpy(muxd->tx_backlog,
+                        (const uint8_t *) iov[i].base + written,
+                        muxd->tx_backlog_len);
+                written = 0;
+            } else {
+                written -= iov[i].size;
+            }
+
+            owners[i]->has_frame = false;
+            smp_muxd_client_parse(owners[i]);
+            muxd->stats.tx_frames++;
+        }
+
+        if (i < n_iov)
+            return 0;
+    }
+}
+
+/* write the client frames, then start the writes the device transport may
+ * have queued */
+static int smp_muxd_write_device(SmpMuxd *muxd)
+{
+    int flush_ret = 0;
+    int ret;
+
+    ret = smp_muxd_write_device_frames(muxd);
+    if (muxd->device->vtable->flush != NULL)
+        flush_ret = muxd->device->vtable->flush(muxd->device);
+
+    return (ret < 0) ? ret : flush_ret;
+}
+
+/**
+ * Create a new multiplexer.
+ *
+ * @return a new SmpMuxd or NULL on error.
+ */
+SmpMuxd *smp_muxd_new(void)
+{
+    SmpMuxd *muxd;
+
+    muxd = calloc(1, sizeof(*muxd));
+    if (muxd == NULL)
+        return NULL;
+
+    muxd->device = smp_transport_new_serial();
+    if (muxd->device == NULL) {
+        free(muxd);
+        return NULL;
+    }
+
+    muxd->device_fd = -1;
+    muxd->listen_fd = -1;
+    return muxd;
+}
+
+/**
+ * Close and free the multiplexer.
+ *
+ * @param[in] muxd the SmpMuxd
+ */
+void smp_muxd_free(SmpMuxd *muxd)
+{
+    if (muxd == NULL)
+        return;
+
+    smp_muxd_close(muxd);
+    smp_transport_free(muxd->device);
+    free(muxd->frames);
+    free(muxd);
+}
+
+/**
+ * Open the device and listen for clients on socket_path. An existing socket
+ * at this path, left by a previous instance, is replaced.
+ *
+ * @param[in] muxd the SmpMuxd
+ * @param[in] device path to the serial device
+ * @param[in] socket_path path of the Unix socket to create
+ *
+ * @return 0 on success, a SmpError otherwise.
+ */
+int smp_muxd_open(SmpMuxd *muxd, const char *device, const char *socket_path)
+{
+    struct sockaddr_un addr;
+    struct stat st;
+    intptr_t fd;
+    int ret;
+
+    if (muxd->listen_fd >= 0)
+        return SMP_ERROR_BUSY;
+
+    if (strlen(socket_path) >= sizeof(addr.sun_path))
+        return SMP_ERROR_INVALID_PARAM;
+
+    muxd->socket_path = strdup(socket_path);
+    if (muxd->socket_path == NULL)
+        return SMP_ERROR_NO_MEM;
+
+    ret = muxd->device->vtable->open(muxd->device, device);
+    if (ret < 0)
+        goto error;
+
+    fd = muxd->device->vtable->get_fd(muxd->device);
+    if (fd < 0) {
+        ret = (int) fd;
+        goto error_device;
+    }
+    muxd->device_fd = (int) fd;
+
+    if (stat(socket_path, &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(socket_path);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+
+    muxd->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (muxd->listen_fd < 0) {
+        ret = errno_to_smp_error(errno);
+        goto error_device;
+    }
+
+    if (bind(muxd->listen_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0
+            || listen(muxd->listen_fd, 16) < 0
+            || fcntl(muxd->listen_fd, F_SETFL, O_NONBLOCK) < 0) {
+        ret = errno_to_smp_error(errno);
+        goto error_socket;
+    }
+
+    return 0;
+
+error_socket:
+    close(muxd->listen_fd);
+    muxd->listen_fd = -1;
+error_device:
+    muxd->device->vtable->close(muxd->device);
+    muxd->device_fd = -1;
+error:
+    free(muxd->socket_path);
+    muxd->socket_path = NULL;
+    return ret;
+}
+
+/**
+ * Disconnect the clients, close the device and remove the socket.
+ *
+ * @param[in] muxd the SmpMuxd
+ */
+void smp_muxd_close(SmpMuxd *muxd)
+{
+    size_t i;
+
+    if (muxd->listen_fd < 0)
+        return;
+
+    for (i = 0; i < muxd->n_clients; i++)
+        smp_muxd_client_free(muxd->clients[i]);
+    muxd->n_clients = 0;
+    muxd->next_client = 0;
+
+    close(muxd->listen_fd);
+    muxd->listen_fd = -1;
+    unlink(muxd->socket_path);
+    free(muxd->socket_path);
+    muxd->socket_path = NULL;
+
+    muxd->device->vtable->close(muxd->device);
+    muxd->device_fd = -1;
+    muxd->rx_len = 0;
+    muxd->rx_pos = 0;
+    muxd->tx_backlog_len = 0;
+    smp_muxd_scanner_reset(&muxd->rx_scanner);
+}
+
+/**
+ * Set the device serial configuration.
+ *
+ * @param[in] muxd the SmpMuxd
+ * @param[in] baudrate the baudrate
+ * @param[in] parity the parity configuration
+ * @param[in] flow_control 1 to enable flow control, 0 to disable
+ *
+ * @return 0 on success, a SmpError otherwise.
+ */
+int smp_muxd_set_serial_config(SmpMuxd *muxd, SmpSerialBaudrate baudrate,
+        SmpSerialParity parity, int flow_control)
+{
+    return muxd->device->vtable->set_config(muxd->device, baudrate, parity,
+            flow_control);
+}
+
+/**
+ * Wait for activity on the device or the clients and process it.
+ *
+ * @param[in] muxd the SmpMuxd
+ * @param[in] timeout_ms a timeout in milliseconds, negative for no timeout
+ *
+ * @return 0 on success, SMP_ERROR_TIMEDOUT if nothing happened, another
+ *         SmpError if the device can't be used anymore.
+ */
+int smp_muxd_iterate(SmpMuxd *muxd, int timeout_ms)
+{
+    struct pollfd pfds[2 + SMP_MUXD_MAX_CLIENTS];
+    size_t n_clients = muxd->n_clients;
+    size_t i;
+    int ret;
+
+    if (muxd->listen_fd < 0)
+        return SMP_ERROR_BAD_FD;
+
+    pfds[0].fd = muxd->device_fd;
+    pfds[0].events = POLLIN;
+    if (smp_muxd_has_tx_pending(muxd))
+        pfds[0].events |= POLLOUT;
+
+    pfds[1].fd = muxd->listen_fd;
+    pfds[1].events = POLLIN;
+
+    for (i = 0; i < n_clients; i++) {
+        SmpMuxdClient *client = muxd->clients[i];
+
+        pfds[2 + i].fd = client->fd;
+        pfds[2 + i].events = 0;
+
+        /* stop reading a client whose frames are not written yet */
+        if (!client->has_frame)
+            pfds[2 + i].events |= POLLIN;
+        if (client->backlog_len > 0)
+            pfds[2 + i].events |= POLLOUT;
+    }
+
+    for (i = 0; i < 2 + n_clients; i++)
+        pfds[i].revents = 0;
+
+    ret = poll(pfds, 2 + n_clients, timeout_ms);
+    if (ret < 0)
+        return (errno == EINTR) ? 0 : errno_to_smp_error(errno);
+    else if (ret == 0)
+        return SMP_ERROR_TIMEDOUT;
+
+    if (pfds[0].revents & (POLLIN | POLLERR | POLLHUP)) {
+        ret = smp_muxd_read_device(muxd);
+        if (ret < 0)
+            return ret;
+    }
+
+    for (i = 0; i < n_clients; i++) {
+        SmpMuxdClient *client = muxd->clients[i];
+        short revents = pfds[2 + i].revents;
+
+        if (revents & (POLLIN | POLLERR | POLLHUP))
+            smp_muxd_client_read(muxd, client);
+        if ((revents & POLLOUT) && !client->dead)
+            smp_muxd_client_flush(client);
+    }
+
+    ret = smp_muxd_write_device(muxd);
+    smp_muxd_remove_dead_clients(muxd);
+    if (ret < 0)
+        return ret;
+
+    if (pfds[1].revents & POLLIN)
+        smp_muxd_accept(muxd);
+
+    return 0;
+}
+
+/**
+ * Get the number of connected clients.
+ *
+ * @param[in] muxd the SmpMuxd
+ *
+ * @return the number of clients.
+ */
+size_t smp_muxd_get_n_clients(SmpMuxd *muxd)
+{
+    return muxd->n_clients;
+}
+
+/**
+ * Get the multiplexer counters.
+ *
+ * @param[in] muxd the SmpMuxd
+ * @param[out] stats the counters
+ */
+void smp_muxd_get_stats(SmpMuxd *muxd, SmpMuxdStats *stats)
+{
+    *stats = muxd->stats;
+}
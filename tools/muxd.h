@@ -0,0 +1,58 @@
+/* libsmp
+ * Copyright (C) 2026 Actronika SAS
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SMP_MUXD_H
+#define SMP_MUXD_H
+
+#include <libsmp.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Control messages sent by clients to the daemon, never forwarded to the
+ * device. Arguments are the uint32 message ids to add to or remove from the
+ * client filter. A client receives every frame until it subscribes, and a
+ * subscribe message without argument restores this. */
+#define SMP_MUXD_MSGID_SUBSCRIBE 0xffff0001
+#define SMP_MUXD_MSGID_UNSUBSCRIBE 0xffff0002
+
+typedef struct SmpMuxd SmpMuxd;
+
+typedef struct
+{
+    uint64_t rx_frames;         /* frames read from the device */
+    uint64_t tx_frames;         /* client frames written to the device */
+    uint64_t forwarded_frames;  /* frames queued to clients */
+    uint64_t dropped_frames;    /* frames dropped for slow clients */
+    uint64_t oversize_frames;   /* frames larger than the buffers */
+} SmpMuxdStats;
+
+SmpMuxd *smp_muxd_new(void);
+void smp_muxd_free(SmpMuxd *muxd);
+int smp_muxd_open(SmpMuxd *muxd, const char *device, const char *socket_path);
+void smp_muxd_close(SmpMuxd *muxd);
+int smp_muxd_set_serial_config(SmpMuxd *muxd, SmpSerialBaudrate baudrate,
+        SmpSerialParity parity, int flow_control);
+int smp_muxd_iterate(SmpMuxd *muxd, int timeout_ms);
+size_t smp_muxd_get_n_clients(SmpMuxd *muxd);
+void smp_muxd_get_stats(SmpMuxd *muxd, SmpMuxdStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
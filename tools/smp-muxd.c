@@ -0,0 +1,164 @@
+/* libsmp
+ * Copyright (C) 2026 Actronika SAS
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* smp-muxd: share a serial device among local clients, see muxd.c */
+
+#include "config.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "muxd.h"
+
+static volatile sig_atomic_t quit = 0;
+
+static const struct {
+    long bauds;
+    SmpSerialBaudrate baudrate;
+} baudrates[] = {
+    { 1200, SMP_SERIAL_BAUDRATE_1200 },
+    { 2400, SMP_SERIAL_BAUDRATE_2400 },
+    { 4800, SMP_SERIAL_BAUDRATE_4800 },
+    { 9600, SMP_SERIAL_BAUDRATE_9600 },
+    { 19200, SMP_SERIAL_BAUDRATE_19200 },
+    { 38400, SMP_SERIAL_BAUDRATE_38400 },
+    { 57600, SMP_SERIAL_BAUDRATE_57600 },
+    { 115200, SMP_SERIAL_BAUDRATE_115200 },
+    { 230400, SMP_SERIAL_BAUDRATE_230400 },
+    { 460800, SMP_SERIAL_BAUDRATE_460800 },
+    { 921600, SMP_SERIAL_BAUDRATE_921600 },
+    { 1000000, SMP_SERIAL_BAUDRATE_1000000 },
+    { 2000000, SMP_SERIAL_BAUDRATE_2000000 },
+    { 4000000, SMP_SERIAL_BAUDRATE_4000000 },
+};
+
+static void on_signal(int signum)
+{
+    quit = 1;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-b BAUDRATE] [-f] DEVICE SOCKET\n"
+            "\n"
+            "Share the serial DEVICE among the clients connected to the Unix\n"
+            "socket SOCKET.\n"
+            "\n"
+            "  -b BAUDRATE  set the device baudrate\n"
+            "  -f           enable hardware flow control\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+    struct sigaction sa;
+    SmpMuxdStats stats;
+    SmpMuxd *muxd;
+    long bauds = 0;
+    int flow_control = 0;
+    int ret;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:fh")) != -1) {
+        switch (opt) {
+            case 'b':
+                bauds = strtol(optarg, NULL, 10);
+                break;
+            case 'f':
+                flow_control = 1;
+                break;
+            case 'h':
+                usage(argv[0]);
+                return 0;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (argc - optind != 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sa.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &sa, NULL);
+
+    muxd = smp_muxd_new();
+    if (muxd == NULL) {
+        fprintf(stderr, "failed to create the multiplexer\n");
+        return 1;
+    }
+
+    ret = smp_muxd_open(muxd, argv[optind], argv[optind + 1]);
+    if (ret < 0) {
+        fprintf(stderr, "failed to open %s or %s: %s\n", argv[optind],
+                argv[optind + 1], smp_error_to_string(ret));
+        smp_muxd_free(muxd);
+        return 1;
+    }
+
+    if (bauds != 0 || flow_control) {
+        SmpSerialBaudrate baudrate = SMP_SERIAL_BAUDRATE_115200;
+        size_t i;
+
+        for (i = 0; i < sizeof(baudrates) / sizeof(baudrates[0]); i++) {
+            if (baudrates[i].bauds == bauds)
+                break;
+        }
+
+        if (bauds != 0 && i == sizeof(baudrates) / sizeof(baudrates[0])) {
+            fprintf(stderr, "unsupported baudrate %ld\n", bauds);
+            smp_muxd_free(muxd);
+            return 1;
+        }
+        if (bauds != 0)
+            baudrate = baudrates[i].baudrate;
+
+        ret = smp_muxd_set_serial_config(muxd, baudrate,
+                SMP_SERIAL_PARITY_NONE, flow_control);
+        if (ret < 0) {
+            fprintf(stderr, "failed to configure %s: %s\n", argv[optind],
+                    smp_error_to_string(ret));
+            smp_muxd_free(muxd);
+            return 1;
+        }
+    }
+
+    while (!quit) {
+        ret = smp_muxd_iterate(muxd, -1);
+        if (ret < 0 && ret != SMP_ERROR_TIMEDOUT) {
+            fprintf(stderr, "device error: %s\n", smp_error_to_string(ret));
+            break;
+        }
+    }
+
+    smp_muxd_get_stats(muxd, &stats);
+    fprintf(stderr, "rx frames: %llu, tx frames: %llu, forwarded: %llu, "
+            "dropped: %llu\n", (unsigned long long) stats.rx_frames,
+            (unsigned long long) stats.tx_frames,
+            (unsigned long long) stats.forwarded_frames,
+            (unsigned long long) stats.dropped_frames);
+
+    smp_muxd_free(muxd);
+    return (quit) ? 0 : 1;
+}